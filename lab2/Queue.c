@@ -1,7 +1,7 @@
 /*
  * Queue.c
  *
- * Generic queue, implemented with linked list.
+ * Generic queue, implemented with a growable ring array.
  *
  * Shengsong Gao, 2020
  */
@@ -11,23 +11,54 @@
 #include <stdlib.h>  // for malloc()
 #include "Queue.h"
 
-typedef struct qnode {
-	void *item;
-	struct qnode *node_behind;
-} qnode_t;
+// the capacity an array starts with; always a power of 2
+#define QUEUE_INITIAL_CAPACITY 8
 
+/* the items live in items[head], items[head + 1], ... (wrapping around
+ * at capacity), num_items of them. The array only grows (doubling) and
+ * is kept when the queue empties, so a queue that has reached its
+ * working size enqueues and dequeues without touching malloc().
+ */
 typedef struct queue {
-	qnode_t *head;
-	qnode_t *tail;
+	void **items;
+	int capacity;  // 0 until the first enq_q()
+	int head;
+	int num_items;
 } q_t;
 
+/* -------- local functions -------- */
+
+// the index into items of the i-th item from the head.
+static inline int slot_of(q_t *queue, int i) {
+	return (queue->head + i) & (queue->capacity - 1);
+}
+
+/* doubles the array (or allocates the first one), unwrapping the items
+ * so that they start at index 0. Returns -1 if malloc failed.
+ */
+static int grow_q(q_t *queue) {
+	int new_capacity = (queue->capacity == 0) ? QUEUE_INITIAL_CAPACITY : queue->capacity * 2;
+	void **new_items = (void **)malloc(new_capacity * sizeof(void *));
+	if (new_items == NULL) { return -1; }
+	for (int i = 0; i < queue->num_items; i++) {
+		new_items[i] = queue->items[slot_of(queue, i)];
+	}
+	free(queue->items);
+	queue->items = new_items;
+	queue->capacity = new_capacity;
+	queue->head = 0;
+	return 0;
+}
+
 /* -------- basic queue functions -------- */
 
 q_t *make_q() {
 	q_t *queue = (q_t *)malloc(sizeof(q_t));
 	if (queue != NULL) {
-		queue->head = NULL;
-		queue->tail = NULL;
+		queue->items = NULL;
+		queue->capacity = 0;
+		queue->head = 0;
+		queue->num_items = 0;
 	}
 	return queue;
 }
@@ -35,12 +66,13 @@ q_t *make_q() {
 void delete_q(q_t *queue, void (*itemdelete)(void *item)) {
 	if (queue == NULL) { return; }
 	void *item;
-	while(queue->head != NULL) {
-		item = deq_q(queue);  // deq_q() frees the node it deq'd
+	while(queue->num_items > 0) {
+		item = deq_q(queue);
 		if (itemdelete != NULL) {
 			(*itemdelete)(item);
 		}
 	}
+	free(queue->items);
 	free(queue);
 }
 
@@ -49,36 +81,23 @@ int enq_q(q_t *queue, void *item) {
 		perror("enq_q: queue is NULL\n");
 		return -1;
 	}
-	
-	qnode_t *node = (qnode_t *) malloc(sizeof(qnode_t));
-	if (node == NULL) {
-		perror("enq_q: error malloc'ing node\n");
+
+	if (queue->num_items == queue->capacity && grow_q(queue) != 0) {
+		perror("enq_q: error malloc'ing items\n");
 		return -1;
 	}
-	node->item = item;
-	node->node_behind = NULL;
-	
-	if (queue->head == NULL) {
-		queue->head = node;
-		queue->tail = node;
-	} else {
-		queue->tail->node_behind = node;
-		queue->tail = node;
-	}
-	
+	queue->items[slot_of(queue, queue->num_items)] = item;
+	queue->num_items += 1;
+
 	return 0;
 }
 
 void *deq_q(q_t *queue) {
 	void *item = NULL;
-	if (queue != NULL && queue->head != NULL) {
-		item = queue->head->item;
-		qnode_t *new_head = queue->head->node_behind;
-		free(queue->head);
-		queue->head = new_head;
-		if (queue->head == NULL) {
-			queue->tail = NULL;
-		}
+	if (queue != NULL && queue->num_items > 0) {
+		item = queue->items[queue->head];
+		queue->head = slot_of(queue, 1);
+		queue->num_items -= 1;
 	}
 	return item;
 }
@@ -88,73 +107,34 @@ void *deq_q(q_t *queue) {
 
 void iterate_q(q_t *queue, void (*itemfunc)(void *item)) {
 	if (queue == NULL) { return; }
-	qnode_t *currNode = queue->head;
-	while(currNode != NULL) {
-		(*itemfunc)(currNode->item);
-		currNode = currNode->node_behind;
+	for (int i = 0; i < queue->num_items; i++) {
+		(*itemfunc)(queue->items[slot_of(queue, i)]);
 	}
 }
 
 
 void *peek_q(q_t *queue) {
-	if (queue == NULL || queue->head == NULL) return NULL;
-	return queue->head->item;
+	if (queue == NULL || queue->num_items == 0) return NULL;
+	return queue->items[queue->head];
 }
 
 
-
 /* -------- implementation-specific functions -------- */
+
 void delete_integer_targets_q(q_t *queue, int target) {
 	if (queue == NULL) { return; }
 	int curr_number;
-	qnode_t *currNode = queue->head;
-	qnode_t *lastNode;
-	while(currNode != NULL) {
-		curr_number = *((int *) currNode->item);
-		// when a match is found...
-		if (curr_number == target) {
-			// if the current node is a head node...
-			if (queue->head == currNode) {
-				// AND a tail node...
-				if (queue->tail == currNode) {
-					queue->head = NULL;
-					queue->tail = NULL;
-					free(currNode->item);
-					free(currNode);
-					currNode = NULL;
-				}
-				// but NOT a tail node...
-				else {
-					queue->head = currNode->node_behind;
-					free(currNode->item);
-					free(currNode);
-					currNode = queue->head;
-				}
-			}
-			// if the current node is a tail node but not a head node
-			else if (queue->tail == currNode) {
-				// safe to assume that lastNode is not NULL
-				lastNode->node_behind = NULL;
-				queue->tail = lastNode;
-				free(currNode->item);
-				free(currNode);
-				currNode = NULL;
-			}
-			// if the current node is neither the head nor the tail
-			else {
-				// safe to assume that lastNode is not NULL
-				lastNode->node_behind = currNode->node_behind;
-				free(currNode->item);
-				free(currNode);
-				currNode = lastNode->node_behind;
-			}
-		}
-		// not a match, move on...
-		else {
-			lastNode = currNode;
-			currNode = currNode->node_behind;
+	int numKept = 0;
+	// one pass, moving each item that is kept into its final slot
+	for (int i = 0; i < queue->num_items; i++) {
+		curr_number = *((int *) queue->items[slot_of(queue, i)]);
+		if (curr_number != target) {
+			queue->items[slot_of(queue, numKept)] = queue->items[slot_of(queue, i)];
+			numKept += 1;
+		} else {
+			free(queue->items[slot_of(queue, i)]);
 		}
 	}
+	queue->num_items = numKept;
 }
 
-
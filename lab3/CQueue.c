@@ -0,0 +1,310 @@
+/*
+ * CQueue.c
+ *
+ * Generic lock-free queues; see CQueue.h.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>  // for malloc(), aligned_alloc()
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "CQueue.h"
+
+// what is written by enqueuers is kept off the cache line of dequeuers
+#define CACHE_LINE_SIZE 64
+
+#define MSQ_CHUNK_BITS  10  // nodes are added to the pool 1024 at a time
+#define MSQ_CHUNK_SIZE  (1 << MSQ_CHUNK_BITS)
+#define MSQ_MAX_CHUNKS  4096  // so at most 4M nodes
+
+/* -------- bounded queue --------
+ *
+ * Cell i (mod capacity) is free for the enqueuer that claims position
+ * pos when its sequence is pos, and holds an item for the dequeuer that
+ * claims position pos when its sequence is pos + 1; the dequeuer then
+ * sets it to pos + capacity, freeing it for the next lap. Positions are
+ * claimed by compare-and-swap on enq_pos and deq_pos.
+ */
+
+typedef struct cq_cell {
+	atomic_size_t sequence;
+	void *item;
+} cq_cell_t;
+
+typedef struct concurrent_queue {
+	_Alignas(CACHE_LINE_SIZE) atomic_size_t enq_pos;
+	_Alignas(CACHE_LINE_SIZE) atomic_size_t deq_pos;
+	_Alignas(CACHE_LINE_SIZE) cq_cell_t *cells;
+	size_t mask;  // capacity - 1
+} cq_t;
+
+cq_t *make_cq(int capacity) {
+	size_t real_capacity = 2;
+	while (real_capacity < (size_t)capacity) { real_capacity *= 2; }
+
+	cq_t *queue = (cq_t *)aligned_alloc(CACHE_LINE_SIZE, sizeof(cq_t));
+	if (queue == NULL) { return NULL; }
+	queue->cells = (cq_cell_t *)malloc(real_capacity * sizeof(cq_cell_t));
+	if (queue->cells == NULL) {
+		free(queue);
+		return NULL;
+	}
+	for (size_t i = 0; i < real_capacity; i++) {
+		atomic_init(&(queue->cells[i].sequence), i);
+	}
+	queue->mask = real_capacity - 1;
+	atomic_init(&(queue->enq_pos), 0);
+	atomic_init(&(queue->deq_pos), 0);
+	return queue;
+}
+
+void delete_cq(cq_t *queue, void (*itemdelete)(void *item)) {
+	if (queue == NULL) { return; }
+	void *item;
+	while ((item = deq_cq(queue)) != NULL) {
+		if (itemdelete != NULL) {
+			(*itemdelete)(item);
+		}
+	}
+	free(queue->cells);
+	free(queue);
+}
+
+int enq_cq(cq_t *queue, void *item) {
+	if (queue == NULL) { return -1; }
+	cq_cell_t *cell;
+	size_t pos = atomic_load_explicit(&(queue->enq_pos), memory_order_relaxed);
+	while (1) {
+		cell = &(queue->cells[pos & queue->mask]);
+		size_t sequence = atomic_load_explicit(&(cell->sequence), memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+		if (diff == 0) {
+			// the cell is free; claim it (pos is reloaded if someone else did)
+			if (atomic_compare_exchange_weak_explicit(&(queue->enq_pos), &pos, pos + 1,
+			                                          memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return -1;  // still holding the item from a lap ago: full
+		} else {
+			pos = atomic_load_explicit(&(queue->enq_pos), memory_order_relaxed);
+		}
+	}
+	cell->item = item;
+	atomic_store_explicit(&(cell->sequence), pos + 1, memory_order_release);
+	return 0;
+}
+
+void *deq_cq(cq_t *queue) {
+	if (queue == NULL) { return NULL; }
+	cq_cell_t *cell;
+	size_t pos = atomic_load_explicit(&(queue->deq_pos), memory_order_relaxed);
+	while (1) {
+		cell = &(queue->cells[pos & queue->mask]);
+		size_t sequence = atomic_load_explicit(&(cell->sequence), memory_order_acquire);
+		intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+		if (diff == 0) {
+			if (atomic_compare_exchange_weak_explicit(&(queue->deq_pos), &pos, pos + 1,
+			                                          memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		} else if (diff < 0) {
+			return NULL;  // not filled yet: empty
+		} else {
+			pos = atomic_load_explicit(&(queue->deq_pos), memory_order_relaxed);
+		}
+	}
+	void *item = cell->item;
+	atomic_store_explicit(&(cell->sequence), pos + queue->mask + 1, memory_order_release);
+	return item;
+}
+
+
+/* -------- unbounded queue --------
+ *
+ * Links are 64-bit words: the index of a node in the pool in the low
+ * half (0 for none; node 0 is never used) and a count in the high half
+ * that goes up on every change, so that a compare-and-swap against a
+ * link read before the node was recycled fails. Nodes are never given
+ * back to malloc() before delete_msq(), so reading one that another
+ * thread just dequeued is harmless. Free nodes are kept on a stack
+ * (free_top) linked through the same `next` words.
+ */
+
+typedef struct msq_node {
+	_Atomic uint64_t next;
+	_Atomic(void *) item;
+} msq_node_t;
+
+typedef struct ms_queue {
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint64_t head;
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint64_t tail;
+	_Alignas(CACHE_LINE_SIZE) _Atomic uint64_t free_top;
+	msq_node_t *chunks[MSQ_MAX_CHUNKS];
+	_Atomic int num_chunks;
+	pthread_mutex_t grow_lock;
+} msq_t;
+
+static inline uint64_t make_link(uint64_t index, uint64_t count) {
+	return (count << 32) | index;
+}
+
+static inline uint64_t index_of(uint64_t link) { return link & 0xffffffff; }
+static inline uint64_t count_of(uint64_t link) { return link >> 32; }
+
+static inline msq_node_t *node_at(msq_t *queue, uint64_t index) {
+	return &(queue->chunks[index >> MSQ_CHUNK_BITS][index & (MSQ_CHUNK_SIZE - 1)]);
+}
+
+// pushes the node onto the free stack.
+static void free_node(msq_t *queue, uint64_t index) {
+	msq_node_t *node = node_at(queue, index);
+	uint64_t top = atomic_load(&(queue->free_top));
+	do {
+		uint64_t next = atomic_load(&(node->next));
+		atomic_store(&(node->next), make_link(index_of(top), count_of(next) + 1));
+	} while (!atomic_compare_exchange_weak(&(queue->free_top), &top,
+	                                       make_link(index, count_of(top) + 1)));
+}
+
+/* adds a chunk of nodes to the free stack, unless another thread did
+ * while this one waited for grow_lock. Returns -1 if it could not.
+ */
+static int grow_pool(msq_t *queue) {
+	int result = 0;
+	pthread_mutex_lock(&(queue->grow_lock));
+		if (index_of(atomic_load(&(queue->free_top))) == 0) {
+			int chunk_i = atomic_load(&(queue->num_chunks));
+			msq_node_t *chunk = NULL;
+			if (chunk_i < MSQ_MAX_CHUNKS) {
+				chunk = (msq_node_t *)malloc(MSQ_CHUNK_SIZE * sizeof(msq_node_t));
+			}
+			if (chunk == NULL) {
+				result = -1;
+			} else {
+				for (int i = 0; i < MSQ_CHUNK_SIZE; i++) {
+					atomic_init(&(chunk[i].next), 0);
+					atomic_init(&(chunk[i].item), NULL);
+				}
+				queue->chunks[chunk_i] = chunk;
+				atomic_store(&(queue->num_chunks), chunk_i + 1);
+				// node 0 stands for "none", so the first chunk gives one less
+				for (int i = (chunk_i == 0) ? 1 : 0; i < MSQ_CHUNK_SIZE; i++) {
+					free_node(queue, ((uint64_t)chunk_i << MSQ_CHUNK_BITS) | i);
+				}
+			}
+		}
+	pthread_mutex_unlock(&(queue->grow_lock));
+	return result;
+}
+
+// pops a node off the free stack, growing the pool if it is empty; 0 if it could not.
+static uint64_t alloc_node(msq_t *queue) {
+	uint64_t top = atomic_load(&(queue->free_top));
+	while (1) {
+		if (index_of(top) == 0) {
+			if (grow_pool(queue) != 0) { return 0; }
+			top = atomic_load(&(queue->free_top));
+			continue;
+		}
+		uint64_t next = atomic_load(&(node_at(queue, index_of(top))->next));
+		if (atomic_compare_exchange_weak(&(queue->free_top), &top,
+		                                 make_link(index_of(next), count_of(top) + 1))) {
+			return index_of(top);
+		}
+	}
+}
+
+msq_t *make_msq() {
+	msq_t *queue = (msq_t *)aligned_alloc(CACHE_LINE_SIZE, sizeof(msq_t));
+	if (queue == NULL) { return NULL; }
+	atomic_init(&(queue->free_top), 0);
+	atomic_init(&(queue->num_chunks), 0);
+	pthread_mutex_init(&(queue->grow_lock), NULL);
+
+	// the list always starts with a dummy node: the last one dequeued
+	uint64_t dummy = alloc_node(queue);
+	if (dummy == 0) {
+		free(queue);
+		return NULL;
+	}
+	atomic_store(&(node_at(queue, dummy)->next), make_link(0, 0));
+	atomic_init(&(queue->head), make_link(dummy, 0));
+	atomic_init(&(queue->tail), make_link(dummy, 0));
+	return queue;
+}
+
+void delete_msq(msq_t *queue, void (*itemdelete)(void *item)) {
+	if (queue == NULL) { return; }
+	void *item;
+	while ((item = deq_msq(queue)) != NULL) {
+		if (itemdelete != NULL) {
+			(*itemdelete)(item);
+		}
+	}
+	for (int i = 0; i < atomic_load(&(queue->num_chunks)); i++) {
+		free(queue->chunks[i]);
+	}
+	pthread_mutex_destroy(&(queue->grow_lock));
+	free(queue);
+}
+
+int enq_msq(msq_t *queue, void *item) {
+	if (queue == NULL) { return -1; }
+	uint64_t index = alloc_node(queue);
+	if (index == 0) { return -1; }
+	msq_node_t *node = node_at(queue, index);
+	atomic_store(&(node->item), item);
+	atomic_store(&(node->next), make_link(0, count_of(atomic_load(&(node->next))) + 1));
+
+	uint64_t tail, next;
+	while (1) {
+		tail = atomic_load(&(queue->tail));
+		next = atomic_load(&(node_at(queue, index_of(tail))->next));
+		if (tail != atomic_load(&(queue->tail))) { continue; }
+		if (index_of(next) == 0) {
+			// tail is the last node; try to link the new one after it
+			if (atomic_compare_exchange_weak(&(node_at(queue, index_of(tail))->next), &next,
+			                                 make_link(index, count_of(next) + 1))) {
+				break;
+			}
+		} else {
+			// tail fell behind; help it along
+			atomic_compare_exchange_weak(&(queue->tail), &tail,
+			                             make_link(index_of(next), count_of(tail) + 1));
+		}
+	}
+	// fine if this fails: then someone else already moved the tail along
+	atomic_compare_exchange_strong(&(queue->tail), &tail, make_link(index, count_of(tail) + 1));
+	return 0;
+}
+
+void *deq_msq(msq_t *queue) {
+	if (queue == NULL) { return NULL; }
+	uint64_t head, tail, next;
+	void *item;
+	while (1) {
+		head = atomic_load(&(queue->head));
+		tail = atomic_load(&(queue->tail));
+		next = atomic_load(&(node_at(queue, index_of(head))->next));
+		if (head != atomic_load(&(queue->head))) { continue; }
+		if (index_of(head) == index_of(tail)) {
+			if (index_of(next) == 0) { return NULL; }
+			atomic_compare_exchange_weak(&(queue->tail), &tail,
+			                             make_link(index_of(next), count_of(tail) + 1));
+		} else {
+			// read before the swap; after it, the next node may be dequeued and reused
+			item = atomic_load(&(node_at(queue, index_of(next))->item));
+			if (atomic_compare_exchange_weak(&(queue->head), &head,
+			                                 make_link(index_of(next), count_of(head) + 1))) {
+				break;
+			}
+		}
+	}
+	// the old dummy goes; the node just dequeued is the dummy now
+	free_node(queue, index_of(head));
+	return item;
+}
+
@@ -0,0 +1,63 @@
+/*
+ * CQueue.h
+ *
+ * Generic queues that many threads can enqueue into and dequeue from
+ * at once, without a lock around them:
+ *
+ * cq_t: bounded, a ring of cells with sequence numbers (after Dmitry
+ *   Vyukov's MPMC queue). Never allocates after make_cq().
+ * msq_t: unbounded, a Michael-Scott linked list. Its nodes come from a
+ *   pool that only grows (under a mutex, the one time it blocks) and is
+ *   freed by delete_msq(), and every link carries a count, so a node
+ *   that is dequeued and reused under a slow thread's feet can neither
+ *   be read after being freed nor fool its compare-and-swap (ABA).
+ *
+ * Neither has Queue.h's iterate_q()/get_item_q()/pop_item_q(): other
+ * threads may be taking the items out in the meantime.
+ */
+
+#ifndef _CQueue_h
+#define _CQueue_h
+
+typedef struct concurrent_queue cq_t;
+typedef struct ms_queue msq_t;
+
+/* -------- bounded queue -------- */
+
+/* holds up to `capacity` items, rounded up to a power of 2;
+ * returns NULL if malloc failed.
+ */
+cq_t *make_cq(int capacity);
+
+/* allows NULL as the itemdelete(); does nothing for a NULL queue.
+ * No other thread may be using the queue.
+ */
+void delete_cq(cq_t *queue, void (*itemdelete)(void *item));
+
+// returns -1 if the queue is NULL or full; otherwise 0.
+int enq_cq(cq_t *queue, void *item);
+
+// returns NULL if the queue is NULL or empty.
+void *deq_cq(cq_t *queue);
+
+
+/* -------- unbounded queue -------- */
+
+// returns NULL if malloc failed.
+msq_t *make_msq();
+
+/* allows NULL as the itemdelete(); does nothing for a NULL queue.
+ * No other thread may be using the queue.
+ */
+void delete_msq(msq_t *queue, void (*itemdelete)(void *item));
+
+/* returns -1 if the queue is NULL or the node pool could not grow
+ * (malloc failed, or it already holds 4M nodes); otherwise 0.
+ */
+int enq_msq(msq_t *queue, void *item);
+
+// returns NULL if the queue is NULL or empty.
+void *deq_msq(msq_t *queue);
+
+
+#endif  /* _CQueue_h */
@@ -1,7 +1,7 @@
 /*
  * Queue.h
  *
- * Generic queue, implemented with linked list.
+ * Generic queue, implemented with a growable ring array.
  *
  * Shengsong Gao, 2020
  */
@@ -25,9 +25,9 @@ void delete_q(q_t *queue, void (*itemdelete)(void *item));
 int enq_q(q_t *queue, void *item);
 
 
-/* deq_q() frees the node it deq'd, but the caller is still 
- * responsible for freeing the return item. Returns NULL if
- * the queue is NULL or if the queue is empty.
+/* the caller is responsible for freeing the return item.
+ * Returns NULL if the queue is NULL or if the queue is empty.
+ * The queue keeps its array, so refilling it does not malloc.
  */
 void *deq_q(q_t *queue);
 
@@ -0,0 +1,171 @@
+/* Connection setup benchmark for the MRT module: `num_connections`
+ * connections to the `receiver` driver (in its own process) over an
+ * emulated link, set up once one after the other with mrt_connect()
+ * and once all at the same time with mrt_connect_start() and
+ * mrt_connect_next(); then one more to a port nobody is on, which
+ * should be given up on once its timeout is over.
+ *
+ * command line:
+ *	connect_bench num_connections [name=value ...]
+ *
+ * The link conditions are as for transfer_bench (by default 10 ms of
+ * delay each way, nothing lost).
+ *
+ * For each way, the total time and how long each connection took to be
+ * established (median and worst; from the start of the round for the
+ * parallel one) are reported, along with how many threads the process
+ * is running once all of them are. Then all of them are disconnected,
+ * and how long that takes (mrt_disconnect() returns once a connection
+ * is torn down) and the threads left over are reported.
+ *
+ * With MRT_IO=uring, both sides run on io_uring (see mrt_set_io_engine()
+ * in either header; the receiver inherits the environment), so that
+ * the sender's connections share one ring thread instead of having a
+ * handler and a checker each.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+#define _GNU_SOURCE // kill()
+
+#include <stdio.h>
+#include <stdlib.h> // atoi(), malloc(), free(), getenv()
+#include <string.h>
+#include <unistd.h> // fork(), execl(), dup2()
+#include <fcntl.h>  // open()
+#include <signal.h>
+#include <sys/wait.h>
+#include <netinet/in.h>  // INADDR_LOOPBACK
+
+#include "mrt.h"
+#include "mrt_sender.h"
+#include "link_emulator.h"
+#include "utilities.h" // now_usec()
+
+#define RECEIVER_PORT_NUMBER  7878 // the `receiver` driver's
+#define LINK_PORT_NUMBER      6500
+#define NOWHERE_PORT_NUMBER   6501 // nobody answers there
+#define FIRST_SENDER_PORT     6000
+#define RECEIVER_PATH         "./receiver"
+#define MAX_CONNECTIONS       (LINK_MAX_CLIENTS / 2)
+#define NOWHERE_TIMEOUT_USEC  300000
+#define DEFAULT_SEED          60
+
+pid_t start_receiver(int num_connections);
+void report(const char *way, double *times, int num_done, int num_connections, long long elapsed);
+
+int main(int argc, char const *argv[]) {
+  link_conditions_t cond = { .delay_usec = 10000, .seed = DEFAULT_SEED };
+  int num_connections = (argc >= 2) ? atoi(argv[1]) : 0;
+  int i, id, num_done, has_failed = 0, io_engine = MRT_IO_SOCKETS;
+
+  for (i = 2; i < argc; i++) {
+    if (link_parse_condition(&cond, argv[i]) != 0) { num_connections = 0; }
+  }
+  if (num_connections <= 0 || num_connections > MAX_CONNECTIONS) {
+    fprintf(stderr, "usage: %s num_connections (at most %d) [name=value ...]\n"
+                    "  names: loss corrupt reorder duplicate delay_ms jitter_ms rate_kbps seed\n",
+            argv[0], MAX_CONNECTIONS);
+    return 1;
+  }
+  int *ids = malloc(2 * num_connections * sizeof(int));
+  double *times = malloc(num_connections * sizeof(double));
+  if (ids == NULL || times == NULL) { return 1; }
+
+  link_t *link_p = link_start(LINK_PORT_NUMBER, RECEIVER_PORT_NUMBER, &cond);
+  if (link_p == NULL) { return 1; }
+  pid_t receiver_pid = start_receiver(2 * num_connections);
+  if (receiver_pid < 0) {
+    link_stop(link_p);
+    return 1;
+  }
+  const char *io_name = getenv("MRT_IO");
+  if (io_name != NULL && strcmp(io_name, "uring") == 0) { io_engine = mrt_set_io_engine(MRT_IO_URING); }
+  printf("connect: connections=%d io=%s loss=%.3f delay_ms=%.1f\n", num_connections,
+         (io_engine == MRT_IO_URING) ? "uring" : "sockets", cond.loss_rate, cond.delay_usec / 1000.0);
+
+  /****** one after the other ******/
+  long long start_time = now_usec();
+  for (num_done = 0; num_done < num_connections; num_done++) {
+    long long connect_start = now_usec();
+    ids[num_done] = mrt_connect(FIRST_SENDER_PORT + num_done, LINK_PORT_NUMBER, INADDR_LOOPBACK);
+    if (ids[num_done] < 0) { break; }
+    times[num_done] = (now_usec() - connect_start) / 1000.0;
+  }
+  report("sequential", times, num_done, num_connections, now_usec() - start_time);
+  has_failed |= (num_done < num_connections);
+
+  /****** all at once ******/
+  int num_started = 0;
+  start_time = now_usec();
+  for (i = 0; i < num_connections; i++) {
+    if (mrt_connect_start(FIRST_SENDER_PORT + num_connections + i, LINK_PORT_NUMBER, INADDR_LOOPBACK, 0) >= 0) {
+      num_started += 1;
+    }
+  }
+  int num_established = 0;
+  while (mrt_connect_next(&id, -1) == 1) {
+    ids[num_done++] = id;
+    times[num_established++] = (now_usec() - start_time) / 1000.0;
+  }
+  report("parallel", times, num_established, num_connections, now_usec() - start_time);
+  has_failed |= (num_started < num_connections || num_established < num_started);
+  printf("connect: open=%d threads=%d\n", num_done, count_threads());
+
+  /****** nobody there ******/
+  start_time = now_usec();
+  int result = -1;
+  if (mrt_connect_start(FIRST_SENDER_PORT + 2 * num_connections, NOWHERE_PORT_NUMBER, INADDR_LOOPBACK,
+                        NOWHERE_TIMEOUT_USEC) >= 0) {
+    result = mrt_connect_next(&id, 2 * NOWHERE_TIMEOUT_USEC);
+  }
+  printf("connect: unreachable timeout_ms=%d result=%d after_ms=%.1f\n", NOWHERE_TIMEOUT_USEC / 1000, result,
+         (now_usec() - start_time) / 1000.0);
+  has_failed |= (result != 0);
+  fflush(stdout);
+
+  // the receiver reads each connection to its end, in the order it accepted them
+  start_time = now_usec();
+  for (i = 0; i < num_done; i++) { mrt_disconnect(ids[i]); }
+  printf("connect: disconnected=%d total_ms=%.1f threads=%d\n", num_done,
+         (now_usec() - start_time) / 1000.0, count_threads());
+  if (num_done < 2 * num_connections) { kill(receiver_pid, SIGTERM); }
+  waitpid(receiver_pid, NULL, 0);
+  link_stop(link_p);
+  free(ids);
+  free(times);
+  return has_failed;
+}
+
+// prints one way's line; `times` are in milliseconds
+void report(const char *way, double *times, int num_done, int num_connections, long long elapsed) {
+  sort_doubles(times, num_done);
+  printf("connect: %s established=%d/%d total_ms=%.1f", way, num_done, num_connections, elapsed / 1000.0);
+  if (num_done > 0) {
+    printf(" p50_ms=%.1f max_ms=%.1f", percentile(times, num_done, 0.5),
+           percentile(times, num_done, 1.0));
+  }
+  printf("\n");
+  fflush(stdout);
+}
+
+// forks and execs the receiver, its output thrown away; returns its pid, or -1
+pid_t start_receiver(int num_connections) {
+  char num_str[16];
+  snprintf(num_str, sizeof(num_str), "%d", num_connections);
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork() error\n");
+    return -1;
+  }
+  if (pid == 0) {
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) { dup2(null_fd, STDOUT_FILENO); }
+    execl(RECEIVER_PATH, RECEIVER_PATH, num_str, (char *)NULL);
+    perror("execl(" RECEIVER_PATH ") error\n");
+    _exit(127);
+  }
+  return pid;
+}
+
@@ -0,0 +1,455 @@
+/* A lossy link emulator for testing the MRT module on loopback.
+ * See link_emulator.h for its usage.
+ *
+ * One thread polls the listening socket and every sender's upstream
+ * socket, decides the fate of each datagram as it arrives, and keeps
+ * the ones to be forwarded in a min-heap ordered by when they are due
+ * (ties in arrival order), sending them off as they come due.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h> // malloc(), free(), atof()
+#include <string.h> // memcpy(), strchr()
+#include <unistd.h> // close()
+#include <fcntl.h>  // fcntl()
+#include <poll.h>
+#include <sys/socket.h>
+#include <arpa/inet.h> // htons(), htonl()
+#include <pthread.h>
+
+#include "mrt.h"
+#include "utilities.h" // now_usec()
+#include "link_emulator.h"
+
+#define LINK_POLL_PERIOD 10 // milliseconds; how often the thread checks whether to stop
+
+// a datagram on its way
+typedef struct held {
+  long long due_time;
+  long seq; // arrival order, to break ties
+  int client_i;
+  int direction; // 0 toward the receiver, 1 back
+  int len;
+  char bytes[MAX_UDP_PAYLOAD_LENGTH];
+} held_t;
+
+typedef struct client {
+  struct sockaddr_in addr; // the sender's
+  int upstream_sockfd;     // connected to the receiver
+  int has_data;
+  int min_frag, max_frag;  // of its DATA, to tell retransmissions apart
+} client_t;
+
+typedef struct link {
+  pthread_t thread;
+  link_conditions_t conditions;
+  unsigned long long rng_state;
+
+  int listen_sockfd;
+  struct sockaddr_in target_addr;
+  client_t clients[LINK_MAX_CLIENTS];
+  int num_clients;
+
+  held_t *slots;      // LINK_MAX_IN_FLIGHT of them
+  int *free_slots;    // a stack of the unused slot indices
+  int num_free_slots;
+  int *heap;          // slot indices, the earliest due first
+  int heap_size;
+  long next_seq;
+  long long free_time[2]; // when each direction is done sending, under the rate limit
+
+  link_stats_t stats;
+  pthread_mutex_t stats_lock;
+
+  int should_stop;
+  pthread_mutex_t stop_lock;
+} link_t;
+
+void *link_thread(void *link_vp);
+void receive_all(link_t *link_p, int sockfd, int direction, int client_i);
+void impair(link_t *link_p, int client_i, int direction, char *bytes, int len);
+void hold(link_t *link_p, int client_i, int direction, char *bytes, int len, int is_reordered);
+void forward_due(link_t *link_p);
+int find_client(link_t *link_p, struct sockaddr_in *addr_p);
+void note_data(link_t *link_p, int client_i, char *bytes, int len);
+int is_earlier(link_t *link_p, int slot_a, int slot_b);
+void heap_push(link_t *link_p, int slot);
+int heap_pop(link_t *link_p);
+double next_random(link_t *link_p);
+int is_name(const char *arg, int name_len, const char *name);
+
+link_t *link_start(unsigned short listen_port, unsigned short target_port, link_conditions_t *conditions_p) {
+  link_t *link_p = (link_t *)calloc(1, sizeof(link_t));
+  struct sockaddr_in listen_addr = {0};
+  int i;
+
+  if (link_p == NULL) { return NULL; }
+  link_p->conditions = *conditions_p;
+  // xorshift64* must not start from 0
+  link_p->rng_state = ((unsigned long long)conditions_p->seed << 1) | 1;
+  link_p->slots = (held_t *)malloc(LINK_MAX_IN_FLIGHT * sizeof(held_t));
+  link_p->free_slots = (int *)malloc(LINK_MAX_IN_FLIGHT * sizeof(int));
+  link_p->heap = (int *)malloc(LINK_MAX_IN_FLIGHT * sizeof(int));
+  if (link_p->slots == NULL || link_p->free_slots == NULL || link_p->heap == NULL) {
+    perror("link_start: malloc() error\n");
+    goto failed;
+  }
+  for (i = 0; i < LINK_MAX_IN_FLIGHT; i++) {
+    link_p->free_slots[i] = LINK_MAX_IN_FLIGHT - 1 - i;
+  }
+  link_p->num_free_slots = LINK_MAX_IN_FLIGHT;
+
+  link_p->target_addr.sin_family = AF_INET;
+  link_p->target_addr.sin_port = htons(target_port);
+  link_p->target_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  listen_addr = link_p->target_addr;
+  listen_addr.sin_port = htons(listen_port);
+  link_p->listen_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (link_p->listen_sockfd < 0 ||
+      bind(link_p->listen_sockfd, (struct sockaddr *)&listen_addr, sizeof(listen_addr)) < 0 ||
+      fcntl(link_p->listen_sockfd, F_SETFL, O_NONBLOCK) < 0) {
+    perror("link_start: listening socket error\n");
+    goto failed;
+  }
+
+  pthread_mutex_init(&(link_p->stats_lock), NULL);
+  pthread_mutex_init(&(link_p->stop_lock), NULL);
+  if (pthread_create(&(link_p->thread), NULL, link_thread, link_p) != 0) {
+    perror("link_start: pthread_create() error\n");
+    close(link_p->listen_sockfd);
+    goto failed;
+  }
+  return link_p;
+
+failed:
+  free(link_p->slots);
+  free(link_p->free_slots);
+  free(link_p->heap);
+  free(link_p);
+  return NULL;
+}
+
+void link_get_stats(link_t *link_p, link_stats_t *stats_p) {
+  pthread_mutex_lock(&(link_p->stats_lock));
+    *stats_p = link_p->stats;
+  pthread_mutex_unlock(&(link_p->stats_lock));
+}
+
+int link_parse_condition(link_conditions_t *cond_p, const char *arg) {
+  const char *value = strchr(arg, '=');
+  if (value == NULL) { return -1; }
+  int name_len = value - arg;
+  value += 1;
+
+  if (is_name(arg, name_len, "loss")) {
+    cond_p->loss_rate = atof(value);
+  } else if (is_name(arg, name_len, "corrupt")) {
+    cond_p->corrupt_rate = atof(value);
+  } else if (is_name(arg, name_len, "reorder")) {
+    cond_p->reorder_rate = atof(value);
+  } else if (is_name(arg, name_len, "duplicate")) {
+    cond_p->duplicate_rate = atof(value);
+  } else if (is_name(arg, name_len, "delay_ms")) {
+    cond_p->delay_usec = (int)(atof(value) * 1000);
+  } else if (is_name(arg, name_len, "jitter_ms")) {
+    cond_p->jitter_usec = (int)(atof(value) * 1000);
+  } else if (is_name(arg, name_len, "rate_kbps")) {
+    cond_p->rate_bytes_per_sec = (long)(atof(value) * 1000 / 8);
+  } else if (is_name(arg, name_len, "seed")) {
+    cond_p->seed = (unsigned int)atol(value);
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+void link_stop(link_t *link_p) {
+  int i;
+  pthread_mutex_lock(&(link_p->stop_lock));
+    link_p->should_stop = 1;
+  pthread_mutex_unlock(&(link_p->stop_lock));
+  pthread_join(link_p->thread, NULL);
+
+  close(link_p->listen_sockfd);
+  for (i = 0; i < link_p->num_clients; i++) {
+    close(link_p->clients[i].upstream_sockfd);
+  }
+  pthread_mutex_destroy(&(link_p->stats_lock));
+  pthread_mutex_destroy(&(link_p->stop_lock));
+  free(link_p->slots);
+  free(link_p->free_slots);
+  free(link_p->heap);
+  free(link_p);
+}
+
+/****** the proxy's thread ******/
+
+void *link_thread(void *link_vp) {
+  link_t *link_p = (link_t *)link_vp;
+  struct pollfd fds[1 + LINK_MAX_CLIENTS];
+  int num_fds, timeout, i;
+  long long wait_time;
+
+  while (1) {
+    pthread_mutex_lock(&(link_p->stop_lock));
+      int should_stop = link_p->should_stop;
+    pthread_mutex_unlock(&(link_p->stop_lock));
+    if (should_stop) { break; }
+
+    fds[0].fd = link_p->listen_sockfd;
+    fds[0].events = POLLIN;
+    for (i = 0; i < link_p->num_clients; i++) {
+      fds[1 + i].fd = link_p->clients[i].upstream_sockfd;
+      fds[1 + i].events = POLLIN;
+    }
+    num_fds = 1 + link_p->num_clients;
+
+    // sleep until the next datagram is due, at most LINK_POLL_PERIOD
+    timeout = LINK_POLL_PERIOD;
+    if (link_p->heap_size > 0) {
+      wait_time = link_p->slots[link_p->heap[0]].due_time - now_usec();
+      if (wait_time <= 0) {
+        timeout = 0;
+      } else if (wait_time < LINK_POLL_PERIOD * 1000) {
+        timeout = (wait_time + 999) / 1000;
+      }
+    }
+    if (poll(fds, num_fds, timeout) > 0) {
+      if (fds[0].revents & POLLIN) {
+        receive_all(link_p, link_p->listen_sockfd, 0, -1);
+      }
+      for (i = 1; i < num_fds; i++) {
+        if (fds[i].revents & POLLIN) {
+          receive_all(link_p, fds[i].fd, 1, i - 1);
+        }
+      }
+    }
+    forward_due(link_p);
+  }
+  return NULL;
+}
+
+/* takes in every datagram waiting on the socket; from the listening
+ * socket (direction 0) the sender is looked up by its address.
+ */
+void receive_all(link_t *link_p, int sockfd, int direction, int client_i) {
+  char bytes[MAX_UDP_PAYLOAD_LENGTH];
+  struct sockaddr_in addr;
+  socklen_t addr_len;
+  int len;
+
+  while (1) {
+    addr_len = sizeof(addr);
+    len = recvfrom(sockfd, bytes, MAX_UDP_PAYLOAD_LENGTH, MSG_DONTWAIT, (struct sockaddr *)&addr, &addr_len);
+    if (len < 0) { return; } // drained (or the receiver is not there yet)
+    if (direction == 0) {
+      client_i = find_client(link_p, &addr);
+      if (client_i < 0) { continue; } // too many senders; as good as lost
+    }
+    impair(link_p, client_i, direction, bytes, len);
+  }
+}
+
+// decides what becomes of the datagram.
+void impair(link_t *link_p, int client_i, int direction, char *bytes, int len) {
+  link_conditions_t *cond_p = &(link_p->conditions);
+  int is_lost, is_corrupted, is_duplicated, is_reordered;
+
+  // always draw all four, so that one rate does not shift the others' draws
+  is_lost = next_random(link_p) < cond_p->loss_rate;
+  is_corrupted = next_random(link_p) < cond_p->corrupt_rate;
+  is_duplicated = next_random(link_p) < cond_p->duplicate_rate;
+  is_reordered = next_random(link_p) < cond_p->reorder_rate;
+
+  pthread_mutex_lock(&(link_p->stats_lock));
+    link_p->stats.num_received[direction] += 1;
+    if (direction == 0) { note_data(link_p, client_i, bytes, len); }
+    if (is_lost) {
+      link_p->stats.num_dropped[direction] += 1;
+    } else {
+      link_p->stats.num_corrupted[direction] += is_corrupted;
+      link_p->stats.num_duplicated[direction] += is_duplicated;
+      link_p->stats.num_reordered[direction] += is_reordered;
+    }
+  pthread_mutex_unlock(&(link_p->stats_lock));
+  if (is_lost) { return; }
+
+  if (is_corrupted && len > 0) {
+    bytes[(int)(next_random(link_p) * len)] ^= 1 + (int)(next_random(link_p) * 255);
+  }
+  hold(link_p, client_i, direction, bytes, len, is_reordered);
+  if (is_duplicated) {
+    hold(link_p, client_i, direction, bytes, len, 0);
+  }
+}
+
+/* queues the datagram to be forwarded once it has gone through the
+ * rate limit and the delay; drops it if there is no room.
+ */
+void hold(link_t *link_p, int client_i, int direction, char *bytes, int len, int is_reordered) {
+  link_conditions_t *cond_p = &(link_p->conditions);
+  long long curr_time = now_usec(), depart_time = curr_time;
+  int slot;
+
+  if (cond_p->rate_bytes_per_sec > 0) {
+    if (link_p->free_time[direction] > depart_time) { depart_time = link_p->free_time[direction]; }
+    if (depart_time - curr_time > LINK_MAX_QUEUE_USEC) { goto dropped; }
+    depart_time += (long long)len * 1000000 / cond_p->rate_bytes_per_sec;
+    link_p->free_time[direction] = depart_time;
+  }
+  if (link_p->num_free_slots == 0) { goto dropped; }
+
+  slot = link_p->free_slots[--link_p->num_free_slots];
+  held_t *held_p = &(link_p->slots[slot]);
+  held_p->due_time = depart_time + cond_p->delay_usec +
+    (long long)(next_random(link_p) * (cond_p->jitter_usec + 1)) +
+    (is_reordered ? LINK_REORDER_USEC : 0);
+  held_p->seq = link_p->next_seq++;
+  held_p->client_i = client_i;
+  held_p->direction = direction;
+  held_p->len = len;
+  memcpy(held_p->bytes, bytes, len);
+  heap_push(link_p, slot);
+  return;
+
+dropped:
+  pthread_mutex_lock(&(link_p->stats_lock));
+    link_p->stats.num_dropped[direction] += 1;
+  pthread_mutex_unlock(&(link_p->stats_lock));
+}
+
+// sends off every datagram that is due.
+void forward_due(link_t *link_p) {
+  long long curr_time = now_usec();
+  held_t *held_p;
+  client_t *client_p;
+  int slot;
+
+  while (link_p->heap_size > 0 && link_p->slots[link_p->heap[0]].due_time <= curr_time) {
+    slot = heap_pop(link_p);
+    held_p = &(link_p->slots[slot]);
+    client_p = &(link_p->clients[held_p->client_i]);
+    if (held_p->direction == 0) {
+      send(client_p->upstream_sockfd, held_p->bytes, held_p->len, 0);
+    } else {
+      sendto(link_p->listen_sockfd, held_p->bytes, held_p->len, 0,
+             (struct sockaddr *)&(client_p->addr), sizeof(client_p->addr));
+    }
+    link_p->free_slots[link_p->num_free_slots++] = slot;
+    pthread_mutex_lock(&(link_p->stats_lock));
+      link_p->stats.num_forwarded[held_p->direction] += 1;
+    pthread_mutex_unlock(&(link_p->stats_lock));
+  }
+}
+
+/* returns the index of the sender with the address, giving it an
+ * upstream socket if it is new; -1 if there is no room or no socket.
+ */
+int find_client(link_t *link_p, struct sockaddr_in *addr_p) {
+  client_t *client_p;
+  int i;
+  struct sockaddr_in any_addr = {0};
+
+  for (i = 0; i < link_p->num_clients; i++) {
+    client_p = &(link_p->clients[i]);
+    if (client_p->addr.sin_port == addr_p->sin_port &&
+        client_p->addr.sin_addr.s_addr == addr_p->sin_addr.s_addr) {
+      return i;
+    }
+  }
+  if (link_p->num_clients == LINK_MAX_CLIENTS) { return -1; }
+
+  client_p = &(link_p->clients[link_p->num_clients]);
+  any_addr.sin_family = AF_INET;
+  any_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  client_p->upstream_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (client_p->upstream_sockfd < 0) { return -1; }
+  if (bind(client_p->upstream_sockfd, (struct sockaddr *)&any_addr, sizeof(any_addr)) < 0 ||
+      connect(client_p->upstream_sockfd, (struct sockaddr *)&(link_p->target_addr), sizeof(link_p->target_addr)) < 0) {
+    close(client_p->upstream_sockfd);
+    return -1;
+  }
+  client_p->addr = *addr_p;
+  client_p->has_data = 0;
+  return link_p->num_clients++;
+}
+
+/* counts the DATA a sender sent, and the distinct fragments among them
+ * (fragments go up one by one, so the span seen so far, which may wrap
+ * around); assumes that stats_lock is held.
+ */
+void note_data(link_t *link_p, int client_i, char *bytes, int len) {
+  client_t *client_p = &(link_p->clients[client_i]);
+  int type, frag;
+
+  if (len < MRT_HEADER_LENGTH) { return; }
+  memcpy(&type, bytes + MRT_TYPE_LOCATION, MRT_TYPE_LENGTH);
+  if (type != MRT_DATA) { return; }
+  memcpy(&frag, bytes + MRT_FRAGMENT_LOCATION, MRT_FRAGMENT_LENGTH);
+
+  link_p->stats.num_data += 1;
+  if (!client_p->has_data) {
+    client_p->has_data = 1;
+    client_p->min_frag = client_p->max_frag = frag;
+    link_p->stats.num_data_frags += 1;
+  } else if (MRT_FRAG_DIFF(frag, client_p->max_frag) > 0) {
+    link_p->stats.num_data_frags += MRT_FRAG_DIFF(frag, client_p->max_frag);
+    client_p->max_frag = frag;
+  } else if (MRT_FRAG_DIFF(frag, client_p->min_frag) < 0) {
+    link_p->stats.num_data_frags += MRT_FRAG_DIFF(client_p->min_frag, frag);
+    client_p->min_frag = frag;
+  }
+}
+
+/****** the heap of held datagrams ******/
+
+int is_earlier(link_t *link_p, int slot_a, int slot_b) {
+  held_t *a_p = &(link_p->slots[slot_a]), *b_p = &(link_p->slots[slot_b]);
+  return a_p->due_time < b_p->due_time || (a_p->due_time == b_p->due_time && a_p->seq < b_p->seq);
+}
+
+void heap_push(link_t *link_p, int slot) {
+  int i = link_p->heap_size++, parent;
+  while (i > 0) {
+    parent = (i - 1) / 2;
+    if (!is_earlier(link_p, slot, link_p->heap[parent])) { break; }
+    link_p->heap[i] = link_p->heap[parent];
+    i = parent;
+  }
+  link_p->heap[i] = slot;
+}
+
+int heap_pop(link_t *link_p) {
+  int top = link_p->heap[0];
+  int last = link_p->heap[--link_p->heap_size];
+  int i = 0, child;
+  while ((child = 2 * i + 1) < link_p->heap_size) {
+    if (child + 1 < link_p->heap_size && is_earlier(link_p, link_p->heap[child + 1], link_p->heap[child])) {
+      child += 1;
+    }
+    if (!is_earlier(link_p, link_p->heap[child], last)) { break; }
+    link_p->heap[i] = link_p->heap[child];
+    i = child;
+  }
+  link_p->heap[i] = last;
+  return top;
+}
+
+// xorshift64*, uniformly in [0, 1).
+double next_random(link_t *link_p) {
+  unsigned long long x = link_p->rng_state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  link_p->rng_state = x;
+  return ((x * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// whether the first name_len bytes of arg are exactly name, not just a prefix of it.
+int is_name(const char *arg, int name_len, const char *name) {
+  return name_len == (int)strlen(name) && strncmp(arg, name, name_len) == 0;
+}
@@ -0,0 +1,71 @@
+/* Header file for `link_emulator.c`
+ * A lossy link between an MRT sender and receiver on loopback: a UDP
+ * proxy, run by a thread of the calling process, that impairs what it
+ * forwards in both directions.
+ *
+ * Senders connect to the proxy's port instead of the receiver's; the
+ * proxy forwards each sender's datagrams to the receiver from a socket
+ * of their own (so the receiver sees one address per sender) and the
+ * replies back to the sender.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+#ifndef _link_emulator_h
+#define _link_emulator_h
+
+#define LINK_MAX_CLIENTS      256   // senders at once
+#define LINK_MAX_IN_FLIGHT    4096  // datagrams held at once; more are dropped
+#define LINK_MAX_QUEUE_USEC   100000 // what waits longer than this for the rate limit is dropped
+#define LINK_REORDER_USEC     2000  // extra delay of a reordered datagram
+
+/* how every datagram (either way) is treated; rates are probabilities
+ * between 0 and 1, drawn independently from a generator seeded with
+ * `seed`, so the same conditions impair the same way run after run.
+ */
+typedef struct link_conditions {
+  double loss_rate;
+  double corrupt_rate;   // one byte flipped (MRT's hash should catch it)
+  double reorder_rate;   // held LINK_REORDER_USEC longer, so later ones pass it
+  double duplicate_rate; // forwarded twice
+  int delay_usec;        // one way
+  int jitter_usec;       // added to the delay, uniformly in [0, jitter_usec]
+  long rate_bytes_per_sec; // each way; 0 for no limit
+  unsigned int seed;
+} link_conditions_t;
+
+// what the proxy saw; index 0 is toward the receiver, 1 back toward the senders
+typedef struct link_stats {
+  long num_received[2];
+  long num_forwarded[2]; // duplicates included
+  long num_dropped[2];   // lost, or over LINK_MAX_IN_FLIGHT or LINK_MAX_QUEUE_USEC
+  long num_corrupted[2];
+  long num_reordered[2];
+  long num_duplicated[2];
+  long num_data;         // DATA the senders sent (before impairment)
+  long num_data_frags;   // distinct fragments among them
+} link_stats_t;
+
+typedef struct link link_t;
+
+/* starts proxying from 127.0.0.1:listen_port to 127.0.0.1:target_port
+ * under the conditions (copied); returns NULL upon any error.
+ */
+link_t *link_start(unsigned short listen_port, unsigned short target_port, link_conditions_t *conditions_p);
+
+/* sets the condition named in `arg`, "name=value", out of
+ *	loss corrupt reorder duplicate  (rates between 0 and 1)
+ *	delay_ms jitter_ms rate_kbps seed
+ * (for the benchmarks' command lines); returns -1 for an unknown name.
+ */
+int link_parse_condition(link_conditions_t *cond_p, const char *arg);
+
+// copies the current stats into *stats_p.
+void link_get_stats(link_t *link_p, link_stats_t *stats_p);
+
+/* stops the proxy's thread, closes its sockets and frees it;
+ * datagrams still held are dropped.
+ */
+void link_stop(link_t *link_p);
+
+#endif // _link_emulator_h
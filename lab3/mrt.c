@@ -16,3 +16,5 @@ const int data_type = MRT_DATA;
 const int adat_type = MRT_ADAT;
 const int rcls_type = MRT_RCLS;
 const int acls_type = MRT_ACLS;
+const int cook_type = MRT_COOK;
+const int skip_type = MRT_SKIP;
@@ -16,6 +16,8 @@
 #define MRT_ADAT 4
 #define MRT_RCLS 5
 #define MRT_ACLS 6
+#define MRT_COOK 7
+#define MRT_SKIP 8
 
 #define MRT_HASH_LENGTH           8     // unsigned long
 #define MRT_TYPE_LENGTH           4     // int
@@ -28,6 +30,87 @@
 #define MRT_WINDOWSIZE_LOCATION  (MRT_FRAGMENT_LOCATION + MRT_FRAGMENT_LENGTH)
 #define MRT_PAYLOAD_LOCATION     MRT_HEADER_LENGTH
 
+// DATA transmissions have no window size to advertise; they carry flags there
+#define MRT_FLAGS_LOCATION       MRT_WINDOWSIZE_LOCATION
+#define MRT_FLAGS_LENGTH         MRT_WINDOWSIZE_LENGTH
+#define MRT_FLAG_PUSH            1 // the sender is waiting on this fragment's ADAT
+#define MRT_FLAG_ACK             2 // an ADAT rides along; see below
+#define MRT_FLAG_MESSAGE         4 // part of a message (see mrt_send_message())
+#define MRT_FLAG_END_OF_MESSAGE  8 // ...and its last fragment
+
+/* connections are full-duplex: the receiver can send DATA back (see
+ * mrt_reply()), acknowledged by the sender's ADATs, with fragment
+ * numbers of its own (starting from 1). A DATA going either way may
+ * carry the acknowledgement of the other direction instead of a
+ * separate ADAT: flagged MRT_FLAG_ACK, its header is followed by the
+ * fragment and window size an ADAT would have had, then the payload.
+ */
+#define MRT_ACK_FRAGMENT_LOCATION    MRT_HEADER_LENGTH
+#define MRT_ACK_WINDOWSIZE_LOCATION  (MRT_ACK_FRAGMENT_LOCATION + MRT_FRAGMENT_LENGTH)
+#define MRT_ACK_LENGTH               (MRT_FRAGMENT_LENGTH + MRT_WINDOWSIZE_LENGTH)
+
+/* a message the sender abandoned (see mrt_send_message()) is never
+ * sent again; a SKIP tells the receiver to move on past it instead.
+ * Its fragment is the last one abandoned, and the receiver's ADAT
+ * (for that fragment or a later one) confirms it; until then the
+ * sender keeps repeating it.
+ */
+
+/* a connection carries MRT_MAX_STREAMS streams, each in order on its
+ * own, so that a fragment lost on one holds up no other. Stream 0 is
+ * the connection's own (mrt_send(), mrt_receive1() and the rest); the
+ * others (see mrt_send_stream()) have fragment numbers of their own
+ * (starting from 1) and a window of MRT_STREAM_WINDOW_SIZE each. A DATA
+ * of theirs carries the stream in the top byte of its flags, and an
+ * ADAT for one carries it right after the header.
+ */
+#define MRT_MAX_STREAMS          8
+#define MRT_FLAGS_STREAM_SHIFT   24
+#define MRT_STREAM_OF(flags)     (((unsigned int)(flags) >> MRT_FLAGS_STREAM_SHIFT) & 0xff)
+#define MRT_STREAM_LOCATION      MRT_HEADER_LENGTH
+#define MRT_STREAM_LENGTH        4     // int
+
+/* fragment numbers are 32 bits and wrap around after 2^32 fragments
+ * (about 2 TB of payload). Like RFC 1982 serial numbers, two of them
+ * are compared by the sign of their difference modulo 2^32, which is
+ * right as long as they are less than 2^31 apart (any window is far
+ * less); a plain <, > or - on them goes wrong once they pass INT_MAX.
+ */
+#define MRT_FRAG_DIFF(a, b)      ((int)((unsigned int)(a) - (unsigned int)(b)))
+#define MRT_FRAG_ADD(frag, n)    ((int)((unsigned int)(frag) + (unsigned int)(n)))
+
+// neither do RCONs; they echo the receiver's cookie there (0 if none yet)
+#define MRT_COOKIE_LOCATION      MRT_WINDOWSIZE_LOCATION
+#define MRT_COOKIE_LENGTH        MRT_WINDOWSIZE_LENGTH
+
+/* a sender on the same host as its receiver offers a shared-memory
+ * ring (see mrt_shm.h) for stream 0's bytes: its RCONs carry, after the
+ * header, MRT_SHM_MAGIC, its process ID, the ring's descriptor in that
+ * process, the ring's token and its own port, which the receiver checks
+ * against where the RCON came from (so an offer relayed by something in
+ * between, like link_emulator.h, is turned down). A receiver that maps
+ * the ring echoes the token right after its ACONs' header. From then
+ * on, mrt_send() puts the bytes in the ring (no DATA, ADAT or hash for
+ * them), while everything else still goes over UDP: the handshake,
+ * keepalives, the other streams, messages, replies and closing.
+ */
+#define MRT_SHM_OFFER_LOCATION   MRT_HEADER_LENGTH
+#define MRT_SHM_OFFER_LENGTH     20    // five ints
+#define MRT_SHM_TOKEN_LOCATION   MRT_HEADER_LENGTH
+#define MRT_SHM_TOKEN_LENGTH     4     // unsigned int
+
+/* how a module drives its sockets (see mrt_set_io_engine() in either
+ * module's header): with blocking calls, or through io_uring (see
+ * mrt_uring.h), which both sides fall back from when the kernel lacks it
+ */
+#define MRT_IO_SOCKETS           0
+#define MRT_IO_URING             1
+
+/* the low-latency profile (see mrt_set_busy_poll() in either module's
+ * header) spins instead of sleeping, on up to this many CPUs
+ */
+#define MRT_MAX_PINNED_CPUS      64
+
 /* references for MAX_UDP_PAYLOAD_LENGTH:
  * https://stackoverflow.com/questions/14993000/the-most-reliable-and-efficient-udp-packet-size
  * https://stackoverflow.com/questions/1098897/what-is-the-largest-safe-udp-packet-size-on-the-internet
@@ -36,18 +119,26 @@
  */
 #define MAX_UDP_PAYLOAD_LENGTH   508
 #define MAX_MRT_PAYLOAD_LENGTH   (MAX_UDP_PAYLOAD_LENGTH - MRT_HEADER_LENGTH)
+// so that every DATA sent back has room for an acknowledgement
+#define MAX_MRT_REPLY_LENGTH     (MAX_MRT_PAYLOAD_LENGTH - MRT_ACK_LENGTH)
+// what the sender buffers of the receiver's DATA, i.e. the reverse window
+#define MRT_REPLY_WINDOW_SIZE    (MAX_MRT_REPLY_LENGTH * 16)
+// what the receiver buffers of each stream but the first (see above)
+#define MRT_STREAM_WINDOW_SIZE   (MAX_MRT_PAYLOAD_LENGTH * 16)
 
 // consistently less than 0.4ms with `ping -s 64000 localhost`
 // average RTT is about 100ms to Google... so...
 #define EXPECTED_RTT             10000  // MICROSECONDS... for usleep()
 
 // variables initialized in mrt.c; for memmove() use
-const int unkn_type;
-const int rcon_type;
-const int acon_type;
-const int data_type;
-const int adat_type;
-const int rcls_type;
-const int acls_type;
+extern const int unkn_type;
+extern const int rcon_type;
+extern const int acon_type;
+extern const int data_type;
+extern const int adat_type;
+extern const int rcls_type;
+extern const int acls_type;
+extern const int cook_type;
+extern const int skip_type;
 
 #endif // _mrt_h
@@ -7,58 +7,342 @@
 // the following two includes are necessary for usleep()
 #define _XOPEN_SOURCE   600
 #define _POSIX_C_SOURCE 200112L
+// and this one for recvmmsg(), sendmmsg() and pthread_rwlock_t
+#define _GNU_SOURCE
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h> // exit(), malloc(), free()
 #include <unistd.h> // close(), usleep()
+#include <time.h> // clock_gettime()
+#include <poll.h> // ppoll()
+#include <errno.h> // ETIMEDOUT
 #include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/random.h> // getrandom()
+#include <sys/uio.h> // writev()
 #include <arpa/inet.h> // htons()
 #include <pthread.h>
 
 #include "mrt.h"
 #include "mrt_receiver.h"
 #include "Queue.h"
+#include "CQueue.h"
 #include "utilities.h" // hash()
+#include "mrt_trace.h"
+#include "mrt_shm.h"
+#include "mrt_uring.h"
 
 #define CHECKER_PERIOD          EXPECTED_RTT * 4
 #define TIMEOUT_THRESHOLD       CHECKER_PERIOD * 3
-#define ACCEPT1_PERIOD          EXPECTED_RTT * 2 // connection request
-#define RECEIVE1_PERIOD         EXPECTED_RTT * 2 // sender buffer
+#define RECEIVE1_PERIOD         EXPECTED_RTT * 2 // longest wait for data before re-checking
+#define RECEIVER_BATCH_SIZE     32 // max datagrams per recvmmsg()/sendmmsg()
+#define COOKIE_PERIOD           (EXPECTED_RTT * 100) // a COOK is good for 1 to 2 periods
+#define SENDER_SLAB_SIZE        64 // sender_t slots per malloc()
+#define MESSAGE_SLOTS           16 // message lengths a sender starts with room for; doubled as needed
+#define REPLY_RESEND_PERIOD     EXPECTED_RTT * 2 // DATA sent back is resent when unacknowledged this long
+#define PORT_OF(addr_p)         ntohs((addr_p)->sin_port) // what names a connection in the trace
+#define RING_ENTRIES            (RECEIVER_BATCH_SIZE * 2) // a batch of replies, plus the receive and the poll
+#define RING_BUFFERS            256 // datagrams a shard's ring can hold before they are handled
+#define RING_TAG_SOCKET         1
+#define RING_TAG_WAKE           2
 
 /****** declarations ******/
+typedef struct shard shard_t;
+
+/* the counters behind mrt_receiver_stats(); see stat_add() for why
+ * they can be read without the sender's lock
+ */
+typedef struct receiver_counters {
+  _Atomic long long bytes_received;
+  _Atomic long long bytes_read;
+  _Atomic long long frags_received;
+  _Atomic long long frags_out_of_order;
+  _Atomic long long frags_window_full;
+  _Atomic long long frags_duplicate;
+  _Atomic long long adats_sent;
+  _Atomic long long checksum_failures;
+  _Atomic long long usec_blocked;
+  _Atomic long long bytes_replied;
+  _Atomic long long acks_piggybacked;
+  _Atomic long long frags_skipped;
+  _Atomic long long bytes_discarded;
+  _Atomic int buffer_size;
+  _Atomic int advertised_window;
+  _Atomic int rtt_usec;
+  _Atomic int is_shared_memory;
+} receiver_counters_t;
+
+/* one of a sender's streams other than the first (see
+ * mrt_receive_stream()): a ring of MRT_STREAM_WINDOW_SIZE bytes of its
+ * own (malloc'd on its first DATA), filled in order with fragment
+ * numbers of its own. Protected by the sender's lock.
+ */
+typedef struct stream {
+  char *buffer;
+  int read_index;
+  int bytes_unread;
+  int next_frag; // from 1
+  int unacked_frags; // in-order fragments since its last ADAT
+  int gap_acked_frag; // next_frag when a gap was last ADAT'd
+  int last_advertised_window;
+} stream_t;
+
 typedef struct sender {
   struct sockaddr_in addr;
-  char buffer[RECEIVER_MAX_WINDOW_SIZE];
+  shard_t *shard_p; // the shard whose socket the sender's traffic arrives on
+
+  // everything below is protected by `lock`
+  char *buffer; // a ring of buffer_size bytes; unread bytes may wrap around
+  int buffer_size;
+  int read_index; // where the oldest unread byte is
   int bytes_unread;
+  int bytes_borrowed; // lent out by mrt_borrow(); the ring must not move meanwhile
   int next_frag;
   int inactive_time;
+  int is_accepted; // 0 while waiting in pending_senders_q
+  pthread_mutex_t lock;
+  pthread_cond_t readable_cvar; // signaled when bytes arrive or the connection ends
+  int eventfd; // readable while the sender is; -1 until mrt_eventfd()
+  int is_end_reported; // by mrt_poll() or a read, once over and drained
+  int num_waiters; // calls waiting on it unlocked; not reclaimed (or torn down) meanwhile
+  long long last_read_time; // retained senders are evicted least recently read first
+
+  // for autotune_window()
+  int bytes_drained; // by the application since epoch_start
+  long long epoch_start;
+  int rtt_estimate; // microseconds; 0 until the first sample
+  int rtt_probe_frag; // the RTT is sampled when this fragment arrives
+  long long rtt_probe_time; // 0 when none is awaited
+
+  // for delaying and decimating ADATs; see acknowledge()
+  int ack_every;
+  int ack_delay;
+  int unacked_frags; // in-order fragments since the last ADAT
+  int is_ack_pending; // 1 while in its shard's delayed_acks_q with a due ADAT
+  long long ack_due_time;
+  int gap_acked_frag; // next_frag when a gap was last ADAT'd at once
+  int last_advertised_window;
+
+  // for mrt_reply(): DATA sent back, fragments numbered from 1
+  int reply_acked_frag; // the highest the sender acknowledged
+  int reply_window; // the sender's window for them, as last advertised
+  int is_replying; // one mrt_reply() at a time
+  int has_replied; // from then on, PUSH fragments' ADATs wait a bit to ride on a reply
+  pthread_cond_t reply_cvar; // signaled when an acknowledgement arrives or the connection ends
+
+  /* for mrt_receive_message(): the lengths of the whole messages among
+   * the unread bytes, oldest first (a ring, malloc'd on the first
+   * message), and the bytes of the one still coming in after them
+   */
+  int *message_lengths;
+  int message_slots;
+  int message_head;
+  int num_messages;
+  int partial_message_bytes;
+
+  stream_t streams[MRT_MAX_STREAMS - 1];
+  int stream_bytes_unread; // on all of them together
+
+  receiver_counters_t counters; // only changed under `lock`, like the rest
+
   pthread_t checker_thread; // checks for inactivity
+  int has_checker; // from mrt_accept1() until the handler joins the checker
+  pthread_cond_t checker_cvar; // signaled to cut the checker's wait short (see main_handler())
+
+  /* the ring a sender on the same host offered in its RCON (see mrt.h),
+   * if it could be mapped; its bytes are moved into `buffer` by the
+   * taker thread, which waits on room_cvar while that is full
+   */
+  mrt_shm_t *shm_p;
+  pthread_t shm_thread;
+  int has_shm_thread; // from mrt_accept1() until the checker (or the handler) joins it
+  pthread_cond_t room_cvar; // signaled when the application reads
+  struct sender *next_free; // while in free_senders
 } sender_t;
 
-void *main_handler(void *_null);
+/* replies generated while handling one recvmmsg() batch; they are
+ * all flushed with a single sendmmsg() once the batch is processed
+ * (or earlier, should the delayed ADATs fill it up).
+ */
+typedef struct reply_batch {
+  int sockfd; // where the replies go out when the batch is full or flushed
+  mrt_uring_t *ring_p; // ...through which, if the shard is on io_uring
+  struct mmsghdr msgs[RECEIVER_BATCH_SIZE];
+  struct iovec iovecs[RECEIVER_BATCH_SIZE];
+  struct sockaddr_in addrs[RECEIVER_BATCH_SIZE];
+  char buffers[RECEIVER_BATCH_SIZE][MRT_HEADER_LENGTH + MRT_STREAM_LENGTH];
+  int num_replies;
+} reply_batch_t;
+
+/* one socket bound to the receiver port (with SO_REUSEPORT) and the
+ * thread handling it; the kernel hashes each sender to one shard, so
+ * a shard's table holds every sender (pending or accepted) it has seen.
+ *
+ * Only the shard's handler adds to or removes from senders_q, so the
+ * handler itself reads it without locking and takes senders_lock for
+ * writing only when changing it; everyone else reads it under the
+ * read lock. The senders' own state is behind their own locks.
+ */
+typedef struct shard {
+  int sockfd;
+  pthread_t handler_thread;
+  q_t *senders_q;
+  pthread_rwlock_t senders_lock;
+
+  // the pool of receive buffers filled by each recvmmsg() in main_handler()
+  struct mmsghdr incoming_msgs[RECEIVER_BATCH_SIZE];
+  struct iovec incoming_iovecs[RECEIVER_BATCH_SIZE];
+  struct sockaddr_in incoming_addrs[RECEIVER_BATCH_SIZE];
+  char incoming_buffers[RECEIVER_BATCH_SIZE][MAX_UDP_PAYLOAD_LENGTH];
+  reply_batch_t outgoing_replies;
+
+  // accepted senders owing a delayed ADAT; only touched by the handler
+  q_t *delayed_acks_q;
+  long long next_ack_due_time; // the earliest ack_due_time in it; 0 if none
+
+  // senders whose connection is over, on their way out; see reap_senders()
+  int wake_fd; // an eventfd polled next to sockfd; written when there may be some to reap
+  msq_t *closed_q; // handed over by their checkers; lock-free, as they enqueue while the handler dequeues
+  q_t *retained_q; // kept for their unread bytes; only touched by the handler
+  int num_retained;
+
+  // an empty queue the handler refills and swaps with the one it filters
+  q_t *spare_q;
+} shard_t;
+
+void *main_handler(void *shard_vp);
+int run_ring(shard_t *shard_p);
+void handle_transmission(shard_t *shard_p, char *transmission, int num_bytes_received, struct sockaddr_in *addr_p, reply_batch_t *replies_p);
 void *checker(void *sender_vp);
+void *shm_taker(void *sender_vp);
+void take_shm_offer(sender_t *sender_p, char *transmission, int num_bytes_received);
+sender_t *sender_t_new(shard_t *shard_p, struct sockaddr_in *addr_p, int initial_frag);
+void sender_t_free(void *sender_vp);
+sender_t *take_free_sender();
+struct sockaddr_in *accept_pending(int should_wait, int *is_taken_p);
+void abandon_accept(sender_t *sender_p);
+void reap_senders(shard_t *shard_p);
+void reclaim_sender(shard_t *shard_p, sender_t *sender_p);
+int reclaim_superseded(shard_t *shard_p, sender_t *sender_p);
+void find_least_recently_read(void *sender_vp, void *search_vp);
+void wake_handler(shard_t *shard_p);
+void stop_handlers(int num_started);
+void free_shards(int num_allocated, int num_ready, int num_started);
+int abandon_open(int num_allocated, int num_ready, int num_started);
+sender_t *lock_accepted_sender(struct sockaddr_in *id_p);
+sender_t *lock_readable_sender(struct sockaddr_in *id_p, int *status_p, int is_message, int stream);
+void leave_sender(sender_t *sender_p);
+int note_bytes_read(sender_t *sender_p, int len, char *outgoing_buffer);
+void reset_counters(receiver_counters_t *counters_p);
+void count_dropped(sender_t *sender_p, int frag);
+void handle_reply_ack(sender_t *sender_p, int frag, int window_size);
+int build_reply(sender_t *sender_p, char *outgoing_buffer, int frag, const char *payload, int payload_len);
+void handle_stream_data(sender_t *sender_p, int stream, int frag, int flags, char *payload, int payload_size, reply_batch_t *replies_p);
+int unread_anywhere(sender_t *sender_p);
+void buffer_append(sender_t *sender_p, char *bytes, int len);
+int buffer_consume(sender_t *sender_p, char *destination, int len);
+void buffer_release(sender_t *sender_p, int len);
+int reserve_message(sender_t *sender_p);
+void note_message_bytes(sender_t *sender_p, int len, int is_end);
+int buffer_resize(sender_t *sender_p, int new_size);
+void sample_rtt(sender_t *sender_p, int window_size);
+void autotune_window(sender_t *sender_p);
+void acknowledge(shard_t *shard_p, sender_t *sender_p, int is_urgent, reply_batch_t *replies_p);
+void flush_delayed_acks(shard_t *shard_p, reply_batch_t *replies_p);
+int is_window_update_due(sender_t *sender_p);
+void notify_ready(sender_t *sender_p);
+void notify_pollers();
+void drain_eventfd(int fd);
+void collect_events(void *sender_vp, void *collector_vp);
+void deadline_after(struct timespec *deadline_p, int usec);
 int sender_matcher(void *sender_vp, void *id_vp);
 void probe_for_one(void *id_vp, void *target_id_vpp);
-void build_acon(int initial_frag);
-void build_adat(int received_frag, int curr_window_size);
-void build_acls();
+char *add_reply(reply_batch_t *replies_p, struct sockaddr_in *addr_p, int len);
+void send_replies(reply_batch_t *replies_p);
+int build_acon(char *outgoing_buffer, int initial_frag, mrt_shm_t *shm_p);
+void build_adat(char *outgoing_buffer, int received_frag, int curr_window_size);
+void build_stream_adat(char *outgoing_buffer, int stream, int received_frag, int curr_window_size);
+void build_acls(char *outgoing_buffer);
+void build_cook(char *outgoing_buffer, int initial_frag, unsigned int cookie);
+unsigned int make_cookie(struct sockaddr_in *addr_p, int initial_frag, long long period);
+int is_cookie_valid(struct sockaddr_in *addr_p, int initial_frag, unsigned int cookie);
+unsigned long long mix64(unsigned long long x);
 
 /****** global variables ******/
 unsigned int addr_len = (unsigned int) sizeof(struct sockaddr_in);
-int initial_window_size = RECEIVER_MAX_WINDOW_SIZE;
-int rece_sockfd;
+int initial_window_size = RECEIVER_INITIAL_WINDOW_SIZE;
+
+// the total size of all receive buffers, kept within memory_budget
+long memory_budget = RECEIVER_DEFAULT_MEMORY_BUDGET;
+long memory_in_use = 0;
+int max_retained = RECEIVER_DEFAULT_RETENTION; // connections over but not yet reclaimed
+pthread_mutex_t budget_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int io_engine = MRT_IO_SOCKETS; // set before mrt_open() creates the handlers, which read it
+
+/* the low-latency profile (see mrt_set_busy_poll()); the handlers take
+ * it up at mrt_open(), the readers and mrt_reply() with every wait
+ */
+int is_busy_polling = 0;
+int busy_poll_usec = 0; // SO_BUSY_POLL on the shards' sockets, if positive
+int pinned_cpus[MRT_MAX_PINNED_CPUS]; // shard i's handler on pinned_cpus[i % num_pinned_cpus]
+int num_pinned_cpus = 0;
+
+/* sender_t slots are carved SENDER_SLAB_SIZE at a time and go back to
+ * free_senders when reclaimed; a slot's lock and cvar are initialized
+ * once, and it keeps its buffer as long as that is of the initial size.
+ * Slabs are never freed, only reused (by the next mrt_open() as well).
+ */
+sender_t *free_senders = NULL;
+pthread_mutex_t slab_lock = PTHREAD_MUTEX_INITIALIZER;
 
 int should_close = 0;
 pthread_mutex_t close_lock = PTHREAD_MUTEX_INITIALIZER;
 
+/* the accept queue; its senders also live in their shard's table.
+ * Lock order: a shard's senders_lock, then accept_lock, then a sender's lock.
+ */
 q_t *pending_senders_q;
-q_t *connected_senders_q;
-pthread_mutex_t q_lock = PTHREAD_MUTEX_INITIALIZER;
+int num_pending = 0; // RCONs beyond accept_backlog are dropped
+int accept_backlog = RECEIVER_DEFAULT_BACKLOG;
+int num_shards_running = 0;
+pthread_mutex_t accept_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t accept_cvar = PTHREAD_COND_INITIALIZER;
+
+/* the shards themselves; taken for reading by the API around every
+ * look through them, and for writing only when mrt_open() puts them
+ * up and mrt_close() takes them down (once their handlers are joined).
+ * Lock order: shards_lock, then a shard's senders_lock.
+ */
+shard_t *shards = NULL;
+int num_shards = 0;
+pthread_rwlock_t shards_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* mrt_poll() waits for poll_seq to change; it is bumped whenever a
+ * connection becomes readable, is over, or asks to connect.
+ * poll_lock is never held while taking any other lock.
+ */
+long poll_seq = 0;
+pthread_mutex_t poll_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t poll_cvar = PTHREAD_COND_INITIALIZER;
+int accept_eventfd = -1; // readable while pending_senders_q is not empty
+
+// keys the RCON cookies; set once by mrt_open()
+unsigned long long cookie_secret = 0;
 
-pthread_t main_thread;
-char incoming_buffer[MAX_UDP_PAYLOAD_LENGTH + 1]; // +1 for NULL-termination for hash()
-char outgoing_buffer[MRT_HEADER_LENGTH + 1]; // +1 for NULL-termination for hash()
+// for collect_events(), on behalf of mrt_poll()
+typedef struct event_collector {
+  mrt_event_t *events;
+  int max_events;
+  int num_events;
+} event_collector_t;
+
+// for find_least_recently_read(), on behalf of reap_senders()
+typedef struct lru_search {
+  sender_t *sender_p; // NULL until an evictable sender is found
+  long long last_read_time;
+} lru_search_t;
 
 /****** functions ******/
 
@@ -66,38 +350,117 @@ char outgoing_buffer[MRT_HEADER_LENGTH + 1]; // +1 for NULL-termination for hash
  * returns -1 upon any error and 0 upon success.
  */
 int mrt_open(unsigned int port_number) {
-  /****** initializing socket and receiver address ******/
-  rece_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-  if (rece_sockfd < 0)
-  {
-    perror("rece_sockfd = socket() error\n");
+  return mrt_open_sharded(port_number, 1);
+}
+
+/* like mrt_open(), but binds `num_shards` sockets to the port with
+ * SO_REUSEPORT, each with its own handler thread and sender table.
+ * returns -1 upon any error and 0 upon success.
+ */
+int mrt_open_sharded(unsigned int port_number, int num_shards_wanted) {
+  if (num_shards_wanted < 1) { return -1; }
+  pthread_rwlock_wrlock(&shards_lock);
+    if (shards != NULL) {
+  pthread_rwlock_unlock(&shards_lock);
+      return -1;
+    }
+    shards = calloc(num_shards_wanted, sizeof(shard_t));
+  pthread_rwlock_unlock(&shards_lock);
+  if (shards == NULL) {
+    perror("calloc(shards) error\n");
     return -1;
   }
+  // (left set by the last mrt_close(), for whoever was still looking)
+  pthread_mutex_lock(&close_lock);
+    should_close = 0;
+  pthread_mutex_unlock(&close_lock);
 
   struct sockaddr_in rece_addr = {0};
   rece_addr.sin_family = AF_INET;
   rece_addr.sin_port = htons(port_number);
   rece_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  int reuse_port = 1, i, j;
+  // (so that abandon_open() knows what there is to close)
+  for (i = 0; i < num_shards_wanted; i++) {
+    shards[i].sockfd = -1;
+    shards[i].wake_fd = -1;
+  }
 
-  /****** binding the socket ******/
-  if (bind(rece_sockfd, (struct sockaddr *)&rece_addr, addr_len) < 0) {
-    perror("bind(rece_sockfd) error\n");
-    return -1;
+  for (i = 0; i < num_shards_wanted; i++) {
+    shard_t *shard_p = &(shards[i]);
+
+    /****** initializing and binding the socket ******/
+    shard_p->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (shard_p->sockfd < 0) {
+      perror("shard_p->sockfd = socket() error\n");
+      return abandon_open(num_shards_wanted, i, 0);
+    }
+    if (num_shards_wanted > 1 &&
+        setsockopt(shard_p->sockfd, SOL_SOCKET, SO_REUSEPORT, &reuse_port, sizeof(reuse_port)) < 0) {
+      perror("setsockopt(SO_REUSEPORT) error\n");
+      return abandon_open(num_shards_wanted, i, 0);
+    }
+    if (bind(shard_p->sockfd, (struct sockaddr *)&rece_addr, addr_len) < 0) {
+      perror("bind(shard_p->sockfd) error\n");
+      return abandon_open(num_shards_wanted, i, 0);
+    }
+    // (not allowed past net.core.busy_read without CAP_NET_ADMIN; spinning does without)
+    if (is_busy_polling && busy_poll_usec > 0 &&
+        setsockopt(shard_p->sockfd, SOL_SOCKET, SO_BUSY_POLL, &busy_poll_usec, sizeof(busy_poll_usec)) < 0) {
+      perror("setsockopt(SO_BUSY_POLL) error\n");
+    }
+
+    shard_p->senders_q = make_q();
+    shard_p->delayed_acks_q = make_q();
+    shard_p->closed_q = make_msq();
+    shard_p->retained_q = make_q();
+    shard_p->spare_q = make_q();
+    shard_p->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (shard_p->senders_q == NULL || shard_p->delayed_acks_q == NULL ||
+        shard_p->closed_q == NULL || shard_p->retained_q == NULL || shard_p->spare_q == NULL ||
+        shard_p->wake_fd < 0 ||
+        pthread_rwlock_init(&(shard_p->senders_lock), NULL) != 0) {
+      perror("shard initialization error\n");
+      return abandon_open(num_shards_wanted, i, 0);
+    }
+    shard_p->outgoing_replies.sockfd = shard_p->sockfd;
+    shard_p->next_ack_due_time = 0;
+    shard_p->num_retained = 0;
+
+    for (j = 0; j < RECEIVER_BATCH_SIZE; j++) {
+      shard_p->incoming_iovecs[j].iov_base = shard_p->incoming_buffers[j];
+      shard_p->incoming_iovecs[j].iov_len = MAX_UDP_PAYLOAD_LENGTH;
+      shard_p->incoming_msgs[j].msg_hdr.msg_iov = &(shard_p->incoming_iovecs[j]);
+      shard_p->incoming_msgs[j].msg_hdr.msg_iovlen = 1;
+      shard_p->incoming_msgs[j].msg_hdr.msg_name = &(shard_p->incoming_addrs[j]);
+    }
+  }
+
+  if (getrandom(&cookie_secret, sizeof(cookie_secret), 0) != sizeof(cookie_secret)) {
+    // not as good, but still unknown to the senders
+    cookie_secret = mix64((unsigned long long)now_usec() ^ ((unsigned long long)getpid() << 32));
   }
 
-  /****** initiating the main handler ******/
-  pthread_mutex_lock(&q_lock);
+  /****** initiating the handlers ******/
+  pthread_mutex_lock(&accept_lock);
     pending_senders_q = make_q();
-    connected_senders_q = make_q();
-    if (pending_senders_q == NULL || connected_senders_q == NULL) {
-      perror("make_q() returned NULL\n");
-      return -1;
+    accept_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (pending_senders_q == NULL || accept_eventfd < 0) {
+  pthread_mutex_unlock(&accept_lock);
+      perror("accept queue initialization error\n");
+      return abandon_open(num_shards_wanted, num_shards_wanted, 0);
     }
-  pthread_mutex_unlock(&q_lock);
+    num_shards_running = num_shards_wanted;
+  pthread_mutex_unlock(&accept_lock);
+  pthread_rwlock_wrlock(&shards_lock);
+    num_shards = num_shards_wanted;
+  pthread_rwlock_unlock(&shards_lock);
 
-  if (pthread_create(&main_thread, NULL, main_handler, NULL) != 0) {
-    perror("pthread_create(main_thread) error\n");
-    return -1;
+  for (i = 0; i < num_shards; i++) {
+    if (pthread_create(&(shards[i].handler_thread), NULL, main_handler, &(shards[i])) != 0) {
+      perror("pthread_create(handler_thread) error\n");
+      return abandon_open(num_shards, num_shards, i);
+    }
   }
   
   return 0;
@@ -106,52 +469,14 @@ int mrt_open(unsigned int port_number) {
 /* accepts a connection request and returns a pointer to a copy of
  * its ID struct (currently reusing `sockaddr_in`). 
  * If no requests exist yet, will block and wait until one shows up,
- * and then accept it.
+ * and then accept it; returns NULL if mrt_close() is called meanwhile,
+ * or if the request has to be given up on (its threads cannot be
+ * created; the sender will ask again).
  * the sender is responsible for freeing the ID struct.
  */
 struct sockaddr_in *mrt_accept1() {
-  sender_t *curr_sender = NULL;
-  while (1) {
-    pthread_mutex_lock(&q_lock);
-      curr_sender = deq_q(pending_senders_q);
-      if (curr_sender == NULL) {
-    pthread_mutex_unlock(&q_lock);
-        usleep(ACCEPT1_PERIOD);
-        continue;
-      } else {
-    pthread_mutex_unlock(&q_lock);
-        break;
-      }
-  }
-  /* note that the two queues are created in one atomic action
-   * so breaking out of the above while loop mean that both queues
-   * are already initialized correctly... and so are other variables
-   * used below; they are initialized before the two queues.
-   */
-  pthread_mutex_lock(&q_lock);
-    enq_q(connected_senders_q, curr_sender);
-
-    /* TODO: be semantically correct and use a different buffer
-     * than the main outgoing_buffer (currently this should still
-     * work, though)
-     */
-    build_acon(curr_sender->next_frag - 1);
-    sendto(rece_sockfd, outgoing_buffer, MRT_HEADER_LENGTH,  
-      0, (const struct sockaddr *)(&(curr_sender->addr)), 
-      addr_len);
-
-    // as soon the ACON is sent, start the timeout checker thread
-    // TODO: what if pthread_create() fails? FATAL? Retry-worthy?
-    pthread_create(&(curr_sender->checker_thread), NULL, checker, curr_sender);
-    
-    // make a copy of the ID struct
-    struct sockaddr_in *id_p = malloc(addr_len);
-    memmove(id_p, &(curr_sender->addr), addr_len);
-
-  pthread_mutex_unlock(&q_lock);
-  
-  // TODO: dangerously asynchronous? Does it matter?
-  return id_p;
+  int is_taken;
+  return accept_pending(1, &is_taken);
 }
 
 /* Will accepted all the pending connections requests
@@ -164,20 +489,13 @@ struct sockaddr_in *mrt_accept1() {
  */
 q_t *mrt_accept_all() {
   q_t *accepted_q = make_q();
-  sender_t *curr_sender;
   struct sockaddr_in *id_p = NULL;
+  int is_taken = 1;
 
-  while (1) {
-    pthread_mutex_lock(&q_lock);
-      curr_sender = peek_q(pending_senders_q);
-      if (curr_sender == NULL) {
-    pthread_mutex_unlock(&q_lock);
-      break;
-    } else {
-    pthread_mutex_unlock(&q_lock);
-      id_p = mrt_accept1();
-      enq_q(accepted_q, id_p);
-    }
+  while (is_taken) {
+    id_p = accept_pending(0, &is_taken);
+    // (none for a request given up on)
+    if (id_p != NULL) { enq_q(accepted_q, id_p); }
   }
 
   return accepted_q;
@@ -195,54 +513,214 @@ q_t *mrt_accept_all() {
  * mrt_open() not even called yet, etc.)
  */
 int mrt_receive1(struct sockaddr_in *id_p, void *buffer, int len) {
-  sender_t *curr_sender = NULL;
-  pthread_mutex_lock(&q_lock);
-    curr_sender = get_item_q(connected_senders_q, sender_matcher, id_p);
-    if (curr_sender == NULL) { 
-  pthread_mutex_unlock(&q_lock);
-      return -1; 
+  int status;
+  sender_t *curr_sender = lock_readable_sender(id_p, &status, 0, 0);
+  if (curr_sender == NULL) { return status; }
+  if (curr_sender->bytes_borrowed > 0) {
+    // the bytes up front are lent out
+    pthread_mutex_unlock(&(curr_sender->lock));
+    return -1;
+  }
+    int bytes_read = buffer_consume(curr_sender, buffer, len);
+    char outgoing_buffer[MRT_HEADER_LENGTH];
+    int should_update = note_bytes_read(curr_sender, bytes_read, outgoing_buffer);
+    int sockfd = curr_sender->shard_p->sockfd; // the sender may be reclaimed once unlocked
+  pthread_mutex_unlock(&(curr_sender->lock));
+  if (should_update) {
+    sendto(sockfd, outgoing_buffer, MRT_HEADER_LENGTH,  
+      0, (const struct sockaddr *)id_p, addr_len);
+  }
+  return bytes_read;
+}
+
+/* Like mrt_receive1(), but moves exactly one message sent with
+ * mrt_send_message() (cut short to `len` bytes, the rest being
+ * discarded); waits until a whole one is there. Messages the sender
+ * abandoned are skipped, partly received ones included.
+ *
+ * Returns the number of bytes written, 0 or -1 like mrt_receive1().
+ */
+int mrt_receive_message(struct sockaddr_in *id_p, void *buffer, int len) {
+  int status;
+  if (buffer == NULL || len <= 0) { return -1; }
+  sender_t *curr_sender = lock_readable_sender(id_p, &status, 1, 0);
+  if (curr_sender == NULL) { return status; }
+  if (curr_sender->bytes_borrowed > 0) {
+    pthread_mutex_unlock(&(curr_sender->lock));
+    return -1;
+  }
+    int message_length = curr_sender->message_lengths[curr_sender->message_head];
+    int bytes_read = buffer_consume(curr_sender, buffer, (len < message_length) ? len : message_length);
+    if (bytes_read < message_length) { buffer_release(curr_sender, message_length - bytes_read); }
+    char outgoing_buffer[MRT_HEADER_LENGTH];
+    int should_update = note_bytes_read(curr_sender, message_length, outgoing_buffer);
+    int sockfd = curr_sender->shard_p->sockfd; // the sender may be reclaimed once unlocked
+  pthread_mutex_unlock(&(curr_sender->lock));
+  if (should_update) {
+    sendto(sockfd, outgoing_buffer, MRT_HEADER_LENGTH,  
+      0, (const struct sockaddr *)id_p, addr_len);
+  }
+  return bytes_read;
+}
+
+/* Like mrt_receive1(), but reads one of the connection's other streams
+ * (stream 0 being the one mrt_receive1() reads): waits until that
+ * stream has bytes, whatever the others are waiting for. If reading
+ * opened up the stream's window by half of it, an ADAT for the stream
+ * tells the sender right away.
+ *
+ * Returns the number of bytes written, 0 or -1 like mrt_receive1().
+ */
+int mrt_receive_stream(struct sockaddr_in *id_p, int stream, void *buffer, int len) {
+  int status, should_update;
+  if (stream == 0) { return mrt_receive1(id_p, buffer, len); }
+  if (stream < 0 || stream >= MRT_MAX_STREAMS || buffer == NULL || len <= 0) { return -1; }
+  sender_t *curr_sender = lock_readable_sender(id_p, &status, 0, stream);
+  if (curr_sender == NULL) { return status; }
+    stream_t *stream_p = &(curr_sender->streams[stream - 1]);
+    int bytes_read = (len < stream_p->bytes_unread) ? len : stream_p->bytes_unread;
+    int first_part = MRT_STREAM_WINDOW_SIZE - stream_p->read_index;
+    if (first_part >= bytes_read) {
+      memmove(buffer, stream_p->buffer + stream_p->read_index, bytes_read);
+    } else {
+      memmove(buffer, stream_p->buffer + stream_p->read_index, first_part);
+      memmove((char *)buffer + first_part, stream_p->buffer, bytes_read - first_part);
     }
-  pthread_mutex_unlock(&q_lock);
-  
-  while(1) {
-    pthread_mutex_lock(&q_lock);
-      // get the sender again to ensure the connection is still valid
-      curr_sender = get_item_q(connected_senders_q, sender_matcher, id_p);
-      if (curr_sender == NULL) {
-        // the sender is NULL now... after not being NULL once...
-    pthread_mutex_unlock(&q_lock);
-        return 0;    
-      }
+    stream_p->read_index = (stream_p->read_index + bytes_read) % MRT_STREAM_WINDOW_SIZE;
+    stream_p->bytes_unread -= bytes_read;
+    curr_sender->stream_bytes_unread -= bytes_read;
+    stat_add(&(curr_sender->counters.bytes_read), bytes_read);
+    curr_sender->last_read_time = now_usec();
+    if (unread_anywhere(curr_sender) == 0 && curr_sender->eventfd >= 0 &&
+        curr_sender->inactive_time <= TIMEOUT_THRESHOLD) {
+      drain_eventfd(curr_sender->eventfd);
+    }
+    int curr_window_size = MRT_STREAM_WINDOW_SIZE - stream_p->bytes_unread;
+    char outgoing_buffer[MRT_HEADER_LENGTH + MRT_STREAM_LENGTH];
+    should_update = curr_window_size - stream_p->last_advertised_window >= MRT_STREAM_WINDOW_SIZE / 2;
+    if (should_update) {
+      build_stream_adat(outgoing_buffer, stream, MRT_FRAG_ADD(stream_p->next_frag, -1), curr_window_size);
+      stream_p->last_advertised_window = curr_window_size;
+      stream_p->unacked_frags = 0;
+      stat_add(&(curr_sender->counters.adats_sent), 1);
+    }
+    int sockfd = curr_sender->shard_p->sockfd; // the sender may be reclaimed once unlocked
+  pthread_mutex_unlock(&(curr_sender->lock));
+  if (should_update) {
+    sendto(sockfd, outgoing_buffer, MRT_HEADER_LENGTH + MRT_STREAM_LENGTH,
+      0, (const struct sockaddr *)id_p, addr_len);
+  }
+  return bytes_read;
+}
 
-      // the connection remains; now either sleep or perform the copy
-      if (curr_sender->bytes_unread <= 0) {
-        if(curr_sender->inactive_time > TIMEOUT_THRESHOLD) {
-    pthread_mutex_unlock(&q_lock);
-          return 0;
-        }
-    pthread_mutex_unlock(&q_lock);
-        usleep(RECEIVE1_PERIOD);
-        continue; // just to be safe
-      } else {
-        int bytes_unread = curr_sender->bytes_unread;
-        int bytes_read = (len < bytes_unread) ? len : bytes_unread;
-        memmove(buffer, curr_sender->buffer, bytes_read);
-        // TODO: simplify the following if-else?
-        if (bytes_read < bytes_unread) {
-          // if there are bytes remaining:
-          int bytes_remaining = bytes_unread - bytes_read;
-          // note that this relies on memmove() to handle the overlapping
-          memmove(curr_sender->buffer, (curr_sender->buffer) + bytes_read, bytes_remaining);
-          curr_sender->bytes_unread = bytes_remaining;
-    pthread_mutex_unlock(&q_lock);
-          return bytes_read;
-        } else {
-          // if all bytes were read:
-          curr_sender->bytes_unread = 0;
-    pthread_mutex_unlock(&q_lock);
-          return bytes_read;
-        }
-      }
+/* Lends out the oldest unread bytes of the connection in place: sets
+ * `*view_pp` to them and returns how many there are (only up to the
+ * end of the receive ring; borrow again for the rest). Will block and
+ * wait until there is data, like mrt_receive1().
+ *
+ * Returns 0 under the same conditions as mrt_receive1(), and -1 if
+ * the call is spurious or a view is already borrowed.
+ */
+int mrt_borrow(struct sockaddr_in *id_p, const void **view_pp) {
+  int status, len;
+  sender_t *curr_sender = lock_readable_sender(id_p, &status, 0, 0);
+  if (curr_sender == NULL) { return status; }
+    if (curr_sender->bytes_borrowed > 0) {
+      len = -1;
+    } else {
+      len = curr_sender->buffer_size - curr_sender->read_index;
+      if (len > curr_sender->bytes_unread) { len = curr_sender->bytes_unread; }
+      *view_pp = curr_sender->buffer + curr_sender->read_index;
+      curr_sender->bytes_borrowed = len;
+    }
+  pthread_mutex_unlock(&(curr_sender->lock));
+  return len;
+}
+
+/* Returns the view lent by mrt_borrow(), of which the first `len`
+ * bytes are done with (and their space is credited back to the
+ * window); the rest will be lent or received again.
+ *
+ * Returns 0 on success and -1 if the call is spurious (nothing 
+ * borrowed, `len` larger than the view, etc.)
+ */
+int mrt_release(struct sockaddr_in *id_p, int len) {
+  sender_t *curr_sender = lock_accepted_sender(id_p);
+  if (curr_sender == NULL) { return -1; }
+  if (len < 0 || len > curr_sender->bytes_borrowed || curr_sender->bytes_borrowed == 0) {
+    pthread_mutex_unlock(&(curr_sender->lock));
+    return -1;
+  }
+    buffer_release(curr_sender, len);
+    curr_sender->bytes_borrowed = 0;
+    char outgoing_buffer[MRT_HEADER_LENGTH];
+    int should_update = note_bytes_read(curr_sender, len, outgoing_buffer);
+    int sockfd = curr_sender->shard_p->sockfd; // the sender may be reclaimed once unlocked
+  pthread_mutex_unlock(&(curr_sender->lock));
+  if (should_update) {
+    sendto(sockfd, outgoing_buffer, MRT_HEADER_LENGTH,  
+      0, (const struct sockaddr *)id_p, addr_len);
+  }
+  return 0;
+}
+
+/* Drains the connection into `fd` until it is over: every round lends
+ * out all the unread bytes (like mrt_borrow(), but both pieces of the
+ * ring) and writes them with one writev() while the handler keeps
+ * appending behind them, then releases what was written.
+ *
+ * Returns the number of bytes written, or -1 if the call is spurious
+ * or writev() fails.
+ */
+long long mrt_receive_to_fd(struct sockaddr_in *id_p, int fd) {
+  long long total_written = 0;
+  int status, len, first_part, should_update, sockfd, saved_errno;
+  struct iovec iovecs[2];
+  ssize_t num_written;
+  char outgoing_buffer[MRT_HEADER_LENGTH];
+
+  while (1) {
+    sender_t *curr_sender = lock_readable_sender(id_p, &status, 0, 0);
+    if (curr_sender == NULL) {
+      // over (or never there)
+      return (status == 0) ? total_written : -1;
+    }
+    if (curr_sender->bytes_borrowed > 0) {
+      pthread_mutex_unlock(&(curr_sender->lock));
+      return -1;
+    }
+      len = curr_sender->bytes_unread;
+      first_part = curr_sender->buffer_size - curr_sender->read_index;
+      if (first_part > len) { first_part = len; }
+      iovecs[0].iov_base = curr_sender->buffer + curr_sender->read_index;
+      iovecs[0].iov_len = first_part;
+      iovecs[1].iov_base = curr_sender->buffer;
+      iovecs[1].iov_len = len - first_part;
+      // lent out: the ring stays put and the sender is not reclaimed (nor torn down)
+      curr_sender->bytes_borrowed = len;
+      curr_sender->num_waiters += 1;
+    pthread_mutex_unlock(&(curr_sender->lock));
+
+    num_written = writev(fd, iovecs, (len > first_part) ? 2 : 1);
+    saved_errno = errno; // (for the caller; what follows may change errno)
+
+    pthread_mutex_lock(&(curr_sender->lock));
+      if (num_written > 0) { buffer_release(curr_sender, (int)num_written); }
+      curr_sender->bytes_borrowed = 0;
+      leave_sender(curr_sender);
+      should_update = note_bytes_read(curr_sender, (num_written > 0) ? (int)num_written : 0, outgoing_buffer);
+      sockfd = curr_sender->shard_p->sockfd; // the sender may be reclaimed once unlocked
+    pthread_mutex_unlock(&(curr_sender->lock));
+    if (should_update) {
+      sendto(sockfd, outgoing_buffer, MRT_HEADER_LENGTH,
+        0, (const struct sockaddr *)id_p, addr_len);
+    }
+    if (num_written < 0) {
+      if (saved_errno == EINTR) { continue; }
+      errno = saved_errno;
+      return -1;
+    }
+    total_written += num_written;
   }
 }
 
@@ -260,197 +738,1879 @@ struct sockaddr_in *mrt_probe(q_t *probe_q) {
   return target_id_p;
 }
 
-/* the actual logic is handled in main_handler()...
+/* Fills `events` with up to `max_events` connections that are ready
+ * (see mrt_receiver.h), waiting up to `timeout` microseconds for one.
+ *
+ * Returns the number of events filled in (0 on timeout or if the
+ * receiver is closed), or -1 if the call is spurious.
+ */
+int mrt_poll(mrt_event_t *events, int max_events, int timeout) {
+  if (events == NULL || max_events < 1) { return -1; }
+  pthread_rwlock_rdlock(&shards_lock);
+    int is_open = (shards != NULL);
+  pthread_rwlock_unlock(&shards_lock);
+  if (!is_open) { return -1; }
+  event_collector_t collector = { events, max_events, 0 };
+  struct timespec deadline;
+  long curr_seq;
+  int i, is_closed, has_timed_out = 0;
+  if (timeout > 0) { deadline_after(&deadline, timeout); }
+
+  while (1) {
+    pthread_mutex_lock(&poll_lock);
+      curr_seq = poll_seq;
+    pthread_mutex_unlock(&poll_lock);
+    pthread_mutex_lock(&close_lock);
+      is_closed = should_close;
+    pthread_mutex_unlock(&close_lock);
+    if (is_closed) { return 0; }
+
+    // pending senders are in the tables too, so one pass finds everything
+    pthread_rwlock_rdlock(&shards_lock);
+      for (i = 0; i < num_shards; i++) {
+        pthread_rwlock_rdlock(&(shards[i].senders_lock));
+          iterate_q(shards[i].senders_q, collect_events, &collector);
+        pthread_rwlock_unlock(&(shards[i].senders_lock));
+      }
+    pthread_rwlock_unlock(&shards_lock);
+    if (collector.num_events > 0 || timeout == 0 || has_timed_out) {
+      return collector.num_events;
+    }
+
+    // nothing ready yet; wait for anything to change
+    pthread_mutex_lock(&poll_lock);
+      while (poll_seq == curr_seq && !has_timed_out) {
+        if (timeout < 0) {
+          pthread_cond_wait(&poll_cvar, &poll_lock);
+        } else if (pthread_cond_timedwait(&poll_cvar, &poll_lock, &deadline) == ETIMEDOUT) {
+          has_timed_out = 1; // but take one last look
+        }
+      }
+    pthread_mutex_unlock(&poll_lock);
+  }
+}
+
+/* Returns an eventfd that is readable while the accepted connection
+ * has unread bytes or is over; created on the first call.
+ *
+ * Returns -1 if the call is spurious or eventfd() fails.
+ */
+int mrt_eventfd(struct sockaddr_in *id_p) {
+  sender_t *curr_sender = lock_accepted_sender(id_p);
+  if (curr_sender == NULL) { return -1; }
+    if (curr_sender->eventfd < 0) {
+      curr_sender->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+      if (curr_sender->eventfd >= 0 && (unread_anywhere(curr_sender) > 0 ||
+          curr_sender->inactive_time > TIMEOUT_THRESHOLD)) {
+        eventfd_write(curr_sender->eventfd, 1);
+      }
+    }
+    int fd = curr_sender->eventfd;
+  pthread_mutex_unlock(&(curr_sender->lock));
+  return fd;
+}
+
+/* returns the eventfd that is readable while connection requests are
+ * pending; -1 if mrt_open() was not called.
+ */
+int mrt_accept_eventfd() {
+  return accept_eventfd;
+}
+
+/* tunes when ADATs are sent for an accepted connection: after every
+ * `ack_every` in-order fragments, and at most `max_delay` microseconds
+ * after the oldest unacknowledged DATA. `ack_every` = 1 and 
+ * `max_delay` = 0 acknowledge every DATA right away.
+ *
+ * Returns 0 on success and -1 if the call is spurious.
+ */
+int mrt_set_ack_policy(struct sockaddr_in *id_p, int ack_every, int max_delay) {
+  if (ack_every < 1 || max_delay < 0) { return -1; }
+  sender_t *curr_sender = lock_accepted_sender(id_p);
+  if (curr_sender == NULL) { return -1; }
+    curr_sender->ack_every = ack_every;
+    curr_sender->ack_delay = max_delay;
+  pthread_mutex_unlock(&(curr_sender->lock));
+  return 0;
+}
+
+/* Sends the bytes back to the sender with Go-Back-N, in the calling
+ * thread: as many MAX_MRT_REPLY_LENGTH fragments as the sender's
+ * window allows go out, then it waits for their acknowledgements (the
+ * handler signals reply_cvar) and resends from the first unacknowledged
+ * one after REPLY_RESEND_PERIOD without progress; that resend goes out
+ * even into a closed window, as the probe that gets it reopened.
+ *
+ * Returns 1 once all is acknowledged, 0 if the connection is over or
+ * the receiver closed first, and -1 if the call is spurious.
+ */
+int mrt_reply(struct sockaddr_in *id_p, const void *buffer, int len) {
+  const char *bytes = (const char *)buffer;
+  char outgoing_buffer[MAX_UDP_PAYLOAD_LENGTH];
+  struct timespec deadline;
+  int first_frag, last_frag, next_frag, acked_frag, last_acked_frag;
+  int is_closed, is_probe = 0, result;
+  long long last_progress_time;
+
+  if (buffer == NULL || len < 0) { return -1; }
+  sender_t *curr_sender = lock_accepted_sender(id_p);
+  if (curr_sender == NULL) { return -1; }
+  if (curr_sender->is_replying) {
+    pthread_mutex_unlock(&(curr_sender->lock));
+    return -1;
+  }
+  pthread_mutex_t *lock_p = &(curr_sender->lock);
+    curr_sender->is_replying = 1;
+    curr_sender->has_replied = 1;
+    curr_sender->num_waiters += 1; // not reclaimed meanwhile, so it can be unlocked to send
+    first_frag = MRT_FRAG_ADD(curr_sender->reply_acked_frag, 1);
+    last_frag = MRT_FRAG_ADD(first_frag, (len + MAX_MRT_REPLY_LENGTH - 1) / MAX_MRT_REPLY_LENGTH - 1);
+    next_frag = first_frag;
+    last_acked_frag = curr_sender->reply_acked_frag;
+    last_progress_time = now_usec();
+
+    while (1) {
+      acked_frag = curr_sender->reply_acked_frag;
+      if (MRT_FRAG_DIFF(acked_frag, last_frag) >= 0) {
+        result = 1;
+        break;
+      }
+      pthread_mutex_lock(&close_lock);
+        is_closed = should_close;
+      pthread_mutex_unlock(&close_lock);
+      if (is_closed || curr_sender->inactive_time > TIMEOUT_THRESHOLD) {
+        result = 0;
+        break;
+      }
+      if (MRT_FRAG_DIFF(acked_frag, last_acked_frag) > 0) {
+        last_acked_frag = acked_frag;
+        last_progress_time = now_usec();
+        if (MRT_FRAG_DIFF(next_frag, acked_frag) <= 0) { next_frag = MRT_FRAG_ADD(acked_frag, 1); }
+      } else if (now_usec() - last_progress_time >= REPLY_RESEND_PERIOD) {
+        // go back N
+        next_frag = MRT_FRAG_ADD(acked_frag, 1);
+        last_progress_time = now_usec();
+        is_probe = 1;
+      }
+
+      // send what the window allows
+      while (MRT_FRAG_DIFF(next_frag, last_frag) <= 0) {
+        int offset = MRT_FRAG_DIFF(next_frag, first_frag) * MAX_MRT_REPLY_LENGTH;
+        int bytes_in_flight = offset - (MRT_FRAG_DIFF(acked_frag, first_frag) + 1) * MAX_MRT_REPLY_LENGTH;
+        int payload_len = len - offset;
+        if (payload_len > MAX_MRT_REPLY_LENGTH) { payload_len = MAX_MRT_REPLY_LENGTH; }
+        if (bytes_in_flight + payload_len > curr_sender->reply_window && !is_probe) { break; }
+        is_probe = 0;
+        int reply_len = build_reply(curr_sender, outgoing_buffer, next_frag, bytes + offset, payload_len);
+        int sockfd = curr_sender->shard_p->sockfd;
+        pthread_mutex_unlock(lock_p);
+        sendto(sockfd, outgoing_buffer, reply_len, 0, (const struct sockaddr *)id_p, addr_len);
+        pthread_mutex_lock(lock_p);
+        next_frag = MRT_FRAG_ADD(next_frag, 1);
+      }
+
+      // woken up by the handler as soon as an acknowledgement arrives (unless one did while sending)
+      if (curr_sender->reply_acked_frag == acked_frag && is_busy_polling) {
+        // or looked for again right away (see mrt_set_busy_poll())
+        pthread_mutex_unlock(lock_p);
+        spin_pause();
+        pthread_mutex_lock(lock_p);
+      } else if (curr_sender->reply_acked_frag == acked_frag) {
+        deadline_after(&deadline, REPLY_RESEND_PERIOD);
+        pthread_cond_timedwait(&(curr_sender->reply_cvar), lock_p, &deadline);
+      }
+    }
+
+    if (result == 1) { stat_add(&(curr_sender->counters.bytes_replied), len); }
+    curr_sender->is_replying = 0;
+    leave_sender(curr_sender);
+    // a reader may have reported the end meanwhile, leaving the sender to this call
+    if (curr_sender->is_end_reported && curr_sender->num_waiters == 0) {
+      wake_handler(curr_sender->shard_p);
+    }
+  pthread_mutex_unlock(lock_p);
+  return result;
+}
+
+/* copies the connection's statistics into `*stats_p`; the sender is
+ * only looked up under its shard's read lock (which keeps it from
+ * being reclaimed), and its counters are read without its own lock.
+ *
+ * Returns 0 on success and -1 if no such connection exists.
+ */
+int mrt_receiver_stats(struct sockaddr_in *id_p, mrt_receiver_stats_t *stats_p) {
+  sender_t *curr_sender = NULL;
+  if (id_p == NULL || stats_p == NULL) { return -1; }
+  pthread_rwlock_rdlock(&shards_lock);
+  for (int i = 0; i < num_shards; i++) {
+    pthread_rwlock_rdlock(&(shards[i].senders_lock));
+      curr_sender = get_item_q(shards[i].senders_q, sender_matcher, id_p);
+      if (curr_sender != NULL) {
+        receiver_counters_t *counters_p = &(curr_sender->counters);
+        stats_p->bytes_received = atomic_load_explicit(&(counters_p->bytes_received), memory_order_relaxed);
+        stats_p->bytes_read = atomic_load_explicit(&(counters_p->bytes_read), memory_order_relaxed);
+        stats_p->frags_received = atomic_load_explicit(&(counters_p->frags_received), memory_order_relaxed);
+        stats_p->frags_out_of_order = atomic_load_explicit(&(counters_p->frags_out_of_order), memory_order_relaxed);
+        stats_p->frags_window_full = atomic_load_explicit(&(counters_p->frags_window_full), memory_order_relaxed);
+        stats_p->frags_duplicate = atomic_load_explicit(&(counters_p->frags_duplicate), memory_order_relaxed);
+        stats_p->adats_sent = atomic_load_explicit(&(counters_p->adats_sent), memory_order_relaxed);
+        stats_p->checksum_failures = atomic_load_explicit(&(counters_p->checksum_failures), memory_order_relaxed);
+        stats_p->usec_blocked = atomic_load_explicit(&(counters_p->usec_blocked), memory_order_relaxed);
+        stats_p->bytes_replied = atomic_load_explicit(&(counters_p->bytes_replied), memory_order_relaxed);
+        stats_p->acks_piggybacked = atomic_load_explicit(&(counters_p->acks_piggybacked), memory_order_relaxed);
+        stats_p->frags_skipped = atomic_load_explicit(&(counters_p->frags_skipped), memory_order_relaxed);
+        stats_p->bytes_discarded = atomic_load_explicit(&(counters_p->bytes_discarded), memory_order_relaxed);
+        stats_p->buffer_size = atomic_load_explicit(&(counters_p->buffer_size), memory_order_relaxed);
+        stats_p->advertised_window = atomic_load_explicit(&(counters_p->advertised_window), memory_order_relaxed);
+        stats_p->rtt_usec = atomic_load_explicit(&(counters_p->rtt_usec), memory_order_relaxed);
+        stats_p->is_shared_memory = atomic_load_explicit(&(counters_p->is_shared_memory), memory_order_relaxed);
+    pthread_rwlock_unlock(&(shards[i].senders_lock));
+  pthread_rwlock_unlock(&shards_lock);
+        return 0;
+      }
+    pthread_rwlock_unlock(&(shards[i].senders_lock));
+  }
+  pthread_rwlock_unlock(&shards_lock);
+  return -1;
+}
+
+/* caps the memory all receive buffers may use together (the default
+ * is RECEIVER_DEFAULT_MEMORY_BUDGET bytes). Buffers stop growing when
+ * the budget is reached and shrink back as they drain while the total
+ * is over it. Can be called at any time.
+ */
+void mrt_set_memory_budget(long num_bytes) {
+  pthread_mutex_lock(&budget_lock);
+    memory_budget = num_bytes;
+  pthread_mutex_unlock(&budget_lock);
+}
+
+/* caps the number of connection requests waiting for mrt_accept1()
+ * (RECEIVER_DEFAULT_BACKLOG by default); further requests are dropped
+ * until some are accepted, and their senders keep retrying.
+ * Can be called at any time.
+ */
+void mrt_set_backlog(int max_pending) {
+  pthread_mutex_lock(&accept_lock);
+    accept_backlog = max_pending;
+  pthread_mutex_unlock(&accept_lock);
+}
+
+/* caps the number of connections kept after they are over for their
+ * unread bytes (RECEIVER_DEFAULT_RETENTION by default, split evenly
+ * between the shards); see reap_senders(). Can be called at any time.
+ */
+void mrt_set_retention(int max_closed) {
+  pthread_mutex_lock(&budget_lock);
+    max_retained = (max_closed > 0) ? max_closed : 0;
+  pthread_mutex_unlock(&budget_lock);
+}
+
+/* picks the shards' I/O engine for the next mrt_open(); see
+ * mrt_receiver.h. Returns the engine in effect.
+ */
+int mrt_set_io_engine(int engine) {
+  if (engine == MRT_IO_URING && !mrt_uring_probe()) { engine = MRT_IO_SOCKETS; }
+  io_engine = engine;
+  return engine;
+}
+
+/* sets the low-latency profile; see mrt_receiver.h.
+ * Returns 0 on success and -1 if the CPUs are not valid.
+ */
+int mrt_set_busy_poll(int is_on, int usec, const int *cpus, int num_cpus) {
+  int i;
+  if (num_cpus < 0 || num_cpus > MRT_MAX_PINNED_CPUS || (num_cpus > 0 && cpus == NULL)) { return -1; }
+  for (i = 0; i < num_cpus; i++) {
+    if (cpus[i] < 0) { return -1; }
+  }
+  memmove(pinned_cpus, cpus, num_cpus * sizeof(int));
+  num_pinned_cpus = num_cpus;
+  busy_poll_usec = usec;
+  is_busy_polling = is_on;
+  return 0;
+}
+
+/* wakes every shard's handler, which tears down its senders (see
+ * main_handler()) and closes its socket, and joins them all; then frees
+ * what the shards shared, so that mrt_open() may be called again.
  */
 void mrt_close() {
   pthread_mutex_lock(&close_lock);
+    if (shards == NULL || should_close) {
+  pthread_mutex_unlock(&close_lock);
+      return;
+    }
     should_close = 1;
   pthread_mutex_unlock(&close_lock);
+  notify_pollers();
+
+  stop_handlers(num_shards);
+  pthread_mutex_lock(&accept_lock);
+    close(accept_eventfd);
+    accept_eventfd = -1;
+    num_pending = 0;
+  pthread_mutex_unlock(&accept_lock);
+  free_shards(num_shards, num_shards, num_shards);
 }
 
 /****** thread functions (unavailable to module users) ******/
 
-/* The main handler; all incoming transmissions will be validated
- * and handled here.
+/* The main handler of a shard; all transmissions arriving on the
+ * shard's socket will be validated and handled here.
+ *
+ * Transmissions are received up to RECEIVER_BATCH_SIZE at a time with
+ * recvmmsg(); the whole batch is handled and the resulting replies are
+ * then sent out with one sendmmsg(), without holding any lock. On
+ * io_uring, run_ring() does the same with the shard's ring instead,
+ * until mrt_close() (or until the ring fails, and this loop takes over).
+ *
+ * Under the low-latency profile, the loop never waits in ppoll() but
+ * goes round again at once, on a CPU of its own if there are any.
  */
-void *main_handler(void *_null) {
-  int num_bytes_received = 0;
+void *main_handler(void *shard_vp) {
+  shard_t *shard_p = (shard_t *)shard_vp;
+  int num_msgs_received = 0, i, is_closed = 0;
   sender_t *curr_sender = NULL;
-  struct sockaddr_in addr_holder = {0}; // to hold the addr of incoming transmission
-  unsigned long hash_holder = 0;
-  unsigned int addr_len_holder = addr_len; // VERY IMPORTANT NOT TO BE ZERO
-  int type_holder = 0, frag_holder = 0;
+  struct pollfd poll_fds[2] = { { shard_p->sockfd, POLLIN, 0 }, { shard_p->wake_fd, POLLIN, 0 } };
+  struct timespec timeout, deadline, no_wait = {0, 0};
+  long long time_left;
+  int is_spinning = is_busy_polling;
+
+  if (is_spinning && num_pinned_cpus > 0 &&
+      pin_thread(pinned_cpus[(shard_p - shards) % num_pinned_cpus]) < 0) {
+    perror("pin_thread(handler_thread) error\n");
+  }
+  // (made here, as only this thread ever touches it)
+  if (io_engine == MRT_IO_URING && !is_spinning) {
+    shard_p->outgoing_replies.ring_p = mrt_uring_new(RING_ENTRIES, RING_BUFFERS, MAX_UDP_PAYLOAD_LENGTH);
+  }
+  if (shard_p->outgoing_replies.ring_p != NULL) {
+    is_closed = run_ring(shard_p);
+    mrt_uring_free(shard_p->outgoing_replies.ring_p);
+    shard_p->outgoing_replies.ring_p = NULL;
+  }
 
   // the main loop; processes all the incoming transmissions
-  while (1) {
-    num_bytes_received = recvfrom(rece_sockfd, incoming_buffer,
-      MAX_UDP_PAYLOAD_LENGTH, 0, (struct sockaddr *)(&addr_holder),
-      &addr_len_holder);
+  while (!is_closed) {
+    for (i = 0; i < RECEIVER_BATCH_SIZE; i++) {
+      shard_p->incoming_msgs[i].msg_hdr.msg_namelen = addr_len; // VERY IMPORTANT NOT TO BE ZERO
+    }
+    /* wait for a transmission (or for senders to reap), but no longer
+     * than until an ADAT is due
+     */
+    if (is_spinning) {
+      ppoll(poll_fds, 2, &no_wait, NULL);
+    } else if (shard_p->next_ack_due_time == 0) {
+      ppoll(poll_fds, 2, NULL, NULL);
+    } else {
+      time_left = shard_p->next_ack_due_time - now_usec();
+      if (time_left < 0) { time_left = 0; }
+      timeout.tv_sec = time_left / 1000000;
+      timeout.tv_nsec = (time_left % 1000000) * 1000;
+      ppoll(poll_fds, 2, &timeout, NULL);
+    }
+    // then take whatever is queued without blocking
+    num_msgs_received = recvmmsg(shard_p->sockfd, shard_p->incoming_msgs,
+      RECEIVER_BATCH_SIZE, MSG_DONTWAIT, NULL);
 
     // before processing, check if close is flagged
     pthread_mutex_lock(&close_lock);
       if (should_close == 1) {
-        printf("Breaking from main loop because should_close\n");
     pthread_mutex_unlock(&close_lock);
         break;
       }
     pthread_mutex_unlock(&close_lock);
 
-    // NULL-terminate the transmission to enable hash()
-    incoming_buffer[num_bytes_received] = '\0';
-
-    // first validate the transmission with checksum
-    memmove(&hash_holder, incoming_buffer, MRT_HASH_LENGTH);
-    if (hash(incoming_buffer + MRT_HASH_LENGTH) != hash_holder) {
-      continue;
-    }
-
-    // then check the transmission type and act accordingly
-    memmove(&type_holder, incoming_buffer + MRT_TYPE_LOCATION, MRT_TYPE_LENGTH);
-    memmove(&frag_holder, incoming_buffer + MRT_FRAGMENT_LOCATION, MRT_FRAGMENT_LENGTH);
-
-    switch (type_holder) {
-
-      case MRT_RCON :
-        // if the sender is not queued...
-        pthread_mutex_lock(&q_lock);
-          curr_sender = get_item_q(pending_senders_q, sender_matcher, &addr_holder);
-          if (curr_sender == NULL) {
-            // AND not connected, it must be a new sender... queue it.
-            curr_sender = get_item_q(connected_senders_q, sender_matcher, &addr_holder);
-            if (curr_sender == NULL) {
-                curr_sender = malloc(sizeof(sender_t));
-                curr_sender->bytes_unread = 0;
-                curr_sender->next_frag = frag_holder + 1;
-                curr_sender->inactive_time = 0;
-                memmove(&(curr_sender->addr), &addr_holder, addr_len);
-                enq_q(pending_senders_q, curr_sender);
-            }
-            // if it is already connected, send a (duplicate) ACON
-            else {
-              build_acon(frag_holder);
-              sendto(rece_sockfd, outgoing_buffer, MRT_HEADER_LENGTH,  
-                0, (const struct sockaddr *)(&addr_holder), 
-                addr_len);
-            }
-          }
-          /* else the sender is queued, and must not be already connected
-          * do nothing (drop the packet)
-          * Assumption here: all RCONs from one sender propose the same
-          * initial fragment number
-          */
-        pthread_mutex_unlock(&q_lock);
-        break;
-
-      case MRT_DATA :
-        pthread_mutex_lock(&q_lock);
-          curr_sender = get_item_q(connected_senders_q, sender_matcher, &addr_holder);
-          if (curr_sender != NULL) {
-            /* buffer the transmitted payload if there is enough free space
-             * AND it is not out of order;
-             */
-            int curr_window_size = RECEIVER_MAX_WINDOW_SIZE - curr_sender->bytes_unread;
-            int payload_size = num_bytes_received - MRT_HEADER_LENGTH;
-            if (curr_window_size >= payload_size && curr_sender->next_frag == frag_holder) {
-              char *next_free_slot = (curr_sender->buffer) + curr_sender->bytes_unread;
-              memmove(next_free_slot, incoming_buffer + MRT_PAYLOAD_LOCATION, payload_size);
-              curr_sender->bytes_unread += payload_size;
-              curr_sender->next_frag += 1;
-              curr_window_size -= payload_size;
-            }
-            // else {
-            //   // else the packet must be dropped (out of order / buffer space)
-            //   printf("out of order / buffer space \n");
-            // }
-
-            /* either way, sender just proved that he's still connected,
-             * so reset the inactivity counter and replies with ADAT
-             */
-            curr_sender->inactive_time = 0;
-            build_adat(curr_sender->next_frag - 1, curr_window_size);
-            sendto(rece_sockfd, outgoing_buffer, MRT_HEADER_LENGTH,  
-                    0, (const struct sockaddr *)(&addr_holder), 
-                    addr_len);
-          }
-          // else the sender is sending data without being connected
-          // do nothing (drop the packet)
-        pthread_mutex_unlock(&q_lock);
-        break;
-
-      case MRT_RCLS :
-        pthread_mutex_lock(&q_lock);
-          curr_sender = get_item_q(connected_senders_q, sender_matcher, &addr_holder);
-          /* note that RCLS is only sent upon receiving the final ADAT,
-           * so there is no need to check/use the fragment number here.
-           */
-          if (curr_sender != NULL) {
-            // trick the checker into doing clean-up
-            curr_sender->inactive_time = TIMEOUT_THRESHOLD;
-            // then be polite and do an ACLS
-            build_acls();
-            sendto(rece_sockfd, outgoing_buffer, 
-              (MRT_HASH_LENGTH + MRT_TYPE_LENGTH), 0, 
-              (const struct sockaddr *)(&addr_holder), addr_len);
-          } else {
-            /* else the sender is trying to disconnect without being connected;
-            * in that case, just try to remove it from the queue...
-            */
-            free(pop_item_q(pending_senders_q, sender_matcher, &addr_holder));
-          }
-        pthread_mutex_unlock(&q_lock);
-        break;
-
-      default :
-        // ACON, ADAT, ACLS, UNKN
-        continue;
+    shard_p->outgoing_replies.num_replies = 0;
+    for (i = 0; i < num_msgs_received; i++) {
+      handle_transmission(shard_p, shard_p->incoming_buffers[i], 
+        shard_p->incoming_msgs[i].msg_len, &(shard_p->incoming_addrs[i]),
+        &(shard_p->outgoing_replies));
     }
+    flush_delayed_acks(shard_p, &(shard_p->outgoing_replies));
+    send_replies(&(shard_p->outgoing_replies));
+    if (poll_fds[1].revents & POLLIN) {
+      drain_eventfd(shard_p->wake_fd);
+      reap_senders(shard_p);
+    }
+    if (is_spinning && num_msgs_received <= 0) { spin_pause(); }
   }
-  /* No longer accepting new connections...
-   * TODO: there must be a better way than pthread_cancel()...
+  /* No longer accepting new connections; every sender's checker is
+   * woken to find its connection over, and joined (it joins the taker)
    */
-  pthread_mutex_lock(&q_lock);
-    delete_q(pending_senders_q, free);
-    while((curr_sender = (sender_t *)deq_q(connected_senders_q)) != NULL) {
-      pthread_cancel(curr_sender->checker_thread);
-      free(curr_sender);
+  pthread_rwlock_wrlock(&(shard_p->senders_lock));
+    pthread_mutex_lock(&accept_lock);
+      // the last shard standing gets rid of the accept queue (and of anyone waiting on it)
+      num_shards_running -= 1;
+      if (num_shards_running == 0) {
+        delete_q(pending_senders_q, NULL); // senders freed below
+        pending_senders_q = NULL;
+        pthread_cond_broadcast(&accept_cvar);
+      }
+    pthread_mutex_unlock(&accept_lock);
+    delete_q(shard_p->delayed_acks_q, NULL); // senders freed below
+    delete_q(shard_p->retained_q, NULL); // senders freed below
+    delete_q(shard_p->spare_q, NULL);
+    while((curr_sender = (sender_t *)deq_q(shard_p->senders_q)) != NULL) {
+      // not to be accepted any more (mrt_accept1() holds its lock if it already was)
+      pthread_mutex_lock(&accept_lock);
+        if (pending_senders_q != NULL &&
+            pop_item_q(pending_senders_q, sender_matcher, &(curr_sender->addr)) != NULL) {
+          num_pending -= 1;
+        }
+      pthread_mutex_unlock(&accept_lock);
+      pthread_mutex_lock(&(curr_sender->lock));
+        int has_checker = curr_sender->has_checker;
+        curr_sender->inactive_time = TIMEOUT_THRESHOLD + 1;
+        pthread_cond_signal(&(curr_sender->checker_cvar));
+        pthread_cond_signal(&(curr_sender->room_cvar));
+      pthread_mutex_unlock(&(curr_sender->lock));
+      if (curr_sender->shm_p != NULL) { mrt_shm_wake(&(curr_sender->shm_p->put_count)); }
+      if (has_checker) { pthread_join(curr_sender->checker_thread, NULL); }
+      // (the checker took the taker along; or there was no checker to)
+      pthread_mutex_lock(&(curr_sender->lock));
+        int has_shm_thread = curr_sender->has_shm_thread;
+      pthread_mutex_unlock(&(curr_sender->lock));
+      if (has_shm_thread) { pthread_join(curr_sender->shm_thread, NULL); }
+      // and whoever is still waiting on it is let out before the slot goes
+      pthread_mutex_lock(&(curr_sender->lock));
+        while (curr_sender->num_waiters > 0) {
+          pthread_cond_broadcast(&(curr_sender->readable_cvar));
+          pthread_cond_broadcast(&(curr_sender->reply_cvar));
+          deadline_after(&deadline, CHECKER_PERIOD);
+          pthread_cond_timedwait(&(curr_sender->checker_cvar), &(curr_sender->lock), &deadline);
+        }
+      pthread_mutex_unlock(&(curr_sender->lock));
+      sender_t_free(curr_sender);
     }
-    delete_q(connected_senders_q, free); // could use free(q) directly
-  pthread_mutex_unlock(&q_lock);
+    // no checker is left to hand anything over
+    delete_msq(shard_p->closed_q, NULL); // senders freed above
+  pthread_rwlock_unlock(&(shard_p->senders_lock));
 
-  close(rece_sockfd);
+  close(shard_p->wake_fd);
+  close(shard_p->sockfd);
   return NULL;
 }
 
-/* checker: runs in a new thread for each sender as soon as its first
- * DATA is received; whether the transmission ends successfully or 
- * as a result of a timeout, this function garbage-collects the sender
- * before terminating
+/* main_handler()'s loop on the shard's ring: one multishot receive on
+ * the socket and one multishot poll on wake_fd stay armed (re-armed
+ * whenever the kernel ends them, say for running out of buffers), and
+ * a batch is whatever completions one wait turns up. Every datagram is
+ * handled right in the ring's buffer, which then goes back to the ring;
+ * the replies go out through it as well (see send_replies()).
+ *
+ * Returns 1 once mrt_close() is called, or 0 if the ring fails.
  */
-void *checker(void *sender_vp) {
-  sender_t *sender_p = (sender_t *)sender_vp;
+int run_ring(shard_t *shard_p) {
+  mrt_uring_t *ring_p = shard_p->outgoing_replies.ring_p;
+  mrt_uring_event_t event;
+  int is_woken, time_left;
 
+  mrt_uring_recv(ring_p, shard_p->sockfd, RING_TAG_SOCKET);
+  mrt_uring_poll(ring_p, shard_p->wake_fd, RING_TAG_WAKE);
   while (1) {
-    pthread_mutex_lock(&q_lock);
-      sender_p->inactive_time += CHECKER_PERIOD;
-      // if it would sleep past the threshold, go BOOM
-      if (sender_p->inactive_time > TIMEOUT_THRESHOLD) {
-    pthread_mutex_unlock(&q_lock);
-        break;
-      }
-    pthread_mutex_unlock(&q_lock);
-    usleep(CHECKER_PERIOD);
+    // wait for a transmission (or for senders to reap), but no longer than until an ADAT is due
+    time_left = -1;
+    if (shard_p->next_ack_due_time != 0) {
+      time_left = (int)(shard_p->next_ack_due_time - now_usec());
+      if (time_left < 0) { time_left = 0; }
+    }
+    if (mrt_uring_submit(ring_p, 1, time_left) < 0) { return 0; }
+
+    pthread_mutex_lock(&close_lock);
+      if (should_close == 1) {
+    pthread_mutex_unlock(&close_lock);
+        return 1;
+      }
+    pthread_mutex_unlock(&close_lock);
+
+    is_woken = 0;
+    shard_p->outgoing_replies.num_replies = 0;
+    while (mrt_uring_next(ring_p, &event)) {
+      if (event.tag == RING_TAG_SOCKET) {
+        if (event.payload != NULL) {
+          handle_transmission(shard_p, event.payload, event.payload_len, event.addr_p,
+            &(shard_p->outgoing_replies));
+          mrt_uring_recycle(ring_p, event.buffer_id);
+        }
+        // (out of buffers, handled and given back by now; anything else is not going away)
+        if (event.is_last) {
+          if (event.result < 0 && event.result != -ENOBUFS) { return 0; }
+          mrt_uring_recv(ring_p, shard_p->sockfd, RING_TAG_SOCKET);
+        }
+      } else if (event.tag == RING_TAG_WAKE) {
+        is_woken = 1;
+        if (event.is_last) { mrt_uring_poll(ring_p, shard_p->wake_fd, RING_TAG_WAKE); }
+      }
+      // (the replies' own completions tell nothing that matters)
+    }
+    flush_delayed_acks(shard_p, &(shard_p->outgoing_replies));
+    send_replies(&(shard_p->outgoing_replies));
+    if (is_woken) {
+      drain_eventfd(shard_p->wake_fd);
+      reap_senders(shard_p);
+    }
+  }
+}
+
+/* validates and handles one transmission received by main_handler();
+ * any reply is queued in `replies_p` instead of being sent right away.
+ *
+ * Must be called from the shard's handler thread.
+ */
+void handle_transmission(shard_t *shard_p, char *transmission, int num_bytes_received, struct sockaddr_in *addr_p, reply_batch_t *replies_p) {
+  sender_t *curr_sender = NULL;
+  unsigned long hash_holder = 0;
+  int type_holder = 0, frag_holder = 0, flags_holder = 0;
+  unsigned int cookie_holder = 0;
+  int is_over = 0;
+  char *reply_buffer = NULL;
+
+  // first validate the transmission with checksum
+  memmove(&hash_holder, transmission, MRT_HASH_LENGTH);
+  if (hash(transmission + MRT_HASH_LENGTH, num_bytes_received - MRT_HASH_LENGTH) != hash_holder) {
+    // (the address is the socket's word, so it can be trusted)
+    TRACE(TRACE_CHECKSUM_FAILED, PORT_OF(addr_p), 0, num_bytes_received);
+    curr_sender = get_item_q(shard_p->senders_q, sender_matcher, addr_p);
+    if (curr_sender != NULL) {
+      pthread_mutex_lock(&(curr_sender->lock));
+        stat_add(&(curr_sender->counters.checksum_failures), 1);
+      pthread_mutex_unlock(&(curr_sender->lock));
+    }
+    return;
+  }
+
+  // then check the transmission type and act accordingly
+  memmove(&type_holder, transmission + MRT_TYPE_LOCATION, MRT_TYPE_LENGTH);
+  memmove(&frag_holder, transmission + MRT_FRAGMENT_LOCATION, MRT_FRAGMENT_LENGTH);
+
+  // only this thread changes the table, so no need for the read lock
+  curr_sender = get_item_q(shard_p->senders_q, sender_matcher, addr_p);
+
+  switch (type_holder) {
+
+    case MRT_RCON :
+      /* a sender whose connection is over and is sending RCONs again
+       * is a new connection from a reused port
+       */
+      if (curr_sender != NULL) {
+        pthread_mutex_lock(&(curr_sender->lock));
+          is_over = curr_sender->is_accepted && curr_sender->inactive_time >= TIMEOUT_THRESHOLD;
+        pthread_mutex_unlock(&(curr_sender->lock));
+      }
+      // if the sender is neither queued nor connected, it must be new...
+      if (curr_sender == NULL || is_over) {
+        /* like SYN cookies: keep no state until the sender echoes a
+         * cookie, proving it really receives at its address
+         */
+        if (num_bytes_received >= MRT_HEADER_LENGTH) {
+          memmove(&cookie_holder, transmission + MRT_COOKIE_LOCATION, MRT_COOKIE_LENGTH);
+        }
+        TRACE(TRACE_RCON_RECEIVED, PORT_OF(addr_p), frag_holder, (int)cookie_holder);
+        if (!is_cookie_valid(addr_p, frag_holder, cookie_holder)) {
+          unsigned int cookie = make_cookie(addr_p, frag_holder, now_usec() / COOKIE_PERIOD);
+          reply_buffer = add_reply(replies_p, addr_p, MRT_HEADER_LENGTH);
+          build_cook(reply_buffer, frag_holder, cookie);
+          TRACE(TRACE_COOK_SENT, PORT_OF(addr_p), frag_holder, (int)cookie);
+          break;
+        }
+        // the new connection supersedes the old one, unread bytes and all
+        if (is_over && reclaim_superseded(shard_p, curr_sender) != 0) { break; } // it will retry
+        // ...then queue it, unless the backlog is full (it will retry)
+        pthread_mutex_lock(&accept_lock);
+          int is_backlog_full = (num_pending >= accept_backlog);
+        pthread_mutex_unlock(&accept_lock);
+        if (is_backlog_full) { break; }
+        curr_sender = sender_t_new(shard_p, addr_p, frag_holder);
+        if (curr_sender == NULL) { break; } // maybe the next RCON will do
+        take_shm_offer(curr_sender, transmission, num_bytes_received);
+        pthread_rwlock_wrlock(&(shard_p->senders_lock));
+          enq_q(shard_p->senders_q, curr_sender);
+          pthread_mutex_lock(&accept_lock);
+            enq_q(pending_senders_q, curr_sender);
+            num_pending += 1;
+            pthread_cond_signal(&accept_cvar);
+            eventfd_write(accept_eventfd, 1);
+          pthread_mutex_unlock(&accept_lock);
+        pthread_rwlock_unlock(&(shard_p->senders_lock));
+        notify_pollers();
+        break;
+      }
+      // if it is already connected, send a (duplicate) ACON
+      pthread_mutex_lock(&(curr_sender->lock));
+        if (curr_sender->is_accepted) {
+          // (the same as the first one, which may be what got lost)
+          reply_buffer = add_reply(replies_p, addr_p,
+            MRT_HEADER_LENGTH + ((curr_sender->shm_p != NULL) ? MRT_SHM_TOKEN_LENGTH : 0));
+          build_acon(reply_buffer, frag_holder, curr_sender->shm_p);
+          TRACE(TRACE_ACON_SENT, PORT_OF(addr_p), frag_holder, 0);
+        }
+        /* else the sender is queued, and must not be already connected
+        * do nothing (drop the packet)
+        * Assumption here: all RCONs from one sender propose the same
+        * initial fragment number
+        */
+      pthread_mutex_unlock(&(curr_sender->lock));
+      break;
+
+    case MRT_DATA :
+      if (curr_sender == NULL) { break; }
+      pthread_mutex_lock(&(curr_sender->lock));
+      // (once over, a connection stays over; its checker is gone)
+      if (curr_sender->is_accepted && curr_sender->inactive_time < TIMEOUT_THRESHOLD) {
+        /* buffer the transmitted payload if there is enough free space
+         * AND it is not out of order;
+         */
+        int curr_window_size = curr_sender->buffer_size - curr_sender->bytes_unread;
+        int payload_location = MRT_PAYLOAD_LOCATION;
+        int is_urgent = 0, is_buffered = 0;
+        if (num_bytes_received >= MRT_HEADER_LENGTH) {
+          memmove(&flags_holder, transmission + MRT_FLAGS_LOCATION, MRT_FLAGS_LENGTH);
+        }
+        // an acknowledgement of what was sent back may ride along
+        if ((flags_holder & MRT_FLAG_ACK) && num_bytes_received >= MRT_HEADER_LENGTH + MRT_ACK_LENGTH) {
+          int ack_frag_holder = 0, ack_winsize_holder = 0;
+          memmove(&ack_frag_holder, transmission + MRT_ACK_FRAGMENT_LOCATION, MRT_FRAGMENT_LENGTH);
+          memmove(&ack_winsize_holder, transmission + MRT_ACK_WINDOWSIZE_LOCATION, MRT_WINDOWSIZE_LENGTH);
+          handle_reply_ack(curr_sender, ack_frag_holder, ack_winsize_holder);
+          payload_location += MRT_ACK_LENGTH;
+        }
+        int payload_size = num_bytes_received - payload_location;
+        if (MRT_STREAM_OF(flags_holder) != 0) {
+          // another stream: in order on its own, with ADATs of its own
+          handle_stream_data(curr_sender, MRT_STREAM_OF(flags_holder), frag_holder, flags_holder,
+            transmission + payload_location, payload_size, replies_p);
+          curr_sender->inactive_time = 0;
+          pthread_mutex_unlock(&(curr_sender->lock));
+          break;
+        }
+        // (the end of a message needs room for its length, too)
+        if (payload_size > 0 && curr_window_size >= payload_size && curr_sender->next_frag == frag_holder &&
+            (!(flags_holder & MRT_FLAG_END_OF_MESSAGE) || reserve_message(curr_sender) == 0)) {
+          is_buffered = 1;
+          if (unread_anywhere(curr_sender) == 0) { notify_ready(curr_sender); }
+          buffer_append(curr_sender, transmission + payload_location, payload_size);
+          if (flags_holder & MRT_FLAG_MESSAGE) {
+            note_message_bytes(curr_sender, payload_size, flags_holder & MRT_FLAG_END_OF_MESSAGE);
+          }
+          curr_sender->next_frag = MRT_FRAG_ADD(curr_sender->next_frag, 1);
+          stat_add(&(curr_sender->counters.bytes_received), payload_size);
+          TRACE(TRACE_DATA_RECEIVED, PORT_OF(addr_p), frag_holder, payload_size);
+          stat_add(&(curr_sender->counters.frags_received), 1);
+          sample_rtt(curr_sender, curr_window_size);
+          // (readers of other streams wait on it, too)
+          pthread_cond_broadcast(&(curr_sender->readable_cvar));
+          /* ACK every ack_every'th fragment, and the ones the sender waits
+           * on; but once the application replies, give it the ack_delay
+           * to answer those, so the ADAT can ride on the answer
+           */
+          curr_sender->unacked_frags += 1;
+          is_urgent = curr_sender->unacked_frags >= curr_sender->ack_every ||
+            ((flags_holder & MRT_FLAG_PUSH) && !curr_sender->has_replied);
+        } else if (payload_size > 0 && MRT_FRAG_DIFF(frag_holder, curr_sender->next_frag) >= 0 &&
+            curr_sender->gap_acked_frag != curr_sender->next_frag) {
+          /* dropped for a gap (or a full window): say so right away, but
+           * only once, so the rest of the sender's window doesn't get a 
+           * duplicate ADAT each
+           */
+          curr_sender->gap_acked_frag = curr_sender->next_frag;
+          is_urgent = 1;
+        }
+        // else it's a keepalive or a duplicate; the ADAT can wait
+        if (payload_size > 0 && !is_buffered) { count_dropped(curr_sender, frag_holder); }
+        autotune_window(curr_sender);
+
+        /* either way, sender just proved that he's still connected,
+         * so reset the inactivity counter and (eventually) reply with ADAT
+         */
+        curr_sender->inactive_time = 0;
+        acknowledge(shard_p, curr_sender, is_urgent, replies_p);
+      }
+      // else the sender is sending data without being connected
+      // do nothing (drop the packet)
+      pthread_mutex_unlock(&(curr_sender->lock));
+      break;
+
+    case MRT_ADAT :
+      // acknowledging what mrt_reply() sent back
+      if (curr_sender == NULL) { break; }
+      pthread_mutex_lock(&(curr_sender->lock));
+        if (curr_sender->is_accepted && curr_sender->inactive_time < TIMEOUT_THRESHOLD) {
+          int winsize_holder = 0;
+          memmove(&winsize_holder, transmission + MRT_WINDOWSIZE_LOCATION, MRT_WINDOWSIZE_LENGTH);
+          handle_reply_ack(curr_sender, frag_holder, winsize_holder);
+          curr_sender->inactive_time = 0;
+        }
+      pthread_mutex_unlock(&(curr_sender->lock));
+      break;
+
+    case MRT_SKIP :
+      // the sender gave up on messages up to this fragment; move on past them
+      if (curr_sender == NULL) { break; }
+      pthread_mutex_lock(&(curr_sender->lock));
+        if (curr_sender->is_accepted && curr_sender->inactive_time < TIMEOUT_THRESHOLD) {
+          if (MRT_FRAG_DIFF(frag_holder, curr_sender->next_frag) >= 0) {
+            /* what arrived of the first abandoned message is no use now;
+             * it is at the end of the ring (a view of it, which only a
+             * mix-up with mrt_borrow() would lend, is left alone)
+             */
+            int num_discarded = curr_sender->partial_message_bytes;
+            if (num_discarded > curr_sender->bytes_unread - curr_sender->bytes_borrowed) {
+              num_discarded = curr_sender->bytes_unread - curr_sender->bytes_borrowed;
+            }
+            curr_sender->bytes_unread -= num_discarded;
+            curr_sender->partial_message_bytes = 0;
+            if (curr_sender->bytes_unread == 0) {
+              curr_sender->read_index = 0;
+              if (curr_sender->eventfd >= 0 && unread_anywhere(curr_sender) == 0) {
+                drain_eventfd(curr_sender->eventfd);
+              }
+            }
+            stat_add(&(curr_sender->counters.bytes_discarded), num_discarded);
+            stat_add(&(curr_sender->counters.frags_skipped), MRT_FRAG_DIFF(frag_holder, curr_sender->next_frag) + 1);
+            TRACE(TRACE_SKIP_RECEIVED, PORT_OF(addr_p), frag_holder, num_discarded);
+            curr_sender->next_frag = MRT_FRAG_ADD(frag_holder, 1);
+            curr_sender->rtt_probe_time = 0; // its fragment may never arrive now
+            curr_sender->gap_acked_frag = frag_holder;
+          }
+          // either way, the sender waits to hear that we are past them
+          curr_sender->inactive_time = 0;
+          acknowledge(shard_p, curr_sender, 1, replies_p);
+        }
+      pthread_mutex_unlock(&(curr_sender->lock));
+      break;
+
+    case MRT_RCLS :
+      if (curr_sender == NULL) { break; }
+      /* note that RCLS is only sent upon receiving the final ADAT,
+       * so there is no need to check/use the fragment number here.
+       */
+      pthread_mutex_lock(&(curr_sender->lock));
+      if (curr_sender->is_accepted) {
+        TRACE(TRACE_RCLS_RECEIVED, PORT_OF(addr_p), 0, 0);
+        // trick the checker into doing clean-up
+        curr_sender->inactive_time = TIMEOUT_THRESHOLD;
+        // then be polite and do an ACLS
+        reply_buffer = add_reply(replies_p, addr_p, MRT_HASH_LENGTH + MRT_TYPE_LENGTH);
+        build_acls(reply_buffer);
+        TRACE(TRACE_ACLS_SENT, PORT_OF(addr_p), 0, 0);
+        pthread_mutex_unlock(&(curr_sender->lock));
+      } else {
+        pthread_mutex_unlock(&(curr_sender->lock));
+        /* else the sender is trying to disconnect without being connected;
+        * in that case, just try to remove it from the queue... unless
+        * mrt_accept1() has already taken it out.
+        */
+        pthread_rwlock_wrlock(&(shard_p->senders_lock));
+          pthread_mutex_lock(&accept_lock);
+            if (pop_item_q(pending_senders_q, sender_matcher, addr_p) != NULL) {
+              num_pending -= 1;
+              sender_t_free(pop_item_q(shard_p->senders_q, sender_matcher, addr_p));
+              if (peek_q(pending_senders_q) == NULL) { drain_eventfd(accept_eventfd); }
+            }
+          pthread_mutex_unlock(&accept_lock);
+        pthread_rwlock_unlock(&(shard_p->senders_lock));
+      }
+      break;
+
+    default :
+      // ACON, ACLS, COOK, UNKN
+      break;
   }
-  // garbage collection (SKIP THIS SO BUFFER REMAINS AVAILABLE)
-  // pthread_mutex_lock(&q_lock);
-  //   free(pop_item_q(connected_senders_q, sender_matcher, &(sender_p->addr)));
-  // pthread_mutex_unlock(&q_lock);
+}
+
+/* checker: runs in a new thread for each sender as soon as its first
+ * DATA is received; whether the transmission ends successfully or 
+ * as a result of a timeout, this function hands the sender over to
+ * its handler for garbage collection before terminating. The handler
+ * wakes it (through checker_cvar) to end it at once at mrt_close().
+ */
+void *checker(void *sender_vp) {
+  sender_t *sender_p = (sender_t *)sender_vp;
+  shard_t *shard_p = sender_p->shard_p;
+  struct timespec deadline;
+
+  pthread_mutex_lock(&(sender_p->lock));
+    while (1) {
+      sender_p->inactive_time += CHECKER_PERIOD;
+      // if it would sleep past the threshold, go BOOM
+      if (sender_p->inactive_time > TIMEOUT_THRESHOLD) {
+        TRACE(TRACE_RECEIVER_OVER, PORT_OF(&(sender_p->addr)), 0, 0);
+        // wake up any reader (or replier) so it notices the connection is over
+        pthread_cond_broadcast(&(sender_p->readable_cvar));
+        pthread_cond_broadcast(&(sender_p->reply_cvar));
+        notify_ready(sender_p);
+        break;
+      }
+      deadline_after(&deadline, CHECKER_PERIOD);
+      pthread_cond_timedwait(&(sender_p->checker_cvar), &(sender_p->lock), &deadline);
+    }
+    // the taker sees the connection is over, too (and the ring goes with the sender)
+    int has_shm_thread = sender_p->has_shm_thread;
+    sender_p->has_shm_thread = 0;
+    pthread_cond_signal(&(sender_p->room_cvar));
+  pthread_mutex_unlock(&(sender_p->lock));
+  if (has_shm_thread) { pthread_join(sender_p->shm_thread, NULL); }
+  /* garbage collection: only the handler may change its table, and
+   * the buffer remains available until the application is done with it
+   */
+  enq_msq(shard_p->closed_q, sender_p);
+  wake_handler(shard_p);
 
   return NULL;
 }
 
+/* shm_taker: runs in a new thread for each sender whose ring was taken
+ * (see mrt.h), from mrt_accept1() until the checker joins it once the
+ * connection is over; moves what the sender puts in the ring into the
+ * sender's buffer as it comes and as there is room (waiting on
+ * room_cvar otherwise), where the application reads it like any DATA.
+ * Bytes that arrive count as the sender being heard from. Under the
+ * low-latency profile, it looks for them again right away instead of
+ * sleeping on the ring.
+ */
+void *shm_taker(void *sender_vp) {
+  sender_t *sender_p = (sender_t *)sender_vp;
+  mrt_shm_t *shm_p = sender_p->shm_p;
+  struct timespec deadline;
+  unsigned int seen_count;
+  char *bytes = NULL;
+  int len, room;
+
+  while (1) {
+    seen_count = atomic_load(&(shm_p->put_count));
+    len = mrt_shm_peek(shm_p, &bytes);
+    pthread_mutex_lock(&(sender_p->lock));
+      if (sender_p->inactive_time >= TIMEOUT_THRESHOLD) {
+    pthread_mutex_unlock(&(sender_p->lock));
+        break;
+      }
+      room = sender_p->buffer_size - sender_p->bytes_unread;
+      if (len > room) { len = room; }
+      if (len > 0) {
+        if (unread_anywhere(sender_p) == 0) { notify_ready(sender_p); }
+        buffer_append(sender_p, bytes, len);
+        stat_add(&(sender_p->counters.bytes_received), len);
+        sender_p->inactive_time = 0;
+        pthread_cond_broadcast(&(sender_p->readable_cvar));
+        autotune_window(sender_p);
+      } else if (room == 0) {
+        deadline_after(&deadline, CHECKER_PERIOD);
+        pthread_cond_timedwait(&(sender_p->room_cvar), &(sender_p->lock), &deadline);
+      }
+    pthread_mutex_unlock(&(sender_p->lock));
+    if (len > 0) {
+      mrt_shm_take(shm_p, len);
+    } else if (room > 0 && is_busy_polling) {
+      spin_pause();
+    } else if (room > 0) {
+      mrt_shm_wait(&(shm_p->put_count), seen_count, &(shm_p->is_taker_waiting), CHECKER_PERIOD);
+    }
+  }
+  return NULL;
+}
+
 
 /****** helper functions (unavailable to module users) ******/
 
+/* maps the ring offered in a new sender's RCON, if there is an offer
+ * and it came straight from the sender's own port on this host (not
+ * relayed by anything in between); otherwise the sender's bytes come
+ * in DATA as usual. Only to be called by the handler, before the
+ * sender is queued.
+ */
+void take_shm_offer(sender_t *sender_p, char *transmission, int num_bytes_received) {
+  int offer[MRT_SHM_OFFER_LENGTH / sizeof(int)];
+  if (num_bytes_received < MRT_HEADER_LENGTH + MRT_SHM_OFFER_LENGTH) { return; }
+  memmove(offer, transmission + MRT_SHM_OFFER_LOCATION, MRT_SHM_OFFER_LENGTH);
+  // magic, pid, fd, token and port, in that order
+  if (offer[0] != MRT_SHM_MAGIC || (ntohl(sender_p->addr.sin_addr.s_addr) >> 24) != 127 ||
+      offer[4] != PORT_OF(&(sender_p->addr))) {
+    return;
+  }
+  sender_p->shm_p = mrt_shm_attach(offer[1], offer[2], (unsigned int)offer[3]);
+  if (sender_p->shm_p != NULL) { stat_set(&(sender_p->counters.is_shared_memory), 1); }
+}
+
+/* allocates a pending sender for a new RCON; returns NULL on failure.
+ */
+sender_t *sender_t_new(shard_t *shard_p, struct sockaddr_in *addr_p, int initial_frag) {
+  sender_t *sender_p = take_free_sender();
+  if (sender_p == NULL) { return NULL; }
+  if (sender_p->buffer == NULL) {
+    sender_p->buffer = malloc(RECEIVER_INITIAL_WINDOW_SIZE);
+    if (sender_p->buffer == NULL) {
+      sender_p->buffer_size = 0;
+      sender_p->eventfd = -1;
+      sender_t_free(sender_p); // back to the slab
+      return NULL;
+    }
+  }
+  memmove(&(sender_p->addr), addr_p, addr_len);
+  sender_p->shard_p = shard_p;
+  sender_p->buffer_size = RECEIVER_INITIAL_WINDOW_SIZE;
+  sender_p->read_index = 0;
+  sender_p->bytes_unread = 0;
+  sender_p->bytes_borrowed = 0;
+  sender_p->next_frag = MRT_FRAG_ADD(initial_frag, 1);
+  sender_p->inactive_time = 0;
+  sender_p->is_accepted = 0;
+  sender_p->eventfd = -1;
+  sender_p->is_end_reported = 0;
+  sender_p->num_waiters = 0;
+  sender_p->last_read_time = 0;
+  sender_p->has_checker = 0;
+  sender_p->shm_p = NULL;
+  sender_p->has_shm_thread = 0;
+
+  sender_p->bytes_drained = 0;
+  sender_p->epoch_start = now_usec();
+  sender_p->rtt_estimate = 0;
+  sender_p->rtt_probe_frag = 0;
+  sender_p->rtt_probe_time = 0;
+
+  sender_p->ack_every = RECEIVER_DEFAULT_ACK_EVERY;
+  sender_p->ack_delay = RECEIVER_DEFAULT_ACK_DELAY;
+  sender_p->unacked_frags = 0;
+  sender_p->is_ack_pending = 0;
+  sender_p->ack_due_time = 0;
+  sender_p->gap_acked_frag = initial_frag; // never the next one
+  sender_p->last_advertised_window = RECEIVER_INITIAL_WINDOW_SIZE;
+  sender_p->reply_acked_frag = 0;
+  sender_p->reply_window = MRT_REPLY_WINDOW_SIZE;
+  sender_p->is_replying = 0;
+  sender_p->has_replied = 0;
+  sender_p->message_head = 0;
+  sender_p->num_messages = 0;
+  sender_p->partial_message_bytes = 0;
+  for (int i = 0; i < MRT_MAX_STREAMS - 1; i++) {
+    // (their rings are only malloc'd when used)
+    sender_p->streams[i].read_index = 0;
+    sender_p->streams[i].bytes_unread = 0;
+    sender_p->streams[i].next_frag = 1;
+    sender_p->streams[i].unacked_frags = 0;
+    sender_p->streams[i].gap_acked_frag = 0;
+    sender_p->streams[i].last_advertised_window = MRT_STREAM_WINDOW_SIZE;
+  }
+  sender_p->stream_bytes_unread = 0;
+  reset_counters(&(sender_p->counters)); // the slot may have had another sender
+
+  pthread_mutex_lock(&budget_lock);
+    memory_in_use += RECEIVER_INITIAL_WINDOW_SIZE;
+  pthread_mutex_unlock(&budget_lock);
+  return sender_p;
+}
+
+/* puts the sender back into free_senders; the signature is so that 
+ * it can be used as a clean-up callback to q
+ */
+void sender_t_free(void *sender_vp) {
+  sender_t *sender_p = (sender_t *)sender_vp;
+  if (sender_p == NULL) { return; }
+  pthread_mutex_lock(&budget_lock);
+    memory_in_use -= sender_p->buffer_size;
+  pthread_mutex_unlock(&budget_lock);
+  if (sender_p->eventfd >= 0) { close(sender_p->eventfd); }
+  mrt_shm_detach(sender_p->shm_p);
+  sender_p->shm_p = NULL;
+  if (sender_p->buffer_size != RECEIVER_INITIAL_WINDOW_SIZE) {
+    free(sender_p->buffer);
+    sender_p->buffer = NULL;
+  }
+  free(sender_p->message_lengths);
+  sender_p->message_lengths = NULL;
+  sender_p->message_slots = 0;
+  for (int i = 0; i < MRT_MAX_STREAMS - 1; i++) {
+    if (sender_p->streams[i].buffer == NULL) { continue; }
+    free(sender_p->streams[i].buffer);
+    sender_p->streams[i].buffer = NULL;
+    pthread_mutex_lock(&budget_lock);
+      memory_in_use -= MRT_STREAM_WINDOW_SIZE;
+    pthread_mutex_unlock(&budget_lock);
+  }
+  pthread_mutex_lock(&slab_lock);
+    sender_p->next_free = free_senders;
+    free_senders = sender_p;
+  pthread_mutex_unlock(&slab_lock);
+}
+
+/* pops a slot off free_senders, carving a new slab first if there are
+ * none left; returns NULL on failure.
+ */
+sender_t *take_free_sender() {
+  sender_t *sender_p = NULL, *slab;
+  pthread_mutex_lock(&slab_lock);
+    if (free_senders == NULL) {
+      slab = calloc(SENDER_SLAB_SIZE, sizeof(sender_t));
+      for (int i = 0; slab != NULL && i < SENDER_SLAB_SIZE; i++) {
+        // neither can fail with the default attributes
+        pthread_mutex_init(&(slab[i].lock), NULL);
+        pthread_cond_init(&(slab[i].readable_cvar), NULL);
+        pthread_cond_init(&(slab[i].reply_cvar), NULL);
+        pthread_cond_init(&(slab[i].room_cvar), NULL);
+        pthread_cond_init(&(slab[i].checker_cvar), NULL);
+        slab[i].next_free = free_senders;
+        free_senders = &(slab[i]);
+      }
+    }
+    if (free_senders != NULL) {
+      sender_p = free_senders;
+      free_senders = sender_p->next_free;
+    }
+  pthread_mutex_unlock(&slab_lock);
+  return sender_p;
+}
+
+/* takes the oldest request off the accept queue under accept_lock and
+ * accepts it, on behalf of mrt_accept1() and mrt_accept_all(); if there
+ * is none, waits for one if `should_wait`, or else returns NULL at once.
+ * `*is_taken_p` tells whether a request was taken, as its ID is NULL
+ * if it had to be given up on (see abandon_accept()).
+ */
+struct sockaddr_in *accept_pending(int should_wait, int *is_taken_p) {
+  sender_t *curr_sender = NULL;
+  *is_taken_p = 0;
+  pthread_mutex_lock(&accept_lock);
+    // (the queue is gone once the receiver is closed)
+    while (pending_senders_q != NULL && (curr_sender = deq_q(pending_senders_q)) == NULL &&
+           should_wait) {
+      pthread_cond_wait(&accept_cvar, &accept_lock);
+    }
+    if (curr_sender == NULL) {
+  pthread_mutex_unlock(&accept_lock);
+      return NULL;
+    }
+    *is_taken_p = 1;
+    num_pending -= 1;
+    if (peek_q(pending_senders_q) == NULL) { drain_eventfd(accept_eventfd); }
+    /* the sender stays in its shard's table the whole time, so its
+     * handler cannot mistake a retransmitted RCON for a new sender
+     * while it is being accepted here; and it is locked before the
+     * queue is let go, so a closing handler cannot free it meanwhile.
+     */
+    pthread_mutex_lock(&(curr_sender->lock));
+  pthread_mutex_unlock(&accept_lock);
+  char outgoing_buffer[MRT_HEADER_LENGTH + MRT_SHM_TOKEN_LENGTH];
+  // make a copy of the ID struct
+  struct sockaddr_in *id_p = malloc(addr_len);
+    // as soon the ACON is sent, start the timeout checker thread
+    if (pthread_create(&(curr_sender->checker_thread), NULL, checker, curr_sender) == 0) {
+      curr_sender->has_checker = 1;
+    }
+    // (and the taker, if the ACON tells the sender its ring is taken)
+    if (curr_sender->has_checker && curr_sender->shm_p != NULL &&
+        pthread_create(&(curr_sender->shm_thread), NULL, shm_taker, curr_sender) == 0) {
+      curr_sender->has_shm_thread = 1;
+    }
+    if (!curr_sender->has_checker || (curr_sender->shm_p != NULL && !curr_sender->has_shm_thread)) {
+      perror("pthread_create(checker_thread, shm_thread) error\n");
+      abandon_accept(curr_sender);
+  pthread_mutex_unlock(&(curr_sender->lock));
+      free(id_p);
+      return NULL;
+    }
+    curr_sender->is_accepted = 1;
+    curr_sender->last_read_time = now_usec();
+    int acon_length = build_acon(outgoing_buffer, MRT_FRAG_ADD(curr_sender->next_frag, -1), curr_sender->shm_p);
+    TRACE(TRACE_ACCEPTED, PORT_OF(&(curr_sender->addr)), 0, 0);
+    // once unlocked, the sender may be over and reclaimed any time
+    int sockfd = curr_sender->shard_p->sockfd;
+    memmove(id_p, &(curr_sender->addr), addr_len);
+  pthread_mutex_unlock(&(curr_sender->lock));
+
+  sendto(sockfd, outgoing_buffer, acon_length,  
+    0, (const struct sockaddr *)id_p, 
+    addr_len);
+  return id_p;
+}
+
+/* gives up on accepting the sender (whose lock is held) when its
+ * threads cannot all be created: it stays unaccepted, is marked over
+ * and as already reported, and is handed over to the handler to be
+ * reclaimed, by its checker if there is one, or else from here.
+ */
+void abandon_accept(sender_t *sender_p) {
+  sender_p->inactive_time = TIMEOUT_THRESHOLD + 1;
+  sender_p->is_end_reported = 1;
+  if (sender_p->has_checker) {
+    pthread_cond_signal(&(sender_p->checker_cvar));
+  } else {
+    enq_msq(sender_p->shard_p->closed_q, sender_p);
+    wake_handler(sender_p->shard_p);
+  }
+}
+
+/* reclaims the shard's senders whose connection is over once the
+ * application has seen the end (or can no longer see it); until then
+ * they are retained for their unread bytes, up to the shard's share of
+ * max_retained, past which the least recently read are reclaimed.
+ * Only to be called by the shard's handler, when woken through wake_fd.
+ */
+void reap_senders(shard_t *shard_p) {
+  sender_t *curr_sender;
+  q_t *still_retained_q = shard_p->spare_q;
+  int is_done, cap;
+
+  // take over what the checkers handed over, once they are gone
+  while ((curr_sender = (sender_t *)deq_msq(shard_p->closed_q)) != NULL) {
+    pthread_mutex_lock(&(curr_sender->lock));
+      int has_checker = curr_sender->has_checker;
+    pthread_mutex_unlock(&(curr_sender->lock));
+    // (none if mrt_accept1() could not create it; see abandon_accept())
+    if (has_checker) { pthread_join(curr_sender->checker_thread, NULL); }
+    pthread_mutex_lock(&(curr_sender->lock));
+      curr_sender->has_checker = 0;
+    pthread_mutex_unlock(&(curr_sender->lock));
+    if (enq_q(shard_p->retained_q, curr_sender) == 0) { shard_p->num_retained += 1; }
+    // else out of memory; it just stays in the table until mrt_close()
+  }
+
+  pthread_mutex_lock(&budget_lock);
+    cap = (max_retained + num_shards - 1) / num_shards;
+  pthread_mutex_unlock(&budget_lock);
+
+  // readers look senders up under the read lock, so none can show up now
+  pthread_rwlock_wrlock(&(shard_p->senders_lock));
+    while ((curr_sender = (sender_t *)deq_q(shard_p->retained_q)) != NULL) {
+      pthread_mutex_lock(&(curr_sender->lock));
+        is_done = curr_sender->is_end_reported && curr_sender->bytes_borrowed == 0 &&
+          curr_sender->num_waiters == 0;
+      pthread_mutex_unlock(&(curr_sender->lock));
+      if (is_done) {
+        reclaim_sender(shard_p, curr_sender);
+        shard_p->num_retained -= 1;
+      } else {
+        enq_q(still_retained_q, curr_sender);
+      }
+    }
+    shard_p->spare_q = shard_p->retained_q; // now empty
+    shard_p->retained_q = still_retained_q;
+
+    while (shard_p->num_retained > cap) {
+      lru_search_t search = { NULL, 0 };
+      iterate_q(shard_p->retained_q, find_least_recently_read, &search);
+      if (search.sender_p == NULL) { break; } // all being read; next time
+      pop_item_q(shard_p->retained_q, sender_matcher, &(search.sender_p->addr));
+      reclaim_sender(shard_p, search.sender_p);
+      shard_p->num_retained -= 1;
+    }
+  pthread_rwlock_unlock(&(shard_p->senders_lock));
+}
+
+/* takes the sender out of its shard's queues and back to the slab;
+ * assumes that the shard's senders_lock is held for writing and that
+ * no reader holds or waits on the sender.
+ */
+void reclaim_sender(shard_t *shard_p, sender_t *sender_p) {
+  TRACE(TRACE_RECLAIMED, PORT_OF(&(sender_p->addr)), 0, sender_p->bytes_unread);
+  pop_item_q(shard_p->senders_q, sender_matcher, &(sender_p->addr));
+  pop_item_q(shard_p->delayed_acks_q, sender_matcher, &(sender_p->addr));
+  sender_t_free(sender_p);
+}
+
+/* reclaims a retained sender ahead of time, for a new connection from
+ * its address; returns -1 if it is not retained yet (its checker is
+ * still on the way out) or is in use. Only to be called by the handler.
+ */
+int reclaim_superseded(shard_t *shard_p, sender_t *sender_p) {
+  int is_in_use;
+  if (get_item_q(shard_p->retained_q, sender_matcher, &(sender_p->addr)) == NULL) { return -1; }
+  pthread_rwlock_wrlock(&(shard_p->senders_lock));
+    pthread_mutex_lock(&(sender_p->lock));
+      is_in_use = sender_p->bytes_borrowed > 0 || sender_p->num_waiters > 0;
+    pthread_mutex_unlock(&(sender_p->lock));
+    if (!is_in_use) {
+      pop_item_q(shard_p->retained_q, sender_matcher, &(sender_p->addr));
+      reclaim_sender(shard_p, sender_p);
+      shard_p->num_retained -= 1;
+    }
+  pthread_rwlock_unlock(&(shard_p->senders_lock));
+  return is_in_use ? -1 : 0;
+}
+
+/* callback for reap_senders(); keeps the least recently read sender
+ * that is not in use in the lru_search_t.
+ */
+void find_least_recently_read(void *sender_vp, void *search_vp) {
+  sender_t *sender_p = (sender_t *)sender_vp;
+  lru_search_t *search_p = (lru_search_t *)search_vp;
+  pthread_mutex_lock(&(sender_p->lock));
+    if (sender_p->bytes_borrowed == 0 && sender_p->num_waiters == 0 &&
+        (search_p->sender_p == NULL || sender_p->last_read_time < search_p->last_read_time)) {
+      search_p->sender_p = sender_p;
+      search_p->last_read_time = sender_p->last_read_time;
+    }
+  pthread_mutex_unlock(&(sender_p->lock));
+}
+
+// gets the shard's handler to run reap_senders()
+void wake_handler(shard_t *shard_p) {
+  eventfd_write(shard_p->wake_fd, 1);
+}
+
+/* wakes the first `num_started` shards' handlers, which find
+ * should_close set and tear their shards down, and joins them.
+ */
+void stop_handlers(int num_started) {
+  int i;
+  for (i = 0; i < num_started; i++) {
+    wake_handler(&(shards[i]));
+  }
+  for (i = 0; i < num_started; i++) {
+    pthread_join(shards[i].handler_thread, NULL);
+  }
+}
+
+/* frees the shards under shards_lock, so that no call is looking
+ * through them meanwhile: of the `num_allocated` shards, the first
+ * `num_ready` were set up, and the first `num_started` of those had
+ * handlers, now joined, that closed and freed the rest themselves.
+ */
+void free_shards(int num_allocated, int num_ready, int num_started) {
+  int i;
+  pthread_rwlock_wrlock(&shards_lock);
+    for (i = 0; i < num_allocated; i++) {
+      shard_t *shard_p = &(shards[i]);
+      delete_q(shard_p->senders_q, NULL); // emptied by the handler, if any
+      if (i < num_ready) { pthread_rwlock_destroy(&(shard_p->senders_lock)); }
+      if (i < num_started) { continue; }
+      if (shard_p->sockfd >= 0) { close(shard_p->sockfd); }
+      if (shard_p->wake_fd >= 0) { close(shard_p->wake_fd); }
+      delete_q(shard_p->delayed_acks_q, NULL);
+      delete_msq(shard_p->closed_q, NULL);
+      delete_q(shard_p->retained_q, NULL);
+      delete_q(shard_p->spare_q, NULL);
+    }
+    free(shards);
+    shards = NULL;
+    num_shards = 0;
+  pthread_rwlock_unlock(&shards_lock);
+}
+
+/* undoes a failed mrt_open_sharded(): of the `num_allocated` shards,
+ * the first `num_ready` were set up and the first `num_started` of
+ * those have their handlers running. Stops and joins those handlers,
+ * closes and frees everything else created so far, and leaves no
+ * shards behind, so that mrt_open() may be tried again.
+ * returns -1, for mrt_open_sharded() to return.
+ */
+int abandon_open(int num_allocated, int num_ready, int num_started) {
+  if (num_started > 0) {
+    // (the last of them gets rid of the accept queue)
+    pthread_mutex_lock(&accept_lock);
+      num_shards_running = num_started;
+    pthread_mutex_unlock(&accept_lock);
+    pthread_mutex_lock(&close_lock);
+      should_close = 1;
+    pthread_mutex_unlock(&close_lock);
+    stop_handlers(num_started);
+  }
+
+  pthread_mutex_lock(&accept_lock);
+    if (num_started == 0) {
+      delete_q(pending_senders_q, NULL); // nothing was ever queued
+      pending_senders_q = NULL;
+    }
+    if (accept_eventfd >= 0) { close(accept_eventfd); }
+    accept_eventfd = -1;
+    num_pending = 0;
+    num_shards_running = 0;
+  pthread_mutex_unlock(&accept_lock);
+  free_shards(num_allocated, num_ready, num_started);
+  return -1;
+}
+
+/* looks the ID up in every shard's table; returns the accepted sender
+ * with its own lock held, or NULL (nothing held) if no shard has
+ * accepted such a sender.
+ */
+sender_t *lock_accepted_sender(struct sockaddr_in *id_p) {
+  sender_t *curr_sender = NULL;
+  pthread_rwlock_rdlock(&shards_lock);
+  for (int i = 0; i < num_shards; i++) {
+    pthread_rwlock_rdlock(&(shards[i].senders_lock));
+      curr_sender = get_item_q(shards[i].senders_q, sender_matcher, id_p);
+      if (curr_sender != NULL) {
+        pthread_mutex_lock(&(curr_sender->lock));
+        if (curr_sender->is_accepted) {
+    pthread_rwlock_unlock(&(shards[i].senders_lock));
+  pthread_rwlock_unlock(&shards_lock);
+          return curr_sender;
+        }
+        pthread_mutex_unlock(&(curr_sender->lock));
+      }
+    pthread_rwlock_unlock(&(shards[i].senders_lock));
+  }
+  pthread_rwlock_unlock(&shards_lock);
+  return NULL;
+}
+
+/* waits until the accepted sender has unread bytes (a whole message,
+ * if `is_message`) on the `stream`, then returns it with its lock held.
+ * Otherwise returns NULL (nothing held) with `*status_p` set to what
+ * mrt_receive1() returns: 0 if the connection is over or gone, or -1
+ * if it was never accepted.
+ */
+sender_t *lock_readable_sender(struct sockaddr_in *id_p, int *status_p, int is_message, int stream) {
+  sender_t *curr_sender = lock_accepted_sender(id_p);
+  struct timespec deadline;
+  *status_p = -1;
+  if (curr_sender == NULL) { return NULL; }
+  pthread_mutex_unlock(&(curr_sender->lock));
+  *status_p = 0;
+
+  while (1) {
+    // get the sender again to ensure the connection is still valid
+    curr_sender = lock_accepted_sender(id_p);
+    if (curr_sender == NULL) {
+      // the sender is NULL now... after not being NULL once...
+      return NULL;
+    }
+    pthread_mutex_t *lock_p = &(curr_sender->lock);
+
+      // the connection remains; now either wait or hand it over
+      if ((stream > 0) ? curr_sender->streams[stream - 1].bytes_unread > 0 :
+          is_message ? curr_sender->num_messages > 0 : curr_sender->bytes_unread > 0) {
+        return curr_sender;
+      }
+      if (curr_sender->inactive_time > TIMEOUT_THRESHOLD) {
+        // the application knows it's over; the sender can go (once no stream has bytes left)
+        if (unread_anywhere(curr_sender) == 0) {
+          curr_sender->is_end_reported = 1;
+          wake_handler(curr_sender->shard_p);
+        }
+    pthread_mutex_unlock(lock_p);
+        return NULL;
+      }
+      if (is_busy_polling) {
+        // looking again right away instead (see mrt_set_busy_poll())
+    pthread_mutex_unlock(lock_p);
+        spin_pause();
+        continue;
+      }
+      // woken up by the handler as soon as bytes arrive
+      deadline_after(&deadline, RECEIVE1_PERIOD);
+      curr_sender->num_waiters += 1;
+      long long wait_start = now_usec();
+      pthread_cond_timedwait(&(curr_sender->readable_cvar), lock_p, &deadline);
+      stat_add(&(curr_sender->counters.usec_blocked), now_usec() - wait_start);
+      leave_sender(curr_sender);
+    pthread_mutex_unlock(lock_p);
+  }
+}
+
+/* counts a waiter out of the sender, whose lock is held; the last one
+ * out of a connection that is over lets main_handler() free it, should
+ * the receiver be closing (the checker is gone by then, so checker_cvar
+ * is free to tell).
+ */
+void leave_sender(sender_t *sender_p) {
+  sender_p->num_waiters -= 1;
+  if (sender_p->num_waiters == 0 && sender_p->inactive_time > TIMEOUT_THRESHOLD) {
+    pthread_cond_signal(&(sender_p->checker_cvar));
+  }
+}
+
+/* bookkeeping after the application read `len` bytes: the eventfd is
+ * cleared once drained, and if reading opened up the window a lot,
+ * an ADAT is built in `outgoing_buffer` to tell the sender right away
+ * instead of waiting for its next DATA. Returns whether one was built
+ * (to be sent after unlocking); assumes that the sender's lock is held.
+ */
+int note_bytes_read(sender_t *sender_p, int len, char *outgoing_buffer) {
+  stat_add(&(sender_p->counters.bytes_read), len);
+  // the handler skips resizing while a view is out, so catch up here
+  autotune_window(sender_p);
+  if (sender_p->shm_p != NULL) { pthread_cond_signal(&(sender_p->room_cvar)); }
+  int curr_window_size = sender_p->buffer_size - sender_p->bytes_unread;
+  sender_p->last_read_time = now_usec();
+  // no longer readable, unless the connection is over
+  if (unread_anywhere(sender_p) == 0 && sender_p->eventfd >= 0 &&
+      sender_p->inactive_time <= TIMEOUT_THRESHOLD) {
+    drain_eventfd(sender_p->eventfd);
+  }
+  if (!is_window_update_due(sender_p)) { return 0; }
+  build_adat(outgoing_buffer, MRT_FRAG_ADD(sender_p->next_frag, -1), curr_window_size);
+  sender_p->last_advertised_window = curr_window_size;
+  stat_set(&(sender_p->counters.advertised_window), curr_window_size);
+  stat_add(&(sender_p->counters.adats_sent), 1);
+  TRACE(TRACE_ADAT_SENT, PORT_OF(&(sender_p->addr)), MRT_FRAG_ADD(sender_p->next_frag, -1), curr_window_size);
+  sender_p->unacked_frags = 0;
+  sender_p->is_ack_pending = 0;
+  return 1;
+}
+
+/* handles a DATA on one of the other streams: buffers it if it is the
+ * stream's next fragment and fits, and ADATs the stream at once if the
+ * sender waits on it (PUSH), after every ack_every'th fragment, for the
+ * first fragment after a gap, and for one dropped for a full window
+ * (which is what the sender probes a shut window with). There is no
+ * delayed ADAT for these; the sender flags the last fragment it can
+ * send PUSH anyway. Assumes that the sender's lock is held; only to be
+ * called by the sender's shard handler.
+ */
+void handle_stream_data(sender_t *sender_p, int stream, int frag, int flags, char *payload, int payload_size, reply_batch_t *replies_p) {
+  if (stream >= MRT_MAX_STREAMS || payload_size <= 0) { return; }
+  stream_t *stream_p = &(sender_p->streams[stream - 1]);
+  int is_urgent = 0;
+  if (stream_p->buffer == NULL) {
+    stream_p->buffer = malloc(MRT_STREAM_WINDOW_SIZE);
+    if (stream_p->buffer == NULL) { return; } // maybe when it is resent
+    pthread_mutex_lock(&budget_lock);
+      memory_in_use += MRT_STREAM_WINDOW_SIZE;
+    pthread_mutex_unlock(&budget_lock);
+  }
+
+  if (frag == stream_p->next_frag && payload_size <= MRT_STREAM_WINDOW_SIZE - stream_p->bytes_unread) {
+    if (unread_anywhere(sender_p) == 0) { notify_ready(sender_p); }
+    int write_index = (stream_p->read_index + stream_p->bytes_unread) % MRT_STREAM_WINDOW_SIZE;
+    int first_part = MRT_STREAM_WINDOW_SIZE - write_index;
+    if (first_part >= payload_size) {
+      memmove(stream_p->buffer + write_index, payload, payload_size);
+    } else {
+      memmove(stream_p->buffer + write_index, payload, first_part);
+      memmove(stream_p->buffer, payload + first_part, payload_size - first_part);
+    }
+    stream_p->bytes_unread += payload_size;
+    sender_p->stream_bytes_unread += payload_size;
+    stream_p->next_frag = MRT_FRAG_ADD(stream_p->next_frag, 1);
+    stat_add(&(sender_p->counters.bytes_received), payload_size);
+    stat_add(&(sender_p->counters.frags_received), 1);
+    pthread_cond_broadcast(&(sender_p->readable_cvar));
+    stream_p->unacked_frags += 1;
+    is_urgent = stream_p->unacked_frags >= sender_p->ack_every || (flags & MRT_FLAG_PUSH);
+  } else if (MRT_FRAG_DIFF(frag, stream_p->next_frag) > 0) {
+    stat_add(&(sender_p->counters.frags_out_of_order), 1);
+    is_urgent = (stream_p->gap_acked_frag != stream_p->next_frag);
+    stream_p->gap_acked_frag = stream_p->next_frag;
+  } else if (frag == stream_p->next_frag) {
+    stat_add(&(sender_p->counters.frags_window_full), 1);
+    is_urgent = 1;
+  } else {
+    // its ADAT got lost; the sender only waits on the last of them
+    stat_add(&(sender_p->counters.frags_duplicate), 1);
+    is_urgent = (flags & MRT_FLAG_PUSH);
+  }
+  if (!is_urgent) { return; }
+
+  int curr_window_size = MRT_STREAM_WINDOW_SIZE - stream_p->bytes_unread;
+  char *reply_buffer = add_reply(replies_p, &(sender_p->addr), MRT_HEADER_LENGTH + MRT_STREAM_LENGTH);
+  build_stream_adat(reply_buffer, stream, MRT_FRAG_ADD(stream_p->next_frag, -1), curr_window_size);
+  stream_p->last_advertised_window = curr_window_size;
+  stream_p->unacked_frags = 0;
+  stat_add(&(sender_p->counters.adats_sent), 1);
+}
+
+/* unread bytes on all of the sender's streams together (what mrt_poll()
+ * and the eventfd report); assumes that the sender's lock is held.
+ */
+int unread_anywhere(sender_t *sender_p) {
+  return sender_p->bytes_unread + sender_p->stream_bytes_unread;
+}
+
+/* copies `len` bytes into the sender's ring right after its unread
+ * bytes, wrapping around the end if needed; the caller makes sure
+ * there is room (at most the current window size) and holds the lock.
+ */
+void buffer_append(sender_t *sender_p, char *bytes, int len) {
+  int write_index = (sender_p->read_index + sender_p->bytes_unread) % sender_p->buffer_size;
+  int first_part = sender_p->buffer_size - write_index;
+  if (first_part >= len) {
+    memmove(sender_p->buffer + write_index, bytes, len);
+  } else {
+    memmove(sender_p->buffer + write_index, bytes, first_part);
+    memmove(sender_p->buffer, bytes + first_part, len - first_part);
+  }
+  sender_p->bytes_unread += len;
+}
+
+/* moves up to `len` of the oldest unread bytes out of the sender's
+ * ring into `destination` and returns how many were moved; the
+ * remaining bytes stay where they are. The caller holds the lock.
+ */
+int buffer_consume(sender_t *sender_p, char *destination, int len) {
+  int bytes_read = (len < sender_p->bytes_unread) ? len : sender_p->bytes_unread;
+  int first_part = sender_p->buffer_size - sender_p->read_index;
+  if (first_part >= bytes_read) {
+    memmove(destination, sender_p->buffer + sender_p->read_index, bytes_read);
+  } else {
+    memmove(destination, sender_p->buffer + sender_p->read_index, first_part);
+    memmove(destination + first_part, sender_p->buffer, bytes_read - first_part);
+  }
+  buffer_release(sender_p, bytes_read);
+  return bytes_read;
+}
+
+/* frees up the `len` oldest unread bytes of the sender's ring, which
+ * the caller is done with; assumes that the sender's lock is held.
+ */
+void buffer_release(sender_t *sender_p, int len) {
+  sender_p->read_index = (sender_p->read_index + len) % sender_p->buffer_size;
+  sender_p->bytes_unread -= len;
+  sender_p->bytes_drained += len;
+  if (sender_p->bytes_unread == 0) {
+    // keeps the next payloads contiguous for as long as possible
+    sender_p->read_index = 0;
+  }
+  // the messages those bytes were (part of) are read as well
+  while (len > 0 && sender_p->num_messages > 0) {
+    int *length_p = &(sender_p->message_lengths[sender_p->message_head]);
+    if (*length_p > len) {
+      *length_p -= len;
+      break;
+    }
+    len -= *length_p;
+    sender_p->message_head = (sender_p->message_head + 1) % sender_p->message_slots;
+    sender_p->num_messages -= 1;
+  }
+}
+
+/* makes sure there is a slot for one more message length, growing the
+ * ring if needed; returns -1 if it cannot (the message's last fragment
+ * is then dropped like for a full window). Assumes that the sender's
+ * lock is held.
+ */
+int reserve_message(sender_t *sender_p) {
+  if (sender_p->num_messages < sender_p->message_slots) { return 0; }
+  int new_slots = (sender_p->message_slots > 0) ? sender_p->message_slots * 2 : MESSAGE_SLOTS;
+  int *new_lengths = malloc(new_slots * sizeof(int));
+  if (new_lengths == NULL) { return -1; }
+  for (int i = 0; i < sender_p->num_messages; i++) {
+    new_lengths[i] = sender_p->message_lengths[(sender_p->message_head + i) % sender_p->message_slots];
+  }
+  free(sender_p->message_lengths);
+  sender_p->message_lengths = new_lengths;
+  sender_p->message_slots = new_slots;
+  sender_p->message_head = 0;
+  return 0;
+}
+
+/* counts `len` bytes just buffered towards the message coming in, which
+ * is whole if `is_end` (reserve_message() was called for it). Assumes
+ * that the sender's lock is held.
+ */
+void note_message_bytes(sender_t *sender_p, int len, int is_end) {
+  sender_p->partial_message_bytes += len;
+  if (!is_end) { return; }
+  int tail = (sender_p->message_head + sender_p->num_messages) % sender_p->message_slots;
+  sender_p->message_lengths[tail] = sender_p->partial_message_bytes;
+  sender_p->num_messages += 1;
+  sender_p->partial_message_bytes = 0;
+}
+
+/* moves the unread bytes into a new ring of `new_size` bytes (which
+ * must be at least bytes_unread); returns 0 on success and -1 if the
+ * memory could not be allocated (the old ring is then kept).
+ */
+int buffer_resize(sender_t *sender_p, int new_size) {
+  char *new_buffer = malloc(new_size);
+  if (new_buffer == NULL) { return -1; }
+  int bytes_unread = sender_p->bytes_unread;
+  int bytes_drained = sender_p->bytes_drained;
+  int message_head = sender_p->message_head, num_messages = sender_p->num_messages;
+  buffer_consume(sender_p, new_buffer, bytes_unread);
+  // nor is it reading the messages
+  sender_p->message_head = message_head;
+  sender_p->num_messages = num_messages;
+  free(sender_p->buffer);
+
+  pthread_mutex_lock(&budget_lock);
+    memory_in_use += new_size - sender_p->buffer_size;
+  pthread_mutex_unlock(&budget_lock);
+  sender_p->buffer = new_buffer;
+  sender_p->buffer_size = new_size;
+  stat_set(&(sender_p->counters.buffer_size), new_size);
+  TRACE(TRACE_WINDOW_RESIZED, PORT_OF(&(sender_p->addr)), 0, new_size);
+  sender_p->read_index = 0;
+  sender_p->bytes_unread = bytes_unread;
+  sender_p->bytes_drained = bytes_drained; // moving is not draining
+  return 0;
+}
+
+/* called whenever a payload is buffered. Like TCP's receiver-side
+ * RTT measurement: note when a window's worth of fragments is
+ * expected, and the time it takes for them to arrive is a sample.
+ * A sample is only an upper bound (the sender may have had less than
+ * a window to send), so after the first one the estimate only drops.
+ */
+void sample_rtt(sender_t *sender_p, int window_size) {
+  long long now = now_usec();
+  if (sender_p->rtt_probe_time != 0 && MRT_FRAG_DIFF(sender_p->next_frag, sender_p->rtt_probe_frag) > 0) {
+    int sample = (int)(now - sender_p->rtt_probe_time);
+    if (sample < 1) { sample = 1; }
+    if (sender_p->rtt_estimate == 0 || sample < sender_p->rtt_estimate) {
+      sender_p->rtt_estimate = sample;
+      stat_set(&(sender_p->counters.rtt_usec), sample);
+    }
+    sender_p->rtt_probe_time = 0;
+  }
+  if (sender_p->rtt_probe_time == 0) {
+    int window_frags = window_size / MAX_MRT_PAYLOAD_LENGTH;
+    sender_p->rtt_probe_frag = MRT_FRAG_ADD(sender_p->next_frag, window_frags > 1 ? window_frags : 1);
+    sender_p->rtt_probe_time = now;
+  }
+}
+
+/* once every estimated RTT, sizes the receive buffer to twice what the
+ * application drained during that RTT (what Linux does for TCP rcvbuf),
+ * so a fast reader gets its window doubled every RTT up to the max.
+ * Growing is capped by the memory budget; while over budget, buffers
+ * that have drained enough are shrunk to what their reader needs.
+ */
+void autotune_window(sender_t *sender_p) {
+  long long now = now_usec();
+  int epoch_length = (sender_p->rtt_estimate > 0) ? sender_p->rtt_estimate : EXPECTED_RTT;
+  if (now - sender_p->epoch_start < epoch_length) { return; }
+  if (sender_p->bytes_borrowed > 0) { return; } // try again once the view is back
+
+  int wanted_size = 2 * sender_p->bytes_drained;
+  // whole payloads only, within [initial, max]
+  wanted_size = (wanted_size / MAX_MRT_PAYLOAD_LENGTH + 1) * MAX_MRT_PAYLOAD_LENGTH;
+  if (wanted_size < RECEIVER_INITIAL_WINDOW_SIZE) { wanted_size = RECEIVER_INITIAL_WINDOW_SIZE; }
+  if (wanted_size > RECEIVER_MAX_WINDOW_SIZE) { wanted_size = RECEIVER_MAX_WINDOW_SIZE; }
+  sender_p->bytes_drained = 0;
+  sender_p->epoch_start = now;
+
+  pthread_mutex_lock(&budget_lock);
+    long memory_free = memory_budget - memory_in_use;
+  pthread_mutex_unlock(&budget_lock);
+
+  if (wanted_size > sender_p->buffer_size) {
+    if (memory_free <= 0) { return; }
+    if (wanted_size - sender_p->buffer_size > memory_free) {
+      wanted_size = sender_p->buffer_size + (int)(memory_free / MAX_MRT_PAYLOAD_LENGTH) * MAX_MRT_PAYLOAD_LENGTH;
+    }
+    if (wanted_size > sender_p->buffer_size) {
+      buffer_resize(sender_p, wanted_size);
+    }
+  } else if (memory_free < 0 && wanted_size < sender_p->buffer_size) {
+    // under pressure; shrink as far as the unread bytes allow
+    if (wanted_size < sender_p->bytes_unread) {
+      wanted_size = (sender_p->bytes_unread / MAX_MRT_PAYLOAD_LENGTH + 1) * MAX_MRT_PAYLOAD_LENGTH;
+    }
+    if (wanted_size < sender_p->buffer_size) {
+      buffer_resize(sender_p, wanted_size);
+    }
+  }
+}
+
+/* replies to a DATA with ADAT, either now (into the batch) or within
+ * the sender's ack_delay; assumes that the sender's lock is held.
+ * Only to be called by the sender's shard handler.
+ */
+void acknowledge(shard_t *shard_p, sender_t *sender_p, int is_urgent, reply_batch_t *replies_p) {
+  char *reply_buffer;
+  int curr_window_size;
+
+  if (is_urgent || sender_p->ack_delay == 0) {
+    curr_window_size = sender_p->buffer_size - sender_p->bytes_unread;
+    reply_buffer = add_reply(replies_p, &(sender_p->addr), MRT_HEADER_LENGTH);
+    build_adat(reply_buffer, MRT_FRAG_ADD(sender_p->next_frag, -1), curr_window_size);
+    sender_p->last_advertised_window = curr_window_size;
+    stat_set(&(sender_p->counters.advertised_window), curr_window_size);
+    stat_add(&(sender_p->counters.adats_sent), 1);
+    TRACE(TRACE_ADAT_SENT, PORT_OF(&(sender_p->addr)), MRT_FRAG_ADD(sender_p->next_frag, -1), curr_window_size);
+    sender_p->unacked_frags = 0;
+    sender_p->is_ack_pending = 0; // flush_delayed_acks() will skip it
+  } else if (!sender_p->is_ack_pending) {
+    if (enq_q(shard_p->delayed_acks_q, sender_p) != 0) {
+      // out of memory; don't hold the ADAT back
+      acknowledge(shard_p, sender_p, 1, replies_p);
+      return;
+    }
+    sender_p->is_ack_pending = 1;
+    sender_p->ack_due_time = now_usec() + sender_p->ack_delay;
+    if (shard_p->next_ack_due_time == 0 || sender_p->ack_due_time < shard_p->next_ack_due_time) {
+      shard_p->next_ack_due_time = sender_p->ack_due_time;
+    }
+  }
+}
+
+/* sends the delayed ADATs that are due and recomputes when the next
+ * one is; entries whose ADAT already went out are dropped.
+ */
+void flush_delayed_acks(shard_t *shard_p, reply_batch_t *replies_p) {
+  long long curr_time = now_usec();
+  sender_t *curr_sender;
+  q_t *still_delayed_q = shard_p->spare_q;
+
+  if (shard_p->next_ack_due_time == 0 || curr_time < shard_p->next_ack_due_time) { return; }
+  shard_p->next_ack_due_time = 0;
+  while ((curr_sender = (sender_t *)deq_q(shard_p->delayed_acks_q)) != NULL) {
+    pthread_mutex_lock(&(curr_sender->lock));
+      if (curr_sender->is_ack_pending) {
+        if (curr_sender->ack_due_time <= curr_time) {
+          acknowledge(shard_p, curr_sender, 1, replies_p);
+        } else {
+          enq_q(still_delayed_q, curr_sender);
+          if (shard_p->next_ack_due_time == 0 || curr_sender->ack_due_time < shard_p->next_ack_due_time) {
+            shard_p->next_ack_due_time = curr_sender->ack_due_time;
+          }
+        }
+      }
+    pthread_mutex_unlock(&(curr_sender->lock));
+  }
+  shard_p->spare_q = shard_p->delayed_acks_q; // now empty
+  shard_p->delayed_acks_q = still_delayed_q;
+}
+
+/* whether the application has read enough to warrant an ADAT of its
+ * own, i.e. the window opened by at least half of the buffer since 
+ * it was last advertised; assumes that the sender's lock is held.
+ */
+int is_window_update_due(sender_t *sender_p) {
+  int curr_window_size = sender_p->buffer_size - sender_p->bytes_unread;
+  return curr_window_size - sender_p->last_advertised_window >= sender_p->buffer_size / 2;
+}
+
+/* zeroes the counters and sets the gauges to a new sender's values.
+ */
+void reset_counters(receiver_counters_t *counters_p) {
+  atomic_store(&(counters_p->bytes_received), 0);
+  atomic_store(&(counters_p->bytes_read), 0);
+  atomic_store(&(counters_p->frags_received), 0);
+  atomic_store(&(counters_p->frags_out_of_order), 0);
+  atomic_store(&(counters_p->frags_window_full), 0);
+  atomic_store(&(counters_p->frags_duplicate), 0);
+  atomic_store(&(counters_p->adats_sent), 0);
+  atomic_store(&(counters_p->checksum_failures), 0);
+  atomic_store(&(counters_p->usec_blocked), 0);
+  atomic_store(&(counters_p->bytes_replied), 0);
+  atomic_store(&(counters_p->acks_piggybacked), 0);
+  atomic_store(&(counters_p->frags_skipped), 0);
+  atomic_store(&(counters_p->bytes_discarded), 0);
+  atomic_store(&(counters_p->buffer_size), RECEIVER_INITIAL_WINDOW_SIZE);
+  atomic_store(&(counters_p->advertised_window), RECEIVER_INITIAL_WINDOW_SIZE);
+  atomic_store(&(counters_p->rtt_usec), 0);
+  atomic_store(&(counters_p->is_shared_memory), 0);
+}
+
+/* counts a payload that was not buffered by why; assumes that the
+ * sender's lock is held.
+ */
+void count_dropped(sender_t *sender_p, int frag) {
+  if (MRT_FRAG_DIFF(frag, sender_p->next_frag) < 0) {
+    stat_add(&(sender_p->counters.frags_duplicate), 1);
+    TRACE(TRACE_DATA_DROPPED, PORT_OF(&(sender_p->addr)), frag, TRACE_DROP_DUPLICATE);
+  } else if (frag == sender_p->next_frag) {
+    stat_add(&(sender_p->counters.frags_window_full), 1);
+    TRACE(TRACE_DATA_DROPPED, PORT_OF(&(sender_p->addr)), frag, TRACE_DROP_WINDOW_FULL);
+  } else {
+    stat_add(&(sender_p->counters.frags_out_of_order), 1);
+    TRACE(TRACE_DATA_DROPPED, PORT_OF(&(sender_p->addr)), frag, TRACE_DROP_OUT_OF_ORDER);
+  }
+}
+
+/* takes in an acknowledgement of DATA sent back by mrt_reply(),
+ * whether it came in an ADAT or rode on a DATA, and wakes the replier
+ * up; assumes that the sender's lock is held.
+ */
+void handle_reply_ack(sender_t *sender_p, int frag, int window_size) {
+  TRACE(TRACE_ADAT_RECEIVED, PORT_OF(&(sender_p->addr)), frag, window_size);
+  if (MRT_FRAG_DIFF(frag, sender_p->reply_acked_frag) < 0) { return; } // an old one, overtaken
+  sender_p->reply_acked_frag = frag;
+  sender_p->reply_window = window_size;
+  pthread_cond_signal(&(sender_p->reply_cvar));
+}
+
+/* builds a DATA carrying `payload` back to the sender in
+ * `outgoing_buffer`, with the ADAT for what was received so far riding
+ * along (which makes any pending one unnecessary); returns the length
+ * of the transmission. Assumes that the sender's lock is held.
+ */
+int build_reply(sender_t *sender_p, char *outgoing_buffer, int frag, const char *payload, int payload_len) {
+  int flags = MRT_FLAG_ACK;
+  int received_frag = MRT_FRAG_ADD(sender_p->next_frag, -1);
+  int curr_window_size = sender_p->buffer_size - sender_p->bytes_unread;
+
+  memmove(outgoing_buffer + MRT_TYPE_LOCATION, &data_type, MRT_TYPE_LENGTH);
+  memmove(outgoing_buffer + MRT_FRAGMENT_LOCATION, &frag, MRT_FRAGMENT_LENGTH);
+  memmove(outgoing_buffer + MRT_FLAGS_LOCATION, &flags, MRT_FLAGS_LENGTH);
+  memmove(outgoing_buffer + MRT_ACK_FRAGMENT_LOCATION, &received_frag, MRT_FRAGMENT_LENGTH);
+  memmove(outgoing_buffer + MRT_ACK_WINDOWSIZE_LOCATION, &curr_window_size, MRT_WINDOWSIZE_LENGTH);
+  memmove(outgoing_buffer + MRT_HEADER_LENGTH + MRT_ACK_LENGTH, payload, payload_len);
+  int len = MRT_HEADER_LENGTH + MRT_ACK_LENGTH + payload_len;
+  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH, len - MRT_HASH_LENGTH);
+  memmove(outgoing_buffer, &hash_holder, MRT_HASH_LENGTH);
+
+  // an ADAT was due (or about to be); this one does instead
+  if (sender_p->unacked_frags > 0 || sender_p->is_ack_pending) {
+    stat_add(&(sender_p->counters.acks_piggybacked), 1);
+  }
+  sender_p->last_advertised_window = curr_window_size;
+  stat_set(&(sender_p->counters.advertised_window), curr_window_size);
+  sender_p->unacked_frags = 0;
+  sender_p->is_ack_pending = 0; // flush_delayed_acks() will skip it
+  TRACE(TRACE_DATA_SENT, PORT_OF(&(sender_p->addr)), frag, payload_len);
+  return len;
+}
+
+/* marks the sender readable for mrt_eventfd() and mrt_poll() users;
+ * assumes that the sender's lock is held.
+ */
+void notify_ready(sender_t *sender_p) {
+  if (sender_p->eventfd >= 0) { eventfd_write(sender_p->eventfd, 1); }
+  notify_pollers();
+}
+
+// wakes up every mrt_poll() waiting for a change
+void notify_pollers() {
+  pthread_mutex_lock(&poll_lock);
+    poll_seq += 1;
+    pthread_cond_broadcast(&poll_cvar);
+  pthread_mutex_unlock(&poll_lock);
+}
+
+// resets an eventfd made with EFD_NONBLOCK to unreadable
+void drain_eventfd(int fd) {
+  eventfd_t value;
+  eventfd_read(fd, &value);
+}
+
+/* callback for mrt_poll(); adds the sender to the collector's events
+ * if it is ready and there is room left.
+ */
+void collect_events(void *sender_vp, void *collector_vp) {
+  sender_t *sender_p = (sender_t *)sender_vp;
+  event_collector_t *collector_p = (event_collector_t *)collector_vp;
+  int events = 0;
+  if (collector_p->num_events == collector_p->max_events) { return; }
+
+  pthread_mutex_lock(&(sender_p->lock));
+    if (!sender_p->is_accepted) {
+      // (unless mrt_accept1() gave up on it)
+      if (!sender_p->is_end_reported) { events = MRT_POLLPENDING; }
+    } else {
+      if (unread_anywhere(sender_p) > 0) { events |= MRT_POLLIN; }
+      if (sender_p->inactive_time > TIMEOUT_THRESHOLD) {
+        // a drained connection is only reported over once; then it can go
+        if (events != 0 || !sender_p->is_end_reported) { events |= MRT_POLLHUP; }
+        if (events == MRT_POLLHUP) {
+          sender_p->is_end_reported = 1;
+          wake_handler(sender_p->shard_p);
+        }
+      }
+    }
+  pthread_mutex_unlock(&(sender_p->lock));
+
+  if (events != 0) {
+    mrt_event_t *event_p = &(collector_p->events[collector_p->num_events++]);
+    memmove(&(event_p->id), &(sender_p->addr), addr_len);
+    event_p->events = events;
+  }
+}
+
+/* sets `deadline_p` to `usec` microseconds from now, for
+ * pthread_cond_timedwait()
+ */
+void deadline_after(struct timespec *deadline_p, int usec) {
+  clock_gettime(CLOCK_REALTIME, deadline_p);
+  deadline_p->tv_nsec += (long)usec * 1000;
+  deadline_p->tv_sec += deadline_p->tv_nsec / 1000000000;
+  deadline_p->tv_nsec %= 1000000000;
+}
+
 /* returns 1 if the sender's addr matches
  * the input addr (byte by byte with memcmp()); returns 0 otherwise
  *
@@ -483,50 +2643,146 @@ int sender_matcher(void *sender_vp, void *id_vp) {
 void probe_for_one(void *id_vp, void *target_id_vpp) {
   struct sockaddr_in **target_id_pp = (struct sockaddr_in  **)target_id_vpp;
   struct sockaddr_in  *target_id_p  = *target_id_pp;
-  if (target_id_p != NULL) {
+  if (target_id_p == NULL) {
     struct sockaddr_in *id_p = (struct sockaddr_in  *)id_vp;
-    sender_t *curr_sender;
-    pthread_mutex_lock(&q_lock);
-      curr_sender = get_item_q(connected_senders_q, sender_matcher, id_p);
-      if (curr_sender != NULL && curr_sender->bytes_unread > 0) {
-        target_id_p = malloc(addr_len);
-        memmove(target_id_p, id_p, addr_len);
+    sender_t *curr_sender = lock_accepted_sender(id_p);
+    if (curr_sender != NULL) {
+      if (unread_anywhere(curr_sender) > 0) {
+        *target_id_pp = malloc(addr_len);
+        memmove(*target_id_pp, id_p, addr_len);
       }
       // otherwise a mismatch; do nothing.
-    pthread_mutex_unlock(&q_lock);
+      pthread_mutex_unlock(&(curr_sender->lock));
+    }
   }
   // otherwise the target is already found; do nothing.
 }
 
+/* queues a reply of `len` bytes to `addr_p` and returns the buffer
+ * it should be built in; a full batch is sent out first (delayed
+ * ADATs can outnumber the received transmissions).
+ */
+char *add_reply(reply_batch_t *replies_p, struct sockaddr_in *addr_p, int len) {
+  int i;
+  if (replies_p->num_replies == RECEIVER_BATCH_SIZE) { send_replies(replies_p); }
+  i = replies_p->num_replies++;
+  memmove(&(replies_p->addrs[i]), addr_p, addr_len);
+  replies_p->iovecs[i].iov_base = replies_p->buffers[i];
+  replies_p->iovecs[i].iov_len = len;
+  replies_p->msgs[i].msg_hdr.msg_iov = &(replies_p->iovecs[i]);
+  replies_p->msgs[i].msg_hdr.msg_iovlen = 1;
+  replies_p->msgs[i].msg_hdr.msg_name = &(replies_p->addrs[i]);
+  replies_p->msgs[i].msg_hdr.msg_namelen = addr_len;
+  return replies_p->buffers[i];
+}
+
+/* sends all the queued replies, as few sendmmsg() calls as possible
+ * (or with one submission to the ring, if there is one); replies that
+ * cannot be sent are dropped (the sender will retry).
+ */
+void send_replies(reply_batch_t *replies_p) {
+  int num_sent = 0, num_sent_total = 0;
+  if (replies_p->ring_p != NULL && replies_p->num_replies > 0) {
+    for (int i = 0; i < replies_p->num_replies; i++) {
+      mrt_uring_send(replies_p->ring_p, replies_p->sockfd, &(replies_p->msgs[i].msg_hdr), MRT_URING_TAG_NONE);
+    }
+    // the sends are done by the time it returns, so the buffers can be reused
+    mrt_uring_submit(replies_p->ring_p, 0, 0);
+    replies_p->num_replies = 0;
+    return;
+  }
+  while (num_sent_total < replies_p->num_replies) {
+    num_sent = sendmmsg(replies_p->sockfd, replies_p->msgs + num_sent_total,
+      replies_p->num_replies - num_sent_total, 0);
+    if (num_sent <= 0) { break; }
+    num_sent_total += num_sent;
+  }
+  replies_p->num_replies = 0;
+}
+
 // the build_x() functions assume that memmove() always succeeds
-void build_acon(int initial_frag) {
+// (an ACON echoes the token of a ring that was taken; returns its length)
+int build_acon(char *outgoing_buffer, int initial_frag, mrt_shm_t *shm_p) {
+  int len = MRT_HEADER_LENGTH;
   memmove(outgoing_buffer + MRT_TYPE_LOCATION, &acon_type, MRT_TYPE_LENGTH);
   memmove(outgoing_buffer + MRT_FRAGMENT_LOCATION, &initial_frag, MRT_FRAGMENT_LENGTH);
   /* note that senders ignore ACONs beyond the first one, so the advertised
    * window size here can stay the same as the initial window size
    */
   memmove(outgoing_buffer + MRT_WINDOWSIZE_LOCATION, &initial_window_size, MRT_WINDOWSIZE_LENGTH);
+  if (shm_p != NULL) {
+    memmove(outgoing_buffer + MRT_SHM_TOKEN_LOCATION, &(shm_p->token), MRT_SHM_TOKEN_LENGTH);
+    len += MRT_SHM_TOKEN_LENGTH;
+  }
   
-  outgoing_buffer[MRT_HEADER_LENGTH] = '\0';
-  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH);
+  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH, len - MRT_HASH_LENGTH);
   memmove(outgoing_buffer, &hash_holder, MRT_HASH_LENGTH);
+  return len;
 }
 
-void build_adat(int received_frag, int curr_window_size) {
+void build_adat(char *outgoing_buffer, int received_frag, int curr_window_size) {
   memmove(outgoing_buffer + MRT_TYPE_LOCATION, &adat_type, MRT_TYPE_LENGTH);
   memmove(outgoing_buffer + MRT_FRAGMENT_LOCATION, &received_frag, MRT_FRAGMENT_LENGTH);
   memmove(outgoing_buffer + MRT_WINDOWSIZE_LOCATION, &curr_window_size, MRT_WINDOWSIZE_LENGTH);
   
-  outgoing_buffer[MRT_HEADER_LENGTH] = '\0';
-  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH);
+  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH, MRT_HEADER_LENGTH - MRT_HASH_LENGTH);
   memmove(outgoing_buffer, &hash_holder, MRT_HASH_LENGTH);
 }
 
-void build_acls() {
+// an ADAT for one of the streams but the first, which it names after the header
+void build_stream_adat(char *outgoing_buffer, int stream, int received_frag, int curr_window_size) {
+  memmove(outgoing_buffer + MRT_TYPE_LOCATION, &adat_type, MRT_TYPE_LENGTH);
+  memmove(outgoing_buffer + MRT_FRAGMENT_LOCATION, &received_frag, MRT_FRAGMENT_LENGTH);
+  memmove(outgoing_buffer + MRT_WINDOWSIZE_LOCATION, &curr_window_size, MRT_WINDOWSIZE_LENGTH);
+  memmove(outgoing_buffer + MRT_STREAM_LOCATION, &stream, MRT_STREAM_LENGTH);
+
+  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH,
+    MRT_HEADER_LENGTH + MRT_STREAM_LENGTH - MRT_HASH_LENGTH);
+  memmove(outgoing_buffer, &hash_holder, MRT_HASH_LENGTH);
+}
+
+void build_acls(char *outgoing_buffer) {
   memmove(outgoing_buffer + MRT_TYPE_LOCATION, &acls_type, MRT_TYPE_LENGTH);
   
-  outgoing_buffer[MRT_HASH_LENGTH + MRT_TYPE_LENGTH] = '\0';
-  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH);
+  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH, MRT_TYPE_LENGTH);
   memmove(outgoing_buffer, &hash_holder, MRT_HASH_LENGTH);
 }
 
+/* a COOK answers an RCON from an unknown sender with the cookie it
+ * must echo; the fragment is echoed as well
+ */
+void build_cook(char *outgoing_buffer, int initial_frag, unsigned int cookie) {
+  memmove(outgoing_buffer + MRT_TYPE_LOCATION, &cook_type, MRT_TYPE_LENGTH);
+  memmove(outgoing_buffer + MRT_FRAGMENT_LOCATION, &initial_frag, MRT_FRAGMENT_LENGTH);
+  memmove(outgoing_buffer + MRT_COOKIE_LOCATION, &cookie, MRT_COOKIE_LENGTH);
+
+  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH, MRT_HEADER_LENGTH - MRT_HASH_LENGTH);
+  memmove(outgoing_buffer, &hash_holder, MRT_HASH_LENGTH);
+}
+
+/* the cookie for a sender's RCON during the given COOKIE_PERIOD: a
+ * keyed hash of its address, port and initial fragment; never 0
+ * (which RCONs use for "no cookie yet").
+ */
+unsigned int make_cookie(struct sockaddr_in *addr_p, int initial_frag, long long period) {
+  unsigned long long x = cookie_secret;
+  x = mix64(x ^ ((unsigned long long)addr_p->sin_addr.s_addr << 16 | addr_p->sin_port));
+  x = mix64(x ^ (unsigned int)initial_frag);
+  x = mix64(x ^ (unsigned long long)period);
+  return (unsigned int)(x >> 32) | 1;
+}
+
+// cookies from this and the previous COOKIE_PERIOD are accepted
+int is_cookie_valid(struct sockaddr_in *addr_p, int initial_frag, unsigned int cookie) {
+  long long period = now_usec() / COOKIE_PERIOD;
+  if (cookie == 0) { return 0; }
+  return cookie == make_cookie(addr_p, initial_frag, period) ||
+    cookie == make_cookie(addr_p, initial_frag, period - 1);
+}
+
+// the splitmix64 finalizer; scrambles all 64 bits
+unsigned long long mix64(unsigned long long x) {
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
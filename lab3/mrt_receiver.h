@@ -8,19 +8,86 @@
 #ifndef _mrt_receiver_h
 #define _mrt_receiver_h
 
+#include <netinet/in.h> // struct sockaddr_in
 #include "Queue.h"  // q_t
 
-#define RECEIVER_MAX_WINDOW_SIZE (MAX_MRT_PAYLOAD_LENGTH * 5)
+/* each connection's receive buffer starts at the initial size and is
+ * grown (up to the max) as the application proves it drains it quickly,
+ * as long as all buffers together stay within the memory budget.
+ */
+#define RECEIVER_INITIAL_WINDOW_SIZE    (MAX_MRT_PAYLOAD_LENGTH * 5)
+#define RECEIVER_MAX_WINDOW_SIZE        (MAX_MRT_PAYLOAD_LENGTH * 1024)
+#define RECEIVER_DEFAULT_MEMORY_BUDGET  (64L * 1024 * 1024)
+
+// connection requests waiting for mrt_accept1(), at most
+#define RECEIVER_DEFAULT_BACKLOG        128
+
+/* connections that are over but still have unread bytes (or whose end
+ * the application has not seen yet) are kept readable, at most this
+ * many; past it the least recently read ones are dropped.
+ */
+#define RECEIVER_DEFAULT_RETENTION      64
+
+/* by default an ADAT is sent for every other in-order fragment, and no
+ * later than the delay (microseconds) after the oldest unacknowledged
+ * DATA; gaps, PUSH fragments and window openings are ADAT'd at once.
+ */
+#define RECEIVER_DEFAULT_ACK_EVERY      2
+#define RECEIVER_DEFAULT_ACK_DELAY      (EXPECTED_RTT / 5)
+
+/* readiness reported by mrt_poll(), OR'ed together in `events`
+ */
+#define MRT_POLLIN       1 // has unread bytes (on some stream; see mrt_receive_stream())
+#define MRT_POLLHUP      2 // the connection is over (unread bytes remain readable)
+#define MRT_POLLPENDING  4 // a connection request waits for mrt_accept1()
+
+typedef struct mrt_event {
+  struct sockaddr_in id; // a copy; pass &id to mrt_receive1() etc.
+  int events;
+} mrt_event_t;
+
+/* what mrt_receiver_stats() reports for a connection; counts are since
+ * the connection request, sizes are in bytes and times in microseconds
+ */
+typedef struct mrt_receiver_stats {
+  long long bytes_received;     // payloads buffered in order
+  long long bytes_read;         // by the application, in any of the ways
+  long long frags_received;     // buffered in order
+  long long frags_out_of_order; // dropped for a gap before them
+  long long frags_window_full;  // in order, but dropped for want of room
+  long long frags_duplicate;    // received before (their ADAT got lost)
+  long long adats_sent;
+  long long checksum_failures;  // transmissions dropped for a bad hash
+  long long usec_blocked;       // waiting for data in mrt_receive1() etc.
+  long long bytes_replied;      // sent back with mrt_reply() and acknowledged
+  long long acks_piggybacked;   // ADATs that rode on a reply instead of going alone
+  long long frags_skipped;      // abandoned by the sender (see mrt_send_message())
+  long long bytes_discarded;    // of messages partly received before being abandoned
+  int buffer_size;              // the receive buffer, as autotuned
+  int advertised_window;        // in the last ADAT
+  int rtt_usec;                 // the estimate; 0 until the first sample
+  int is_shared_memory;         // 1 if the sender's bytes come through a ring it shared (see mrt.h)
+} mrt_receiver_stats_t;
 
 /* will create the main thread that handles all incoming transmissions
  * returns -1 upon any error and 0 upon success.
  */
 int mrt_open(unsigned int port_number);
 
+/* like mrt_open(), but binds `num_shards` sockets to the same port
+ * with SO_REUSEPORT, each handled by its own thread with its own
+ * sender table; the kernel spreads the senders across the shards.
+ * The rest of the API works the same regardless of the shard count.
+ * returns -1 upon any error and 0 upon success.
+ */
+int mrt_open_sharded(unsigned int port_number, int num_shards);
+
 /* accepts a connection request and returns a pointer to a copy of
  * its ID struct (currently reusing `sockaddr_in`). 
  * If no requests exist yet, will block and wait until one shows up,
- * and then accept it.
+ * and then accept it; returns NULL if mrt_close() is called meanwhile,
+ * or if the request has to be given up on (its threads cannot be
+ * created; the sender will ask again).
  * the sender is responsible for freeing the ID struct.
  */
 struct sockaddr_in *mrt_accept1();
@@ -44,10 +111,81 @@ q_t *mrt_accept_all();
  * the connection times out without having received any bytes yet
  * 
  * Returns -1 if the call is spurious (connection not accepted yet,
- * mrt_open() not even called yet, etc.)
+ * mrt_open() not even called yet, etc.), which includes connections
+ * that are over and already reclaimed: once mrt_receive1() (or
+ * mrt_borrow(), or mrt_poll()'s lone MRT_POLLHUP) has reported the end,
+ * or once dropped under the retention cap (see mrt_set_retention()) or
+ * for a new connection from the same address.
  */
 int mrt_receive1(struct sockaddr_in *id_p, void *buffer, int len);
 
+/* Like mrt_receive1(), but for a connection whose sender uses
+ * mrt_send_message(): moves exactly one whole message to `buffer`,
+ * waiting until there is one. A message longer than `len` is cut
+ * short (the rest is discarded). Messages the sender abandoned never
+ * show up; what arrived of them is discarded.
+ *
+ * Readiness (mrt_poll(), mrt_eventfd()) counts bytes, so it may be
+ * reported while only part of a message is there. Bytes sent with
+ * mrt_send() on the same connection are not told apart from messages;
+ * read those with mrt_receive1() instead.
+ *
+ * Returns the number of bytes written, and 0 or -1 like mrt_receive1().
+ */
+int mrt_receive_message(struct sockaddr_in *id_p, void *buffer, int len);
+
+/* Like mrt_receive1(), but on one of the connection's streams (see
+ * mrt.h and mrt_send_stream()); stream 0 is the one mrt_receive1()
+ * and the rest read. Waits only for bytes on this stream, so a
+ * fragment lost on another does not hold it up. Different streams may
+ * be read by different threads at the same time.
+ *
+ * Readiness (mrt_poll(), mrt_eventfd()) counts the bytes of all the
+ * streams. The connection is reclaimed once its end is reported with
+ * no bytes left on any stream.
+ *
+ * Returns the number of bytes written, and 0 or -1 like mrt_receive1()
+ * (-1 for a `stream` out of range, too).
+ */
+int mrt_receive_stream(struct sockaddr_in *id_p, int stream, void *buffer, int len);
+
+/* Like mrt_receive1(), but without the copy: sets `*view_pp` to the
+ * oldest unread bytes, in place in the connection's receive buffer,
+ * and returns how many of them there are (the view stops at the end of
+ * the buffer; the rest comes with the next borrow). Will block and
+ * wait until there is data.
+ *
+ * The view is read-only and stays valid until mrt_release() (or 
+ * mrt_close()); until then mrt_receive1() and mrt_borrow() on the same
+ * connection return -1.
+ *
+ * Returns 0 under the same conditions as mrt_receive1(), and -1 if
+ * the call is spurious or a view is already borrowed.
+ */
+int mrt_borrow(struct sockaddr_in *id_p, const void **view_pp);
+
+/* Returns the view lent by mrt_borrow(), of which the first `len`
+ * bytes are consumed and credited back to the window (the rest will
+ * be lent or received again).
+ *
+ * Returns 0 on success and -1 if the call is spurious (nothing 
+ * borrowed, `len` larger than the view, etc.)
+ */
+int mrt_release(struct sockaddr_in *id_p, int len);
+
+/* Drains the connection into the file descriptor `fd` (a file, pipe,
+ * socket...) until the connection is over, writing everything unread
+ * at once with writev() straight from the receive buffer, as the data
+ * comes in. `fd` should be blocking. Blocks until the end, like a
+ * loop of mrt_receive1() until it returns 0.
+ *
+ * Returns the number of bytes written once the connection is over.
+ * Returns -1 if the call is spurious (as for mrt_borrow()) or if 
+ * writing fails (with errno set by writev(); the bytes not written
+ * remain readable).
+ */
+long long mrt_receive_to_fd(struct sockaddr_in *id_p, int fd);
+
 /* Returns the first connection that has some unread bytes
  * found in input queue.
  *
@@ -58,7 +196,135 @@ int mrt_receive1(struct sockaddr_in *id_p, void *buffer, int len);
  */
 struct sockaddr_in *mrt_probe(q_t *probe_q);
 
-/* the actual logic is handled in main_handler()...
+/* Fills `events` with up to `max_events` connections that are ready:
+ * accepted ones with unread bytes (MRT_POLLIN) or that are over
+ * (MRT_POLLHUP; reported with MRT_POLLIN while bytes remain, and once
+ * more alone after they are drained), and pending ones
+ * (MRT_POLLPENDING; call mrt_accept1() once for each, which won't block).
+ *
+ * Waits up to `timeout` microseconds for one to be ready (forever if
+ * negative; not at all if 0).
+ *
+ * Returns the number of events filled in (0 on timeout or if the
+ * receiver is closed), or -1 if the call is spurious.
+ */
+int mrt_poll(mrt_event_t *events, int max_events, int timeout);
+
+/* Returns an eventfd (see eventfd(2)) that is readable while the
+ * accepted connection has unread bytes or is over, for applications
+ * that wait with their own poll()/epoll next to other descriptors.
+ * Reading it is not necessary; the module clears it when the
+ * connection is drained. The fd belongs to the module and stays valid
+ * until the connection is reclaimed (see mrt_receive1()) or
+ * mrt_close(); do not close() it.
+ *
+ * Returns -1 if the call is spurious or eventfd() fails.
+ */
+int mrt_eventfd(struct sockaddr_in *id_p);
+
+/* like mrt_eventfd(), but readable while connection requests are
+ * pending (i.e. while mrt_accept1() would not block).
+ * Returns -1 if mrt_open() was not called.
+ */
+int mrt_accept_eventfd();
+
+/* Sends `len` bytes from `buffer` back to the sender over the same
+ * connection, reliably and in order; the sender reads them with its
+ * mrt_receive(). Blocks until all of them are acknowledged.
+ *
+ * Every DATA sent back carries the ADAT for what was received so far,
+ * so a request answered within the ack delay (see mrt_set_ack_policy())
+ * costs no ADAT of its own. Only one mrt_reply() at a time per
+ * connection; it may run while another thread reads.
+ *
+ * Returns 1 once everything is acknowledged, 0 if the connection is
+ * over before that (or the receiver is closed), and -1 if the call is
+ * spurious (connection not accepted, another mrt_reply() running,
+ * etc.)
+ */
+int mrt_reply(struct sockaddr_in *id_p, const void *buffer, int len);
+
+/* tunes when ADATs are sent for an accepted connection: after every
+ * `ack_every` in-order fragments, and at most `max_delay` microseconds
+ * after the oldest unacknowledged DATA. `ack_every` = 1 and 
+ * `max_delay` = 0 acknowledge every DATA right away.
+ *
+ * Returns 0 on success and -1 if the call is spurious.
+ */
+int mrt_set_ack_policy(struct sockaddr_in *id_p, int ack_every, int max_delay);
+
+/* copies the connection's statistics into `*stats_p`. Works for
+ * pending connections too, and for those that are over until they are
+ * reclaimed. The counters are kept all the time and read without
+ * blocking the connection, so this can be called as often as wanted;
+ * they are not read at one instant, though, so they may be off by the
+ * transmission being handled.
+ *
+ * Returns 0 on success and -1 if no such connection exists.
+ */
+int mrt_receiver_stats(struct sockaddr_in *id_p, mrt_receiver_stats_t *stats_p);
+
+/* caps the memory all receive buffers may use together (the default
+ * is RECEIVER_DEFAULT_MEMORY_BUDGET bytes). Buffers stop growing when
+ * the budget is reached and shrink back as they drain while the total
+ * is over it. Can be called at any time.
+ */
+void mrt_set_memory_budget(long num_bytes);
+
+/* caps the number of connection requests waiting for mrt_accept1()
+ * (RECEIVER_DEFAULT_BACKLOG by default); further requests are dropped
+ * until some are accepted, and their senders keep retrying.
+ * Can be called at any time.
+ */
+void mrt_set_backlog(int max_pending);
+
+/* caps the number of connections kept after they are over for their
+ * unread bytes (RECEIVER_DEFAULT_RETENTION by default; split evenly
+ * between the shards). Past it, the least recently read ones are
+ * reclaimed with whatever they still hold. Connections whose end the
+ * application has seen are reclaimed right away regardless.
+ * Can be called at any time.
+ */
+void mrt_set_retention(int max_closed);
+
+/* picks how the shards drive their sockets from the next mrt_open() on:
+ * MRT_IO_SOCKETS (the default) waits with ppoll() and moves batches
+ * with recvmmsg() and sendmmsg(); MRT_IO_URING has each shard keep one
+ * multishot receive going on an io_uring (see mrt_uring.h), so that
+ * datagrams land in the ring's own buffers without a system call each,
+ * and sends its replies through the same ring.
+ *
+ * Returns the engine in effect: MRT_IO_SOCKETS if io_uring was asked
+ * for but the kernel cannot do it. A shard whose ring cannot be set up
+ * (or fails later on) falls back to MRT_IO_SOCKETS on its own.
+ */
+int mrt_set_io_engine(int engine);
+
+/* turns the low-latency profile on (`is_on` = 1) or off (the default):
+ * instead of sleeping until woken, the shards' handlers keep polling
+ * their sockets without blocking, and mrt_receive1() (and the other
+ * reads) and mrt_reply() keep looking for what they wait for, each
+ * burning a CPU meanwhile. If `usec` is positive, the shards' sockets
+ * also busy-poll the device queue for that long on each receive
+ * (SO_BUSY_POLL). If `num_cpus` is positive, shard i's handler is
+ * pinned to `cpus[i % num_cpus]` (at most MRT_MAX_PINNED_CPUS of them).
+ *
+ * The handlers take it up from the next mrt_open() on, and spinning
+ * takes the place of io_uring (see mrt_set_io_engine()); the readers
+ * take it up right away.
+ *
+ * Returns 0 on success and -1 if the CPUs are not valid.
+ */
+int mrt_set_busy_poll(int is_on, int usec, const int *cpus, int num_cpus);
+
+/* closes every connection and the socket(s): wakes the handlers at
+ * once (without waiting for a datagram), which wake and join every
+ * connection's threads and free them; returns once all of it is done,
+ * after which mrt_open() may be called again. Calls blocked in the rest
+ * of the API return as if their connections were over, and a
+ * connection is only freed once every call waiting on it has let go
+ * (mrt_receive_to_fd() finishing its writev() first); calls made
+ * meanwhile, from any thread, find no connection rather than a freed one.
  */
 void mrt_close();
 
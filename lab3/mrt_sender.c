@@ -7,12 +7,17 @@
 // the following two includes are necessary for usleep()
 #define _XOPEN_SOURCE   600
 #define _POSIX_C_SOURCE 200112L
+// and this one for SO_BUSY_POLL
+#define _DEFAULT_SOURCE
 
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h> // exit(), calloc(), free()
 #include <unistd.h> // close(), usleep()
+#include <errno.h> // ETIMEDOUT
+#include <time.h> // clock_gettime()
 #include <sys/socket.h>
+#include <sys/eventfd.h>
 #include <arpa/inet.h> // htons()
 #include <pthread.h>
 
@@ -20,17 +25,99 @@
 #include "mrt_sender.h"
 #include "Queue.h"
 #include "utilities.h" // hash()
+#include "mrt_trace.h"
+#include "mrt_shm.h"
+#include "mrt_uring.h"
 
 #define RCON_PERIOD               EXPECTED_RTT * 2
+#define RCON_MAX_PERIOD           RCON_PERIOD * 16 // RCONs no COOK answered back off up to this
 #define EMPTY_DATA_PERIOD         EXPECTED_RTT * 2
+#define WINDOW_WAIT_PERIOD        EXPECTED_RTT / 20 // buffered but not within the window
 #define MRT_SEND_PERIOD           EXPECTED_RTT * 2
-#define MRT_DISCONNECT_PERIOD     EXPECTED_RTT * 4
 #define RESEND_TIMEOUT_THRESHOLD  EMPTY_DATA_PERIOD * 3
 #define CLOSE_TIMEOUT_INCREMENT   EMPTY_DATA_PERIOD * 2 // timeout increment
 #define CLOSE_TIMEOUT_THRESHOLD   CLOSE_TIMEOUT_INCREMENT * 3
-#define MAX_PAYLOADS_BUFFERABLE   10
+#define MAX_PAYLOADS_BUFFERABLE   64
+#define STREAM_PAYLOADS_BUFFERABLE  (MRT_STREAM_WINDOW_SIZE / MAX_MRT_PAYLOAD_LENGTH) // for the other streams
+#define STREAM_PASS_SCALE         4096 // see pick_stream()
+#define REPLY_ACK_DELAY           EXPECTED_RTT / 5 // for the ADAT of the receiver's DATA to find a DATA to ride on
+#define MRT_RECEIVE_PERIOD        EXPECTED_RTT * 2 // longest wait for the receiver's DATA before re-checking
+#define PORT_OF(conn_p)           ntohs((conn_p)->send_addr.sin_port) // what names a connection in the trace
+#define RING_ENTRIES              256 // receives (re-)armed, cancellations, and the wake-up poll per round
+#define RING_BUFFERS              256 // ADATs (and replies) the ring can hold before they are handled
+#define RING_TAG_WAKE             0   // no connection's address
+// the first fragment is numbered one past it; set (-D) near 2^31 or 2^32 to test wraparound
+#ifndef SENDER_INITIAL_FRAG
+#define SENDER_INITIAL_FRAG       0
+#endif
+// set (-D) to 0 to keep connections on the same host on UDP, too
+#ifndef SENDER_SHARED_MEMORY
+#define SENDER_SHARED_MEMORY      1
+#endif
 
 /****** declarations ******/
+
+/* the counters behind mrt_stats(); each has one writer at a time (see
+ * stat_add()) and is read without any of the connection's locks
+ */
+typedef struct sender_counters {
+  _Atomic long long bytes_sent;
+  _Atomic long long bytes_acked;
+  _Atomic long long frags_sent;
+  _Atomic long long frags_retransmitted;
+  _Atomic long long empty_data_sent;
+  _Atomic long long duplicate_adats;
+  _Atomic long long checksum_failures;
+  _Atomic long long window_stalls;
+  _Atomic long long usec_blocked;
+  _Atomic long long bytes_received;
+  _Atomic long long adats_sent;
+  _Atomic long long acks_piggybacked;
+  _Atomic long long messages_sent;
+  _Atomic long long messages_abandoned;
+  _Atomic long long frags_abandoned;
+  _Atomic long long skips_sent;
+  _Atomic int receiver_window;
+  _Atomic int rtt_usec;
+  _Atomic int is_shared_memory;
+} sender_counters_t;
+
+/* how a handshake ended, until mrt_connect() or mrt_connect_next()
+ * takes it
+ */
+typedef struct connect_outcome {
+  int id;
+  int is_established; // 0 if given up on past its deadline
+  int is_async; // from mrt_connect_start(), for mrt_connect_next()
+} connect_outcome_t;
+
+/* what mrt_send_message() adds to a buffered payload; all zeroes for
+ * mrt_send()'s, which never expire
+ */
+typedef struct payload_meta {
+  long long expiry_time; // abandoned from then on; 0 if never
+  int max_sends; // abandoned rather than sent more times than this; 0 if no limit
+  int num_sends;
+  int flags; // MRT_FLAG_MESSAGE, and MRT_FLAG_END_OF_MESSAGE on its last payload
+} payload_meta_t;
+
+/* one of the streams other than the first (see mrt_send_stream()):
+ * like the connection's own buffer variables below, but with fragment
+ * numbers (from 1) and a window of its own, and its own resend timeout,
+ * so that a loss on it holds up no other stream. Protected by the
+ * connection's receiver_lock.
+ */
+typedef struct send_stream {
+  char buffer[MRT_STREAM_WINDOW_SIZE];
+  int num_bytes_buffered[STREAM_PAYLOADS_BUFFERABLE];
+  int last_payload_index;
+  int last_sent_index;
+  int last_acknowledged_frag;
+  int highest_sent_frag; // anything up to it that is sent again is resent
+  int receiver_window_size;
+  long long progress_time; // of the last ADAT that acknowledged something, or of the first sending since
+} send_stream_t;
+
 typedef struct connection {
   int id;
   int send_sockfd;
@@ -41,14 +128,14 @@ typedef struct connection {
   int last_payload_index; // must be below MAX_PAYLOADS_BUFFERABLE
   char sender_buffer[MAX_MRT_PAYLOAD_LENGTH * MAX_PAYLOADS_BUFFERABLE];
   int num_bytes_buffered[MAX_PAYLOADS_BUFFERABLE];
+  payload_meta_t payload_meta[MAX_PAYLOADS_BUFFERABLE];
   pthread_mutex_t buffer_lock;
-  /* note that the two arrays above only have valid elements in index
+  /* note that the three arrays above only have valid elements in index
    * up to the last_payload_index (should not access anything beyond it)
    */
 
-  /* always 1 lower than oldest buffered fragment;
-   * initially -1, and set to 0 upon first ACON to indict a connection
-   * is formed.
+  /* always 1 lower than oldest buffered fragment (modulo 2^32; see
+   * MRT_FRAG_DIFF()); initially initial_frag.
    *
    * WARNING:
    * last_acknowledged_frag changing would require the buffer
@@ -58,40 +145,196 @@ typedef struct connection {
    * TODO: enough to just put last_acknowledged_frag under buffer_lock?
    */
   int last_acknowledged_frag;
+  int is_established; // set upon first ACON to indicate a connection is formed
+  /* until then, the connector thread sends RCONs (see
+   * mrt_connect_start()), backing off
+   */
+  long long next_rcon_time;
+  int rcon_period; // doubled after every RCON until a COOK, up to RCON_MAX_PERIOD
+  long long connect_deadline; // 0 if none
+  int is_given_up; // the deadline passed first; ACONs are ignored from then on
   int receiver_window_size;
+  /* the RTT is sampled like TCP does without timestamps: one fragment
+   * at a time is timed from its first sending to its ADAT, and the
+   * timing is abandoned if anything is resent meanwhile (Karn)
+   */
+  int highest_sent_frag; // anything up to it that is sent again is resent
+  int rtt_probe_frag;
+  long long rtt_probe_time; // 0 when none is timed
+  int rtt_estimate;      // smoothed like TCP's SRTT; 0 until the first sample
+  /* abandoned payloads count as acknowledged here; the receiver is
+   * told with SKIPs until its ADAT gets past them
+   */
+  int skip_frag;         // the last one abandoned
+  int is_skip_pending;   // until then
+  long long last_skip_time; // SKIPs are repeated at most once per RTT
+  /* the other streams, and how the sender thread shares the link
+   * between them all (stream 0 being the one above); see pick_stream()
+   */
+  send_stream_t streams[MRT_MAX_STREAMS - 1];
+  int stream_weights[MRT_MAX_STREAMS];
+  long long stream_passes[MRT_MAX_STREAMS];
+  long long virtual_time; // the pass of the stream sent on last
   pthread_mutex_t receiver_lock;
 
   int inactive_time;
   pthread_mutex_t timeout_lock;
+  pthread_cond_t timeout_cvar; // cuts checker()'s wait short once the connection is closing
 
   int should_close;
   pthread_mutex_t close_lock;
 
   pthread_t handler_thread, sender_thread, checker_thread;
+  /* with MRT_IO_URING, the ring thread stands in for the handler and
+   * the checker (see ring_handler()); set before the handshake starts.
+   * is_recv_cancelled is only touched by the ring thread.
+   */
+  int is_on_ring;
+  int is_recv_cancelled; // the connection is being dropped; its receive is to end
+  /* under the low-latency profile (see mrt_set_busy_poll()), set
+   * before the handshake starts as well: the handler, the sender thread
+   * and the callers waiting on the connection spin instead of sleeping,
+   * the first two on the given CPUs (-1 for any)
+   */
+  int is_busy_polling;
+  int handler_cpu, sender_cpu;
+
+  // these two are protected by connect_lock
+  int is_async; // started by mrt_connect_start()
+  int handshake_outcome; // -1 until the connector thread is done with it
 
-  char incoming_buffer[MRT_HEADER_LENGTH + 1]; // +1 for NULL-termination for hash()
+  char incoming_buffer[MAX_UDP_PAYLOAD_LENGTH];
   char outgoing_buffer[MAX_UDP_PAYLOAD_LENGTH + 1];
+  unsigned int cookie; // echoed in RCONs; 0 until the receiver's COOK arrives
   pthread_mutex_t outgoing_lock;
+
+  /* the ring offered in RCONs to a receiver on the same host (see
+   * mrt.h); once its ACON takes it, mrt_send() goes through it. Set
+   * before the connection is established, and only read afterwards.
+   */
+  mrt_shm_t *shm_p; // NULL if none is offered (anymore)
+  int shm_fd;       // -1 once the receiver has answered
+  int is_shm;
+
+  /* everything below is protected by waiter_lock, which is taken last,
+   * after any of the other locks.
+   *
+   * What the receiver sends back with mrt_reply(), until mrt_receive()
+   * reads it; a ring like the receiver's.
+   */
+  char reply_buffer[MRT_REPLY_WINDOW_SIZE];
+  int reply_read_index;
+  int reply_bytes_unread;
+  int reply_next_frag; // the next one expected, starting from 1
+  int reply_last_advertised_window;
+  int is_reply_ack_pending; // an ADAT is owed, preferably riding on a DATA
+  long long reply_ack_due_time; // after which it goes alone
+  /* mrt_send() and mrt_receive() wait on waiter_cvar instead of
+   * polling, holding the connection through num_waiters
+   */
+  long adat_seq; // bumped whenever an ADAT (or a DATA carrying one) is handled
+  int num_waiters; // the handler does not free the connection meanwhile
+  int is_reply_over; // set by the handler on its way out
+  int is_sender_woken; // there is news for the sender thread
+  pthread_mutex_t waiter_lock;
+  pthread_cond_t waiter_cvar; // broadcast when bytes arrive, an ADAT is handled or the connection ends
+  pthread_cond_t sender_cvar; // signaled when the sender thread is woken
+
+  sender_counters_t counters;
 } connection_t;
 
 void *handler(void *conn_vp);
+void handle_transmission(connection_t *conn_p, char *transmission, int num_bytes_received);
+void *dropper(void *conn_vp);
 void *sender(void *conn_vp);
 void *checker(void *conn_vp);
+int check_inactivity(connection_t *conn_p);
+void *connector(void *unused);
+void *ring_handler(void *ring_vp);
+int hand_to_ring(connection_t *conn_p);
+void tend_ring_connection(void *conn_vp, void *round_vp);
+void wake_ring();
+int is_same_connection(void *conn_vp, void *target_vp);
+int start_connecting(unsigned short sender_port_number, unsigned short receiver_port_number, unsigned int s_addr,
+                     int timeout, int is_async);
+void tend_handshake(void *conn_vp, void *next_time_vp);
+int is_handshake_over(void *conn_vp, void *unused);
+void finish_handshake(connection_t *conn_p);
+int outcome_matcher(void *outcome_vp, void *id_vp);
 connection_t *connection_t_init(unsigned short sender_port_number, unsigned short receiver_port_number, unsigned long receiver_s_addr);
 void connection_t_free(void *conn_vp);
 int connection_matcher(void *connection_vp, void *id_vp);
-void build_rcon(char *outgoing_buffer);
+int build_rcon(connection_t *conn_p);
 void build_data_empty(char *outgoing_buffer);
-void build_data(connection_t *conn_p, int payload_index, int len);
+int build_data(connection_t *conn_p, char *payload, int frag, int len, int flags);
+void build_adat(char *outgoing_buffer, int received_frag, int curr_window_size);
 void build_rcls(char *outgoing_buffer);
+void build_skip(char *outgoing_buffer, int last_abandoned_frag);
+void handle_adat(connection_t *conn_p, int frag, int window_size, int is_piggybacked);
+void take_shm_answer(connection_t *conn_p, char *transmission, int num_bytes_received);
+void handle_stream_adat(connection_t *conn_p, int stream, int frag, int window_size);
+int is_stream_ready(send_stream_t *stream_p);
+int pick_stream(connection_t *conn_p, int is_first_ready, long long now);
+void send_stream_data(connection_t *conn_p, int stream, long long now);
+int has_stream_payloads(connection_t *conn_p);
+void drop_payloads(connection_t *conn_p, int num_payloads);
+int abandon_expired(connection_t *conn_p, long long now);
+int time_to_expiry(connection_t *conn_p, long long now, int usec);
+void send_skip(connection_t *conn_p, int last_abandoned_frag, int num_abandoned);
+void handle_reply_data(connection_t *conn_p, int frag, char *payload, int payload_len);
+int take_reply_ack(connection_t *conn_p, int is_due_only, int *received_frag_p, int *window_size_p);
+void send_reply_ack(connection_t *conn_p, int is_due_only);
+void sender_sleep(connection_t *conn_p, int usec);
+void wake_sender(connection_t *conn_p);
+void close_soon(connection_t *conn_p);
+int wait_for_adat(int id, long seen_seq);
+int send_through_shm(int id, char *buffer, int len);
+void deadline_after(struct timespec *deadline_p, int usec);
+void note_frag_sent(connection_t *conn_p, int frag, int payload_length, long long now);
+void sample_rtt(connection_t *conn_p);
 
 /****** global variables ******/
 unsigned int addr_len = (unsigned int) sizeof(struct sockaddr_in);
 int next_id = 0;
-int initial_frag = 0;
+int initial_frag = SENDER_INITIAL_FRAG;
 
 q_t *connections_q = NULL;
 pthread_mutex_t q_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t drop_cvar = PTHREAD_COND_INITIALIZER; // with q_lock; a connection is gone
+
+/* connections being established and the outcomes not yet taken; all
+ * protected by connect_lock, which is taken before any connection's
+ * locks (and never while holding q_lock)
+ */
+q_t *connecting_q = NULL;
+q_t *outcomes_q = NULL;
+int num_async_connecting = 0; // started by mrt_connect_start(), outcome not yet queued
+int is_connector_running = 0;
+pthread_mutex_t connect_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t connect_cvar = PTHREAD_COND_INITIALIZER; // broadcast when a handshake moves on
+
+/* for MRT_IO_URING (see mrt_set_io_engine()): connections handed to the
+ * ring thread wait in arrivals_q for it to take them in. All protected
+ * by ring_lock, which is taken after connect_lock and never while
+ * holding any connection's locks; so is the low-latency profile (see
+ * mrt_set_busy_poll()), which new connections take up.
+ */
+int io_engine = MRT_IO_SOCKETS;
+int is_busy_polling = 0;
+int busy_poll_usec = 0; // SO_BUSY_POLL on the connections' sockets, if positive
+int pinned_cpus[MRT_MAX_PINNED_CPUS];
+int num_pinned_cpus = 0;
+int next_pinned_cpu = 0; // handed out in turn
+q_t *arrivals_q = NULL;
+int ring_wake_fd = -1; // polled by the ring thread; written when there is news for it
+int is_ring_running = 0;
+pthread_mutex_t ring_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// for tend_ring_connection(), on behalf of ring_handler()
+typedef struct ring_round {
+  mrt_uring_t *ring_p;
+  int is_check_due;
+} ring_round_t;
 
 /****** functions ******/
 
@@ -104,56 +347,84 @@ pthread_mutex_t q_lock = PTHREAD_MUTEX_INITIALIZER;
  * `s_addr` will be put inside `htonl()` before use
  */
 int mrt_connect(unsigned short sender_port_number, unsigned short receiver_port_number, unsigned int s_addr) {
-  /****** initializing the module if not done so yet ******/
-  pthread_mutex_lock(&q_lock);
-  if (connections_q == NULL) {
-    connections_q = make_q();
-    if (connections_q == NULL) {
-      perror("make_q() failed\n");
-      return -1;
-    }
-  }
-  pthread_mutex_unlock(&q_lock);
-  
-  /****** initialize a new connection struct and queue it ******/
-  connection_t *curr_conn = connection_t_init(sender_port_number, receiver_port_number, s_addr);
-  if (curr_conn == NULL) {
-    perror ("connection_t_init() failed\n");
-    return -1;
+  connect_outcome_t *outcome_p = NULL;
+  int id = start_connecting(sender_port_number, receiver_port_number, s_addr, 0, 0);
+  if (id < 0) { return -1; }
+
+  // the connector thread sends the RCONs; just wait for it to see the ACON
+  pthread_mutex_lock(&connect_lock);
+  while ((outcome_p = pop_item_q(outcomes_q, outcome_matcher, &id)) == NULL) {
+    pthread_cond_wait(&connect_cvar, &connect_lock);
   }
-  
-  pthread_mutex_lock(&q_lock);
-  enq_q(connections_q, curr_conn);
-  pthread_mutex_unlock(&q_lock);
+  pthread_mutex_unlock(&connect_lock);
+  free(outcome_p);
+  return id;
+}
 
-  /****** just keep trying to connect to server... ******/
+/* starts connecting without waiting for it; see mrt_sender.h.
+ */
+int mrt_connect_start(unsigned short sender_port_number, unsigned short receiver_port_number, unsigned int s_addr,
+                      int timeout) {
+  if (timeout < 0) { return -1; }
+  return start_connecting(sender_port_number, receiver_port_number, s_addr, timeout, 1);
+}
 
-  // create the handler thread first (or else ACON cannot be handled)
-  if (pthread_create(&(curr_conn->handler_thread), NULL, handler, curr_conn) != 0) {
-    perror("pthread_create(handler) error\n");
-    return -1;
-  }
- 
-  while(1) {
-    pthread_mutex_lock(&(curr_conn->receiver_lock));
-    if (curr_conn->last_acknowledged_frag != -1) {
-      pthread_mutex_unlock(&(curr_conn->receiver_lock));
-      break;
+/* reports the next handshake mrt_connect_start() started to end; see
+ * mrt_sender.h.
+ */
+int mrt_connect_next(int *id_p, int timeout) {
+  connect_outcome_t *outcome_p = NULL;
+  struct timespec deadline;
+  int is_timed_out = 0, result;
+  if (id_p == NULL) { return -1; }
+  if (timeout >= 0) { deadline_after(&deadline, timeout); }
+
+  pthread_mutex_lock(&connect_lock);
+  while (1) {
+    outcome_p = (outcomes_q == NULL) ? NULL : pop_item_q(outcomes_q, outcome_matcher, NULL);
+    if (outcome_p != NULL || num_async_connecting == 0 || is_timed_out) { break; }
+    if (timeout < 0) {
+      pthread_cond_wait(&connect_cvar, &connect_lock);
+    } else if (pthread_cond_timedwait(&connect_cvar, &connect_lock, &deadline) == ETIMEDOUT) {
+      is_timed_out = 1; // (one last look)
     }
-    pthread_mutex_unlock(&(curr_conn->receiver_lock));
+  }
+  pthread_mutex_unlock(&connect_lock);
+  if (outcome_p == NULL) { return -1; }
+  *id_p = outcome_p->id;
+  result = outcome_p->is_established;
+  free(outcome_p);
+  return result;
+}
 
-    pthread_mutex_lock(&(curr_conn->outgoing_lock));
-    build_rcon(curr_conn->outgoing_buffer);
-    sendto(curr_conn->send_sockfd, curr_conn->outgoing_buffer,
-          MRT_HASH_LENGTH + MRT_TYPE_LENGTH + MRT_FRAGMENT_LENGTH,
-          0, (const struct sockaddr *)(&(curr_conn->rece_addr)), 
-          addr_len);
-    pthread_mutex_unlock(&(curr_conn->outgoing_lock));
+/* picks how connections started from now on take in transmissions; see
+ * mrt_sender.h. Returns the engine in effect.
+ */
+int mrt_set_io_engine(int engine) {
+  if (engine == MRT_IO_URING && !mrt_uring_probe()) { engine = MRT_IO_SOCKETS; }
+  pthread_mutex_lock(&ring_lock);
+  io_engine = engine;
+  pthread_mutex_unlock(&ring_lock);
+  return engine;
+}
 
-    usleep(RCON_PERIOD);
+/* sets the low-latency profile for connections started from now on;
+ * see mrt_sender.h. Returns 0 on success and -1 if the CPUs are not valid.
+ */
+int mrt_set_busy_poll(int is_on, int usec, const int *cpus, int num_cpus) {
+  int i;
+  if (num_cpus < 0 || num_cpus > MRT_MAX_PINNED_CPUS || (num_cpus > 0 && cpus == NULL)) { return -1; }
+  for (i = 0; i < num_cpus; i++) {
+    if (cpus[i] < 0) { return -1; }
   }
-  
-  return curr_conn->id;
+  pthread_mutex_lock(&ring_lock);
+  memmove(pinned_cpus, cpus, num_cpus * sizeof(int));
+  num_pinned_cpus = num_cpus;
+  next_pinned_cpu = 0;
+  busy_poll_usec = usec;
+  is_busy_polling = is_on;
+  pthread_mutex_unlock(&ring_lock);
+  return 0;
 }
 
 /* Returns 1 if all bytes are successfully sent (acknowledged).
@@ -179,22 +450,29 @@ int mrt_send(int id, char *buffer, int len) {
     printf("mrt_send(): spurious call with id=%d.\n", id);
     return -1; 
   }
+  pthread_mutex_lock(&(conn_p->receiver_lock));
+  int is_shm = conn_p->is_shm;
+  pthread_mutex_unlock(&(conn_p->receiver_lock));
   pthread_mutex_unlock(&q_lock);
+  if (is_shm) { return send_through_shm(id, buffer, len); }
 
   // DANGEROUS: nested mutex... receiver_lock, then buffer_lock!
   pthread_mutex_lock(&(conn_p->receiver_lock));
   pthread_mutex_lock(&(conn_p->buffer_lock));
-  int last_buffered_frag = conn_p->last_payload_index + conn_p->last_acknowledged_frag + 1;
+  int last_buffered_frag = MRT_FRAG_ADD(conn_p->last_acknowledged_frag, conn_p->last_payload_index + 1);
   pthread_mutex_unlock(&(conn_p->buffer_lock));
   pthread_mutex_unlock(&(conn_p->receiver_lock));
 
   // magic ceiling division: https://stackoverflow.com/a/14878734
   // NOTE: no need to wrap in mutex... right?
-  int final_frag = last_buffered_frag + len / MAX_MRT_PAYLOAD_LENGTH + (len % MAX_MRT_PAYLOAD_LENGTH != 0);
+  int final_frag = MRT_FRAG_ADD(last_buffered_frag,
+    len / MAX_MRT_PAYLOAD_LENGTH + (len % MAX_MRT_PAYLOAD_LENGTH != 0));
 
   int num_free_payload_spaces;
   int num_bytes_to_copy=0, num_bytes_remaining=len, num_bytes_copied=0;
   char *first_free_space=NULL, *first_byte_to_copy=NULL;
+  long long last_time = now_usec(), now;
+  long seen_seq;
   while (1) {
     // get it again to ensure the connection is still valid
     pthread_mutex_lock(&q_lock);
@@ -206,11 +484,20 @@ int mrt_send(int id, char *buffer, int len) {
       // TODO: anyway to tell how many bytes are acknowledged?
       return 0;  
     }
+    // (only this thread adds to it)
+    now = now_usec();
+    stat_add(&(conn_p->counters.usec_blocked), now - last_time);
+    last_time = now;
     pthread_mutex_unlock(&q_lock);
 
+    // an ADAT handled after this is one to wake up for
+    pthread_mutex_lock(&(conn_p->waiter_lock));
+    seen_seq = conn_p->adat_seq;
+    pthread_mutex_unlock(&(conn_p->waiter_lock));
+
     // if the final_frag is acknowledged, time to skedaddle
     pthread_mutex_lock(&(conn_p->receiver_lock));
-    if (conn_p->last_acknowledged_frag >= final_frag) {
+    if (MRT_FRAG_DIFF(conn_p->last_acknowledged_frag, final_frag) >= 0) {
       pthread_mutex_unlock(&(conn_p->receiver_lock));
       break;
     }
@@ -235,20 +522,311 @@ int mrt_send(int id, char *buffer, int len) {
         num_bytes_copied += num_bytes_to_copy;
         conn_p->last_payload_index += 1;
         conn_p->num_bytes_buffered[conn_p->last_payload_index] = num_bytes_to_copy;
+        memset(&(conn_p->payload_meta[conn_p->last_payload_index]), 0, sizeof(payload_meta_t));
       }
       pthread_mutex_unlock(&(conn_p->buffer_lock));
-    } else {
-      // done copying already; go to sleep...
-      usleep(MRT_SEND_PERIOD);
-      continue; // just to be safe
+      if (num_free_payload_spaces > 0) {
+        // the sender thread may be asleep with nothing to send
+        pthread_mutex_lock(&(conn_p->waiter_lock));
+        wake_sender(conn_p);
+        pthread_mutex_unlock(&(conn_p->waiter_lock));
+        continue;
+      }
     }
+    // done copying already (or no room left); wait for an ADAT...
+    wait_for_adat(id, seen_seq);
   }
   // TODO: num_bytes_copied SHOULD be equal to len now...
   return 1;
 }
 
+/* Buffers `len` bytes as one message that expires after `lifetime`
+ * microseconds (if positive) or `max_retransmits` resends (if not
+ * negative); the sender thread abandons it then (see abandon_expired()).
+ * The message is copied in all at once, so a partly buffered message is
+ * never up for abandoning; until there is room, it waits for ADATs.
+ *
+ * Returns 1 once buffered, 0 if it expired first or the connection is
+ * dropped, and -1 if the call is spurious.
+ */
+int mrt_send_message(int id, char *buffer, int len, int lifetime, int max_retransmits) {
+  connection_t *conn_p = NULL;
+  if (buffer == NULL || len <= 0 || len > SENDER_MAX_MESSAGE_LENGTH) { return -1; }
+  pthread_mutex_lock(&q_lock);
+  conn_p = (connections_q == NULL) ? NULL : get_item_q(connections_q, connection_matcher, &id);
+  if (conn_p == NULL) {
+    pthread_mutex_unlock(&q_lock);
+    printf("mrt_send_message(): spurious call with id=%d.\n", id);
+    return -1;
+  }
+  pthread_mutex_unlock(&q_lock);
+
+  int num_payloads = len / MAX_MRT_PAYLOAD_LENGTH + (len % MAX_MRT_PAYLOAD_LENGTH != 0);
+  long long last_time = now_usec(), now;
+  long long expiry_time = (lifetime > 0) ? last_time + lifetime : 0;
+  int i, num_bytes_copied, num_bytes_to_copy, is_buffered, is_expired;
+  long seen_seq;
+  while (1) {
+    pthread_mutex_lock(&q_lock);
+    conn_p = get_item_q(connections_q, connection_matcher, &id);
+    if (conn_p == NULL) {
+      pthread_mutex_unlock(&q_lock);
+      printf("sender %d: connection dropped before a message could be sent.\n", id);
+      return 0;
+    }
+    now = now_usec();
+    stat_add(&(conn_p->counters.usec_blocked), now - last_time);
+    last_time = now;
+    pthread_mutex_unlock(&q_lock);
+
+    pthread_mutex_lock(&(conn_p->waiter_lock));
+    seen_seq = conn_p->adat_seq;
+    pthread_mutex_unlock(&(conn_p->waiter_lock));
+
+    pthread_mutex_lock(&(conn_p->buffer_lock));
+    is_buffered = (MAX_PAYLOADS_BUFFERABLE - (conn_p->last_payload_index + 1) >= num_payloads);
+    for (i = 0, num_bytes_copied = 0; is_buffered && i < num_payloads; i++) {
+      num_bytes_to_copy = len - num_bytes_copied;
+      if (num_bytes_to_copy > MAX_MRT_PAYLOAD_LENGTH) { num_bytes_to_copy = MAX_MRT_PAYLOAD_LENGTH; }
+      conn_p->last_payload_index += 1;
+      memmove(conn_p->sender_buffer + conn_p->last_payload_index * MAX_MRT_PAYLOAD_LENGTH,
+        buffer + num_bytes_copied, num_bytes_to_copy);
+      num_bytes_copied += num_bytes_to_copy;
+      conn_p->num_bytes_buffered[conn_p->last_payload_index] = num_bytes_to_copy;
+      payload_meta_t *meta_p = &(conn_p->payload_meta[conn_p->last_payload_index]);
+      meta_p->expiry_time = expiry_time;
+      meta_p->max_sends = (max_retransmits >= 0) ? max_retransmits + 1 : 0;
+      meta_p->num_sends = 0;
+      meta_p->flags = MRT_FLAG_MESSAGE | ((i == num_payloads - 1) ? MRT_FLAG_END_OF_MESSAGE : 0);
+    }
+    // never buffered, so the receiver need not hear of it
+    is_expired = !is_buffered && expiry_time != 0 && now >= expiry_time;
+    // (counted under the buffer_lock, like the sender thread's abandoning)
+    if (is_buffered || is_expired) { stat_add(&(conn_p->counters.messages_sent), 1); }
+    if (is_expired) { stat_add(&(conn_p->counters.messages_abandoned), 1); }
+    pthread_mutex_unlock(&(conn_p->buffer_lock));
+    if (is_expired) { return 0; }
+    if (is_buffered) {
+      pthread_mutex_lock(&(conn_p->waiter_lock));
+      wake_sender(conn_p);
+      pthread_mutex_unlock(&(conn_p->waiter_lock));
+      return 1;
+    }
+    // the buffer only empties as ADATs come in (or messages are abandoned)
+    wait_for_adat(id, seen_seq);
+  }
+}
+
+/* Like mrt_send(), but on one of the other streams, whose state is all
+ * under the receiver_lock: copies in as many payloads as there is room
+ * for at a time and waits for ADATs, until the last one is acknowledged.
+ *
+ * Returns 1 once all bytes are acknowledged, 0 if the connection is
+ * dropped first, and -1 if the call is spurious.
+ */
+int mrt_send_stream(int id, int stream, char *buffer, int len) {
+  connection_t *conn_p = NULL;
+  if (stream == 0) { return mrt_send(id, buffer, len); }
+  if (stream < 0 || stream >= MRT_MAX_STREAMS || buffer == NULL || len < 0) { return -1; }
+  pthread_mutex_lock(&q_lock);
+  conn_p = (connections_q == NULL) ? NULL : get_item_q(connections_q, connection_matcher, &id);
+  if (conn_p == NULL) {
+    pthread_mutex_unlock(&q_lock);
+    printf("mrt_send_stream(): spurious call with id=%d.\n", id);
+    return -1;
+  }
+  send_stream_t *stream_p = &(conn_p->streams[stream - 1]);
+  pthread_mutex_unlock(&q_lock);
+
+  pthread_mutex_lock(&(conn_p->receiver_lock));
+  int final_frag = MRT_FRAG_ADD(stream_p->last_acknowledged_frag, stream_p->last_payload_index + 1 +
+    len / MAX_MRT_PAYLOAD_LENGTH + (len % MAX_MRT_PAYLOAD_LENGTH != 0));
+  pthread_mutex_unlock(&(conn_p->receiver_lock));
+
+  int num_bytes_copied = 0, num_bytes_to_copy, is_copied;
+  long long last_time = now_usec(), now;
+  long seen_seq;
+  while (1) {
+    pthread_mutex_lock(&q_lock);
+    conn_p = get_item_q(connections_q, connection_matcher, &id);
+    if (conn_p == NULL) {
+      pthread_mutex_unlock(&q_lock);
+      printf("sender %d: connection dropped before all data are sent on stream %d.\n", id, stream);
+      return 0;
+    }
+    now = now_usec();
+    stat_add(&(conn_p->counters.usec_blocked), now - last_time);
+    last_time = now;
+    stream_p = &(conn_p->streams[stream - 1]);
+    pthread_mutex_unlock(&q_lock);
+
+    pthread_mutex_lock(&(conn_p->waiter_lock));
+    seen_seq = conn_p->adat_seq;
+    pthread_mutex_unlock(&(conn_p->waiter_lock));
+
+    pthread_mutex_lock(&(conn_p->receiver_lock));
+    if (MRT_FRAG_DIFF(stream_p->last_acknowledged_frag, final_frag) >= 0) {
+      pthread_mutex_unlock(&(conn_p->receiver_lock));
+      break;
+    }
+    is_copied = 0;
+    while (num_bytes_copied < len && stream_p->last_payload_index + 1 < STREAM_PAYLOADS_BUFFERABLE) {
+      num_bytes_to_copy = len - num_bytes_copied;
+      if (num_bytes_to_copy > MAX_MRT_PAYLOAD_LENGTH) { num_bytes_to_copy = MAX_MRT_PAYLOAD_LENGTH; }
+      stream_p->last_payload_index += 1;
+      memmove(stream_p->buffer + stream_p->last_payload_index * MAX_MRT_PAYLOAD_LENGTH,
+        buffer + num_bytes_copied, num_bytes_to_copy);
+      stream_p->num_bytes_buffered[stream_p->last_payload_index] = num_bytes_to_copy;
+      num_bytes_copied += num_bytes_to_copy;
+      is_copied = 1;
+    }
+    pthread_mutex_unlock(&(conn_p->receiver_lock));
+    if (is_copied) {
+      pthread_mutex_lock(&(conn_p->waiter_lock));
+      wake_sender(conn_p);
+      pthread_mutex_unlock(&(conn_p->waiter_lock));
+    }
+    // the rest (and the ADATs) only fit in as ADATs come in
+    wait_for_adat(id, seen_seq);
+  }
+  return 1;
+}
+
+/* sets the stream's weight for pick_stream().
+ * Returns 0 on success and -1 if the call is spurious.
+ */
+int mrt_set_stream_weight(int id, int stream, int weight) {
+  connection_t *conn_p = NULL;
+  if (stream < 0 || stream >= MRT_MAX_STREAMS || weight < 1 || weight > SENDER_MAX_STREAM_WEIGHT) { return -1; }
+  pthread_mutex_lock(&q_lock);
+  conn_p = (connections_q == NULL) ? NULL : get_item_q(connections_q, connection_matcher, &id);
+  if (conn_p != NULL) {
+    pthread_mutex_lock(&(conn_p->receiver_lock));
+    conn_p->stream_weights[stream] = weight;
+    pthread_mutex_unlock(&(conn_p->receiver_lock));
+  }
+  pthread_mutex_unlock(&q_lock);
+  return (conn_p == NULL) ? -1 : 0;
+}
+
+/* copies the connection's statistics into `*stats_p`; q_lock keeps
+ * the connection from being freed meanwhile, and its counters are read
+ * without its own locks.
+ *
+ * Returns 0 on success and -1 if no such connection exists (anymore).
+ */
+int mrt_stats(int id, mrt_sender_stats_t *stats_p) {
+  connection_t *conn_p = NULL;
+  if (stats_p == NULL) { return -1; }
+  pthread_mutex_lock(&q_lock);
+  conn_p = get_item_q(connections_q, connection_matcher, &id);
+  if (conn_p == NULL) {
+    pthread_mutex_unlock(&q_lock);
+    return -1;
+  }
+  sender_counters_t *counters_p = &(conn_p->counters);
+  stats_p->bytes_sent = atomic_load_explicit(&(counters_p->bytes_sent), memory_order_relaxed);
+  stats_p->bytes_acked = atomic_load_explicit(&(counters_p->bytes_acked), memory_order_relaxed);
+  stats_p->frags_sent = atomic_load_explicit(&(counters_p->frags_sent), memory_order_relaxed);
+  stats_p->frags_retransmitted = atomic_load_explicit(&(counters_p->frags_retransmitted), memory_order_relaxed);
+  stats_p->empty_data_sent = atomic_load_explicit(&(counters_p->empty_data_sent), memory_order_relaxed);
+  stats_p->duplicate_adats = atomic_load_explicit(&(counters_p->duplicate_adats), memory_order_relaxed);
+  stats_p->checksum_failures = atomic_load_explicit(&(counters_p->checksum_failures), memory_order_relaxed);
+  stats_p->window_stalls = atomic_load_explicit(&(counters_p->window_stalls), memory_order_relaxed);
+  stats_p->usec_blocked = atomic_load_explicit(&(counters_p->usec_blocked), memory_order_relaxed);
+  stats_p->bytes_received = atomic_load_explicit(&(counters_p->bytes_received), memory_order_relaxed);
+  stats_p->adats_sent = atomic_load_explicit(&(counters_p->adats_sent), memory_order_relaxed);
+  stats_p->acks_piggybacked = atomic_load_explicit(&(counters_p->acks_piggybacked), memory_order_relaxed);
+  stats_p->messages_sent = atomic_load_explicit(&(counters_p->messages_sent), memory_order_relaxed);
+  stats_p->messages_abandoned = atomic_load_explicit(&(counters_p->messages_abandoned), memory_order_relaxed);
+  stats_p->frags_abandoned = atomic_load_explicit(&(counters_p->frags_abandoned), memory_order_relaxed);
+  stats_p->skips_sent = atomic_load_explicit(&(counters_p->skips_sent), memory_order_relaxed);
+  stats_p->receiver_window = atomic_load_explicit(&(counters_p->receiver_window), memory_order_relaxed);
+  stats_p->rtt_usec = atomic_load_explicit(&(counters_p->rtt_usec), memory_order_relaxed);
+  stats_p->is_shared_memory = atomic_load_explicit(&(counters_p->is_shared_memory), memory_order_relaxed);
+  pthread_mutex_unlock(&q_lock);
+  return 0;
+}
+
+/* Moves to `buffer` at least 1 byte and at most `len` of what the
+ * receiver sent back with mrt_reply(); waits until there is some.
+ *
+ * The connection is looked up under q_lock and then held through
+ * num_waiters while waiting, which the handler waits out before
+ * freeing it. If reading opened up the window a lot, an ADAT tells the
+ * receiver right away.
+ *
+ * Returns the number of bytes moved, 0 once the connection is over,
+ * and -1 if the call is spurious.
+ */
+int mrt_receive(int id, char *buffer, int len) {
+  connection_t *conn_p = NULL;
+  struct timespec deadline;
+  int bytes_read = 0, first_part, should_update = 0;
+
+  if (buffer == NULL || len <= 0) { return -1; }
+  pthread_mutex_lock(&q_lock);
+  conn_p = (connections_q == NULL) ? NULL : get_item_q(connections_q, connection_matcher, &id);
+  if (conn_p == NULL) {
+    pthread_mutex_unlock(&q_lock);
+    printf("mrt_receive(): spurious call with id=%d.\n", id);
+    return -1;
+  }
+  pthread_mutex_lock(&(conn_p->waiter_lock));
+  pthread_mutex_unlock(&q_lock);
+
+  long long wait_start = now_usec();
+  while (conn_p->reply_bytes_unread == 0 && !conn_p->is_reply_over) {
+    // woken up by the handler as soon as bytes arrive (or looking again right away)
+    conn_p->num_waiters += 1;
+    if (conn_p->is_busy_polling) {
+      pthread_mutex_unlock(&(conn_p->waiter_lock));
+      spin_pause();
+      pthread_mutex_lock(&(conn_p->waiter_lock));
+    } else {
+      deadline_after(&deadline, MRT_RECEIVE_PERIOD);
+      pthread_cond_timedwait(&(conn_p->waiter_cvar), &(conn_p->waiter_lock), &deadline);
+    }
+    conn_p->num_waiters -= 1;
+  }
+  stat_add(&(conn_p->counters.usec_blocked), now_usec() - wait_start);
+  if (conn_p->reply_bytes_unread == 0) {
+    // over and drained; the handler may be waiting for us to leave
+    pthread_cond_broadcast(&(conn_p->waiter_cvar));
+    pthread_mutex_unlock(&(conn_p->waiter_lock));
+    return 0;
+  }
+
+  bytes_read = (len < conn_p->reply_bytes_unread) ? len : conn_p->reply_bytes_unread;
+  first_part = MRT_REPLY_WINDOW_SIZE - conn_p->reply_read_index;
+  if (first_part >= bytes_read) {
+    memmove(buffer, conn_p->reply_buffer + conn_p->reply_read_index, bytes_read);
+  } else {
+    memmove(buffer, conn_p->reply_buffer + conn_p->reply_read_index, first_part);
+    memmove(buffer + first_part, conn_p->reply_buffer, bytes_read - first_part);
+  }
+  conn_p->reply_read_index = (conn_p->reply_read_index + bytes_read) % MRT_REPLY_WINDOW_SIZE;
+  conn_p->reply_bytes_unread -= bytes_read;
+  // like the receiver: the window opened by half the buffer is news
+  should_update = (MRT_REPLY_WINDOW_SIZE - conn_p->reply_bytes_unread) -
+    conn_p->reply_last_advertised_window >= MRT_REPLY_WINDOW_SIZE / 2;
+  if (should_update) { conn_p->is_reply_ack_pending = 1; }
+  // the handler only frees the connection once we have left
+  if (conn_p->is_reply_over) { pthread_cond_broadcast(&(conn_p->waiter_cvar)); }
+  pthread_mutex_unlock(&(conn_p->waiter_lock));
+
+  if (should_update) {
+    pthread_mutex_lock(&q_lock);
+    conn_p = (connections_q == NULL) ? NULL : get_item_q(connections_q, connection_matcher, &id);
+    if (conn_p != NULL) { send_reply_ack(conn_p, 0); }
+    pthread_mutex_unlock(&q_lock);
+  }
+  return bytes_read;
+}
+
 /* will wait until final ADAT is received to send a RCLS
- * (unless signaled to close by timeout). Blocking.
+ * (unless signaled to close by timeout), then until the connection is
+ * torn down and its threads are gone. Blocking.
  */
 void mrt_disconnect(int id) {
   connection_t *conn_p = NULL;
@@ -262,6 +840,8 @@ void mrt_disconnect(int id) {
   pthread_mutex_unlock(&q_lock);
 
   // only proceed if no more data buffered...!
+  long long last_time = now_usec(), now;
+  long seen_seq;
   while(1) {
     // get it again to ensure the connection is still valid
     pthread_mutex_lock(&q_lock);
@@ -273,18 +853,32 @@ void mrt_disconnect(int id) {
       // TODO: anyway to tell how many bytes are acknowledged?
       return;  
     }
+    now = now_usec();
+    stat_add(&(conn_p->counters.usec_blocked), now - last_time);
+    last_time = now;
     pthread_mutex_unlock(&q_lock);
 
+    pthread_mutex_lock(&(conn_p->waiter_lock));
+    seen_seq = conn_p->adat_seq;
+    pthread_mutex_unlock(&(conn_p->waiter_lock));
+
+    pthread_mutex_lock(&(conn_p->receiver_lock));
     pthread_mutex_lock(&(conn_p->buffer_lock));
-    // HOW CLEVER! IT ALL CAME TOGETHER!
-    if (conn_p->last_payload_index < 0) {
+    // HOW CLEVER! IT ALL CAME TOGETHER! (the other streams too)
+    if (conn_p->last_payload_index < 0 && !has_stream_payloads(conn_p)) {
       pthread_mutex_unlock(&(conn_p->buffer_lock));
+      pthread_mutex_unlock(&(conn_p->receiver_lock));
       break;
     }
     pthread_mutex_unlock(&(conn_p->buffer_lock));
-    usleep(MRT_DISCONNECT_PERIOD);
+    pthread_mutex_unlock(&(conn_p->receiver_lock));
+    // the buffer only empties as ADATs come in
+    wait_for_adat(id, seen_seq);
   }
 
+  // the receiver's last DATA is owed an ADAT, which will not be riding on anything now
+  send_reply_ack(conn_p, 0);
+
   // NOW send RCLS...
   pthread_mutex_lock(&(conn_p->outgoing_lock));
   build_rcls(conn_p->outgoing_buffer);
@@ -292,39 +886,42 @@ void mrt_disconnect(int id) {
               MRT_HASH_LENGTH + MRT_TYPE_LENGTH,  
               0, (const struct sockaddr *)(&(conn_p->rece_addr)), 
               addr_len);
+  TRACE(TRACE_RCLS_SENT, PORT_OF(conn_p), 0, 0);
   pthread_mutex_unlock(&(conn_p->outgoing_lock));
   
-  /* TODO: do nothing here, maybe? Since handler also does this
-   * trick when receiving an ACLS...
-   */
-  pthread_mutex_lock(&(conn_p->timeout_lock));
-  conn_p->inactive_time = CLOSE_TIMEOUT_THRESHOLD + 1;
-  pthread_mutex_unlock(&(conn_p->timeout_lock));
+  // no need to wait for the ACLS (the handler would do the same with it)
+  close_soon(conn_p);
+
+  // the dropper is the last to touch it (IDs are never reused)
+  pthread_mutex_lock(&q_lock);
+  while (connections_q != NULL && get_item_q(connections_q, connection_matcher, &id) != NULL) {
+    pthread_cond_wait(&drop_cvar, &q_lock);
+  }
+  pthread_mutex_unlock(&q_lock);
 }
 
 /****** thread functions (unavailable to module users) ******/
 
-/* The main handler; all incoming transmissions will be validated
- * and handled here.
- *
- * deletes the connections_q if the last sender exited (should not affect
- * anything - handler also sets the pointer to be NULL so it will be
- * re-initialized in the next mrt_onnect())
+/* The main handler of a connection not on the ring; all incoming
+ * transmissions are received here and handed to handle_transmission().
+ * Once the connection is to be dropped, it tears it down itself (see
+ * dropper()). Under the low-latency profile, it never blocks in
+ * recvfrom() but tries again right away.
  */
 void *handler(void *conn_vp) {
   connection_t *conn_p = (connection_t *)conn_vp;
   int num_bytes_received = 0;
   struct sockaddr_in addr_holder = {0}; // to be used in recvfrom() only
-  unsigned long hash_holder = 0;
   unsigned int addr_len_holder = addr_len; // MUST BE addr_len... semantically...
-  int type_holder = 0, frag_holder = 0, winsize_holder = 0;
-  int frag_difference = 0, num_remaining_bytes = 0;
-  char *remaining_bytes_location = NULL;
+  int recv_flags = conn_p->is_busy_polling ? MSG_DONTWAIT : 0;
 
+  if (conn_p->handler_cpu >= 0 && pin_thread(conn_p->handler_cpu) < 0) {
+    perror("pin_thread(handler) error\n");
+  }
   // the main loop; handle all the incoming transmissions
   while (1) {
     num_bytes_received = recvfrom(conn_p->send_sockfd, conn_p->incoming_buffer,
-                      MRT_HEADER_LENGTH, 0, (struct sockaddr *)(&addr_holder),
+                      MAX_UDP_PAYLOAD_LENGTH, recv_flags, (struct sockaddr *)(&addr_holder),
                       &addr_len_holder);
     
     // before processing, check if close is flagged
@@ -336,115 +933,204 @@ void *handler(void *conn_vp) {
     }
     pthread_mutex_unlock(&(conn_p->close_lock));
 
-    // NULL-terminate the transmission to enable hash()
-    conn_p->incoming_buffer[num_bytes_received] = '\0';
-
-    // first validate the transmission with checksum
-    memmove(&hash_holder, conn_p->incoming_buffer, MRT_HASH_LENGTH);
-
-    if (hash(conn_p->incoming_buffer + MRT_HASH_LENGTH) != hash_holder) {
+    if (num_bytes_received < 0 && conn_p->is_busy_polling) {
+      spin_pause();
       continue;
     }
+    handle_transmission(conn_p, conn_p->incoming_buffer, num_bytes_received);
+  }
+  return dropper(conn_p);
+}
 
-    // then check the transmission type and act accordingly
-    memmove(&type_holder, conn_p->incoming_buffer + MRT_TYPE_LOCATION, MRT_TYPE_LENGTH);
-    memmove(&frag_holder, conn_p->incoming_buffer + MRT_FRAGMENT_LOCATION, MRT_FRAGMENT_LENGTH);
-    memmove(&winsize_holder, conn_p->incoming_buffer + MRT_WINDOWSIZE_LOCATION, MRT_WINDOWSIZE_LENGTH);
-
-    switch (type_holder) {
-      
-      case MRT_ACON :
-        // start the sender_thread if it hasn't yet (meaning first ACON)
-        // TODO: what if pthread_create() fails?
-        pthread_mutex_lock(&(conn_p->receiver_lock));
-        if (conn_p->last_acknowledged_frag == -1) {
-          pthread_create(&(conn_p->sender_thread), NULL, sender, conn_p);
-          pthread_create(&(conn_p->checker_thread), NULL, checker, conn_p);
-          conn_p->last_acknowledged_frag = 0;
-        }
+/* validates and handles one transmission from the receiver, for the
+ * connection's handler or the ring thread (whichever the connection
+ * has; never both).
+ */
+void handle_transmission(connection_t *conn_p, char *transmission, int num_bytes_received) {
+  unsigned long hash_holder = 0;
+  int type_holder = 0, frag_holder = 0, winsize_holder = 0;
+  int ack_frag_holder = 0, ack_winsize_holder = 0, stream_holder = 0;
+
+  // first validate the transmission with checksum
+  memmove(&hash_holder, transmission, MRT_HASH_LENGTH);
+
+  if (hash(transmission + MRT_HASH_LENGTH, num_bytes_received - MRT_HASH_LENGTH) != hash_holder) {
+    stat_add(&(conn_p->counters.checksum_failures), 1);
+    TRACE(TRACE_CHECKSUM_FAILED, PORT_OF(conn_p), 0, num_bytes_received);
+    return;
+  }
+
+  // then check the transmission type and act accordingly
+  memmove(&type_holder, transmission + MRT_TYPE_LOCATION, MRT_TYPE_LENGTH);
+  memmove(&frag_holder, transmission + MRT_FRAGMENT_LOCATION, MRT_FRAGMENT_LENGTH);
+  memmove(&winsize_holder, transmission + MRT_WINDOWSIZE_LOCATION, MRT_WINDOWSIZE_LENGTH);
+
+  switch (type_holder) {
+    
+    case MRT_COOK :
+      /* the receiver keeps no state for us until we echo its cookie;
+       * do so right away instead of waiting for the next RCON_PERIOD
+       */
+      pthread_mutex_lock(&(conn_p->receiver_lock));
+      if (!conn_p->is_established && !conn_p->is_given_up) {
+        pthread_mutex_lock(&(conn_p->outgoing_lock));
+        conn_p->cookie = (unsigned int)winsize_holder;
+        TRACE(TRACE_COOK_RECEIVED, PORT_OF(conn_p), frag_holder, winsize_holder);
+        sendto(conn_p->send_sockfd, conn_p->outgoing_buffer, build_rcon(conn_p),
+              0, (const struct sockaddr *)(&(conn_p->rece_addr)), 
+              addr_len);
+        TRACE(TRACE_RCON_SENT, PORT_OF(conn_p), initial_frag, winsize_holder);
+        pthread_mutex_unlock(&(conn_p->outgoing_lock));
+        /* the receiver is there, and once it accepts us, it gives us
+         * only a few of its checker periods to be heard from; so no
+         * more backing off (the connector thread is told so)
+         */
+        conn_p->rcon_period = RCON_PERIOD;
+        conn_p->next_rcon_time = now_usec() + RCON_PERIOD;
         pthread_mutex_unlock(&(conn_p->receiver_lock));
-        // otherwise do nothing (duplicate ACONs are ignored)
+        pthread_mutex_lock(&connect_lock);
+        pthread_cond_broadcast(&connect_cvar);
+        pthread_mutex_unlock(&connect_lock);
         break;
+      }
+      pthread_mutex_unlock(&(conn_p->receiver_lock));
+      break;
 
-      case MRT_ADAT :
-        // first of all, receiver just proved the connection is alive
-        pthread_mutex_lock(&(conn_p->timeout_lock));
-        conn_p->inactive_time = 0;
-        pthread_mutex_unlock(&(conn_p->timeout_lock));
-        
-        /* if the ADAT is at least as new as the last one, update
-         * the frag and receiver_window_size if necessary
-         */
-        pthread_mutex_lock(&(conn_p->receiver_lock));
-        frag_difference = frag_holder - conn_p->last_acknowledged_frag;
-        if (frag_difference >= 0) {
-          conn_p->last_acknowledged_frag = frag_holder;
-          if (conn_p->receiver_window_size < winsize_holder) {
-            conn_p->receiver_window_size = winsize_holder;
-          }
-        }
-        // if we can free up the buffer, do it
-        // note that we cannot release receiver_lock yet!
-        if (frag_difference > 0) {
-          pthread_mutex_lock(&(conn_p->buffer_lock));
-          // update the buffer
-          remaining_bytes_location = conn_p->sender_buffer + MAX_MRT_PAYLOAD_LENGTH * frag_difference;
-          num_remaining_bytes = MAX_MRT_PAYLOAD_LENGTH * (conn_p->last_payload_index - frag_difference + 1);
-          memmove(conn_p->sender_buffer, remaining_bytes_location, num_remaining_bytes);
-          // update the num_bytes_buffered array
-          remaining_bytes_location = (char *)(conn_p->num_bytes_buffered + frag_difference);
-          num_remaining_bytes = sizeof(int) * (conn_p->last_payload_index - frag_difference + 1);
-          memmove(conn_p->num_bytes_buffered, remaining_bytes_location, num_remaining_bytes);
-          // update the last_payload_index
-          conn_p->last_payload_index -= frag_difference;
-          pthread_mutex_unlock(&(conn_p->buffer_lock));
-        }
+    case MRT_ACON :
+      // start the sender_thread if it hasn't yet (meaning first ACON)
+      // TODO: what if pthread_create() fails?
+      pthread_mutex_lock(&(conn_p->receiver_lock));
+      if (!conn_p->is_established && !conn_p->is_given_up) {
+        TRACE(TRACE_ACON_RECEIVED, PORT_OF(conn_p), frag_holder, 0);
+        take_shm_answer(conn_p, transmission, num_bytes_received);
+        pthread_create(&(conn_p->sender_thread), NULL, sender, conn_p);
+        // (the ring thread checks its connections itself)
+        if (!conn_p->is_on_ring) { pthread_create(&(conn_p->checker_thread), NULL, checker, conn_p); }
+        conn_p->is_established = 1;
         pthread_mutex_unlock(&(conn_p->receiver_lock));
+        // the connector thread reports it (connect_lock comes first)
+        pthread_mutex_lock(&connect_lock);
+        pthread_cond_broadcast(&connect_cvar);
+        pthread_mutex_unlock(&connect_lock);
         break;
+      }
+      pthread_mutex_unlock(&(conn_p->receiver_lock));
+      // otherwise do nothing (duplicate ACONs are ignored)
+      break;
+
+    case MRT_ADAT :
+      // first of all, receiver just proved the connection is alive
+      // (unless it is closing: an ADAT crossing our RCLS must not revive it)
+      pthread_mutex_lock(&(conn_p->timeout_lock));
+      if (conn_p->inactive_time <= CLOSE_TIMEOUT_THRESHOLD) { conn_p->inactive_time = 0; }
+      pthread_mutex_unlock(&(conn_p->timeout_lock));
+      // one for another stream names it after the header
+      stream_holder = 0;
+      if (num_bytes_received >= MRT_HEADER_LENGTH + MRT_STREAM_LENGTH) {
+        memmove(&stream_holder, transmission + MRT_STREAM_LOCATION, MRT_STREAM_LENGTH);
+      }
+      if (stream_holder == 0) {
+        handle_adat(conn_p, frag_holder, winsize_holder, 0);
+      } else if (stream_holder > 0 && stream_holder < MRT_MAX_STREAMS) {
+        handle_stream_adat(conn_p, stream_holder, frag_holder, winsize_holder);
+      }
+      break;
 
-      case MRT_ACLS :
-        // could just do nothing here but...
-        pthread_mutex_lock(&(conn_p->timeout_lock));
-        conn_p->inactive_time = CLOSE_TIMEOUT_THRESHOLD + 1;
-        pthread_mutex_unlock(&(conn_p->timeout_lock));
+    case MRT_DATA :
+      // sent back by mrt_reply(), always with an ADAT riding along
+      if (!(winsize_holder & MRT_FLAG_ACK) || num_bytes_received < MRT_HEADER_LENGTH + MRT_ACK_LENGTH) {
         break;
+      }
+      pthread_mutex_lock(&(conn_p->timeout_lock));
+      if (conn_p->inactive_time <= CLOSE_TIMEOUT_THRESHOLD) { conn_p->inactive_time = 0; }
+      pthread_mutex_unlock(&(conn_p->timeout_lock));
+      memmove(&ack_frag_holder, transmission + MRT_ACK_FRAGMENT_LOCATION, MRT_FRAGMENT_LENGTH);
+      memmove(&ack_winsize_holder, transmission + MRT_ACK_WINDOWSIZE_LOCATION, MRT_WINDOWSIZE_LENGTH);
+      handle_adat(conn_p, ack_frag_holder, ack_winsize_holder, 1);
+      handle_reply_data(conn_p, frag_holder, transmission + MRT_HEADER_LENGTH + MRT_ACK_LENGTH,
+        num_bytes_received - MRT_HEADER_LENGTH - MRT_ACK_LENGTH);
+      break;
 
-      default :
-        // RCON, DATA, RCLS, UNKN
-        continue;
-    }
+    case MRT_ACLS :
+      TRACE(TRACE_ACLS_RECEIVED, PORT_OF(conn_p), 0, 0);
+      close_soon(conn_p);
+      break;
+
+    default :
+      // RCON, RCLS, UNKN
+      break;
   }
-  /* Do the clean-ups
-   */
+}
+
+/* does the clean-ups once a connection is to be dropped (its handler,
+ * or the ring thread, having stopped taking in its transmissions):
+ * waits for its threads and its waiters, then frees it.
+ *
+ * deletes the connections_q if the last connection is gone (should not
+ * affect anything - the pointer is also set to NULL so it will be
+ * re-initialized in the next mrt_connect())
+ */
+void *dropper(void *conn_vp) {
+  connection_t *conn_p = (connection_t *)conn_vp;
   int id = conn_p->id;
   printf("sender %d: closing. Cleaning up.\n", id);
-  pthread_join(conn_p->checker_thread, NULL);
-  pthread_join(conn_p->sender_thread, NULL);
+  // (a handshake given up on never started them)
+  pthread_mutex_lock(&(conn_p->receiver_lock));
+  int is_established = conn_p->is_established;
+  pthread_mutex_unlock(&(conn_p->receiver_lock));
+  if (is_established) {
+    if (!conn_p->is_on_ring) { pthread_join(conn_p->checker_thread, NULL); }
+    pthread_join(conn_p->sender_thread, NULL);
+  }
 
-  pthread_mutex_lock(&q_lock);
+  // wake up any mrt_receive() (or mrt_send() on the ring) so it notices, and wait for it to leave
+  pthread_mutex_lock(&(conn_p->waiter_lock));
+  conn_p->is_reply_over = 1;
+  pthread_cond_broadcast(&(conn_p->waiter_cvar));
+  pthread_mutex_unlock(&(conn_p->waiter_lock));
+  if (conn_p->shm_p != NULL) { mrt_shm_wake(&(conn_p->shm_p->take_count)); }
+  while (1) {
+    pthread_mutex_lock(&q_lock);
+    pthread_mutex_lock(&(conn_p->waiter_lock));
+    if (conn_p->num_waiters == 0) {
+      // none can look it up again without q_lock
+      pthread_mutex_unlock(&(conn_p->waiter_lock));
+      break;
+    }
+    pthread_mutex_unlock(&q_lock);
+    pthread_cond_wait(&(conn_p->waiter_cvar), &(conn_p->waiter_lock));
+    pthread_mutex_unlock(&(conn_p->waiter_lock));
+  }
   connection_t_free(pop_item_q(connections_q, connection_matcher, &id));
   if (peek_q(connections_q) == NULL) { 
     delete_q(connections_q, connection_t_free); 
     connections_q = NULL;
   }
+  pthread_cond_broadcast(&drop_cvar); // for mrt_disconnect()
   pthread_mutex_unlock(&q_lock);
-  // TODO: signal all blocked mrt_send()... or let them wake up from sleep?
   return NULL;
 }
 
-/* the main sender; simply keeps sending DATA:
- * if the receiver window_size is too small or all data sent:
- *   if all data sent:
- *     start a timer... once threshold exceeded, start re-sending old
- *     payloads (by marking them as unsent)
- *   send empty DATA
+/* the main sender; simply keeps sending DATA, on whichever stream
+ * pick_stream() says is next:
+ * if all data sent or the next payload does not fit in the receiver
+ * window (counting the payloads already in flight), on every stream:
+ *   start a timer... once threshold exceeded, start re-sending old
+ *   payloads (by marking them as unsent)
+ *   send empty DATA (at most once per EMPTY_DATA_PERIOD)
  * else:
- *    send the next payload in the buffer
+ *    send the next payload in the buffer, flagged PUSH if it's the
+ *    last one that can go out for now (so the receiver won't delay
+ *    its ADAT)
  */
 void *sender(void *conn_vp) {
   connection_t *conn_p = (connection_t *)conn_vp;
-  int resend_time = 0;
+  long long stalled_since = now_usec(), last_empty_data_time = 0, now;
+  int bytes_in_flight, i, is_window_stalled = 0;
 
+  if (conn_p->sender_cpu >= 0 && pin_thread(conn_p->sender_cpu) < 0) {
+    perror("pin_thread(sender) error\n");
+  }
   while (1) {
     pthread_mutex_lock(&(conn_p->close_lock));
     if (conn_p->should_close == 1) {
@@ -456,47 +1142,100 @@ void *sender(void *conn_vp) {
     // TODO: simplify dangerously nested mutex
     pthread_mutex_lock(&(conn_p->receiver_lock));
     pthread_mutex_lock(&(conn_p->buffer_lock));
+    now = now_usec();
+    // messages up front that are no longer worth sending make way
+    if (abandon_expired(conn_p, now) > 0) { stalled_since = now; }
     int next_payload_index = conn_p->last_sent_index + 1;
-    if (conn_p->receiver_window_size < MAX_MRT_PAYLOAD_LENGTH
-        || next_payload_index > conn_p->last_payload_index) {
-      if (next_payload_index > conn_p->last_payload_index) {
-        // the sender has nothing to send, consider resending fragments
-        if (resend_time > RESEND_TIMEOUT_THRESHOLD) {
-          conn_p->last_sent_index = -1;
-          resend_time = 0;
-        } else { resend_time += EMPTY_DATA_PERIOD; }
-      } else {
-        // the sender has something to send; reset timer
-        resend_time = 0; 
+    int next_frag = MRT_FRAG_ADD(conn_p->last_acknowledged_frag, next_payload_index + 1);
+    bytes_in_flight = 0;
+    for (i = 0; i < next_payload_index; i++) {
+      bytes_in_flight += conn_p->num_bytes_buffered[i];
+    }
+    int has_unsent = (next_payload_index <= conn_p->last_payload_index);
+    int is_first_ready = has_unsent &&
+      bytes_in_flight + conn_p->num_bytes_buffered[next_payload_index] <= conn_p->receiver_window_size;
+    if (!is_first_ready) {
+      // the sender cannot send anything new, consider resending fragments
+      if (has_unsent && !is_window_stalled) {
+        stat_add(&(conn_p->counters.window_stalls), 1);
+        TRACE(TRACE_WINDOW_STALL, PORT_OF(conn_p), next_frag, conn_p->receiver_window_size);
+      }
+      is_window_stalled = has_unsent;
+      if (now - stalled_since > RESEND_TIMEOUT_THRESHOLD) {
+        TRACE(TRACE_RESEND_TIMEOUT, PORT_OF(conn_p), MRT_FRAG_ADD(conn_p->last_acknowledged_frag, 1), next_payload_index);
+        conn_p->last_sent_index = -1;
+        stalled_since = now;
       }
+    }
+    // stream 0 being stuck does not keep the others from sending, nor the other way around
+    int stream = pick_stream(conn_p, is_first_ready, now);
+    if (stream > 0) {
+      send_stream_data(conn_p, stream, now);
       pthread_mutex_unlock(&(conn_p->buffer_lock));
       pthread_mutex_unlock(&(conn_p->receiver_lock));
-
-      // send empty DATA and sleep
-      pthread_mutex_lock(&(conn_p->outgoing_lock));
-      build_data_empty(conn_p->outgoing_buffer);
-      sendto(conn_p->send_sockfd, conn_p->outgoing_buffer, 
-              MRT_HASH_LENGTH + MRT_TYPE_LENGTH + MRT_FRAGMENT_LENGTH,  
-              0, (const struct sockaddr *)(&(conn_p->rece_addr)), 
-              addr_len);
-      pthread_mutex_unlock(&(conn_p->outgoing_lock));
-      usleep(EMPTY_DATA_PERIOD);
+      send_reply_ack(conn_p, 1);
+      continue;
+    }
+    if (stream < 0) {
+      // nothing can go out on any stream
+      // a SKIP not yet confirmed is repeated (its ADAT proves the connection alive as well)
+      if (conn_p->is_skip_pending && now - conn_p->last_skip_time >= EMPTY_DATA_PERIOD) {
+        send_skip(conn_p, conn_p->skip_frag, 0);
+        last_empty_data_time = now;
+      }
+      // ADATs opening the window come back quickly, so check often
+      int sleep_usec = time_to_expiry(conn_p, now, has_unsent ? WINDOW_WAIT_PERIOD : EMPTY_DATA_PERIOD);
+      pthread_mutex_unlock(&(conn_p->buffer_lock));
+      pthread_mutex_unlock(&(conn_p->receiver_lock));
+
+      // send empty DATA (doubling as a window probe) and sleep
+      if (now - last_empty_data_time >= EMPTY_DATA_PERIOD) {
+        pthread_mutex_lock(&(conn_p->outgoing_lock));
+        build_data_empty(conn_p->outgoing_buffer);
+        sendto(conn_p->send_sockfd, conn_p->outgoing_buffer, 
+                MRT_HASH_LENGTH + MRT_TYPE_LENGTH + MRT_FRAGMENT_LENGTH,  
+                0, (const struct sockaddr *)(&(conn_p->rece_addr)), 
+                addr_len);
+        pthread_mutex_unlock(&(conn_p->outgoing_lock));
+        stat_add(&(conn_p->counters.empty_data_sent), 1);
+        TRACE(TRACE_EMPTY_DATA_SENT, PORT_OF(conn_p), 0, 0);
+        last_empty_data_time = now;
+      }
+      // nothing went out for an owed ADAT to ride on; once due, it goes alone
+      send_reply_ack(conn_p, 1);
+      sender_sleep(conn_p, sleep_usec);
       continue; // just to be safe
     } else {
       // the sender has something to send; reset timer
-      resend_time = 0;
+      stalled_since = now;
+      is_window_stalled = 0;
       // send meaningful DATA
       pthread_mutex_lock(&(conn_p->outgoing_lock));
       int payload_length = (conn_p->num_bytes_buffered)[next_payload_index];
-      build_data(conn_p, next_payload_index, payload_length);
+      payload_meta_t *meta_p = &(conn_p->payload_meta[next_payload_index]);
+      int flags = meta_p->flags;
+      if (next_payload_index == conn_p->last_payload_index ||
+          bytes_in_flight + payload_length + conn_p->num_bytes_buffered[next_payload_index + 1] > conn_p->receiver_window_size) {
+        flags |= MRT_FLAG_PUSH;
+      }
+      // a message that can expire wants its ADAT at once, or it may be given up on needlessly
+      if ((flags & MRT_FLAG_END_OF_MESSAGE) && (meta_p->expiry_time != 0 || meta_p->max_sends != 0)) {
+        flags |= MRT_FLAG_PUSH;
+      }
+      meta_p->num_sends += 1;
+      int transmission_length = build_data(conn_p, conn_p->sender_buffer + next_payload_index * MAX_MRT_PAYLOAD_LENGTH,
+        next_frag, payload_length, flags);
       sendto(conn_p->send_sockfd, conn_p->outgoing_buffer, 
-              MRT_PAYLOAD_LOCATION + payload_length, 0,
+              transmission_length, 0,
               (const struct sockaddr *)(&(conn_p->rece_addr)), 
               addr_len);
       pthread_mutex_unlock(&(conn_p->outgoing_lock));
+      note_frag_sent(conn_p, next_frag, payload_length, now);
       conn_p->last_sent_index += 1;
       pthread_mutex_unlock(&(conn_p->buffer_lock));
       pthread_mutex_unlock(&(conn_p->receiver_lock));
+      // full payloads leave no room for an owed ADAT; it must not wait forever
+      send_reply_ack(conn_p, 1);
     }
   }
   // TODO: clean-ups?
@@ -505,31 +1244,173 @@ void *sender(void *conn_vp) {
 
 /* should be run as soon as connection is established (first ACON
  * received). Just keeps incrementing the inactivity counter until
- * the connection needs to be dropped...
+ * the connection needs to be dropped; woken at once by close_soon().
  */
 void *checker(void *conn_vp) {
   connection_t *conn_p = (connection_t *)conn_vp;
-  while (1) {
+  struct timespec deadline;
+  while (!check_inactivity(conn_p)) {
     pthread_mutex_lock(&(conn_p->timeout_lock));
-    conn_p->inactive_time += CLOSE_TIMEOUT_INCREMENT;
-    // if it would sleep past the threshold, go BOOM
-    if (conn_p->inactive_time > CLOSE_TIMEOUT_THRESHOLD) {
-      pthread_mutex_unlock(&(conn_p->timeout_lock));
-      pthread_mutex_lock(&(conn_p->close_lock));
-      conn_p->should_close = 1;
-      pthread_mutex_unlock(&(conn_p->close_lock));
-      break;
+    if (conn_p->inactive_time <= CLOSE_TIMEOUT_THRESHOLD) {
+      deadline_after(&deadline, CLOSE_TIMEOUT_INCREMENT);
+      pthread_cond_timedwait(&(conn_p->timeout_cvar), &(conn_p->timeout_lock), &deadline);
     }
     pthread_mutex_unlock(&(conn_p->timeout_lock));
-    usleep(CLOSE_TIMEOUT_INCREMENT);
-    continue; // just to be safe
   }
-  // TODO: any garbage collection necessary?
   return NULL;
 }
 
+/* one round of checker()'s (or of the ring thread's, for a connection
+ * on the ring): returns 1 once the connection is to be dropped, after
+ * flagging it so and waking its handler (out of recvfrom(), by
+ * shutting the socket's receiving side) and its sender thread.
+ */
+int check_inactivity(connection_t *conn_p) {
+  pthread_mutex_lock(&(conn_p->timeout_lock));
+  // (closing sets it past the threshold at once)
+  int is_closed = (conn_p->inactive_time > CLOSE_TIMEOUT_THRESHOLD);
+  conn_p->inactive_time += CLOSE_TIMEOUT_INCREMENT;
+  // if it would sleep past the threshold, go BOOM
+  if (conn_p->inactive_time > CLOSE_TIMEOUT_THRESHOLD) {
+    pthread_mutex_unlock(&(conn_p->timeout_lock));
+    TRACE(TRACE_SENDER_OVER, PORT_OF(conn_p), 0, !is_closed);
+    pthread_mutex_lock(&(conn_p->close_lock));
+    conn_p->should_close = 1;
+    pthread_mutex_unlock(&(conn_p->close_lock));
+    // (the ring thread cancels the receive itself; DATA can still go out)
+    if (!conn_p->is_on_ring) { shutdown(conn_p->send_sockfd, SHUT_RD); }
+    pthread_mutex_lock(&(conn_p->waiter_lock));
+    wake_sender(conn_p);
+    pthread_mutex_unlock(&(conn_p->waiter_lock));
+    return 1;
+  }
+  pthread_mutex_unlock(&(conn_p->timeout_lock));
+  return 0;
+}
+
 /****** helper functions (unavailable to module users) ******/
 
+/* the connector thread: drives every handshake in connecting_q until
+ * the handler sees its first ACON or its deadline passes, and queues
+ * the outcomes. RCONs go out RCON_PERIOD apart at first and, while the
+ * receiver has not answered with a COOK, twice as far apart after each,
+ * up to RCON_MAX_PERIOD. Sleeps until the next RCON or deadline is due,
+ * or until woken by a COOK, an ACON or a new handshake; exits once
+ * there is none left (start_connecting() starts it again).
+ */
+void *connector(void *unused) {
+  connection_t *conn_p;
+  struct timespec deadline;
+  long long next_time, time_left;
+
+  pthread_mutex_lock(&connect_lock);
+  while (peek_q(connecting_q) != NULL) {
+    next_time = now_usec() + RCON_MAX_PERIOD;
+    iterate_q(connecting_q, tend_handshake, &next_time);
+    while ((conn_p = pop_item_q(connecting_q, is_handshake_over, NULL)) != NULL) {
+      finish_handshake(conn_p);
+    }
+    if (peek_q(connecting_q) == NULL) { break; }
+    time_left = next_time - now_usec();
+    if (time_left > 0) {
+      deadline_after(&deadline, (int)time_left);
+      pthread_cond_timedwait(&connect_cvar, &connect_lock, &deadline);
+    }
+  }
+  is_connector_running = 0;
+  pthread_mutex_unlock(&connect_lock);
+  return NULL;
+}
+
+/* the ring thread: takes in the transmissions of every connection on
+ * the ring (see mrt_set_io_engine()), each socket with a multishot
+ * receive of its own, tagged with the connection, and handles them in
+ * the ring's buffers as they complete. Every CLOSE_TIMEOUT_INCREMENT it
+ * does the checkers' job for the established ones, and when woken it
+ * looks for handshakes given up on. A connection to be dropped has its
+ * receive cancelled; once that is over, a dropper thread tears the
+ * connection down as its handler would have. Exits once there is none
+ * left (hand_to_ring() starts it again, with a new ring).
+ */
+void *ring_handler(void *ring_vp) {
+  ring_round_t round = { (mrt_uring_t *)ring_vp, 0 };
+  mrt_uring_t *ring_p = round.ring_p;
+  q_t *served_q = make_q(); // the connections whose receive is armed (or being cancelled)
+  connection_t *conn_p;
+  mrt_uring_event_t event;
+  long long now, next_check_time = now_usec() + CLOSE_TIMEOUT_INCREMENT;
+  eventfd_t value;
+  int is_woken;
+
+  pthread_mutex_lock(&ring_lock);
+  int wake_fd = ring_wake_fd; // (hand_to_ring() makes another once this thread is done)
+  pthread_mutex_unlock(&ring_lock);
+  mrt_uring_poll(ring_p, wake_fd, RING_TAG_WAKE);
+  while (1) {
+    // take in the new connections, or stop if there is none left at all
+    pthread_mutex_lock(&ring_lock);
+    while ((conn_p = deq_q(arrivals_q)) != NULL) {
+      enq_q(served_q, conn_p);
+      mrt_uring_recv(ring_p, conn_p->send_sockfd, (unsigned long long)(unsigned long)conn_p);
+    }
+    if (served_q == NULL || peek_q(served_q) == NULL) {
+      is_ring_running = 0;
+      ring_wake_fd = -1;
+      pthread_mutex_unlock(&ring_lock);
+      break;
+    }
+    pthread_mutex_unlock(&ring_lock);
+
+    now = now_usec();
+    if (mrt_uring_submit(ring_p, 1, (next_check_time > now) ? (int)(next_check_time - now) : 0) < 0) {
+      usleep(CLOSE_TIMEOUT_INCREMENT); // (should never happen; nothing to do but try again later)
+    }
+    is_woken = 0;
+    while (mrt_uring_next(ring_p, &event)) {
+      if (event.tag == RING_TAG_WAKE) {
+        is_woken = 1;
+        if (event.is_last) { mrt_uring_poll(ring_p, wake_fd, RING_TAG_WAKE); }
+        continue;
+      }
+      if (event.tag == MRT_URING_TAG_NONE) { continue; }
+      conn_p = (connection_t *)(unsigned long)event.tag;
+      if (event.payload != NULL) {
+        // (like the handler, nothing is handled once the connection is to be dropped)
+        if (!conn_p->is_recv_cancelled) { handle_transmission(conn_p, event.payload, event.payload_len); }
+        mrt_uring_recycle(ring_p, event.buffer_id);
+      }
+      if (!event.is_last) { continue; }
+      // the receive is over: re-armed if it only ran out of buffers, which are handled and back by now
+      if (!conn_p->is_recv_cancelled) {
+        pthread_mutex_lock(&(conn_p->close_lock));
+        if (event.result < 0 && event.result != -ENOBUFS) { conn_p->should_close = 1; }
+        conn_p->is_recv_cancelled = conn_p->should_close;
+        pthread_mutex_unlock(&(conn_p->close_lock));
+      }
+      if (!conn_p->is_recv_cancelled) {
+        mrt_uring_recv(ring_p, conn_p->send_sockfd, event.tag);
+        continue;
+      }
+      pop_item_q(served_q, is_same_connection, conn_p);
+      // (the dropper takes the handler's place)
+      if (pthread_create(&(conn_p->handler_thread), NULL, dropper, conn_p) == 0) {
+        pthread_detach(conn_p->handler_thread);
+      } else {
+        dropper(conn_p);
+      }
+    }
+
+    round.is_check_due = (now_usec() >= next_check_time);
+    if (round.is_check_due) { next_check_time = now_usec() + CLOSE_TIMEOUT_INCREMENT; }
+    if (is_woken) { eventfd_read(wake_fd, &value); }
+    if (is_woken || round.is_check_due) { iterate_q(served_q, tend_ring_connection, &round); }
+  }
+  delete_q(served_q, NULL);
+  close(wake_fd);
+  mrt_uring_free(ring_p);
+  return NULL;
+}
+
 /* initialize a new connection struct and returns its pointer
  * the caller is responsible for freeing it.
  */
@@ -541,8 +1422,12 @@ connection_t *connection_t_init(unsigned short sender_port_number, unsigned shor
   if (pthread_mutex_init(&(connection_p->buffer_lock), NULL) != 0 ||
       pthread_mutex_init(&(connection_p->receiver_lock), NULL) != 0 ||
       pthread_mutex_init(&(connection_p->timeout_lock), NULL) != 0 ||
+      pthread_cond_init(&(connection_p->timeout_cvar), NULL) != 0 ||
       pthread_mutex_init(&(connection_p->close_lock), NULL) != 0 ||
-      pthread_mutex_init(&(connection_p->outgoing_lock), NULL) != 0
+      pthread_mutex_init(&(connection_p->outgoing_lock), NULL) != 0 ||
+      pthread_mutex_init(&(connection_p->waiter_lock), NULL) != 0 ||
+      pthread_cond_init(&(connection_p->waiter_cvar), NULL) != 0 ||
+      pthread_cond_init(&(connection_p->sender_cvar), NULL) != 0
       ) { return NULL; }
 
   connection_p->send_sockfd = socket(AF_INET, SOCK_DGRAM, 0);
@@ -568,7 +1453,35 @@ connection_t *connection_t_init(unsigned short sender_port_number, unsigned shor
   connection_p->last_payload_index = -1;
   
   connection_p->receiver_window_size = 0;
-  connection_p->last_acknowledged_frag = -1;
+  connection_p->last_acknowledged_frag = initial_frag;
+  connection_p->is_established = 0;
+  connection_p->rcon_period = RCON_PERIOD;
+  connection_p->is_given_up = 0;
+  connection_p->handshake_outcome = -1;
+  connection_p->highest_sent_frag = initial_frag;
+  connection_p->rtt_probe_frag = 0;
+  connection_p->rtt_probe_time = 0;
+  connection_p->skip_frag = 0;
+  connection_p->is_skip_pending = 0;
+  connection_p->cookie = 0;
+  connection_p->shm_fd = -1;
+  // (only a receiver on this host could map it)
+  if (SENDER_SHARED_MEMORY && (receiver_s_addr >> 24) == 127) {
+    connection_p->shm_p = mrt_shm_create(&(connection_p->shm_fd));
+  }
+
+  // (the rest of the streams' state starts zeroed by calloc())
+  for (int i = 0; i < MRT_MAX_STREAMS; i++) {
+    connection_p->stream_weights[i] = 1;
+    if (i == 0) { continue; }
+    connection_p->streams[i - 1].last_payload_index = -1;
+    connection_p->streams[i - 1].last_sent_index = -1;
+    connection_p->streams[i - 1].receiver_window_size = MRT_STREAM_WINDOW_SIZE;
+  }
+
+  // (the rest of the reply state starts zeroed by calloc())
+  connection_p->reply_next_frag = 1;
+  connection_p->reply_last_advertised_window = MRT_REPLY_WINDOW_SIZE;
 
   connection_p->inactive_time = 0;
 
@@ -586,16 +1499,610 @@ void connection_t_free(void *conn_vp) {
   if (conn_p == NULL) { return; }
 
   close(conn_p->send_sockfd);
+  if (conn_p->shm_fd >= 0) { close(conn_p->shm_fd); }
+  mrt_shm_detach(conn_p->shm_p);
 
   pthread_mutex_destroy(&(conn_p->buffer_lock));
   pthread_mutex_destroy(&(conn_p->receiver_lock));
   pthread_mutex_destroy(&(conn_p->timeout_lock));
+  pthread_cond_destroy(&(conn_p->timeout_cvar));
   pthread_mutex_destroy(&(conn_p->close_lock));
   pthread_mutex_destroy(&(conn_p->outgoing_lock));
+  pthread_mutex_destroy(&(conn_p->waiter_lock));
+  pthread_cond_destroy(&(conn_p->waiter_cvar));
+  pthread_cond_destroy(&(conn_p->sender_cvar));
 
   free(conn_p);
 }
 
+/* keeps count of a DATA just sent, and times it if it is new and no
+ * other fragment is timed; a resent one spoils the timing, as its ADAT
+ * could be for either sending. Needs the receiver_lock.
+ */
+void note_frag_sent(connection_t *conn_p, int frag, int payload_length, long long now) {
+  stat_add(&(conn_p->counters.frags_sent), 1);
+  stat_add(&(conn_p->counters.bytes_sent), payload_length);
+  if (MRT_FRAG_DIFF(frag, conn_p->highest_sent_frag) <= 0) {
+    stat_add(&(conn_p->counters.frags_retransmitted), 1);
+    TRACE(TRACE_DATA_RESENT, PORT_OF(conn_p), frag, payload_length);
+    conn_p->rtt_probe_time = 0;
+    return;
+  }
+  conn_p->highest_sent_frag = frag;
+  TRACE(TRACE_DATA_SENT, PORT_OF(conn_p), frag, payload_length);
+  if (conn_p->rtt_probe_time == 0) {
+    conn_p->rtt_probe_frag = frag;
+    conn_p->rtt_probe_time = now;
+  }
+}
+
+/* the timed fragment was just acknowledged: folds the sample into the
+ * estimate (7/8 old, 1/8 new, as TCP does). Needs the receiver_lock.
+ */
+void sample_rtt(connection_t *conn_p) {
+  int sample = (int)(now_usec() - conn_p->rtt_probe_time);
+  if (sample < 1) { sample = 1; }
+  if (conn_p->rtt_estimate == 0) {
+    conn_p->rtt_estimate = sample;
+  } else {
+    conn_p->rtt_estimate = conn_p->rtt_estimate - conn_p->rtt_estimate / 8 + sample / 8;
+  }
+  conn_p->rtt_probe_time = 0;
+  stat_set(&(conn_p->counters.rtt_usec), conn_p->rtt_estimate);
+  TRACE(TRACE_RTT_UPDATED, PORT_OF(conn_p), 0, conn_p->rtt_estimate);
+}
+
+/* for the first ACON: if it echoes the ring's token, the receiver has
+ * mapped the ring and mrt_send() goes through it from now on; if not,
+ * the ring is of no more use. Either way, its descriptor is not needed
+ * anymore. Needs the receiver_lock.
+ */
+void take_shm_answer(connection_t *conn_p, char *transmission, int num_bytes_received) {
+  unsigned int token_holder = 0;
+  if (conn_p->shm_fd < 0) { return; }
+  if (num_bytes_received >= MRT_HEADER_LENGTH + MRT_SHM_TOKEN_LENGTH) {
+    memmove(&token_holder, transmission + MRT_SHM_TOKEN_LOCATION, MRT_SHM_TOKEN_LENGTH);
+  }
+  pthread_mutex_lock(&(conn_p->outgoing_lock));
+  close(conn_p->shm_fd);
+  conn_p->shm_fd = -1; // (no more offers in RCONs)
+  pthread_mutex_unlock(&(conn_p->outgoing_lock));
+  if (token_holder == conn_p->shm_p->token) {
+    conn_p->is_shm = 1;
+    stat_set(&(conn_p->counters.is_shared_memory), 1);
+  } else {
+    mrt_shm_detach(conn_p->shm_p);
+    conn_p->shm_p = NULL;
+  }
+}
+
+/* takes in an ADAT, or the acknowledgement riding on a DATA sent back
+ * (`is_piggybacked`, which is no duplicate for acknowledging nothing
+ * new): if it is at least as new as the last one, updates the frag and
+ * receiver_window_size, and frees up the acknowledged part of the buffer.
+ */
+void handle_adat(connection_t *conn_p, int frag, int window_size, int is_piggybacked) {
+  int frag_difference;
+
+  pthread_mutex_lock(&(conn_p->receiver_lock));
+  TRACE(TRACE_ADAT_RECEIVED, PORT_OF(conn_p), frag, window_size);
+  frag_difference = MRT_FRAG_DIFF(frag, conn_p->last_acknowledged_frag);
+  if (frag_difference >= 0) {
+    conn_p->last_acknowledged_frag = frag;
+    // the receiver autotunes its window, so it can shrink as well
+    conn_p->receiver_window_size = window_size;
+    stat_set(&(conn_p->counters.receiver_window), window_size);
+  }
+  if (frag_difference <= 0 && !is_piggybacked) {
+    stat_add(&(conn_p->counters.duplicate_adats), 1);
+  }
+  if (conn_p->is_skip_pending && MRT_FRAG_DIFF(frag, conn_p->skip_frag) >= 0) {
+    conn_p->is_skip_pending = 0; // the receiver has moved past the abandoned fragments
+  } else if (conn_p->is_skip_pending && !is_piggybacked &&
+             now_usec() - conn_p->last_skip_time >= (conn_p->rtt_estimate > 0 ? conn_p->rtt_estimate : EXPECTED_RTT)) {
+    // still short of them a while after the SKIP: it is likely lost
+    send_skip(conn_p, conn_p->skip_frag, 0);
+  }
+  if (conn_p->rtt_probe_time != 0 && MRT_FRAG_DIFF(frag, conn_p->rtt_probe_frag) >= 0) {
+    sample_rtt(conn_p);
+  }
+  // if we can free up the buffer, do it
+  // note that we cannot release receiver_lock yet!
+  if (frag_difference > 0) {
+    pthread_mutex_lock(&(conn_p->buffer_lock));
+    for (int i = 0; i < frag_difference && i <= conn_p->last_payload_index; i++) {
+      stat_add(&(conn_p->counters.bytes_acked), conn_p->num_bytes_buffered[i]);
+    }
+    drop_payloads(conn_p, frag_difference);
+    pthread_mutex_unlock(&(conn_p->buffer_lock));
+  }
+  // mrt_send() may be done, and the sender thread may have room now
+  pthread_mutex_lock(&(conn_p->waiter_lock));
+  conn_p->adat_seq += 1;
+  pthread_cond_broadcast(&(conn_p->waiter_cvar));
+  if (frag_difference > 0) { wake_sender(conn_p); }
+  pthread_mutex_unlock(&(conn_p->waiter_lock));
+  pthread_mutex_unlock(&(conn_p->receiver_lock));
+}
+
+/* removes the `num_payloads` oldest payloads from the buffer, whose
+ * fragments were just acknowledged (or abandoned), moving the rest up
+ * front. Needs the receiver_lock and the buffer_lock.
+ */
+void drop_payloads(connection_t *conn_p, int num_payloads) {
+  int num_remaining = conn_p->last_payload_index - num_payloads + 1;
+  if (num_remaining < 0) { num_remaining = 0; }
+  // update the buffer
+  memmove(conn_p->sender_buffer, conn_p->sender_buffer + MAX_MRT_PAYLOAD_LENGTH * num_payloads,
+    MAX_MRT_PAYLOAD_LENGTH * num_remaining);
+  // and the arrays alongside it
+  memmove(conn_p->num_bytes_buffered, conn_p->num_bytes_buffered + num_payloads, sizeof(int) * num_remaining);
+  memmove(conn_p->payload_meta, conn_p->payload_meta + num_payloads, sizeof(payload_meta_t) * num_remaining);
+  // update the last_payload_index
+  conn_p->last_payload_index = num_remaining - 1;
+  /* and the last_sent_index, which counts from the same (now moved)
+   * start; otherwise the next payload would be skipped over until
+   * the resend timeout went back for it
+   */
+  conn_p->last_sent_index -= num_payloads;
+  if (conn_p->last_sent_index < -1) { conn_p->last_sent_index = -1; }
+}
+
+/* gives up on the messages at the front of the buffer that have
+ * expired, up to the first one that has not (or the first mrt_send()
+ * payload): their fragments count as acknowledged from now on, and the
+ * receiver is sent a SKIP past them. A message has expired once its
+ * lifetime is over, or once a fragment of it that is due to go out
+ * (again) has been sent as many times as allowed.
+ *
+ * Returns the number of payloads abandoned. Needs the receiver_lock and
+ * the buffer_lock.
+ */
+int abandon_expired(connection_t *conn_p, long long now) {
+  int first = 0, last, i, is_expired, num_messages = 0;
+  payload_meta_t *meta = conn_p->payload_meta;
+
+  while (first <= conn_p->last_payload_index && (meta[first].flags & MRT_FLAG_MESSAGE)) {
+    // messages are buffered whole, so the end is there
+    for (last = first; !(meta[last].flags & MRT_FLAG_END_OF_MESSAGE); last++) { }
+    is_expired = (meta[first].expiry_time != 0 && now >= meta[first].expiry_time);
+    for (i = (conn_p->last_sent_index + 1 > first) ? conn_p->last_sent_index + 1 : first;
+         !is_expired && meta[first].max_sends > 0 && i <= last; i++) {
+      is_expired = (meta[i].num_sends >= meta[i].max_sends);
+    }
+    if (!is_expired) { break; }
+    num_messages += 1;
+    first = last + 1;
+  }
+  if (first == 0) { return 0; }
+
+  stat_add(&(conn_p->counters.messages_abandoned), num_messages);
+  stat_add(&(conn_p->counters.frags_abandoned), first);
+  conn_p->last_acknowledged_frag = MRT_FRAG_ADD(conn_p->last_acknowledged_frag, first);
+  conn_p->skip_frag = conn_p->last_acknowledged_frag;
+  conn_p->is_skip_pending = 1;
+  // (a fragment timed for the RTT may be among them; it will never be acknowledged)
+  if (conn_p->rtt_probe_time != 0 && MRT_FRAG_DIFF(conn_p->rtt_probe_frag, conn_p->skip_frag) <= 0) {
+    conn_p->rtt_probe_time = 0;
+  }
+  drop_payloads(conn_p, first);
+  // whatever went out past the gap was dropped as out of order, so go back for it
+  conn_p->last_sent_index = -1;
+  send_skip(conn_p, conn_p->skip_frag, first);
+  // mrt_send_message() may be waiting for the room
+  pthread_mutex_lock(&(conn_p->waiter_lock));
+  conn_p->adat_seq += 1;
+  pthread_cond_broadcast(&(conn_p->waiter_cvar));
+  pthread_mutex_unlock(&(conn_p->waiter_lock));
+  return first;
+}
+
+/* returns `usec`, or how long until the message at the front of the
+ * buffer expires if sooner (the sender thread sleeps no longer than
+ * that). Needs the buffer_lock.
+ */
+int time_to_expiry(connection_t *conn_p, long long now, int usec) {
+  if (conn_p->last_payload_index < 0 || conn_p->payload_meta[0].expiry_time == 0) { return usec; }
+  long long time_left = conn_p->payload_meta[0].expiry_time - now;
+  if (time_left < usec) { usec = (time_left > 0) ? (int)time_left : 0; }
+  return usec;
+}
+
+/* tells the receiver to skip past `last_abandoned_frag`; `num_abandoned`
+ * is how many fragments were just given up on (0 for a repeat). Needs
+ * the receiver_lock.
+ */
+void send_skip(connection_t *conn_p, int last_abandoned_frag, int num_abandoned) {
+  conn_p->last_skip_time = now_usec();
+  pthread_mutex_lock(&(conn_p->outgoing_lock));
+  build_skip(conn_p->outgoing_buffer, last_abandoned_frag);
+  sendto(conn_p->send_sockfd, conn_p->outgoing_buffer, MRT_HASH_LENGTH + MRT_TYPE_LENGTH + MRT_FRAGMENT_LENGTH,
+        0, (const struct sockaddr *)(&(conn_p->rece_addr)), 
+        addr_len);
+  pthread_mutex_unlock(&(conn_p->outgoing_lock));
+  stat_add(&(conn_p->counters.skips_sent), 1);
+  TRACE(TRACE_SKIP_SENT, PORT_OF(conn_p), last_abandoned_frag, num_abandoned);
+}
+
+/* takes in an ADAT for one of the other streams: like handle_adat(),
+ * frees up what it acknowledges in the stream's buffer and updates its
+ * window.
+ */
+void handle_stream_adat(connection_t *conn_p, int stream, int frag, int window_size) {
+  pthread_mutex_lock(&(conn_p->receiver_lock));
+  send_stream_t *stream_p = &(conn_p->streams[stream - 1]);
+  int frag_difference = MRT_FRAG_DIFF(frag, stream_p->last_acknowledged_frag);
+  if (frag_difference >= 0) { stream_p->receiver_window_size = window_size; }
+  if (frag_difference <= 0) { stat_add(&(conn_p->counters.duplicate_adats), 1); }
+  if (frag_difference > stream_p->last_payload_index + 1) {
+    frag_difference = stream_p->last_payload_index + 1; // acknowledging what was never sent
+  }
+  if (frag_difference > 0) {
+    int num_remaining = stream_p->last_payload_index + 1 - frag_difference;
+    for (int i = 0; i < frag_difference; i++) {
+      stat_add(&(conn_p->counters.bytes_acked), stream_p->num_bytes_buffered[i]);
+    }
+    memmove(stream_p->buffer, stream_p->buffer + MAX_MRT_PAYLOAD_LENGTH * frag_difference,
+      MAX_MRT_PAYLOAD_LENGTH * num_remaining);
+    memmove(stream_p->num_bytes_buffered, stream_p->num_bytes_buffered + frag_difference,
+      sizeof(int) * num_remaining);
+    stream_p->last_acknowledged_frag = MRT_FRAG_ADD(stream_p->last_acknowledged_frag, frag_difference);
+    stream_p->last_payload_index -= frag_difference;
+    stream_p->last_sent_index -= frag_difference;
+    if (stream_p->last_sent_index < -1) { stream_p->last_sent_index = -1; }
+    stream_p->progress_time = now_usec();
+  }
+  // mrt_send_stream() may be done, and the sender thread may have room now
+  pthread_mutex_lock(&(conn_p->waiter_lock));
+  conn_p->adat_seq += 1;
+  pthread_cond_broadcast(&(conn_p->waiter_cvar));
+  if (frag_difference > 0) { wake_sender(conn_p); }
+  pthread_mutex_unlock(&(conn_p->waiter_lock));
+  pthread_mutex_unlock(&(conn_p->receiver_lock));
+}
+
+/* whether the stream has a payload to send now: the next one unsent,
+ * if it fits in the receiver's window for the stream. The first one
+ * always goes when nothing is in flight, so that a stream whose window
+ * is shut still gets an ADAT when the window opens again (the payload
+ * is then dropped, but ADAT'd, like a window probe). Needs the
+ * receiver_lock.
+ */
+int is_stream_ready(send_stream_t *stream_p) {
+  int next_payload_index = stream_p->last_sent_index + 1, bytes_in_flight = 0;
+  if (next_payload_index > stream_p->last_payload_index) { return 0; }
+  for (int i = 0; i < next_payload_index; i++) {
+    bytes_in_flight += stream_p->num_bytes_buffered[i];
+  }
+  return next_payload_index == 0 ||
+    bytes_in_flight + stream_p->num_bytes_buffered[next_payload_index] <= stream_p->receiver_window_size;
+}
+
+/* picks the stream to send the next DATA on (stream 0 if
+ * `is_first_ready`), or returns -1 if none has anything to send. The
+ * other streams' resend timeouts are checked here, too: once nothing
+ * is acknowledged for RESEND_TIMEOUT_THRESHOLD, a stream goes back to
+ * its oldest fragment, as the receiver dropped everything after a gap.
+ *
+ * The link is shared like start-time fair queueing: each stream has a
+ * pass, which goes up by a payload's length over its weight (times
+ * STREAM_PASS_SCALE) whenever one is sent on it, and the ready stream
+ * with the lowest pass goes next. A stream that was idle starts from
+ * the pass of the last one sent on (virtual_time), so it does not get
+ * to catch up on what it did not use. Needs the receiver_lock and the
+ * buffer_lock.
+ */
+int pick_stream(connection_t *conn_p, int is_first_ready, long long now) {
+  int i, stream = -1, payload_length = 0, is_ready;
+  for (i = 0; i < MRT_MAX_STREAMS; i++) {
+    if (i == 0) {
+      is_ready = is_first_ready;
+    } else {
+      send_stream_t *stream_p = &(conn_p->streams[i - 1]);
+      if (stream_p->last_sent_index >= 0 && now - stream_p->progress_time > RESEND_TIMEOUT_THRESHOLD) {
+        stream_p->last_sent_index = -1;
+      }
+      is_ready = is_stream_ready(stream_p);
+    }
+    if (!is_ready) { continue; }
+    if (conn_p->stream_passes[i] < conn_p->virtual_time) { conn_p->stream_passes[i] = conn_p->virtual_time; }
+    if (stream < 0 || conn_p->stream_passes[i] < conn_p->stream_passes[stream]) { stream = i; }
+  }
+  if (stream < 0) { return -1; }
+  if (stream == 0) {
+    payload_length = conn_p->num_bytes_buffered[conn_p->last_sent_index + 1];
+  } else {
+    send_stream_t *stream_p = &(conn_p->streams[stream - 1]);
+    payload_length = stream_p->num_bytes_buffered[stream_p->last_sent_index + 1];
+  }
+  conn_p->virtual_time = conn_p->stream_passes[stream];
+  conn_p->stream_passes[stream] += (long long)payload_length * STREAM_PASS_SCALE / conn_p->stream_weights[stream];
+  return stream;
+}
+
+/* sends the next payload of one of the other streams (which
+ * is_stream_ready()), flagged PUSH if it is the last one that can go
+ * out for now. Needs the receiver_lock.
+ */
+void send_stream_data(connection_t *conn_p, int stream, long long now) {
+  send_stream_t *stream_p = &(conn_p->streams[stream - 1]);
+  int payload_index = stream_p->last_sent_index + 1, bytes_in_flight = 0;
+  int payload_length = stream_p->num_bytes_buffered[payload_index];
+  int frag = MRT_FRAG_ADD(stream_p->last_acknowledged_frag, payload_index + 1);
+  int flags = stream << MRT_FLAGS_STREAM_SHIFT;
+
+  for (int i = 0; i <= payload_index; i++) {
+    bytes_in_flight += stream_p->num_bytes_buffered[i];
+  }
+  if (payload_index == stream_p->last_payload_index ||
+      bytes_in_flight + stream_p->num_bytes_buffered[payload_index + 1] > stream_p->receiver_window_size) {
+    flags |= MRT_FLAG_PUSH;
+  }
+  pthread_mutex_lock(&(conn_p->outgoing_lock));
+  int transmission_length = build_data(conn_p, stream_p->buffer + payload_index * MAX_MRT_PAYLOAD_LENGTH,
+    frag, payload_length, flags);
+  sendto(conn_p->send_sockfd, conn_p->outgoing_buffer, transmission_length, 0,
+        (const struct sockaddr *)(&(conn_p->rece_addr)), addr_len);
+  pthread_mutex_unlock(&(conn_p->outgoing_lock));
+  stat_add(&(conn_p->counters.frags_sent), 1);
+  stat_add(&(conn_p->counters.bytes_sent), payload_length);
+  if (MRT_FRAG_DIFF(frag, stream_p->highest_sent_frag) <= 0) {
+    stat_add(&(conn_p->counters.frags_retransmitted), 1);
+  } else {
+    stream_p->highest_sent_frag = frag;
+  }
+  // the resend timeout runs from the first of a flight
+  if (payload_index == 0) { stream_p->progress_time = now; }
+  stream_p->last_sent_index += 1;
+}
+
+/* returns 1 if any stream but the first still has payloads buffered
+ * (sent or not), otherwise 0. Needs the receiver_lock.
+ */
+int has_stream_payloads(connection_t *conn_p) {
+  for (int i = 0; i < MRT_MAX_STREAMS - 1; i++) {
+    if (conn_p->streams[i].last_payload_index >= 0) { return 1; }
+  }
+  return 0;
+}
+
+/* buffers a DATA sent back by mrt_reply() if it is the next one and
+ * fits. Its ADAT is held back for REPLY_ACK_DELAY, in case a DATA of
+ * ours goes out meanwhile to carry it; anything out of order, a
+ * duplicate or dropped for want of room is ADAT'd at once instead, as
+ * is everything once mrt_send() goes through the ring.
+ */
+void handle_reply_data(connection_t *conn_p, int frag, char *payload, int payload_len) {
+  int is_urgent = 1;
+  pthread_mutex_lock(&(conn_p->waiter_lock));
+  if (payload_len > 0 && frag == conn_p->reply_next_frag &&
+      payload_len <= MRT_REPLY_WINDOW_SIZE - conn_p->reply_bytes_unread) {
+    int write_index = (conn_p->reply_read_index + conn_p->reply_bytes_unread) % MRT_REPLY_WINDOW_SIZE;
+    int first_part = MRT_REPLY_WINDOW_SIZE - write_index;
+    if (first_part >= payload_len) {
+      memmove(conn_p->reply_buffer + write_index, payload, payload_len);
+    } else {
+      memmove(conn_p->reply_buffer + write_index, payload, first_part);
+      memmove(conn_p->reply_buffer, payload + first_part, payload_len - first_part);
+    }
+    conn_p->reply_bytes_unread += payload_len;
+    conn_p->reply_next_frag = MRT_FRAG_ADD(conn_p->reply_next_frag, 1);
+    stat_add(&(conn_p->counters.bytes_received), payload_len);
+    TRACE(TRACE_DATA_RECEIVED, PORT_OF(conn_p), frag, payload_len);
+    pthread_cond_broadcast(&(conn_p->waiter_cvar));
+    // (mrt_send() through the ring sends no DATA for it to ride on)
+    if (!conn_p->is_reply_ack_pending && !conn_p->is_shm) {
+      conn_p->is_reply_ack_pending = 1;
+      conn_p->reply_ack_due_time = now_usec() + REPLY_ACK_DELAY;
+      // so that it sleeps no longer than that
+      wake_sender(conn_p);
+    }
+    is_urgent = conn_p->is_shm;
+  } else if (payload_len > 0) {
+    TRACE(TRACE_DATA_DROPPED, PORT_OF(conn_p), frag,
+      (MRT_FRAG_DIFF(frag, conn_p->reply_next_frag) < 0) ? TRACE_DROP_DUPLICATE :
+      (frag == conn_p->reply_next_frag) ? TRACE_DROP_WINDOW_FULL : TRACE_DROP_OUT_OF_ORDER);
+  }
+  if (is_urgent) { conn_p->is_reply_ack_pending = 1; }
+  pthread_mutex_unlock(&(conn_p->waiter_lock));
+  if (is_urgent) { send_reply_ack(conn_p, 0); }
+}
+
+/* takes the owed ADAT (only once due, if `is_due_only`): fills in what
+ * it acknowledges and advertises and clears it. Returns 0 if none is
+ * owed (or due). Takes the waiter_lock, so must be called after any of
+ * the other locks, never before.
+ */
+int take_reply_ack(connection_t *conn_p, int is_due_only, int *received_frag_p, int *window_size_p) {
+  int is_taken = 0;
+  pthread_mutex_lock(&(conn_p->waiter_lock));
+  if (conn_p->is_reply_ack_pending &&
+      (!is_due_only || now_usec() >= conn_p->reply_ack_due_time)) {
+    *received_frag_p = MRT_FRAG_ADD(conn_p->reply_next_frag, -1);
+    *window_size_p = MRT_REPLY_WINDOW_SIZE - conn_p->reply_bytes_unread;
+    conn_p->reply_last_advertised_window = *window_size_p;
+    conn_p->is_reply_ack_pending = 0;
+    is_taken = 1;
+  }
+  pthread_mutex_unlock(&(conn_p->waiter_lock));
+  return is_taken;
+}
+
+/* sends the owed ADAT on its own (only once due, if `is_due_only`) */
+void send_reply_ack(connection_t *conn_p, int is_due_only) {
+  int received_frag, window_size;
+  pthread_mutex_lock(&(conn_p->outgoing_lock));
+  if (take_reply_ack(conn_p, is_due_only, &received_frag, &window_size)) {
+    build_adat(conn_p->outgoing_buffer, received_frag, window_size);
+    sendto(conn_p->send_sockfd, conn_p->outgoing_buffer, MRT_HEADER_LENGTH,
+          0, (const struct sockaddr *)(&(conn_p->rece_addr)), 
+          addr_len);
+    stat_add(&(conn_p->counters.adats_sent), 1);
+    TRACE(TRACE_ADAT_SENT, PORT_OF(conn_p), received_frag, window_size);
+  }
+  pthread_mutex_unlock(&(conn_p->outgoing_lock));
+}
+
+/* puts the sender thread to sleep for up to `usec` microseconds, but
+ * not past an owed ADAT's due time, until woken with wake_sender();
+ * under the low-latency profile, it only lets another thread run
+ */
+void sender_sleep(connection_t *conn_p, int usec) {
+  struct timespec deadline;
+  if (conn_p->is_busy_polling) {
+    spin_pause();
+    usec = 0;
+  }
+  pthread_mutex_lock(&(conn_p->waiter_lock));
+  if (!conn_p->is_sender_woken && usec > 0) {
+    if (conn_p->is_reply_ack_pending) {
+      long long time_left = conn_p->reply_ack_due_time - now_usec();
+      if (time_left < usec) { usec = (time_left > 0) ? (int)time_left : 0; }
+    }
+    deadline_after(&deadline, usec);
+    pthread_cond_timedwait(&(conn_p->sender_cvar), &(conn_p->waiter_lock), &deadline);
+  }
+  conn_p->is_sender_woken = 0;
+  pthread_mutex_unlock(&(conn_p->waiter_lock));
+}
+
+// cuts the sender thread's sleep short; assumes that waiter_lock is held.
+void wake_sender(connection_t *conn_p) {
+  conn_p->is_sender_woken = 1;
+  pthread_cond_signal(&(conn_p->sender_cvar));
+}
+
+/* flags the connection to be dropped (past the inactivity threshold)
+ * and gets its checker, or the ring thread, to see to it right away
+ */
+void close_soon(connection_t *conn_p) {
+  pthread_mutex_lock(&(conn_p->timeout_lock));
+  conn_p->inactive_time = CLOSE_TIMEOUT_THRESHOLD + 1;
+  pthread_cond_signal(&(conn_p->timeout_cvar));
+  pthread_mutex_unlock(&(conn_p->timeout_lock));
+  if (conn_p->is_on_ring) { wake_ring(); }
+}
+
+/* for mrt_send() and mrt_disconnect(): waits (up to MRT_SEND_PERIOD)
+ * for the connection to handle an ADAT
+ * after the `seen_seq`'th, or to end; returns -1 if it is gone already
+ */
+int wait_for_adat(int id, long seen_seq) {
+  connection_t *conn_p = NULL;
+  struct timespec deadline;
+  pthread_mutex_lock(&q_lock);
+  conn_p = (connections_q == NULL) ? NULL : get_item_q(connections_q, connection_matcher, &id);
+  if (conn_p == NULL) {
+    pthread_mutex_unlock(&q_lock);
+    return -1;
+  }
+  pthread_mutex_lock(&(conn_p->waiter_lock));
+  pthread_mutex_unlock(&q_lock);
+  int is_busy_polling = conn_p->is_busy_polling;
+  if (conn_p->adat_seq == seen_seq && !conn_p->is_reply_over && !is_busy_polling) {
+    deadline_after(&deadline, MRT_SEND_PERIOD);
+    conn_p->num_waiters += 1;
+    pthread_cond_timedwait(&(conn_p->waiter_cvar), &(conn_p->waiter_lock), &deadline);
+    conn_p->num_waiters -= 1;
+  }
+  // the handler only frees the connection once we have left
+  if (conn_p->is_reply_over) { pthread_cond_broadcast(&(conn_p->waiter_cvar)); }
+  pthread_mutex_unlock(&(conn_p->waiter_lock));
+  // (spinning, the caller looks again right away instead; see mrt_set_busy_poll())
+  if (is_busy_polling) { spin_pause(); }
+  return 0;
+}
+
+/* mrt_send() for a connection whose receiver took the ring: once what
+ * mrt_send_message() buffered before is acknowledged (so the bytes stay
+ * in order), puts the bytes in the ring as there is room and returns
+ * once the receiver has taken them all out, which is when it would have
+ * acknowledged them. The connection is held through num_waiters
+ * meanwhile, as the ring goes away with it.
+ *
+ * Returns 1 once all bytes are taken, 0 if the connection is dropped
+ * first.
+ */
+int send_through_shm(int id, char *buffer, int len) {
+  connection_t *conn_p = NULL;
+  long long last_time = now_usec(), now;
+  long seen_seq;
+  int is_drained;
+  while (1) {
+    pthread_mutex_lock(&q_lock);
+    conn_p = (connections_q == NULL) ? NULL : get_item_q(connections_q, connection_matcher, &id);
+    if (conn_p == NULL) {
+      pthread_mutex_unlock(&q_lock);
+      printf("sender %d: connection dropped before all data are sent.\n", id);
+      return 0;
+    }
+    pthread_mutex_lock(&(conn_p->waiter_lock));
+    seen_seq = conn_p->adat_seq;
+    pthread_mutex_unlock(&(conn_p->waiter_lock));
+    pthread_mutex_lock(&(conn_p->buffer_lock));
+    is_drained = (conn_p->last_payload_index < 0);
+    pthread_mutex_unlock(&(conn_p->buffer_lock));
+    if (is_drained) {
+      pthread_mutex_lock(&(conn_p->waiter_lock));
+      conn_p->num_waiters += 1;
+      pthread_mutex_unlock(&(conn_p->waiter_lock));
+      pthread_mutex_unlock(&q_lock);
+      break;
+    }
+    pthread_mutex_unlock(&q_lock);
+    wait_for_adat(id, seen_seq);
+  }
+
+  mrt_shm_t *shm_p = conn_p->shm_p;
+  // (only this thread moves put_count)
+  unsigned int final_count = atomic_load(&(shm_p->put_count)) + (unsigned int)len;
+  unsigned int take_count;
+  int num_bytes_put = 0, is_over = 0, is_done = 0;
+  while (1) {
+    take_count = atomic_load(&(shm_p->take_count));
+    if (num_bytes_put < len) {
+      num_bytes_put += mrt_shm_put(shm_p, buffer + num_bytes_put, len - num_bytes_put);
+    }
+    if (take_count == final_count) {
+      is_done = 1;
+      break;
+    }
+    pthread_mutex_lock(&(conn_p->waiter_lock));
+    is_over = conn_p->is_reply_over;
+    pthread_mutex_unlock(&(conn_p->waiter_lock));
+    if (is_over) { break; }
+    // for room, or for the receiver to take the rest (looking again right away if spinning)
+    if (conn_p->is_busy_polling) {
+      spin_pause();
+    } else {
+      mrt_shm_wait(&(shm_p->take_count), take_count, &(shm_p->is_putter_waiting), MRT_SEND_PERIOD);
+    }
+  }
+  now = now_usec();
+
+  pthread_mutex_lock(&(conn_p->receiver_lock));
+  stat_add(&(conn_p->counters.bytes_sent), num_bytes_put);
+  if (is_done) { stat_add(&(conn_p->counters.bytes_acked), len); }
+  pthread_mutex_unlock(&(conn_p->receiver_lock));
+
+  pthread_mutex_lock(&(conn_p->waiter_lock));
+  stat_add(&(conn_p->counters.usec_blocked), now - last_time);
+  conn_p->num_waiters -= 1;
+  // the handler only frees the connection once we have left
+  if (conn_p->is_reply_over) { pthread_cond_broadcast(&(conn_p->waiter_cvar)); }
+  pthread_mutex_unlock(&(conn_p->waiter_lock));
+  if (!is_done) { printf("sender %d: connection dropped before all data are sent.\n", id); }
+  return is_done;
+}
+
+// sets `*deadline_p` to `usec` microseconds from now (for timed waits)
+void deadline_after(struct timespec *deadline_p, int usec) {
+  clock_gettime(CLOCK_REALTIME, deadline_p);
+  deadline_p->tv_nsec += (long)usec * 1000;
+  deadline_p->tv_sec += deadline_p->tv_nsec / 1000000000;
+  deadline_p->tv_nsec %= 1000000000;
+}
+
 /* returns 1 if the connection's id matches the input id;
  * returns 0 otherwise.
  *
@@ -611,42 +2118,335 @@ int connection_matcher(void *connection_vp, void *id_vp) {
   return 0;
 }
 
+/* sets up a connection and hands its handshake to the connector
+ * thread (starting it if need be), giving up after `timeout`
+ * microseconds unless 0; the outcome is queued for mrt_connect() or,
+ * if `is_async`, for mrt_connect_next().
+ *
+ * Returns the connection ID, or -1 upon any error.
+ */
+int start_connecting(unsigned short sender_port_number, unsigned short receiver_port_number, unsigned int s_addr,
+                     int timeout, int is_async) {
+  /****** initializing the module if not done so yet ******/
+  pthread_mutex_lock(&q_lock);
+  if (connections_q == NULL) {
+    connections_q = make_q();
+    if (connections_q == NULL) {
+      pthread_mutex_unlock(&q_lock);
+      perror("make_q() failed\n");
+      return -1;
+    }
+  }
+  pthread_mutex_unlock(&q_lock);
+  pthread_mutex_lock(&connect_lock);
+  if (connecting_q == NULL) { connecting_q = make_q(); }
+  if (outcomes_q == NULL) { outcomes_q = make_q(); }
+  pthread_mutex_unlock(&connect_lock);
+  if (connecting_q == NULL || outcomes_q == NULL) {
+    perror("make_q() failed\n");
+    return -1;
+  }
+
+  /****** initialize a new connection struct and queue it ******/
+  connection_t *curr_conn = connection_t_init(sender_port_number, receiver_port_number, s_addr);
+  if (curr_conn == NULL) {
+    perror ("connection_t_init() failed\n");
+    return -1;
+  }
+  int id = curr_conn->id;
+  curr_conn->is_async = is_async;
+  curr_conn->next_rcon_time = now_usec();
+  curr_conn->connect_deadline = (timeout > 0) ? curr_conn->next_rcon_time + timeout : 0;
+
+  // create the handler thread first (or else ACON cannot be handled), unless the ring thread takes it
+  pthread_mutex_lock(&ring_lock);
+  curr_conn->is_busy_polling = is_busy_polling;
+  curr_conn->handler_cpu = curr_conn->sender_cpu = -1;
+  if (is_busy_polling && num_pinned_cpus > 0) {
+    curr_conn->handler_cpu = pinned_cpus[next_pinned_cpu++ % num_pinned_cpus];
+    curr_conn->sender_cpu = pinned_cpus[next_pinned_cpu++ % num_pinned_cpus];
+  }
+  int usec = busy_poll_usec;
+  // spinning takes the place of the ring
+  int is_ring_wanted = (io_engine == MRT_IO_URING && !is_busy_polling);
+  pthread_mutex_unlock(&ring_lock);
+  // (not allowed past net.core.busy_read without CAP_NET_ADMIN; spinning does without)
+  if (curr_conn->is_busy_polling && usec > 0 &&
+      setsockopt(curr_conn->send_sockfd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0) {
+    perror("setsockopt(SO_BUSY_POLL) error\n");
+  }
+
+  /* the connector is started before the connection is queued anywhere,
+   * and connect_lock is held until it is in connecting_q: the connector
+   * cannot finish meanwhile, and a failure leaves nothing to undo but
+   * the connection itself
+   */
+  pthread_mutex_lock(&connect_lock);
+  if (!is_connector_running) {
+    pthread_t connector_thread;
+    if (pthread_create(&connector_thread, NULL, connector, NULL) != 0) {
+      pthread_mutex_unlock(&connect_lock);
+      perror("pthread_create(connector) error\n");
+      connection_t_free(curr_conn);
+      return -1;
+    }
+    pthread_detach(connector_thread);
+    is_connector_running = 1;
+  }
+
+  pthread_mutex_lock(&q_lock);
+  enq_q(connections_q, curr_conn);
+  pthread_mutex_unlock(&q_lock);
+  if (!is_ring_wanted || hand_to_ring(curr_conn) < 0) {
+    if (pthread_create(&(curr_conn->handler_thread), NULL, handler, curr_conn) != 0) {
+      perror("pthread_create(handler) error\n");
+      pthread_mutex_lock(&q_lock);
+      pop_item_q(connections_q, connection_matcher, &id);
+      pthread_mutex_unlock(&q_lock);
+      // (the connector, finding nothing to do, goes away)
+      pthread_mutex_unlock(&connect_lock);
+      connection_t_free(curr_conn);
+      return -1;
+    }
+    // (it frees the connection itself, through dropper(); nobody joins it)
+    pthread_detach(curr_conn->handler_thread);
+  }
+
+  /****** the connector thread takes it from here ******/
+  enq_q(connecting_q, curr_conn);
+  if (is_async) { num_async_connecting += 1; }
+  pthread_cond_broadcast(&connect_cvar);
+  pthread_mutex_unlock(&connect_lock);
+  return id;
+}
+
+/* for the connector thread, once per round on every handshake going
+ * on: notes whether it is over (established, or past its deadline and
+ * given up on), or sends its RCON if due; lowers `*next_time_vp` to
+ * when it next needs looking at. Assumes that connect_lock is held.
+ */
+void tend_handshake(void *conn_vp, void *next_time_vp) {
+  connection_t *conn_p = (connection_t *)conn_vp;
+  long long *next_time_p = (long long *)next_time_vp, now = now_usec();
+
+  pthread_mutex_lock(&(conn_p->receiver_lock));
+  if (conn_p->is_established) {
+    conn_p->handshake_outcome = 1;
+  } else if (conn_p->connect_deadline != 0 && now >= conn_p->connect_deadline) {
+    conn_p->is_given_up = 1;
+    conn_p->handshake_outcome = 0;
+  } else {
+    if (now >= conn_p->next_rcon_time) {
+      pthread_mutex_lock(&(conn_p->outgoing_lock));
+      sendto(conn_p->send_sockfd, conn_p->outgoing_buffer, build_rcon(conn_p),
+            0, (const struct sockaddr *)(&(conn_p->rece_addr)),
+            addr_len);
+      TRACE(TRACE_RCON_SENT, PORT_OF(conn_p), initial_frag, (int)conn_p->cookie);
+      pthread_mutex_unlock(&(conn_p->outgoing_lock));
+      conn_p->next_rcon_time = now + conn_p->rcon_period;
+      if (conn_p->cookie == 0) { // (unanswered so far)
+        conn_p->rcon_period = (conn_p->rcon_period * 2 < RCON_MAX_PERIOD) ? conn_p->rcon_period * 2 : RCON_MAX_PERIOD;
+      }
+    }
+    if (conn_p->next_rcon_time < *next_time_p) { *next_time_p = conn_p->next_rcon_time; }
+    if (conn_p->connect_deadline != 0 && conn_p->connect_deadline < *next_time_p) {
+      *next_time_p = conn_p->connect_deadline;
+    }
+  }
+  pthread_mutex_unlock(&(conn_p->receiver_lock));
+}
+
+// for pop_item_q(): whether tend_handshake() found the handshake over
+int is_handshake_over(void *conn_vp, void *unused) {
+  return ((connection_t *)conn_vp)->handshake_outcome >= 0;
+}
+
+/* queues the outcome of a handshake just over and wakes up whoever
+ * waits for it; one given up on is torn down (only its handler is
+ * running, blocked in recvfrom(), which shutdown() cuts short; or the
+ * ring thread has it, and is woken to drop it). Assumes that
+ * connect_lock is held.
+ */
+void finish_handshake(connection_t *conn_p) {
+  connect_outcome_t *outcome_p = malloc(sizeof(connect_outcome_t));
+  if (outcome_p == NULL) {
+    perror("malloc(connect_outcome_t) error\n");
+  } else {
+    outcome_p->id = conn_p->id;
+    outcome_p->is_established = conn_p->handshake_outcome;
+    outcome_p->is_async = conn_p->is_async;
+    enq_q(outcomes_q, outcome_p);
+  }
+  if (conn_p->is_async) { num_async_connecting -= 1; }
+  if (!conn_p->handshake_outcome) {
+    TRACE(TRACE_SENDER_OVER, PORT_OF(conn_p), 0, 1);
+    pthread_mutex_lock(&(conn_p->close_lock));
+    conn_p->should_close = 1;
+    pthread_mutex_unlock(&(conn_p->close_lock));
+    shutdown(conn_p->send_sockfd, SHUT_RDWR); // (the handler frees it from here on)
+    if (conn_p->is_on_ring) { wake_ring(); }
+  }
+  pthread_cond_broadcast(&connect_cvar);
+}
+
+/* gives the connection to the ring thread, starting it (with a new
+ * ring) if it is not running; returns -1 if that cannot be done, for the
+ * caller to start a handler instead, or 0 upon success.
+ */
+int hand_to_ring(connection_t *conn_p) {
+  pthread_t ring_thread;
+  pthread_mutex_lock(&ring_lock);
+  if (arrivals_q == NULL) { arrivals_q = make_q(); }
+  if (!is_ring_running) {
+    mrt_uring_t *ring_p = mrt_uring_new(RING_ENTRIES, RING_BUFFERS, MAX_UDP_PAYLOAD_LENGTH);
+    ring_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (arrivals_q == NULL || ring_p == NULL || ring_wake_fd < 0 ||
+        pthread_create(&ring_thread, NULL, ring_handler, ring_p) != 0) {
+      if (ring_wake_fd >= 0) { close(ring_wake_fd); }
+      ring_wake_fd = -1;
+      mrt_uring_free(ring_p);
+      pthread_mutex_unlock(&ring_lock);
+      return -1;
+    }
+    pthread_detach(ring_thread);
+    is_ring_running = 1;
+  }
+  conn_p->is_on_ring = 1;
+  enq_q(arrivals_q, conn_p);
+  eventfd_write(ring_wake_fd, 1);
+  pthread_mutex_unlock(&ring_lock);
+  return 0;
+}
+
+/* for the ring thread, on each of its connections when woken or when
+ * a check is due (see ring_handler()): does the checker's round if the
+ * connection is established (and a check is due, or it is closing),
+ * and cancels its receive if it is to be dropped.
+ */
+void tend_ring_connection(void *conn_vp, void *round_vp) {
+  connection_t *conn_p = (connection_t *)conn_vp;
+  ring_round_t *round_p = (ring_round_t *)round_vp;
+  if (conn_p->is_recv_cancelled) { return; }
+  pthread_mutex_lock(&(conn_p->timeout_lock));
+  int is_closing = (conn_p->inactive_time > CLOSE_TIMEOUT_THRESHOLD);
+  pthread_mutex_unlock(&(conn_p->timeout_lock));
+  if (round_p->is_check_due || is_closing) {
+    pthread_mutex_lock(&(conn_p->receiver_lock));
+    int is_established = conn_p->is_established;
+    pthread_mutex_unlock(&(conn_p->receiver_lock));
+    if (is_established) { check_inactivity(conn_p); }
+  }
+  pthread_mutex_lock(&(conn_p->close_lock));
+  conn_p->is_recv_cancelled = conn_p->should_close;
+  pthread_mutex_unlock(&(conn_p->close_lock));
+  if (conn_p->is_recv_cancelled) {
+    mrt_uring_cancel(round_p->ring_p, (unsigned long long)(unsigned long)conn_p);
+  }
+}
+
+// gets the ring thread to look its connections over
+void wake_ring() {
+  pthread_mutex_lock(&ring_lock);
+  if (is_ring_running) { eventfd_write(ring_wake_fd, 1); }
+  pthread_mutex_unlock(&ring_lock);
+}
+
+// for pop_item_q() on the ring thread's connections
+int is_same_connection(void *conn_vp, void *target_vp) {
+  return conn_vp == target_vp;
+}
+
+/* for pop_item_q() on outcomes_q: matches the outcome of the
+ * connection `*id_vp`, or if `id_vp` is NULL, any outcome for
+ * mrt_connect_next()
+ */
+int outcome_matcher(void *outcome_vp, void *id_vp) {
+  connect_outcome_t *outcome_p = (connect_outcome_t *)outcome_vp;
+  if (id_vp == NULL) { return outcome_p->is_async; }
+  return !outcome_p->is_async && outcome_p->id == *(int *)id_vp;
+}
+
 /* the build_x() functions assume that memmove() always succeeds
  * and need to be inside the respective connection's mutex pair
  */
-void build_rcon(char *outgoing_buffer) {
+/* builds the RCON in the connection's outgoing_buffer, with the
+ * shared-memory offer after the header while there is one; returns its
+ * length.
+ */
+int build_rcon(connection_t *conn_p) {
+  char *outgoing_buffer = conn_p->outgoing_buffer;
+  int len = MRT_HEADER_LENGTH;
   memmove(outgoing_buffer + MRT_TYPE_LOCATION, &rcon_type, MRT_TYPE_LENGTH);
   memmove(outgoing_buffer + MRT_FRAGMENT_LOCATION, &initial_frag, MRT_FRAGMENT_LENGTH);
+  memmove(outgoing_buffer + MRT_COOKIE_LOCATION, &(conn_p->cookie), MRT_COOKIE_LENGTH);
+  if (conn_p->shm_fd >= 0) {
+    int offer[MRT_SHM_OFFER_LENGTH / sizeof(int)] = {
+      MRT_SHM_MAGIC, (int)getpid(), conn_p->shm_fd, (int)conn_p->shm_p->token, ntohs(conn_p->send_addr.sin_port)
+    };
+    memmove(outgoing_buffer + MRT_SHM_OFFER_LOCATION, offer, MRT_SHM_OFFER_LENGTH);
+    len += MRT_SHM_OFFER_LENGTH;
+  }
   
-  outgoing_buffer[MRT_HASH_LENGTH + MRT_TYPE_LENGTH + MRT_FRAGMENT_LENGTH] = '\0';
-  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH);
+  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH, len - MRT_HASH_LENGTH);
   memmove(outgoing_buffer, &hash_holder, MRT_HASH_LENGTH);
+  return len;
 }
 
 void build_data_empty(char *outgoing_buffer) {
-  // choose a fake_frag such that the sender will treat it as droppable
+  /* any fragment number is a real one after wraparound; the receiver
+   * tells this apart by its having no payload (nor flags), not by -1
+   */
   int fake_frag = -1;
   memmove(outgoing_buffer + MRT_TYPE_LOCATION, &data_type, MRT_TYPE_LENGTH);
   memmove(outgoing_buffer + MRT_FRAGMENT_LOCATION, &fake_frag, MRT_FRAGMENT_LENGTH);
   
-  outgoing_buffer[MRT_HASH_LENGTH + MRT_TYPE_LENGTH + MRT_FRAGMENT_LENGTH] = '\0';
-  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH);
+  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH, MRT_TYPE_LENGTH + MRT_FRAGMENT_LENGTH);
   memmove(outgoing_buffer, &hash_holder, MRT_HASH_LENGTH);
 }
 
-void build_data(connection_t *conn_p, int payload_index, int payload_len) {
-  int last_acknowledged_frag = conn_p->last_acknowledged_frag;
-  char *sender_buffer = conn_p->sender_buffer;
+/* builds a DATA of the fragment `sending_frag` (of the stream in
+ * `flags`); also lets an owed ADAT of the receiver's DATA ride along
+ * when the payload leaves room for it. Returns the length of the
+ * transmission.
+ */
+int build_data(connection_t *conn_p, char *payload, int sending_frag, int payload_len, int flags) {
   char *outgoing_buffer = conn_p->outgoing_buffer;
-
-  int sending_frag = last_acknowledged_frag + payload_index + 1;
-
+  int payload_location = MRT_PAYLOAD_LOCATION;
+  int received_frag, window_size;
+
+  if (payload_len <= MAX_MRT_PAYLOAD_LENGTH - MRT_ACK_LENGTH &&
+      take_reply_ack(conn_p, 0, &received_frag, &window_size)) {
+    flags |= MRT_FLAG_ACK;
+    memmove(outgoing_buffer + MRT_ACK_FRAGMENT_LOCATION, &received_frag, MRT_FRAGMENT_LENGTH);
+    memmove(outgoing_buffer + MRT_ACK_WINDOWSIZE_LOCATION, &window_size, MRT_WINDOWSIZE_LENGTH);
+    payload_location += MRT_ACK_LENGTH;
+    stat_add(&(conn_p->counters.acks_piggybacked), 1);
+    TRACE(TRACE_ADAT_SENT, PORT_OF(conn_p), received_frag, window_size);
+  }
   memmove(outgoing_buffer + MRT_TYPE_LOCATION, &data_type, MRT_TYPE_LENGTH);
   memmove(outgoing_buffer + MRT_FRAGMENT_LOCATION, &sending_frag, MRT_FRAGMENT_LENGTH);
-  memmove(outgoing_buffer + MRT_PAYLOAD_LOCATION, sender_buffer + payload_index * MAX_MRT_PAYLOAD_LENGTH, payload_len);
+  memmove(outgoing_buffer + MRT_FLAGS_LOCATION, &flags, MRT_FLAGS_LENGTH);
+  memmove(outgoing_buffer + payload_location, payload, payload_len);
+
+  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH, payload_location + payload_len - MRT_HASH_LENGTH);
+  memmove(outgoing_buffer, &hash_holder, MRT_HASH_LENGTH);
+  return payload_location + payload_len;
+}
+
+void build_adat(char *outgoing_buffer, int received_frag, int curr_window_size) {
+  memmove(outgoing_buffer + MRT_TYPE_LOCATION, &adat_type, MRT_TYPE_LENGTH);
+  memmove(outgoing_buffer + MRT_FRAGMENT_LOCATION, &received_frag, MRT_FRAGMENT_LENGTH);
+  memmove(outgoing_buffer + MRT_WINDOWSIZE_LOCATION, &curr_window_size, MRT_WINDOWSIZE_LENGTH);
+  
+  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH, MRT_HEADER_LENGTH - MRT_HASH_LENGTH);
+  memmove(outgoing_buffer, &hash_holder, MRT_HASH_LENGTH);
+}
+
+void build_skip(char *outgoing_buffer, int last_abandoned_frag) {
+  memmove(outgoing_buffer + MRT_TYPE_LOCATION, &skip_type, MRT_TYPE_LENGTH);
+  memmove(outgoing_buffer + MRT_FRAGMENT_LOCATION, &last_abandoned_frag, MRT_FRAGMENT_LENGTH);
 
-  outgoing_buffer[MRT_PAYLOAD_LOCATION + payload_len] = '\0';
-  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH);
+  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH, MRT_TYPE_LENGTH + MRT_FRAGMENT_LENGTH);
   memmove(outgoing_buffer, &hash_holder, MRT_HASH_LENGTH);
 }
 
@@ -656,8 +2456,7 @@ void build_data(connection_t *conn_p, int payload_index, int payload_len) {
 void build_rcls(char *outgoing_buffer) {
   memmove(outgoing_buffer + MRT_TYPE_LOCATION, &rcls_type, MRT_TYPE_LENGTH);
   
-  outgoing_buffer[MRT_HASH_LENGTH + MRT_TYPE_LENGTH] = '\0';
-  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH);
+  unsigned long hash_holder = hash(outgoing_buffer + MRT_HASH_LENGTH, MRT_TYPE_LENGTH);
   memmove(outgoing_buffer, &hash_holder, MRT_HASH_LENGTH);
 }
 
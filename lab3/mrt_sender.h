@@ -8,9 +8,41 @@
 #ifndef _mrt_sender_h
 #define _mrt_sender_h
 
+// the largest message mrt_send_message() takes (half the send buffer)
+#define SENDER_MAX_MESSAGE_LENGTH  (MAX_MRT_PAYLOAD_LENGTH * 32)
+// see mrt_set_stream_weight()
+#define SENDER_MAX_STREAM_WEIGHT   64
+
+/* what mrt_stats() reports for a connection; counts are since
+ * mrt_connect(), sizes are in bytes and times in microseconds
+ */
+typedef struct mrt_sender_stats {
+  long long bytes_sent;          // payload bytes, retransmissions included
+  long long bytes_acked;
+  long long frags_sent;          // DATA with a payload, retransmissions included
+  long long frags_retransmitted;
+  long long empty_data_sent;     // keepalives and window probes
+  long long duplicate_adats;     // acknowledging nothing new
+  long long checksum_failures;   // replies dropped for a bad hash
+  long long window_stalls;       // times the receiver's window ran out
+  long long usec_blocked;        // in mrt_send(), mrt_receive() and mrt_disconnect()
+  long long bytes_received;      // sent back by the receiver's mrt_reply(), in order
+  long long adats_sent;          // for those, on their own
+  long long acks_piggybacked;    // for those, riding on a DATA instead
+  long long messages_sent;       // by mrt_send_message(), abandoned ones included
+  long long messages_abandoned;  // expired before their last fragment's ADAT
+  long long frags_abandoned;     // of those; skipped by the receiver
+  long long skips_sent;          // repeats included
+  int receiver_window;           // as last advertised
+  int rtt_usec;                  // smoothed; 0 until the first sample
+  int is_shared_memory;          // 1 if mrt_send() goes through a ring shared with the receiver (see mrt.h)
+} mrt_sender_stats_t;
+
 /* returns the connection ID (int; non-negative)
  * returns -1 upon any error
- * will block until the connection is established
+ * will block until the connection is established (however long that
+ * takes: unanswered RCONs are resent further and further apart, up to
+ * 16 times the first gap)
  *
  * the `s_addr` should have the same format as
  * `(struct sockaddr_in).sin_addr.s_addr`
@@ -18,6 +50,59 @@
  */
 int mrt_connect(unsigned short sender_port_number, unsigned short receiver_port_number, unsigned int s_addr);
 
+/* Starts connecting as mrt_connect() does, but returns at once; the
+ * handshakes of any number of connections started this way go on at
+ * the same time, and mrt_connect_next() reports each as it ends. One
+ * is given up on if not established within `timeout` microseconds
+ * (0 for never).
+ *
+ * Returns the connection ID (non-negative), or -1 upon any error.
+ * The ID is not to be used until mrt_connect_next() reports it
+ * established; one given up on is gone by then.
+ */
+int mrt_connect_start(unsigned short sender_port_number, unsigned short receiver_port_number, unsigned int s_addr,
+                      int timeout);
+
+/* Waits for the next handshake started by mrt_connect_start() to end,
+ * in whatever order they do, for up to `timeout` microseconds (or for
+ * as long as it takes if negative), and puts its connection ID into
+ * `*id_p`.
+ *
+ * Returns 1 if it is established, 0 if it was given up on, or -1 if
+ * none ended in time or none is going on.
+ */
+int mrt_connect_next(int *id_p, int timeout);
+
+/* picks how the connections started from now on take in what the
+ * receiver sends: MRT_IO_SOCKETS (the default) gives each one a
+ * handler thread blocked in recvfrom() and a checker thread of its own;
+ * MRT_IO_URING hands them all to one ring thread instead, which keeps a
+ * multishot receive going on each connection's socket of one io_uring
+ * (see mrt_uring.h) and checks them all for inactivity itself. Each
+ * connection still sends its DATA from a thread of its own.
+ *
+ * Returns the engine in effect: MRT_IO_SOCKETS if io_uring was asked
+ * for but the kernel cannot do it. Should the ring fail to be set up
+ * for a connection, it gets threads of its own after all.
+ */
+int mrt_set_io_engine(int engine);
+
+/* turns the low-latency profile on (`is_on` = 1) or off (the default)
+ * for the connections started from now on: instead of sleeping until
+ * woken, each one's handler keeps polling its socket without blocking,
+ * its sender thread keeps looking for something to send, and
+ * mrt_send() and mrt_receive() keep looking for what they wait for,
+ * each burning a CPU meanwhile. If `usec` is positive, the sockets also
+ * busy-poll the device queue for that long on each receive
+ * (SO_BUSY_POLL). If `num_cpus` is positive, the handlers and sender
+ * threads are pinned to `cpus` (at most MRT_MAX_PINNED_CPUS of them),
+ * one after the other in turn.
+ *
+ * Spinning takes the place of io_uring (see mrt_set_io_engine()).
+ * Returns 0 on success and -1 if the CPUs are not valid.
+ */
+int mrt_set_busy_poll(int is_on, int usec, const int *cpus, int num_cpus);
+
 /* Returns 1 if all bytes are successfully sent (acknowledged).
  * Will block until the corresponding final ADAT is processed (large
  * enough data will be split into multiple fragments).
@@ -29,13 +114,87 @@ int mrt_connect(unsigned short sender_port_number, unsigned short receiver_port_
  * Returns -1 if the call is spurious (connection not accepted yet,
  * mrt_open() not even called yet, etc.)
  *
+ * If the receiver is on the same host and took the shared-memory ring
+ * offered in the handshake (see mrt.h), the bytes go through it
+ * instead, and count as acknowledged once the receiver has taken them.
+ *
  * Does not support getting called multiple times concurrently
  * for the same connection (undefined behavior if attempted).
  */
 int mrt_send(int id, char *buffer, int len);
 
-/* will wait until final ADAT is received to send a RCLS
- * (unless signaled to close by timeout). Blocking.
+/* Like mrt_send(), but sends `len` bytes (at most
+ * SENDER_MAX_MESSAGE_LENGTH) as one message, which the receiver gets
+ * whole with mrt_receive_message() or not at all, and only for as long
+ * as it is worth sending: it is abandoned once `lifetime` microseconds
+ * have passed without it being acknowledged (never if 0), or once any
+ * of its fragments would be sent for the (`max_retransmits` + 1)th
+ * time (never if negative). The receiver is then told to skip past it,
+ * so newer messages are not held up behind it.
+ *
+ * Messages are abandoned oldest first: one that expires behind a live
+ * message (or behind mrt_send() bytes) is sent anyway.
+ *
+ * Does not wait for the ADAT, only for room in the send buffer.
+ * Returns 1 once the message is buffered, 0 if it expired before there
+ * was room or the connection is dropped, and -1 if the call is spurious
+ * (including a `len` out of range). Same concurrency rules as mrt_send().
+ */
+int mrt_send_message(int id, char *buffer, int len, int lifetime, int max_retransmits);
+
+/* Like mrt_send(), but on one of the connection's streams (see mrt.h);
+ * the receiver reads it with mrt_receive_stream(). Each stream is in
+ * order on its own, so bytes on one are never held up by a fragment
+ * lost on another. Stream 0 is the one mrt_send() uses.
+ *
+ * Calls on different streams of the same connection may run at the
+ * same time (one per stream); the sender thread shares the link
+ * between the streams with something to send by their weights (see
+ * mrt_set_stream_weight()).
+ *
+ * Returns 1, 0 or -1 like mrt_send() (-1 for a `stream` out of range,
+ * too).
+ */
+int mrt_send_stream(int id, int stream, char *buffer, int len);
+
+/* sets how much of the link the stream gets while others have
+ * something to send as well: bytes are sent on each in proportion to
+ * its weight (1 by default, at most SENDER_MAX_STREAM_WEIGHT), so a
+ * stream of weight 4 next to one of weight 1 gets 4/5 of the link. A
+ * stream that has nothing to send does not save up its share.
+ *
+ * Returns 0 on success and -1 if the call is spurious.
+ */
+int mrt_set_stream_weight(int id, int stream, int weight);
+
+/* copies the connection's statistics into `*stats_p`. The counters
+ * are kept all the time and read without blocking the connection, so
+ * this can be called as often as wanted (from any thread).
+ *
+ * Returns 0 on success and -1 if no such connection exists (anymore).
+ */
+int mrt_stats(int id, mrt_sender_stats_t *stats_p);
+
+/* Moves to `buffer` at least 1 byte and at most `len` of what the
+ * receiver sent back over the connection with mrt_reply(), in order.
+ * Will block and wait until there is some. Can be called while
+ * another thread is in mrt_send().
+ *
+ * The ADAT for those bytes is held back a little, to ride on the
+ * next DATA mrt_send() sends if it comes soon enough (as a request
+ * following its answer would).
+ *
+ * Returns the number of bytes written.
+ * Returns 0 once the connection is over (bytes sent back but not read
+ * by then are gone with it).
+ * Returns -1 if the call is spurious.
+ */
+int mrt_receive(int id, char *buffer, int len);
+
+/* will wait until final ADAT is received (on every stream) to send a
+ * RCLS (unless signaled to close by timeout). Blocking: returns once
+ * the connection is torn down, its threads gone and its resources
+ * freed, without waiting out the inactivity timeout for the ACLS.
  */
 void mrt_disconnect(int id);
 
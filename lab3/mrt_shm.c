@@ -0,0 +1,139 @@
+/* The shared-memory ring of the MRT module; see mrt_shm.h.
+ *
+ * The counters only ever grow (modulo 2^32, which a power-of-2 ring
+ * size divides), so put_count - take_count is what the ring holds. The
+ * ring's bytes are published by the store to a counter and picked up by
+ * the load of it on the other side (both sequentially consistent, which
+ * the flag handshake below needs anyway).
+ *
+ * Sleeping without a lost wake-up: the sleeper raises its flag, then
+ * looks at the counter once more and sleeps in FUTEX_WAIT only if it is
+ * still what it saw, which the kernel checks again atomically; the
+ * other side moves the counter, then looks at the flag. One of the two
+ * sees the other's store. The futex is not FUTEX_PRIVATE, as the two
+ * sides are two processes.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+// memfd_create() and syscall()
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h> // close(), ftruncate(), getpid(), syscall()
+#include <fcntl.h> // open()
+#include <limits.h> // INT_MAX
+#include <time.h> // struct timespec
+#include <sys/mman.h> // memfd_create(), mmap()
+#include <sys/stat.h> // fstat()
+#include <sys/random.h> // getrandom()
+#include <sys/syscall.h> // SYS_futex
+#include <linux/futex.h>
+
+#include "mrt_shm.h"
+#include "utilities.h" // now_usec()
+
+void wake_other(_Atomic unsigned int *count_p, _Atomic int *is_waiting_p);
+
+mrt_shm_t *mrt_shm_create(int *fd_p) {
+  int fd = memfd_create("mrt_shm", MFD_CLOEXEC);
+  if (fd < 0) { return NULL; }
+  if (ftruncate(fd, sizeof(mrt_shm_t)) < 0) {
+    close(fd);
+    return NULL;
+  }
+  mrt_shm_t *shm_p = mmap(NULL, sizeof(mrt_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (shm_p == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+  // (the rest starts zeroed, like any new file)
+  if (getrandom(&(shm_p->token), sizeof(shm_p->token), 0) != sizeof(shm_p->token)) {
+    shm_p->token = (unsigned int)(now_usec() ^ ((long long)getpid() << 16));
+  }
+  shm_p->magic = MRT_SHM_MAGIC;
+  *fd_p = fd;
+  return shm_p;
+}
+
+mrt_shm_t *mrt_shm_attach(int pid, int fd, unsigned int token) {
+  char path[64];
+  struct stat st;
+  snprintf(path, sizeof(path), "/proc/%d/fd/%d", pid, fd);
+  int my_fd = open(path, O_RDWR | O_CLOEXEC);
+  if (my_fd < 0) { return NULL; }
+  // anything else the sender process has open is of no use
+  if (fstat(my_fd, &st) < 0 || st.st_size != sizeof(mrt_shm_t)) {
+    close(my_fd);
+    return NULL;
+  }
+  mrt_shm_t *shm_p = mmap(NULL, sizeof(mrt_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, my_fd, 0);
+  close(my_fd); // the mapping stays
+  if (shm_p == MAP_FAILED) { return NULL; }
+  if (shm_p->magic != MRT_SHM_MAGIC || shm_p->token != token) {
+    munmap(shm_p, sizeof(mrt_shm_t));
+    return NULL;
+  }
+  return shm_p;
+}
+
+void mrt_shm_detach(mrt_shm_t *shm_p) {
+  if (shm_p != NULL) { munmap(shm_p, sizeof(mrt_shm_t)); }
+}
+
+int mrt_shm_put(mrt_shm_t *shm_p, const char *bytes, int len) {
+  unsigned int put_count = atomic_load_explicit(&(shm_p->put_count), memory_order_relaxed);
+  int room = MRT_SHM_RING_SIZE - (int)(put_count - atomic_load(&(shm_p->take_count)));
+  if (len > room) { len = room; }
+  if (len <= 0) { return 0; }
+  int put_index = put_count & (MRT_SHM_RING_SIZE - 1);
+  int first_part = MRT_SHM_RING_SIZE - put_index;
+  if (first_part >= len) {
+    memmove(shm_p->ring + put_index, bytes, len);
+  } else {
+    memmove(shm_p->ring + put_index, bytes, first_part);
+    memmove(shm_p->ring, bytes + first_part, len - first_part);
+  }
+  atomic_store(&(shm_p->put_count), put_count + len);
+  wake_other(&(shm_p->put_count), &(shm_p->is_taker_waiting));
+  return len;
+}
+
+int mrt_shm_peek(mrt_shm_t *shm_p, char **bytes_pp) {
+  unsigned int take_count = atomic_load_explicit(&(shm_p->take_count), memory_order_relaxed);
+  int len = (int)(atomic_load(&(shm_p->put_count)) - take_count);
+  int take_index = take_count & (MRT_SHM_RING_SIZE - 1);
+  if (len > MRT_SHM_RING_SIZE - take_index) { len = MRT_SHM_RING_SIZE - take_index; }
+  *bytes_pp = shm_p->ring + take_index;
+  return len;
+}
+
+void mrt_shm_take(mrt_shm_t *shm_p, int len) {
+  unsigned int take_count = atomic_load_explicit(&(shm_p->take_count), memory_order_relaxed);
+  atomic_store(&(shm_p->take_count), take_count + len);
+  wake_other(&(shm_p->take_count), &(shm_p->is_putter_waiting));
+}
+
+void mrt_shm_wait(_Atomic unsigned int *count_p, unsigned int seen, _Atomic int *is_waiting_p, int usec) {
+  struct timespec timeout = { usec / 1000000, (long)(usec % 1000000) * 1000 };
+  atomic_store(is_waiting_p, 1);
+  if (atomic_load(count_p) == seen) {
+    // (EAGAIN if it moved meanwhile, EINTR or ETIMEDOUT are all fine)
+    syscall(SYS_futex, (unsigned int *)count_p, FUTEX_WAIT, seen, &timeout, NULL, 0);
+  }
+  atomic_store(is_waiting_p, 0);
+}
+
+void mrt_shm_wake(_Atomic unsigned int *count_p) {
+  syscall(SYS_futex, (unsigned int *)count_p, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/****** helper functions (unavailable to module users) ******/
+
+// wakes up the other side if it sleeps on `*count_p`, which was just moved
+void wake_other(_Atomic unsigned int *count_p, _Atomic int *is_waiting_p) {
+  if (atomic_load(is_waiting_p)) {
+    syscall(SYS_futex, (unsigned int *)count_p, FUTEX_WAKE, 1, NULL, NULL, 0);
+  }
+}
@@ -0,0 +1,75 @@
+/* Header file for `mrt_shm.c`
+ * The shared-memory ring that a sender and a receiver on the same host
+ * move a connection's bytes through instead of DATA (see mrt.h for how
+ * the two agree on it).
+ *
+ * The sender creates the ring (a memfd) and offers it in its RCONs; the
+ * receiver maps it through /proc/<pid>/fd/<fd>, which only works on the
+ * same host, and checks the ring's token, which only the sender's RCONs
+ * carry. One side puts bytes in, the other takes them out; each counter
+ * is written by one side only, so there is no lock between them. A side
+ * that runs out of room or bytes sleeps on the other's counter with a
+ * futex, and is only woken with a system call when it says it sleeps.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+#ifndef _mrt_shm_h
+#define _mrt_shm_h
+
+#include <stdatomic.h>
+
+#define MRT_SHM_MAGIC        0x4d525453 // "MRTS"
+#define MRT_SHM_RING_SIZE    (1 << 20)  // a power of 2
+
+typedef struct mrt_shm {
+  unsigned int magic;
+  unsigned int token; // random; the receiver echoes it in the ACON that takes the ring
+  _Atomic unsigned int put_count;  // bytes ever put in (modulo 2^32); only the sender writes it
+  _Atomic unsigned int take_count; // bytes ever taken out; only the receiver writes it
+  _Atomic int is_taker_waiting;    // asleep on put_count
+  _Atomic int is_putter_waiting;   // asleep on take_count
+  char ring[MRT_SHM_RING_SIZE];
+} mrt_shm_t;
+
+/* for the sender: creates and maps a ring, and puts the descriptor the
+ * receiver opens it by into `*fd_p` (the caller closes it once the
+ * receiver has); returns NULL upon any error.
+ */
+mrt_shm_t *mrt_shm_create(int *fd_p);
+
+/* for the receiver: maps the ring that process `pid` has open as `fd`,
+ * if it is one and has the token; returns NULL otherwise (the sender
+ * being on another host included).
+ */
+mrt_shm_t *mrt_shm_attach(int pid, int fd, unsigned int token);
+
+// unmaps the ring (on either side); does nothing for NULL
+void mrt_shm_detach(mrt_shm_t *shm_p);
+
+/* for the sender: copies as much of the `len` bytes as there is room
+ * for into the ring, wakes the receiver if it sleeps, and returns how
+ * many went in.
+ */
+int mrt_shm_put(mrt_shm_t *shm_p, const char *bytes, int len);
+
+/* for the receiver: points `*bytes_pp` at the oldest bytes in the ring
+ * and returns how many of them are in one piece (0 if there are none).
+ */
+int mrt_shm_peek(mrt_shm_t *shm_p, char **bytes_pp);
+
+// for the receiver: takes `len` peeked bytes out, waking the sender if it sleeps
+void mrt_shm_take(mrt_shm_t *shm_p, int len);
+
+/* waits up to `usec` microseconds (or a signal) for `*count_p`, which
+ * the other side moves along, to be past `seen`; `*is_waiting_p` is this
+ * side's flag. Returns at once if it already is.
+ */
+void mrt_shm_wait(_Atomic unsigned int *count_p, unsigned int seen, _Atomic int *is_waiting_p, int usec);
+
+/* cuts short whatever mrt_shm_wait() on `*count_p` is going on, without
+ * moving the count (for tearing a connection down)
+ */
+void mrt_shm_wake(_Atomic unsigned int *count_p);
+
+#endif // _mrt_shm_h
@@ -0,0 +1,230 @@
+/* Event tracing for the Mini Reliable Transport module; see mrt_trace.h.
+ *
+ * Each ring has a single writer (its thread), which fills a record and
+ * then publishes it by bumping `head` with a release store; the dump
+ * reads `head` with an acquire load once tracing is off. The slot the
+ * writer may still be filling is the one at `head`, so the dump skips
+ * it when the ring has wrapped around.
+ *
+ * Rings are never freed: a thread that exits puts its ring back on a
+ * list for the next new thread to carry on in (the receiver starts a
+ * checker per connection, and a ring each would add up).
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+// necessary for clock_gettime()
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h> // malloc()
+#include <time.h> // clock_gettime()
+#include <pthread.h>
+
+#include "mrt_trace.h"
+
+typedef struct trace_ring {
+  trace_record_t records[TRACE_RING_SIZE];
+  _Atomic uint64_t head; // records ever written; the next goes at head % TRACE_RING_SIZE
+  struct trace_ring *next_ring; // in all_rings
+  struct trace_ring *next_free; // in free_rings, while no thread has it
+} trace_ring_t;
+
+trace_ring_t *take_ring();
+void give_back_ring(void *ring_vp);
+
+/****** global variables ******/
+atomic_int trace_enabled = 0;
+
+// everything below is protected by rings_lock, except the thread-locals
+pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+trace_ring_t *all_rings = NULL;
+trace_ring_t *free_rings = NULL;
+FILE *trace_file = NULL;
+int num_rings = 0;
+uint32_t num_threads = 0;
+pthread_key_t ring_key; // gives the ring back when its thread exits
+pthread_once_t ring_key_once = PTHREAD_ONCE_INIT;
+
+_Thread_local trace_ring_t *my_ring = NULL;
+_Thread_local uint32_t my_thread = 0;
+
+const char *event_names[TRACE_NUM_EVENTS] = {
+  [TRACE_RCON_SENT] = "RCON_SENT",
+  [TRACE_COOK_RECEIVED] = "COOK_RECEIVED",
+  [TRACE_ACON_RECEIVED] = "ACON_RECEIVED",
+  [TRACE_DATA_SENT] = "DATA_SENT",
+  [TRACE_DATA_RESENT] = "DATA_RESENT",
+  [TRACE_EMPTY_DATA_SENT] = "EMPTY_DATA_SENT",
+  [TRACE_ADAT_RECEIVED] = "ADAT_RECEIVED",
+  [TRACE_WINDOW_STALL] = "WINDOW_STALL",
+  [TRACE_RESEND_TIMEOUT] = "RESEND_TIMEOUT",
+  [TRACE_RTT_UPDATED] = "RTT_UPDATED",
+  [TRACE_SKIP_SENT] = "SKIP_SENT",
+  [TRACE_RCLS_SENT] = "RCLS_SENT",
+  [TRACE_ACLS_RECEIVED] = "ACLS_RECEIVED",
+  [TRACE_SENDER_OVER] = "SENDER_OVER",
+  [TRACE_RCON_RECEIVED] = "RCON_RECEIVED",
+  [TRACE_COOK_SENT] = "COOK_SENT",
+  [TRACE_ACON_SENT] = "ACON_SENT",
+  [TRACE_ACCEPTED] = "ACCEPTED",
+  [TRACE_DATA_RECEIVED] = "DATA_RECEIVED",
+  [TRACE_DATA_DROPPED] = "DATA_DROPPED",
+  [TRACE_ADAT_SENT] = "ADAT_SENT",
+  [TRACE_WINDOW_RESIZED] = "WINDOW_RESIZED",
+  [TRACE_SKIP_RECEIVED] = "SKIP_RECEIVED",
+  [TRACE_RCLS_RECEIVED] = "RCLS_RECEIVED",
+  [TRACE_ACLS_SENT] = "ACLS_SENT",
+  [TRACE_RECEIVER_OVER] = "RECEIVER_OVER",
+  [TRACE_RECLAIMED] = "RECLAIMED",
+  [TRACE_CHECKSUM_FAILED] = "CHECKSUM_FAILED",
+};
+
+/****** functions ******/
+
+/* starts recording for a dump into `path`; returns -1 if tracing is
+ * already on or the file cannot be created, otherwise 0.
+ */
+int mrt_trace_start(const char *path) {
+  pthread_mutex_lock(&rings_lock);
+  if (trace_file != NULL) {
+    pthread_mutex_unlock(&rings_lock);
+    return -1;
+  }
+  trace_file = fopen(path, "wb");
+  if (trace_file == NULL) {
+    pthread_mutex_unlock(&rings_lock);
+    perror("fopen(trace file) error\n");
+    return -1;
+  }
+  // leftovers from an earlier trace don't belong in this one
+  for (trace_ring_t *ring_p = all_rings; ring_p != NULL; ring_p = ring_p->next_ring) {
+    atomic_store(&(ring_p->head), 0);
+  }
+  atomic_store(&trace_enabled, 1);
+  pthread_mutex_unlock(&rings_lock);
+  return 0;
+}
+
+/* stops recording and dumps every ring; returns -1 if tracing was not
+ * on or writing failed, otherwise 0.
+ */
+int mrt_trace_stop() {
+  trace_file_header_t header;
+  uint64_t *heads, first;
+  trace_ring_t *ring_p;
+  int result = 0, i;
+
+  pthread_mutex_lock(&rings_lock);
+  if (trace_file == NULL) {
+    pthread_mutex_unlock(&rings_lock);
+    return -1;
+  }
+  atomic_store(&trace_enabled, 0);
+
+  // the header counts the records, so take every head once, up front
+  memset(&header, 0, sizeof(header));
+  memmove(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  header.version = TRACE_VERSION;
+  header.record_size = sizeof(trace_record_t);
+  heads = malloc((num_rings + 1) * sizeof(uint64_t));
+  if (heads == NULL) { result = -1; }
+  for (ring_p = all_rings, i = 0; heads != NULL && ring_p != NULL; ring_p = ring_p->next_ring, i++) {
+    heads[i] = atomic_load_explicit(&(ring_p->head), memory_order_acquire);
+    first = (heads[i] > TRACE_RING_SIZE - 1) ? heads[i] - (TRACE_RING_SIZE - 1) : 0;
+    header.num_records += heads[i] - first;
+  }
+  if (heads != NULL && fwrite(&header, sizeof(header), 1, trace_file) != 1) { result = -1; }
+  for (ring_p = all_rings, i = 0; heads != NULL && ring_p != NULL; ring_p = ring_p->next_ring, i++) {
+    first = (heads[i] > TRACE_RING_SIZE - 1) ? heads[i] - (TRACE_RING_SIZE - 1) : 0;
+    // the ring's records may wrap around its end
+    while (first < heads[i]) {
+      uint64_t num_contiguous = TRACE_RING_SIZE - first % TRACE_RING_SIZE;
+      if (num_contiguous > heads[i] - first) { num_contiguous = heads[i] - first; }
+      if (fwrite(&(ring_p->records[first % TRACE_RING_SIZE]), sizeof(trace_record_t),
+                 num_contiguous, trace_file) != num_contiguous) {
+        result = -1;
+      }
+      first += num_contiguous;
+    }
+  }
+  free(heads);
+  if (fclose(trace_file) != 0) { result = -1; }
+  trace_file = NULL;
+  pthread_mutex_unlock(&rings_lock);
+  return result;
+}
+
+/* records an event in the calling thread's ring, taking one for the
+ * thread first if it has none.
+ */
+void trace_record(int event, int port, int frag, int value) {
+  trace_ring_t *ring_p = my_ring;
+  struct timespec ts;
+
+  if (ring_p == NULL) {
+    ring_p = take_ring();
+    if (ring_p == NULL) { return; }
+  }
+  // only this thread writes the ring, so no need for a read-modify-write
+  uint64_t head = atomic_load_explicit(&(ring_p->head), memory_order_relaxed);
+  trace_record_t *record_p = &(ring_p->records[head % TRACE_RING_SIZE]);
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  record_p->time_ns = (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  record_p->event = (uint16_t)event;
+  record_p->port = (uint16_t)port;
+  record_p->thread = my_thread;
+  record_p->frag = frag;
+  record_p->value = value;
+  atomic_store_explicit(&(ring_p->head), head + 1, memory_order_release);
+}
+
+const char *trace_event_name(int event) {
+  if (event <= 0 || event >= TRACE_NUM_EVENTS) { return NULL; }
+  return event_names[event];
+}
+
+/****** helper functions ******/
+
+void make_ring_key() {
+  pthread_key_create(&ring_key, give_back_ring);
+}
+
+/* gives the calling thread a ring (a free one if any) and a number;
+ * returns NULL if malloc() failed.
+ */
+trace_ring_t *take_ring() {
+  trace_ring_t *ring_p;
+  pthread_once(&ring_key_once, make_ring_key);
+  pthread_mutex_lock(&rings_lock);
+    ring_p = free_rings;
+    if (ring_p != NULL) {
+      free_rings = ring_p->next_free;
+    } else {
+      ring_p = malloc(sizeof(trace_ring_t));
+      if (ring_p == NULL) {
+    pthread_mutex_unlock(&rings_lock);
+        return NULL;
+      }
+      atomic_init(&(ring_p->head), 0);
+      ring_p->next_ring = all_rings;
+      all_rings = ring_p;
+      num_rings += 1;
+    }
+    ring_p->next_free = NULL;
+    my_thread = num_threads++;
+  pthread_mutex_unlock(&rings_lock);
+  my_ring = ring_p;
+  pthread_setspecific(ring_key, ring_p);
+  return ring_p;
+}
+
+// the destructor of ring_key: the exiting thread's ring is up for grabs.
+void give_back_ring(void *ring_vp) {
+  trace_ring_t *ring_p = (trace_ring_t *)ring_vp;
+  pthread_mutex_lock(&rings_lock);
+    ring_p->next_free = free_rings;
+    free_rings = ring_p;
+  pthread_mutex_unlock(&rings_lock);
+}
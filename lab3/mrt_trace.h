@@ -0,0 +1,120 @@
+/* Header file for `mrt_trace.c`
+ * Event tracing for the MRT module, cheap enough to leave on while
+ * chasing a stall: what each side sent, received, dropped and decided,
+ * with nanosecond timestamps.
+ *
+ * Every thread that records an event gets a ring of its own, so
+ * recording takes no lock and no atomic read-modify-write: one clock
+ * read and a 24-byte store. The rings keep the latest TRACE_RING_SIZE
+ * events each, and mrt_trace_stop() dumps them into a binary file,
+ * which `trace_to_qlog` turns into a qlog (JSON) timeline.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+#ifndef _mrt_trace_h
+#define _mrt_trace_h
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define TRACE_RING_SIZE  (1 << 14) // events kept per thread (a power of 2); older ones are overwritten
+#define TRACE_MAGIC      "MRTTRACE"
+#define TRACE_VERSION    2
+
+/* what happened; `frag` and `value` of the record are as noted
+ * (a - means unused). The sender side's events come first.
+ */
+enum trace_event {
+  TRACE_RCON_SENT = 1,      // initial frag, cookie
+  TRACE_COOK_RECEIVED,      // -, cookie
+  TRACE_ACON_RECEIVED,      // -, -
+  TRACE_DATA_SENT,          // frag, payload length
+  TRACE_DATA_RESENT,        // frag, payload length
+  TRACE_EMPTY_DATA_SENT,    // -, -
+  TRACE_ADAT_RECEIVED,      // frag, window
+  TRACE_WINDOW_STALL,       // next frag to send, window
+  TRACE_RESEND_TIMEOUT,     // first frag to resend, number of frags in flight
+  TRACE_RTT_UPDATED,        // -, smoothed RTT in microseconds
+  TRACE_SKIP_SENT,          // last frag abandoned, frags abandoned just now (0 if repeated)
+  TRACE_RCLS_SENT,          // -, -
+  TRACE_ACLS_RECEIVED,      // -, -
+  TRACE_SENDER_OVER,        // -, 1 if it timed out rather than closed
+
+  TRACE_RCON_RECEIVED,      // initial frag, cookie
+  TRACE_COOK_SENT,          // initial frag, cookie
+  TRACE_ACON_SENT,          // initial frag, -
+  TRACE_ACCEPTED,           // -, -
+  TRACE_DATA_RECEIVED,      // frag, payload length (buffered)
+  TRACE_DATA_DROPPED,       // frag, a trace_drop_reason
+  TRACE_ADAT_SENT,          // frag, window
+  TRACE_WINDOW_RESIZED,     // -, new buffer size
+  TRACE_SKIP_RECEIVED,      // last frag abandoned, bytes of a partial message discarded
+  TRACE_RCLS_RECEIVED,      // -, -
+  TRACE_ACLS_SENT,          // -, -
+  TRACE_RECEIVER_OVER,      // -, - (closed or timed out; an RCLS_RECEIVED before it tells)
+  TRACE_RECLAIMED,          // -, unread bytes dropped with it
+
+  TRACE_CHECKSUM_FAILED,    // -, transmission length (either side)
+  TRACE_NUM_EVENTS
+};
+
+enum trace_drop_reason {
+  TRACE_DROP_DUPLICATE = 1,
+  TRACE_DROP_WINDOW_FULL,
+  TRACE_DROP_OUT_OF_ORDER,
+};
+
+/* one event, as stored in the rings and in the dump (native byte order;
+ * the dump is read on the machine that wrote it)
+ */
+typedef struct trace_record {
+  uint64_t time_ns;  // CLOCK_MONOTONIC
+  uint16_t event;
+  uint16_t port;     // the sending side's port, which names the connection on both sides
+  uint32_t thread;   // numbered in the order threads first recorded
+  int32_t frag;
+  int32_t value;
+} trace_record_t;
+
+/* the dump: this header, then num_records records (each ring's in
+ * order, the rings one after another)
+ */
+typedef struct trace_file_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t record_size;
+  uint64_t num_records;
+} trace_file_header_t;
+
+extern atomic_int trace_enabled;
+
+// records an event if tracing is on; a load and a branch if it is not
+#define TRACE(event, port, frag, value) do { \
+    if (atomic_load_explicit(&trace_enabled, memory_order_relaxed)) { \
+      trace_record((event), (port), (frag), (value)); \
+    } \
+  } while (0)
+
+/* starts recording the events of every thread (of whichever MRT module
+ * is linked in) for a dump into `path`, which is created right away.
+ * Returns -1 if tracing is already on or the file cannot be created;
+ * otherwise 0.
+ */
+int mrt_trace_start(const char *path);
+
+/* stops recording and writes the latest events of each thread (up to
+ * TRACE_RING_SIZE - 1) to the file given to mrt_trace_start(). An
+ * event being recorded at that very moment may be left out.
+ * Returns -1 if tracing was not on or the dump could not be written;
+ * otherwise 0.
+ */
+int mrt_trace_stop();
+
+// the module's side of TRACE(); records unconditionally.
+void trace_record(int event, int port, int frag, int value);
+
+// e.g. "DATA_SENT"; NULL for an unknown event.
+const char *trace_event_name(int event);
+
+#endif // _mrt_trace_h
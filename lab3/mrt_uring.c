@@ -0,0 +1,308 @@
+/* The io_uring wrapper of the MRT module; see mrt_uring.h.
+ *
+ * The submission and completion queues are shared with the kernel
+ * through one mapping (IORING_FEAT_SINGLE_MMAP), each queue having one
+ * producer and one consumer: this side publishes a submission with a
+ * release store to the tail and sees the kernel's completions with an
+ * acquire load of the other tail (and the other way around for the
+ * heads). The provided buffers go back the same way, through the
+ * buffer ring's tail.
+ *
+ * Nothing here sleeps but mrt_uring_submit(), which waits with a
+ * timeout of its own (IORING_ENTER_EXT_ARG) instead of a timeout
+ * request, so no completion is ever spent on waking up.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+// syscall()
+#define _GNU_SOURCE
+
+#include <stdlib.h> // calloc(), malloc(), free()
+#include <string.h>
+#include <unistd.h> // close(), syscall()
+#include <errno.h> // ETIME, EINTR
+#include <poll.h> // POLLIN
+#include <sys/mman.h> // mmap()
+#include <sys/syscall.h> // __NR_io_uring_*
+#include <arpa/inet.h> // htonl()
+#include <linux/io_uring.h>
+
+#include "mrt_uring.h"
+
+#define TEARDOWN_TAG          (~0ULL - 1) // mrt_uring_free()'s own cancellation
+#define TEARDOWN_WAIT_PERIOD  100000 // microseconds
+
+struct mrt_uring {
+  int fd;
+  void *rings; // both queues' heads, tails and entries, in one mapping
+  size_t rings_size;
+
+  // the submission queue; the last num_queued entries are published but not submitted yet
+  unsigned int *sq_head, *sq_tail, *sq_array;
+  unsigned int sq_mask, sq_entries;
+  struct io_uring_sqe *sqes;
+  size_t sqes_size;
+  unsigned int sqe_tail;
+  unsigned int num_queued;
+
+  // the completion queue
+  unsigned int *cq_head, *cq_tail;
+  unsigned int cq_mask;
+  struct io_uring_cqe *cqes;
+
+  // the provided buffers (group 0), and the ring handing them to the kernel
+  struct io_uring_buf_ring *buf_ring;
+  size_t buf_ring_size;
+  char *buffers;
+  int num_buffers;
+  int buffer_size;
+  unsigned short buf_tail;
+
+  struct msghdr recv_msg; // what every multishot receive is made after
+};
+
+struct io_uring_sqe *take_sqe(mrt_uring_t *ring_p, int opcode, int fd, unsigned long long tag);
+void queue_sqe(mrt_uring_t *ring_p);
+
+mrt_uring_t *mrt_uring_new(int num_entries, int num_buffers, int max_payload) {
+  struct io_uring_params params;
+  struct io_uring_buf_reg reg;
+  unsigned int i;
+  mrt_uring_t *ring_p = calloc(1, sizeof(mrt_uring_t));
+  if (ring_p == NULL) { return NULL; }
+  ring_p->rings = MAP_FAILED;
+  ring_p->sqes = MAP_FAILED;
+  ring_p->buf_ring = MAP_FAILED;
+
+  /****** the queues ******/
+  memset(&params, 0, sizeof(params));
+  // (room for every buffer's datagram on top of the other requests)
+  params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+  params.cq_entries = num_entries * 2 + num_buffers;
+  ring_p->fd = syscall(__NR_io_uring_setup, num_entries, &params);
+  if (ring_p->fd < 0) {
+    free(ring_p);
+    return NULL;
+  }
+  if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP) ||
+      !(params.features & IORING_FEAT_EXT_ARG)) {
+    mrt_uring_free(ring_p);
+    return NULL;
+  }
+  ring_p->rings_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  if (params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe) > ring_p->rings_size) {
+    ring_p->rings_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  }
+  ring_p->rings = mmap(NULL, ring_p->rings_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       ring_p->fd, IORING_OFF_SQ_RING);
+  ring_p->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring_p->sqes = mmap(NULL, ring_p->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_p->fd, IORING_OFF_SQES);
+  if (ring_p->rings == MAP_FAILED || ring_p->sqes == MAP_FAILED) {
+    mrt_uring_free(ring_p);
+    return NULL;
+  }
+  char *rings = (char *)ring_p->rings;
+  ring_p->sq_head = (unsigned int *)(rings + params.sq_off.head);
+  ring_p->sq_tail = (unsigned int *)(rings + params.sq_off.tail);
+  ring_p->sq_array = (unsigned int *)(rings + params.sq_off.array);
+  ring_p->sq_mask = *(unsigned int *)(rings + params.sq_off.ring_mask);
+  ring_p->sq_entries = params.sq_entries;
+  ring_p->sqe_tail = *(ring_p->sq_tail);
+  // (each slot of the array always names the entry of the same index)
+  for (i = 0; i < params.sq_entries; i++) { ring_p->sq_array[i] = i; }
+  ring_p->cq_head = (unsigned int *)(rings + params.cq_off.head);
+  ring_p->cq_tail = (unsigned int *)(rings + params.cq_off.tail);
+  ring_p->cq_mask = *(unsigned int *)(rings + params.cq_off.ring_mask);
+  ring_p->cqes = (struct io_uring_cqe *)(rings + params.cq_off.cqes);
+
+  /****** the provided buffers ******/
+  ring_p->num_buffers = num_buffers;
+  ring_p->buffer_size = sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + max_payload;
+  ring_p->buffers = malloc((size_t)num_buffers * ring_p->buffer_size);
+  ring_p->buf_ring_size = num_buffers * sizeof(struct io_uring_buf);
+  ring_p->buf_ring = mmap(NULL, ring_p->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ring_p->buffers == NULL || ring_p->buf_ring == MAP_FAILED) {
+    mrt_uring_free(ring_p);
+    return NULL;
+  }
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (unsigned long long)(unsigned long)ring_p->buf_ring;
+  reg.ring_entries = num_buffers;
+  reg.bgid = 0;
+  if (syscall(__NR_io_uring_register, ring_p->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+    mrt_uring_free(ring_p);
+    return NULL;
+  }
+  for (i = 0; i < (unsigned int)num_buffers; i++) { mrt_uring_recycle(ring_p, i); }
+
+  // a receive fills in the address, and never any control messages
+  ring_p->recv_msg.msg_namelen = sizeof(struct sockaddr_in);
+  return ring_p;
+}
+
+void mrt_uring_free(mrt_uring_t *ring_p) {
+  mrt_uring_event_t event;
+  if (ring_p == NULL) { return; }
+  /* the receives still going could be filling buffers right up to the
+   * close(), so they are all cancelled first (the cancellation is only
+   * done once they are)
+   */
+  if (ring_p->rings != MAP_FAILED && ring_p->sqes != MAP_FAILED && ring_p->buf_ring != MAP_FAILED) {
+    struct io_uring_sqe *sqe = take_sqe(ring_p, IORING_OP_ASYNC_CANCEL, -1, TEARDOWN_TAG);
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_ANY;
+    queue_sqe(ring_p);
+    int is_done = 0;
+    while (!is_done) {
+      if (mrt_uring_submit(ring_p, 1, TEARDOWN_WAIT_PERIOD) < 0 || !mrt_uring_next(ring_p, &event)) { break; }
+      is_done = (event.tag == TEARDOWN_TAG);
+      while (!is_done && mrt_uring_next(ring_p, &event)) { is_done = (event.tag == TEARDOWN_TAG); }
+    }
+  }
+  close(ring_p->fd);
+  if (ring_p->rings != MAP_FAILED) { munmap(ring_p->rings, ring_p->rings_size); }
+  if (ring_p->sqes != MAP_FAILED) { munmap(ring_p->sqes, ring_p->sqes_size); }
+  if (ring_p->buf_ring != MAP_FAILED) { munmap(ring_p->buf_ring, ring_p->buf_ring_size); }
+  free(ring_p->buffers);
+  free(ring_p);
+}
+
+int mrt_uring_probe() {
+  struct sockaddr_in addr = {0};
+  socklen_t addr_len = sizeof(addr);
+  mrt_uring_event_t event;
+  int is_working = 0;
+
+  mrt_uring_t *ring_p = mrt_uring_new(4, 4, 16);
+  if (ring_p == NULL) { return 0; }
+  int sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  // a datagram to itself, already there when the receive is submitted
+  if (sockfd >= 0 && bind(sockfd, (struct sockaddr *)&addr, addr_len) == 0 &&
+      getsockname(sockfd, (struct sockaddr *)&addr, &addr_len) == 0 &&
+      sendto(sockfd, "?", 1, 0, (struct sockaddr *)&addr, addr_len) == 1) {
+    mrt_uring_recv(ring_p, sockfd, 1);
+    if (mrt_uring_submit(ring_p, 1, TEARDOWN_WAIT_PERIOD) == 0 && mrt_uring_next(ring_p, &event)) {
+      // (an older kernel would end the receive at once, or not know it)
+      is_working = (event.tag == 1 && event.payload != NULL && event.payload_len == 1 && !event.is_last);
+    }
+  }
+  mrt_uring_free(ring_p);
+  if (sockfd >= 0) { close(sockfd); }
+  return is_working;
+}
+
+void mrt_uring_recv(mrt_uring_t *ring_p, int sockfd, unsigned long long tag) {
+  struct io_uring_sqe *sqe = take_sqe(ring_p, IORING_OP_RECVMSG, sockfd, tag);
+  sqe->addr = (unsigned long long)(unsigned long)&(ring_p->recv_msg);
+  sqe->len = 1;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  queue_sqe(ring_p);
+}
+
+void mrt_uring_poll(mrt_uring_t *ring_p, int fd, unsigned long long tag) {
+  struct io_uring_sqe *sqe = take_sqe(ring_p, IORING_OP_POLL_ADD, fd, tag);
+  sqe->poll32_events = POLLIN;
+  sqe->len = IORING_POLL_ADD_MULTI;
+  queue_sqe(ring_p);
+}
+
+void mrt_uring_send(mrt_uring_t *ring_p, int sockfd, struct msghdr *msg_p, unsigned long long tag) {
+  struct io_uring_sqe *sqe = take_sqe(ring_p, IORING_OP_SENDMSG, sockfd, tag);
+  sqe->addr = (unsigned long long)(unsigned long)msg_p;
+  sqe->len = 1;
+  // (which also has the send done by the time it is submitted)
+  sqe->msg_flags = MSG_DONTWAIT;
+  queue_sqe(ring_p);
+}
+
+void mrt_uring_cancel(mrt_uring_t *ring_p, unsigned long long tag) {
+  struct io_uring_sqe *sqe = take_sqe(ring_p, IORING_OP_ASYNC_CANCEL, -1, MRT_URING_TAG_NONE);
+  sqe->addr = tag;
+  queue_sqe(ring_p);
+}
+
+int mrt_uring_submit(mrt_uring_t *ring_p, int wait_nr, int usec) {
+  struct io_uring_getevents_arg arg;
+  struct __kernel_timespec timeout;
+  memset(&arg, 0, sizeof(arg));
+  arg.sigmask_sz = sizeof(unsigned long long);
+  if (usec >= 0) {
+    timeout.tv_sec = usec / 1000000;
+    timeout.tv_nsec = (long long)(usec % 1000000) * 1000;
+    arg.ts = (unsigned long long)(unsigned long)&timeout;
+  }
+  // (getting events also flushes any that overflowed the completion queue)
+  int result = syscall(__NR_io_uring_enter, ring_p->fd, ring_p->num_queued, wait_nr,
+                       IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+  if (result < 0) {
+    return (errno == ETIME || errno == EINTR) ? 0 : -1;
+  }
+  ring_p->num_queued -= result;
+  return 0;
+}
+
+int mrt_uring_next(mrt_uring_t *ring_p, mrt_uring_event_t *event_p) {
+  unsigned int head = *(ring_p->cq_head);
+  if (head == __atomic_load_n(ring_p->cq_tail, __ATOMIC_ACQUIRE)) { return 0; }
+  struct io_uring_cqe *cqe = &(ring_p->cqes[head & ring_p->cq_mask]);
+
+  event_p->tag = cqe->user_data;
+  event_p->result = cqe->res;
+  event_p->is_last = !(cqe->flags & IORING_CQE_F_MORE);
+  event_p->payload = NULL;
+  event_p->payload_len = 0;
+  event_p->addr_p = NULL;
+  event_p->buffer_id = -1;
+  if (cqe->flags & IORING_CQE_F_BUFFER) {
+    event_p->buffer_id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+    // the buffer holds the recvmsg() header, the address, then the datagram (cut short if need be)
+    char *buffer = ring_p->buffers + (size_t)event_p->buffer_id * ring_p->buffer_size;
+    struct io_uring_recvmsg_out *out_p = (struct io_uring_recvmsg_out *)buffer;
+    int header_size = sizeof(struct io_uring_recvmsg_out) + ring_p->recv_msg.msg_namelen;
+    event_p->addr_p = (struct sockaddr_in *)(buffer + sizeof(struct io_uring_recvmsg_out));
+    event_p->payload = buffer + header_size;
+    event_p->payload_len = (cqe->res > header_size) ? cqe->res - header_size : 0;
+    if ((int)out_p->payloadlen < event_p->payload_len) { event_p->payload_len = out_p->payloadlen; }
+  }
+  __atomic_store_n(ring_p->cq_head, head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+void mrt_uring_recycle(mrt_uring_t *ring_p, int buffer_id) {
+  struct io_uring_buf *buf_p = &(ring_p->buf_ring->bufs[ring_p->buf_tail & (ring_p->num_buffers - 1)]);
+  buf_p->addr = (unsigned long long)(unsigned long)(ring_p->buffers + (size_t)buffer_id * ring_p->buffer_size);
+  buf_p->len = ring_p->buffer_size;
+  buf_p->bid = buffer_id;
+  ring_p->buf_tail += 1;
+  __atomic_store_n(&(ring_p->buf_ring->tail), ring_p->buf_tail, __ATOMIC_RELEASE);
+}
+
+/****** helper functions (unavailable to module users) ******/
+
+/* returns the next submission entry, cleared and filled in with the
+ * basics; submits what is queued first if the queue is full
+ */
+struct io_uring_sqe *take_sqe(mrt_uring_t *ring_p, int opcode, int fd, unsigned long long tag) {
+  if (ring_p->sqe_tail - __atomic_load_n(ring_p->sq_head, __ATOMIC_ACQUIRE) == ring_p->sq_entries) {
+    int result = syscall(__NR_io_uring_enter, ring_p->fd, ring_p->num_queued, 0, 0, NULL, 0);
+    if (result > 0) { ring_p->num_queued -= result; }
+  }
+  struct io_uring_sqe *sqe = &(ring_p->sqes[ring_p->sqe_tail & ring_p->sq_mask]);
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqe->opcode = opcode;
+  sqe->fd = fd;
+  sqe->user_data = tag;
+  return sqe;
+}
+
+// publishes the entry take_sqe() returned, for the next submission
+void queue_sqe(mrt_uring_t *ring_p) {
+  ring_p->sqe_tail += 1;
+  ring_p->num_queued += 1;
+  __atomic_store_n(ring_p->sq_tail, ring_p->sqe_tail, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,81 @@
+/* Header file for `mrt_uring.c`
+ * A small io_uring wrapper for the MRT module's sockets, on the raw
+ * system calls (there is no liburing to count on).
+ *
+ * A ring receives with multishot RECVMSG: one submission keeps posting
+ * a completion per datagram, each in one of the ring's own buffers (a
+ * provided-buffer ring), until it runs out of them or is cancelled. An
+ * eventfd is watched with a multishot poll the same way. Sends are
+ * queued and go out with the next mrt_uring_submit(), as many as there
+ * are in one system call, which also waits for completions.
+ *
+ * Everything is tagged by the caller; a ring is only ever used by one
+ * thread at a time.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+#ifndef _mrt_uring_h
+#define _mrt_uring_h
+
+#include <sys/socket.h> // struct msghdr
+#include <netinet/in.h> // struct sockaddr_in
+
+#define MRT_URING_TAG_NONE  (~0ULL) // sends and cancellations nobody needs to hear about
+
+typedef struct mrt_uring mrt_uring_t;
+
+/* one completion, as mrt_uring_next() hands it out */
+typedef struct mrt_uring_event {
+  unsigned long long tag;
+  int result; // bytes, or -errno
+  int is_last; // the multishot request behind it is over, to be re-armed if still wanted
+  // for a received datagram; NULL otherwise
+  char *payload;
+  int payload_len;
+  struct sockaddr_in *addr_p;
+  int buffer_id; // to be given back with mrt_uring_recycle()
+} mrt_uring_event_t;
+
+/* sets up a ring with room for `num_entries` submissions (at least) and
+ * `num_buffers` (a power of 2) receive buffers of datagrams up to
+ * `max_payload` bytes; returns NULL if the kernel cannot do any of it.
+ */
+mrt_uring_t *mrt_uring_new(int num_entries, int num_buffers, int max_payload);
+
+// tears it all down (outstanding requests included); does nothing for NULL
+void mrt_uring_free(mrt_uring_t *ring_p);
+
+/* whether io_uring with everything the MRT module needs of it works
+ * here, tried out on a socket of its own
+ */
+int mrt_uring_probe();
+
+// queues a multishot receive on `sockfd` (a UDP socket)
+void mrt_uring_recv(mrt_uring_t *ring_p, int sockfd, unsigned long long tag);
+
+// queues a multishot poll for `fd` (an eventfd, say) to be readable
+void mrt_uring_poll(mrt_uring_t *ring_p, int fd, unsigned long long tag);
+
+/* queues a send of `msg_p` on `sockfd`; the message must stay as it is
+ * until the submission. It never waits for room in the socket: a send
+ * that would is dropped, like sendmmsg() with MSG_DONTWAIT does.
+ */
+void mrt_uring_send(mrt_uring_t *ring_p, int sockfd, struct msghdr *msg_p, unsigned long long tag);
+
+// queues the cancellation of the requests tagged `tag`
+void mrt_uring_cancel(mrt_uring_t *ring_p, unsigned long long tag);
+
+/* submits everything queued, then waits for `wait_nr` completions in
+ * all, but no longer than `usec` microseconds (forever if negative).
+ * Returns 0, or -1 upon an error other than the wait being cut short.
+ */
+int mrt_uring_submit(mrt_uring_t *ring_p, int wait_nr, int usec);
+
+// takes the oldest completion into `*event_p`; returns 0 if there is none
+int mrt_uring_next(mrt_uring_t *ring_p, mrt_uring_event_t *event_p);
+
+// hands a received datagram's buffer back to the ring
+void mrt_uring_recycle(mrt_uring_t *ring_p, int buffer_id);
+
+#endif // _mrt_uring_h
@@ -0,0 +1,131 @@
+/* Request/response benchmark for full-duplex MRT connections. The
+ * server is `receiver_bench echo`, in its own process (since
+ * mrt_receiver cannot be linked next to mrt_sender), which sends back
+ * whatever it reads with mrt_reply(); this side mrt_send()s a request,
+ * then mrt_receive()s the echo in full, `round_trips` times over.
+ *
+ * command line:
+ *	pingpong_bench round_trips [request_size]
+ *
+ * The round-trip latencies (median, 99th and 99.9th percentiles, and
+ * worst) are reported, along with how the acknowledgements of both
+ * directions travelled: riding on a DATA going the other way, or as
+ * ADATs of their own (the server reports its side when the connection
+ * is over).
+ *
+ * With MRT_BUSY_POLL set in the environment, both sides run the
+ * low-latency profile (see mrt_set_busy_poll(); the server inherits the
+ * environment): "any" to spin wherever, or a list of CPUs like "2,3"
+ * to pin each side's threads to in turn.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+#define _GNU_SOURCE // kill()
+
+#include <stdio.h>
+#include <stdlib.h> // atoi(), malloc(), free(), getenv()
+#include <string.h>
+#include <unistd.h> // fork(), execl(), usleep()
+#include <signal.h>
+#include <sys/wait.h>
+#include <netinet/in.h>  // INADDR_LOOPBACK
+
+#include "mrt.h"
+#include "mrt_sender.h"
+#include "utilities.h" // parse_cpus()
+
+#define RECEIVER_PORT_NUMBER  7575
+#define SENDER_PORT_NUMBER    7576
+#define SERVER_PATH           "./receiver_bench"
+#define DEFAULT_REQUEST_SIZE  64
+#define MAX_REQUEST_SIZE      4096
+#define BUSY_POLL_USEC        50 // SO_BUSY_POLL, where allowed
+
+pid_t start_server();
+
+int main(int argc, char const *argv[]) {
+  int round_trips = (argc >= 2) ? atoi(argv[1]) : 0;
+  int request_size = (argc == 3) ? atoi(argv[2]) : DEFAULT_REQUEST_SIZE;
+  if (argc < 2 || argc > 3 || round_trips <= 0 || request_size <= 0 || request_size > MAX_REQUEST_SIZE) {
+    fprintf(stderr, "usage: %s round_trips [request_size (at most %d)]\n", argv[0], MAX_REQUEST_SIZE);
+    return -1;
+  }
+  char request[MAX_REQUEST_SIZE], response[MAX_REQUEST_SIZE];
+  double *latencies = malloc(round_trips * sizeof(double));
+  mrt_sender_stats_t stats = {0};
+  int i, num_bytes, num_received, num_done = 0, cpus[MRT_MAX_PINNED_CPUS], num_cpus;
+
+  const char *cpu_list = getenv("MRT_BUSY_POLL");
+  if (cpu_list != NULL) {
+    if ((num_cpus = parse_cpus(cpu_list, cpus, MRT_MAX_PINNED_CPUS)) < 0 ||
+        mrt_set_busy_poll(1, BUSY_POLL_USEC, cpus, num_cpus) < 0) {
+      fprintf(stderr, "MRT_BUSY_POLL should be \"any\" or a list of CPUs like \"2,3\"\n");
+      return -1;
+    }
+  }
+
+  pid_t server_pid = start_server();
+  if (server_pid < 0 || latencies == NULL) { return -1; }
+  int id = mrt_connect(SENDER_PORT_NUMBER, RECEIVER_PORT_NUMBER, INADDR_LOOPBACK);
+  if (id < 0) {
+    perror("mrt_connect() failed...\n");
+    kill(server_pid, SIGTERM);
+    return -1;
+  }
+
+  /****** one request at a time, each waiting for its whole echo ******/
+  for (i = 0; i < round_trips; i++) {
+    memset(request, 'a' + i % 26, request_size);
+    double start_time = now_seconds();
+    if (mrt_send(id, request, request_size) != 1) { break; }
+    for (num_received = 0; num_received < request_size; num_received += num_bytes) {
+      num_bytes = mrt_receive(id, response + num_received, request_size - num_received);
+      if (num_bytes <= 0) { break; }
+    }
+    latencies[i] = now_seconds() - start_time;
+    if (num_received < request_size || memcmp(request, response, request_size) != 0) {
+      fprintf(stderr, "pingpong: round trip %d came back wrong\n", i);
+      break;
+    }
+    num_done += 1;
+  }
+  mrt_stats(id, &stats);
+  mrt_disconnect(id);
+
+  sort_doubles(latencies, num_done);
+  printf("pingpong: request_size=%d busy_poll=%s round_trips=%d", request_size,
+         (cpu_list != NULL) ? cpu_list : "off", num_done);
+  if (num_done > 0) {
+    printf(" p50_ms=%.3f p99_ms=%.3f p999_ms=%.3f max_ms=%.3f", percentile(latencies, num_done, 0.5) * 1e3,
+           percentile(latencies, num_done, 0.99) * 1e3, percentile(latencies, num_done, 0.999) * 1e3,
+           percentile(latencies, num_done, 1.0) * 1e3);
+  }
+  printf(" data_sent=%lld adats=%lld acks_piggybacked=%lld\n",
+         stats.frags_sent, stats.adats_sent, stats.acks_piggybacked);
+  fflush(stdout);
+
+  // the server reports its side once it sees the end of the connection
+  waitpid(server_pid, NULL, 0);
+  free(latencies);
+  return (num_done == round_trips) ? 0 : -1;
+}
+
+// forks and execs the echo server; returns its pid, or -1 on failure
+pid_t start_server() {
+  char port_str[16];
+  snprintf(port_str, sizeof(port_str), "%d", RECEIVER_PORT_NUMBER);
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork() error\n");
+    return -1;
+  }
+  if (pid == 0) {
+    execl(SERVER_PATH, SERVER_PATH, "echo", port_str, (char *)NULL);
+    perror("execl(" SERVER_PATH ") error\n");
+    _exit(1);
+  }
+  return pid;
+}
+
@@ -0,0 +1,257 @@
+/* Benchmarks for the Queue and CQueue modules.
+ *
+ * command line:
+ *	queue_bench num_items [rounds]
+ *	queue_bench mpmc num_threads [seconds]
+ *
+ * Without "mpmc", the Queue module is timed on the operations the
+ * receiver leans on: cycling items through (enq_q()/deq_q(), as the
+ * delayed ADAT and retained queues are), scanning (get_item_q(), as
+ * every transmission's lookup does) and popping from the middle
+ * (pop_item_q(), as reclaiming a connection does). Every operation is
+ * timed over `rounds` rounds on a queue holding num_items items, and
+ * reported in nanoseconds per item along with the number of malloc()
+ * calls it made per item (counted by wrapping malloc() with the
+ * linker's --wrap).
+ *
+ * mpmc: num_threads threads share one queue, each enqueuing an item and
+ *   dequeuing one in a loop for `seconds`; a Queue behind a mutex, a
+ *   cq_t and an msq_t take turns. The pairs per second are reported,
+ *   and whether every item enqueued came out exactly once (summed up).
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+#define _POSIX_C_SOURCE 200809L // rand_r()
+
+#include <stdio.h>
+#include <stdlib.h> // atoi(), malloc(), free()
+#include <string.h> // strcmp()
+#include <stdint.h> // uintptr_t
+#include <stdatomic.h>
+#include <sched.h>  // sched_yield()
+#include <unistd.h> // sleep()
+#include <pthread.h>
+
+#include "Queue.h"
+#include "CQueue.h"
+#include "utilities.h" // now_seconds()
+
+#define DEFAULT_ROUNDS 1000
+#define DEFAULT_SECONDS 3
+#define MPMC_CAPACITY 1024 // of the cq_t; more than there are threads
+
+enum { KIND_MUTEX, KIND_CQ, KIND_MSQ };
+
+// the queue all the threads of one mpmc run share
+typedef struct shared_queue {
+  int kind;
+  q_t *queue;
+  pthread_mutex_t lock; // for queue only
+  cq_t *cqueue;
+  msq_t *msqueue;
+} shared_queue_t;
+
+typedef struct pairer {
+  pthread_t thread;
+  shared_queue_t *shared_p;
+  long id;
+  long num_pairs;
+  unsigned long long sum_enqueued, sum_dequeued;
+} pairer_t;
+
+void *__real_malloc(size_t size);
+void *__wrap_malloc(size_t size);
+int never_matcher(void *item, void *target);
+int int_matcher(void *item, void *target);
+void report(char *operation, int num_items, long num_ops, double seconds, long num_mallocs);
+int run_mpmc(int num_threads, int seconds);
+void *pairer(void *pairer_vp);
+int shared_enq(shared_queue_t *shared_p, void *item);
+void *shared_deq(shared_queue_t *shared_p);
+
+_Atomic long num_mallocs = 0;
+atomic_int should_stop = 0;
+
+int main(int argc, char const *argv[]) {
+  int num_items, rounds = DEFAULT_ROUNDS;
+  int *numbers;
+  q_t *queue;
+  double start_time;
+  long start_mallocs;
+  int i, r;
+  unsigned int seed = 60;
+  volatile long sink = 0; // so the scans are not optimized away
+
+  if (argc > 2 && strcmp(argv[1], "mpmc") == 0 && atoi(argv[2]) > 0) {
+    return run_mpmc(atoi(argv[2]), (argc > 3 && atoi(argv[3]) > 0) ? atoi(argv[3]) : DEFAULT_SECONDS);
+  }
+  if (argc < 2 || (num_items = atoi(argv[1])) <= 0) {
+    fprintf(stderr, "usage: queue_bench num_items [rounds]\n"
+                    "       queue_bench mpmc num_threads [seconds]\n");
+    return 1;
+  }
+  if (argc > 2 && atoi(argv[2]) > 0) { rounds = atoi(argv[2]); }
+
+  numbers = (int *)malloc(num_items * sizeof(int));
+  queue = make_q();
+  if (numbers == NULL || queue == NULL) {
+    perror("malloc() error\n");
+    return 1;
+  }
+  for (i = 0; i < num_items; i++) { numbers[i] = i; }
+
+  // cycle: fill the queue, then empty it
+  start_mallocs = atomic_load(&num_mallocs);
+  start_time = now_seconds();
+  for (r = 0; r < rounds; r++) {
+    for (i = 0; i < num_items; i++) { enq_q(queue, &numbers[i]); }
+    for (i = 0; i < num_items; i++) { sink += *(int *)deq_q(queue); }
+  }
+  report("enq+deq", num_items, (long)rounds * num_items, now_seconds() - start_time,
+         atomic_load(&num_mallocs) - start_mallocs);
+
+  // scan: look for an item that is not there
+  for (i = 0; i < num_items; i++) { enq_q(queue, &numbers[i]); }
+  start_mallocs = atomic_load(&num_mallocs);
+  start_time = now_seconds();
+  for (r = 0; r < rounds; r++) {
+    sink += (get_item_q(queue, never_matcher, NULL) != NULL);
+  }
+  report("scan", num_items, (long)rounds * num_items, now_seconds() - start_time,
+         atomic_load(&num_mallocs) - start_mallocs);
+
+  // pop: take a random item out of the middle and put it back at the tail
+  start_mallocs = atomic_load(&num_mallocs);
+  start_time = now_seconds();
+  for (r = 0; r < rounds; r++) {
+    int target = rand_r(&seed) % num_items;
+    enq_q(queue, pop_item_q(queue, int_matcher, &target));
+  }
+  report("pop+enq", num_items, rounds, now_seconds() - start_time, atomic_load(&num_mallocs) - start_mallocs);
+
+  delete_q(queue, NULL);
+  free(numbers);
+  return (sink < 0);
+}
+
+/* runs num_threads pairers over a Queue behind a mutex, a cq_t and an
+ * msq_t in turn; returns 1 if any of them lost or duplicated an item.
+ */
+int run_mpmc(int num_threads, int seconds) {
+  char *names[] = { "mutex", "cq", "msq" };
+  pairer_t *pairers = (pairer_t *)malloc(num_threads * sizeof(pairer_t));
+  int has_failed = 0;
+  if (pairers == NULL) {
+    perror("malloc() error\n");
+    return 1;
+  }
+
+  for (int kind = KIND_MUTEX; kind <= KIND_MSQ; kind++) {
+    shared_queue_t shared = { kind, make_q(), PTHREAD_MUTEX_INITIALIZER,
+                              make_cq(MPMC_CAPACITY), make_msq() };
+    unsigned long long sum_enqueued = 0, sum_dequeued = 0;
+    long num_pairs = 0, start_mallocs;
+    void *item;
+    double elapsed;
+
+    if (shared.queue == NULL || shared.cqueue == NULL || shared.msqueue == NULL) {
+      perror("make_q() error\n");
+      return 1;
+    }
+    atomic_store(&should_stop, 0);
+    start_mallocs = atomic_load(&num_mallocs);
+    elapsed = now_seconds();
+    for (int i = 0; i < num_threads; i++) {
+      pairers[i] = (pairer_t){ .shared_p = &shared, .id = i };
+      pthread_create(&(pairers[i].thread), NULL, pairer, &pairers[i]);
+    }
+    sleep(seconds);
+    atomic_store(&should_stop, 1);
+    for (int i = 0; i < num_threads; i++) {
+      pthread_join(pairers[i].thread, NULL);
+      num_pairs += pairers[i].num_pairs;
+      sum_enqueued += pairers[i].sum_enqueued;
+      sum_dequeued += pairers[i].sum_dequeued;
+    }
+    elapsed = now_seconds() - elapsed;
+    // whatever is left was enqueued but not dequeued yet
+    while ((item = shared_deq(&shared)) != NULL) { sum_dequeued += (uintptr_t)item; }
+
+    printf("queue: op=mpmc kind=%s threads=%d pairs_per_sec=%.0f mallocs_per_pair=%.4f intact=%s\n",
+           names[kind], num_threads, num_pairs / elapsed,
+           (double)(atomic_load(&num_mallocs) - start_mallocs) / (num_pairs > 0 ? num_pairs : 1),
+           (sum_enqueued == sum_dequeued) ? "yes" : "NO");
+    has_failed |= (sum_enqueued != sum_dequeued);
+    delete_q(shared.queue, NULL);
+    delete_cq(shared.cqueue, NULL);
+    delete_msq(shared.msqueue, NULL);
+  }
+
+  free(pairers);
+  return has_failed;
+}
+
+/* enqueues a fresh item, then dequeues one (perhaps another thread's),
+ * until should_stop; items are numbers unique across the threads.
+ */
+void *pairer(void *pairer_vp) {
+  pairer_t *pairer_p = (pairer_t *)pairer_vp;
+  uintptr_t next_item = ((uintptr_t)pairer_p->id << 40) + 1; // never NULL
+  void *item;
+
+  while (!atomic_load_explicit(&should_stop, memory_order_relaxed)) {
+    while (shared_enq(pairer_p->shared_p, (void *)next_item) != 0) { sched_yield(); } // full
+    pairer_p->sum_enqueued += next_item;
+    next_item += 1;
+    while ((item = shared_deq(pairer_p->shared_p)) == NULL) { sched_yield(); }
+    pairer_p->sum_dequeued += (uintptr_t)item;
+    pairer_p->num_pairs += 1;
+  }
+  return NULL;
+}
+
+int shared_enq(shared_queue_t *shared_p, void *item) {
+  int result;
+  switch (shared_p->kind) {
+    case KIND_CQ: return enq_cq(shared_p->cqueue, item);
+    case KIND_MSQ: return enq_msq(shared_p->msqueue, item);
+    default:
+      pthread_mutex_lock(&(shared_p->lock));
+        result = enq_q(shared_p->queue, item);
+      pthread_mutex_unlock(&(shared_p->lock));
+      return result;
+  }
+}
+
+void *shared_deq(shared_queue_t *shared_p) {
+  void *item;
+  switch (shared_p->kind) {
+    case KIND_CQ: return deq_cq(shared_p->cqueue);
+    case KIND_MSQ: return deq_msq(shared_p->msqueue);
+    default:
+      pthread_mutex_lock(&(shared_p->lock));
+        item = deq_q(shared_p->queue);
+      pthread_mutex_unlock(&(shared_p->lock));
+      return item;
+  }
+}
+
+// counts the calls, then hands them to the real malloc().
+void *__wrap_malloc(size_t size) {
+  atomic_fetch_add_explicit(&num_mallocs, 1, memory_order_relaxed);
+  return __real_malloc(size);
+}
+
+int never_matcher(void *item, void *target) {
+  return *(int *)item < 0;
+}
+
+int int_matcher(void *item, void *target) {
+  return *(int *)item == *(int *)target;
+}
+
+void report(char *operation, int num_items, long num_ops, double seconds, long num_mallocs) {
+  printf("queue: op=%s items=%d ns_per_op=%.2f mallocs_per_op=%.4f\n",
+         operation, num_items, seconds * 1e9 / num_ops, (double)num_mallocs / num_ops);
+}
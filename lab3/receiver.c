@@ -1,29 +1,36 @@
 /* The receiver application testing the mrt_receiver module
  *
  * command line:
- *	receiver num_connections
+ *	receiver num_connections [num_shards]
+ *
+ * With MRT_TRACE set in the environment, the connections' events are
+ * traced into the file it names (see mrt_trace.h); with MRT_IO=uring,
+ * the receiver runs on io_uring if it can (see mrt_set_io_engine()).
  *
  * For Dartmouth COSC 60 Lab 3;
  * By Shengsong Gao, May 2020.
  */
 
 #include <stdio.h>
-#include <stdlib.h> // atoi(), free()
-#include <unistd.h> // write(), STDOUT_FILENO
+#include <stdlib.h> // atoi(), free(), getenv()
+#include <string.h> // strcmp()
+#include <unistd.h> // STDOUT_FILENO
 #include <sys/socket.h>  // (struct sockaddr_in)
 #include "Queue.h"
+#include "mrt.h"
 #include "mrt_receiver.h"
+#include "mrt_trace.h"
 
 #define RECEIVER_PORT_NUMBER 7878
-#define BUFFER_SIZE 1000
 
 int main(int argc, char const *argv[]) {
   /****** parsing arguments ******/
-	if (argc != 2) {
-		fprintf(stderr, "usage: %s num_connections\n", argv[0]);
+	if (argc != 2 && argc != 3) {
+		fprintf(stderr, "usage: %s num_connections [num_shards]\n", argv[0]);
 		return -1;
 	}
 	int num_connections = atoi(argv[1]);
+  int num_shards = (argc == 3) ? atoi(argv[2]) : 1;
 
   /****** initialization (data structures and connection) ******/
   q_t *sender_id_q = make_q();
@@ -32,7 +39,12 @@ int main(int argc, char const *argv[]) {
     return -1;
   }
 
-  if (mrt_open(RECEIVER_PORT_NUMBER) < 0) {
+  const char *trace_path = getenv("MRT_TRACE");
+  if (trace_path != NULL) { mrt_trace_start(trace_path); }
+  const char *io_name = getenv("MRT_IO");
+  if (io_name != NULL && strcmp(io_name, "uring") == 0) { mrt_set_io_engine(MRT_IO_URING); }
+
+  if (mrt_open_sharded(RECEIVER_PORT_NUMBER, num_shards) < 0) {
     perror("mrt_open() error...\n");
     return -1;
   }
@@ -42,8 +54,7 @@ int main(int argc, char const *argv[]) {
    */
 
   struct sockaddr_in *curr_sender_id = NULL;
-  char buffer[BUFFER_SIZE];
-  int i, num_bytes_read;
+  int i;
 
   for (i = 0; i < num_connections; i++) {
     enq_q(sender_id_q, mrt_accept1());
@@ -52,13 +63,15 @@ int main(int argc, char const *argv[]) {
   for (i = 0; i < num_connections; i++) {
     curr_sender_id = deq_q(sender_id_q);
     
-    while ((num_bytes_read = mrt_receive1(curr_sender_id, buffer, BUFFER_SIZE)) > 0) {
-      write(STDOUT_FILENO, buffer, num_bytes_read);
+    // write straight out of the receive buffer, no copy in between
+    if (mrt_receive_to_fd(curr_sender_id, STDOUT_FILENO) < 0) {
+      perror("mrt_receive_to_fd() error...\n");
     }
     
     free(curr_sender_id);
   }
 
   mrt_close();
+  if (trace_path != NULL) { mrt_trace_stop(); }
   return 0;
 }
@@ -0,0 +1,1029 @@
+/* Benchmarks for the mrt_receiver module. The senders are played by
+ * threads crafting raw MRT transmissions (the mrt_sender module cannot
+ * be linked into the same program as mrt_receiver).
+ *
+ * command line:
+ *	receiver_bench pps num_senders seconds [num_shards]
+ *	receiver_bench contention num_readers seconds read_size [ack_every]
+ *	receiver_bench poll num_connections seconds read_size [epoll]
+ *	receiver_bench borrow num_readers seconds
+ *	receiver_bench flood num_flooders seconds
+ *	receiver_bench churn seconds [read_every]
+ *	receiver_bench sink megabytes receive1|borrow|fd [path]
+ *	receiver_bench echo [port_number]
+ *	receiver_bench close num_connections
+ *
+ * pps: every sender keeps blasting out-of-order DATA (each of which is
+ *   fully validated, looked up and answered with an ADAT), and the
+ *   number of ADATs coming back is reported as packets per second.
+ *   With num_shards > 1 the receiver is opened with mrt_open_sharded().
+ *
+ * contention: one handler thread serves num_readers connections, each
+ *   streamed to by a Go-Back-N sender and drained by its own thread
+ *   calling mrt_receive1() with `read_size` bytes at a time. With
+ *   ack_every, every connection gets mrt_set_ack_policy(ack_every, ...)
+ *   (ack_every = 1 ADATs every DATA at once); adats_per_data tells
+ *   how many ADATs the handler sent per DATA received.
+ *
+ * poll: like contention, but a single thread accepts and drains all
+ *   the connections, waiting with mrt_poll() (or, given "epoll", with
+ *   epoll_wait() on mrt_accept_eventfd() and every mrt_eventfd()).
+ *
+ * borrow: like contention, but the readers process the bytes in place
+ *   with mrt_borrow() and mrt_release() instead of copying them out.
+ *   Every reader (in both modes) sums up the bytes it gets, as a
+ *   stand-in for the application's processing.
+ *
+ * flood: every flooder keeps sending RCONs from FLOOD_SOCKETS source
+ *   ports without ever echoing the cookie, while one legitimate sender
+ *   keeps connecting (and an acceptor accepts whatever is pending);
+ *   the legitimate connection setup latency is reported.
+ *
+ * churn: a sender keeps opening connections, sending one payload and
+ *   closing them, while the application accepts and reads them to
+ *   their end with mrt_poll() and mrt_receive1(); with read_every > 1,
+ *   only the connections whose port is a multiple of it are read, and
+ *   the rest are left over with their payload unread. The receiver's
+ *   RSS is reported every second.
+ *
+ * sink: one connection streams `megabytes` MB and closes, and the
+ *   application writes it all to `path` (/dev/null by default) either
+ *   with mrt_receive1() into a 1000-byte buffer and write() (like the
+ *   receiver driver used to), with mrt_borrow() and write(), or with
+ *   mrt_receive_to_fd(); the throughput and the CPU time spent per GB
+ *   by the whole process and by the application thread are reported
+ *   (the sender's thread shares the process).
+ *
+ * echo: the server for `pingpong_bench`, which runs it: accepts one
+ *   connection and sends back whatever it reads with mrt_reply(),
+ *   until the connection is over; then reports how many ADATs rode on
+ *   the replies and how many went alone.
+ *
+ * close: num_connections are accepted and kept alive with an empty
+ *   DATA every KEEP_ALIVE_PERIOD, then left idle (nothing arrives to
+ *   wake the handler) and mrt_close() is called; how long it takes to
+ *   return, and how many threads the process runs before and after,
+ *   are reported.
+ *
+ * With MRT_TRACE set in the environment, every mode runs with the
+ * receiver's events traced (see mrt_trace.h) into the file it names,
+ * dumped at exit, to measure what tracing costs. With MRT_IO=uring,
+ * the shards run on io_uring (see mrt_set_io_engine()); pps reports
+ * which engine it ended up with. With MRT_BUSY_POLL ("any", or a list
+ * of CPUs like "2,3"), they run the low-latency profile instead (see
+ * mrt_set_busy_poll()), as echo does for `pingpong_bench`.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+#define _GNU_SOURCE // sendmmsg()
+
+#include <stdio.h>
+#include <stdlib.h> // atoi(), malloc(), free()
+#include <string.h>
+#include <unistd.h> // close(), usleep()
+#include <sys/socket.h>
+#include <sys/time.h> // struct timeval
+#include <sys/resource.h> // getrusage()
+#include <fcntl.h> // open()
+#include <sys/epoll.h>
+#include <arpa/inet.h> // htons()
+#include <pthread.h>
+
+#include "mrt.h"
+#include "mrt_receiver.h"
+#include "utilities.h" // hash()
+#include "mrt_trace.h"
+
+#define RECEIVER_PORT_NUMBER  7979
+#define BURST_SIZE            16
+#define BLAST_PAYLOAD_LENGTH  64
+#define BLAST_FRAG            (1 << 30) // far ahead; always out of order
+#define STREAM_WINDOW         4 // fragments in flight per streamer
+#define FLOOD_SOCKETS         64 // source ports per flooder
+#define FLOOD_PAUSE           1000 // usec between rounds over the ports
+#define MAX_SETUP_SAMPLES     100000
+#define CHURN_EVENTS          1024 // mrt_poll() events per call
+#define CHURN_TRIES           10 // unanswered DATAs or RCLSs before giving up on a connection
+#define SINK_READ_SIZE        1000 // what the receiver driver used to read at a time
+#define SINK_WINDOW           32 // fragments in flight for the sink's sender
+#define ECHO_READ_SIZE        4096
+#define BUSY_POLL_USEC        50 // SO_BUSY_POLL, where allowed
+#define KEEP_ALIVE_PERIOD     20000 // usec between empty DATAs on the idle connections
+
+typedef struct blaster {
+  pthread_t thread;
+  int sockfd;
+  long num_sent;
+  long num_replies;
+  long num_to_send; // payloads for a streamer to send before closing; 0 for no limit
+  int window; // fragments a streamer keeps in flight; 0 for STREAM_WINDOW
+} blaster_t;
+
+typedef struct keeper {
+  pthread_t thread;
+  int *sockfds;
+  int num_sockets;
+} keeper_t;
+
+typedef struct reader {
+  pthread_t thread;
+  struct sockaddr_in *id_p;
+  int read_size; // 0 to borrow views instead
+  long num_calls;
+  long num_bytes;
+  unsigned long checksum;
+} reader_t;
+
+int run_pps(int num_senders, int seconds, int num_shards);
+int run_contention(int num_readers, int seconds, int read_size, int ack_every);
+int run_poll(int num_connections, int seconds, int read_size, int use_epoll);
+int run_flood(int num_flooders, int seconds);
+void *flooder(void *blaster_vp);
+void *polling_acceptor(void *num_accepted_vp);
+int run_churn(int seconds, int read_every);
+void *churner(void *blaster_vp);
+long rss_kb();
+int run_sink(int megabytes, const char *method, const char *path);
+double cpu_seconds(int who);
+int run_echo(unsigned short port_number);
+int run_close(int num_connections);
+void *keeper(void *keeper_vp);
+void *blaster(void *blaster_vp);
+void *streamer(void *blaster_vp);
+void *reader(void *reader_vp);
+void *acceptor(void *num_senders_vp);
+int build_transmission(char *buffer, int type, int frag, int flags, char *payload, int payload_len);
+int connect_raw_sender(int sockfd);
+int is_stopped(int *can_start_p);
+void stop_trace();
+
+int should_start = 0, should_stop = 0;
+int io_engine_used = MRT_IO_SOCKETS;
+pthread_mutex_t flag_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int main(int argc, char const *argv[]) {
+  const char *trace_path = getenv("MRT_TRACE");
+  if (trace_path != NULL && mrt_trace_start(trace_path) == 0) { atexit(stop_trace); }
+  const char *io_name = getenv("MRT_IO");
+  if (io_name != NULL && strcmp(io_name, "uring") == 0) { io_engine_used = mrt_set_io_engine(MRT_IO_URING); }
+  const char *cpu_list = getenv("MRT_BUSY_POLL");
+  if (cpu_list != NULL) {
+    int cpus[MRT_MAX_PINNED_CPUS], num_cpus = parse_cpus(cpu_list, cpus, MRT_MAX_PINNED_CPUS);
+    if (num_cpus < 0 || mrt_set_busy_poll(1, BUSY_POLL_USEC, cpus, num_cpus) < 0) {
+      fprintf(stderr, "MRT_BUSY_POLL should be \"any\" or a list of CPUs like \"2,3\"\n");
+      return -1;
+    }
+  }
+
+  /****** parsing arguments ******/
+  if (argc >= 4 && argc <= 5 && strcmp(argv[1], "pps") == 0) {
+    int num_shards = (argc == 5) ? atoi(argv[4]) : 1;
+    if (atoi(argv[2]) > 0 && atoi(argv[3]) > 0 && num_shards > 0) {
+      return run_pps(atoi(argv[2]), atoi(argv[3]), num_shards);
+    }
+  }
+  if (argc >= 5 && argc <= 6 && strcmp(argv[1], "contention") == 0) {
+    int ack_every = (argc == 6) ? atoi(argv[5]) : 0; // 0 for the default policy
+    if (atoi(argv[2]) > 0 && atoi(argv[3]) > 0 && atoi(argv[4]) > 0 && ack_every >= 0) {
+      return run_contention(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]), ack_every);
+    }
+  }
+  if (argc == 4 && strcmp(argv[1], "borrow") == 0) {
+    if (atoi(argv[2]) > 0 && atoi(argv[3]) > 0) {
+      return run_contention(atoi(argv[2]), atoi(argv[3]), 0, 0);
+    }
+  }
+  if (argc == 4 && strcmp(argv[1], "flood") == 0) {
+    if (atoi(argv[2]) >= 0 && atoi(argv[3]) > 0) {
+      return run_flood(atoi(argv[2]), atoi(argv[3]));
+    }
+  }
+  if (argc >= 3 && argc <= 4 && strcmp(argv[1], "churn") == 0) {
+    int read_every = (argc == 4) ? atoi(argv[3]) : 1;
+    if (atoi(argv[2]) > 0 && read_every > 0) {
+      return run_churn(atoi(argv[2]), read_every);
+    }
+  }
+  if (argc >= 4 && argc <= 5 && strcmp(argv[1], "sink") == 0) {
+    if (atoi(argv[2]) > 0 && (strcmp(argv[3], "receive1") == 0 ||
+        strcmp(argv[3], "borrow") == 0 || strcmp(argv[3], "fd") == 0)) {
+      return run_sink(atoi(argv[2]), argv[3], (argc == 5) ? argv[4] : "/dev/null");
+    }
+  }
+  if (argc >= 5 && argc <= 6 && strcmp(argv[1], "poll") == 0) {
+    int use_epoll = (argc == 6 && strcmp(argv[5], "epoll") == 0);
+    if (atoi(argv[2]) > 0 && atoi(argv[3]) > 0 && atoi(argv[4]) > 0 && (argc == 5 || use_epoll)) {
+      return run_poll(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]), use_epoll);
+    }
+  }
+  if (argc >= 2 && argc <= 3 && strcmp(argv[1], "echo") == 0) {
+    int port_number = (argc == 3) ? atoi(argv[2]) : RECEIVER_PORT_NUMBER;
+    if (port_number > 0) {
+      return run_echo((unsigned short)port_number);
+    }
+  }
+  if (argc == 3 && strcmp(argv[1], "close") == 0) {
+    if (atoi(argv[2]) > 0) {
+      return run_close(atoi(argv[2]));
+    }
+  }
+  fprintf(stderr, "usage: %s pps num_senders seconds [num_shards]\n"
+                  "       %s contention num_readers seconds read_size [ack_every]\n"
+                  "       %s poll num_connections seconds read_size [epoll]\n"
+                  "       %s borrow num_readers seconds\n"
+                  "       %s flood num_flooders seconds\n"
+                  "       %s churn seconds [read_every]\n"
+                  "       %s sink megabytes receive1|borrow|fd [path]\n"
+                  "       %s echo [port_number]\n"
+                  "       %s close num_connections\n",
+                  argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+  return -1;
+}
+
+int run_pps(int num_senders, int seconds, int num_shards) {
+  if (mrt_open_sharded(RECEIVER_PORT_NUMBER, num_shards) < 0) {
+    perror("mrt_open() error...\n");
+    return -1;
+  }
+
+  /****** connect all the senders ******/
+  pthread_t acceptor_thread;
+  pthread_create(&acceptor_thread, NULL, acceptor, &num_senders);
+
+  blaster_t *blasters = calloc(num_senders, sizeof(blaster_t));
+  int i;
+  for (i = 0; i < num_senders; i++) {
+    pthread_create(&(blasters[i].thread), NULL, blaster, &(blasters[i]));
+  }
+  pthread_join(acceptor_thread, NULL);
+
+  /****** blast for the given amount of time ******/
+  pthread_mutex_lock(&flag_lock);
+  should_start = 1;
+  pthread_mutex_unlock(&flag_lock);
+  double start_time = now_seconds();
+  sleep(seconds);
+  pthread_mutex_lock(&flag_lock);
+  should_stop = 1;
+  pthread_mutex_unlock(&flag_lock);
+  double elapsed = now_seconds() - start_time;
+
+  long total_sent = 0, total_replies = 0;
+  for (i = 0; i < num_senders; i++) {
+    pthread_join(blasters[i].thread, NULL);
+    total_sent += blasters[i].num_sent;
+    total_replies += blasters[i].num_replies;
+    close(blasters[i].sockfd);
+  }
+  free(blasters);
+
+  printf("pps: senders=%d shards=%d io=%s seconds=%.2f sent=%ld replies=%ld "
+         "offered_pps=%.0f handled_pps=%.0f\n",
+         num_senders, num_shards, (io_engine_used == MRT_IO_URING) ? "uring" : "sockets", elapsed, total_sent, total_replies,
+         total_sent / elapsed, total_replies / elapsed);
+
+  mrt_close();
+  return 0;
+}
+
+int run_contention(int num_readers, int seconds, int read_size, int ack_every) {
+  if (mrt_open(RECEIVER_PORT_NUMBER) < 0) {
+    perror("mrt_open() error...\n");
+    return -1;
+  }
+
+  /****** connect all the senders, one reader per connection ******/
+  blaster_t *streamers = calloc(num_readers, sizeof(blaster_t));
+  reader_t *readers = calloc(num_readers, sizeof(reader_t));
+  int i;
+  for (i = 0; i < num_readers; i++) {
+    pthread_create(&(streamers[i].thread), NULL, streamer, &(streamers[i]));
+  }
+  for (i = 0; i < num_readers; i++) {
+    readers[i].id_p = mrt_accept1();
+    readers[i].read_size = read_size;
+    if (ack_every > 0) {
+      mrt_set_ack_policy(readers[i].id_p, ack_every, 
+        (ack_every == 1) ? 0 : RECEIVER_DEFAULT_ACK_DELAY);
+    }
+    pthread_create(&(readers[i].thread), NULL, reader, &(readers[i]));
+  }
+
+  /****** stream for the given amount of time ******/
+  pthread_mutex_lock(&flag_lock);
+  should_start = 1;
+  pthread_mutex_unlock(&flag_lock);
+  double start_time = now_seconds();
+  sleep(seconds);
+  pthread_mutex_lock(&flag_lock);
+  should_stop = 1;
+  pthread_mutex_unlock(&flag_lock);
+  double elapsed = now_seconds() - start_time;
+
+  long total_calls = 0, total_bytes = 0, total_sent = 0, total_replies = 0;
+  for (i = 0; i < num_readers; i++) {
+    pthread_join(streamers[i].thread, NULL);
+    total_sent += streamers[i].num_sent;
+    total_replies += streamers[i].num_replies;
+    close(streamers[i].sockfd);
+  }
+  // the readers return once their connections time out
+  for (i = 0; i < num_readers; i++) {
+    pthread_join(readers[i].thread, NULL);
+    total_calls += readers[i].num_calls;
+    total_bytes += readers[i].num_bytes;
+    free(readers[i].id_p);
+  }
+  free(streamers);
+  free(readers);
+
+  printf("%s: readers=%d read_size=%d ack_every=%d seconds=%.2f bytes=%ld "
+         "MBps=%.2f receive1_per_sec=%.0f data_pps=%.0f adat_pps=%.0f adats_per_data=%.2f\n",
+         (read_size > 0) ? "contention" : "borrow", num_readers, read_size, ack_every, elapsed, total_bytes,
+         total_bytes / elapsed / 1e6, total_calls / elapsed,
+         total_sent / elapsed, total_replies / elapsed,
+         (total_sent > 0) ? (double)total_replies / total_sent : 0.0);
+
+  mrt_close();
+  return 0;
+}
+
+int run_poll(int num_connections, int seconds, int read_size, int use_epoll) {
+  if (mrt_open(RECEIVER_PORT_NUMBER) < 0) {
+    perror("mrt_open() error...\n");
+    return -1;
+  }
+  blaster_t *streamers = calloc(num_connections, sizeof(blaster_t));
+  mrt_event_t *events = calloc(num_connections + 1, sizeof(mrt_event_t));
+  struct sockaddr_in *ids = calloc(num_connections, sizeof(struct sockaddr_in));
+  struct epoll_event *epoll_events = calloc(num_connections + 1, sizeof(struct epoll_event));
+  char *buffer = malloc(read_size);
+  struct epoll_event epoll_event;
+  int epfd = epoll_create1(0);
+  int i, j, num_ready, num_accepted = 0, num_bytes_read;
+  long num_wakeups = 0, num_calls = 0, total_bytes = 0;
+
+  /****** accept every connection as its request shows up ******/
+  for (i = 0; i < num_connections; i++) {
+    pthread_create(&(streamers[i].thread), NULL, streamer, &(streamers[i]));
+  }
+  epoll_event.events = EPOLLIN;
+  epoll_event.data.u32 = num_connections; // stands for the accept eventfd
+  epoll_ctl(epfd, EPOLL_CTL_ADD, mrt_accept_eventfd(), &epoll_event);
+  while (num_accepted < num_connections) {
+    if (use_epoll) {
+      epoll_wait(epfd, epoll_events, num_connections + 1, -1);
+    } else {
+      mrt_poll(events, num_connections + 1, -1);
+    }
+    // the events just say accepting won't block
+    struct sockaddr_in *id_p = mrt_accept1();
+    memmove(&(ids[num_accepted]), id_p, sizeof(struct sockaddr_in));
+    free(id_p);
+    epoll_event.data.u32 = num_accepted;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, mrt_eventfd(&(ids[num_accepted])), &epoll_event);
+    num_accepted += 1;
+  }
+
+  /****** drain whatever is ready for the given amount of time ******/
+  pthread_mutex_lock(&flag_lock);
+  should_start = 1;
+  pthread_mutex_unlock(&flag_lock);
+  double start_time = now_seconds();
+  while (now_seconds() - start_time < seconds) {
+    if (use_epoll) {
+      num_ready = epoll_wait(epfd, epoll_events, num_connections + 1, EXPECTED_RTT / 1000);
+      for (j = 0; j < num_ready; j++) {
+        if (epoll_events[j].data.u32 == (unsigned int)num_connections) { continue; }
+        memmove(&(events[j].id), &(ids[epoll_events[j].data.u32]), sizeof(struct sockaddr_in));
+      }
+    } else {
+      num_ready = mrt_poll(events, num_connections + 1, EXPECTED_RTT);
+    }
+    num_wakeups += 1;
+    for (j = 0; j < num_ready; j++) {
+      if (use_epoll && epoll_events[j].data.u32 == (unsigned int)num_connections) { continue; }
+      if (!use_epoll && !(events[j].events & MRT_POLLIN)) { continue; }
+      num_bytes_read = mrt_receive1(&(events[j].id), buffer, read_size);
+      if (num_bytes_read > 0) {
+        num_calls += 1;
+        total_bytes += num_bytes_read;
+      }
+    }
+  }
+  pthread_mutex_lock(&flag_lock);
+  should_stop = 1;
+  pthread_mutex_unlock(&flag_lock);
+  double elapsed = now_seconds() - start_time;
+
+  for (i = 0; i < num_connections; i++) {
+    pthread_join(streamers[i].thread, NULL);
+    close(streamers[i].sockfd);
+  }
+  printf("poll: connections=%d read_size=%d waiter=%s seconds=%.2f bytes=%ld "
+         "MBps=%.2f receive1_per_sec=%.0f receive1_per_wakeup=%.2f\n",
+         num_connections, read_size, use_epoll ? "epoll" : "mrt_poll", elapsed,
+         total_bytes, total_bytes / elapsed / 1e6, num_calls / elapsed,
+         (num_wakeups > 0) ? (double)num_calls / num_wakeups : 0.0);
+
+  close(epfd);
+  free(streamers);
+  free(events);
+  free(ids);
+  free(epoll_events);
+  free(buffer);
+  mrt_close();
+  return 0;
+}
+
+int run_flood(int num_flooders, int seconds) {
+  if (mrt_open(RECEIVER_PORT_NUMBER) < 0) {
+    perror("mrt_open() error...\n");
+    return -1;
+  }
+  pthread_t acceptor_thread;
+  long num_accepted = 0;
+  pthread_create(&acceptor_thread, NULL, polling_acceptor, &num_accepted);
+  blaster_t *flooders = calloc(num_flooders, sizeof(blaster_t));
+  double *setup_times = malloc(MAX_SETUP_SAMPLES * sizeof(double));
+  int i, num_samples = 0, sockfd;
+  for (i = 0; i < num_flooders; i++) {
+    pthread_create(&(flooders[i].thread), NULL, flooder, &(flooders[i]));
+  }
+
+  /****** connect over and over while the flooders flood ******/
+  pthread_mutex_lock(&flag_lock);
+  should_start = 1;
+  pthread_mutex_unlock(&flag_lock);
+  double start_time = now_seconds(), setup_start;
+  while (now_seconds() - start_time < seconds && num_samples < MAX_SETUP_SAMPLES) {
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    setup_start = now_seconds();
+    if (sockfd < 0 || connect_raw_sender(sockfd) < 0) {
+      perror("flood: could not connect\n");
+      break;
+    }
+    setup_times[num_samples++] = now_seconds() - setup_start;
+    close(sockfd);
+  }
+  pthread_mutex_lock(&flag_lock);
+  should_stop = 1;
+  pthread_mutex_unlock(&flag_lock);
+  double elapsed = now_seconds() - start_time;
+
+  long total_sent = 0, total_replies = 0;
+  for (i = 0; i < num_flooders; i++) {
+    pthread_join(flooders[i].thread, NULL);
+    total_sent += flooders[i].num_sent;
+    total_replies += flooders[i].num_replies;
+  }
+  pthread_join(acceptor_thread, NULL);
+
+  sort_doubles(setup_times, num_samples);
+  printf("flood: flooders=%d seconds=%.2f flood_rcon_pps=%.0f cook_pps=%.0f "
+         "connects=%d accepted=%ld setup_p50_us=%.0f setup_p99_us=%.0f\n",
+         num_flooders, elapsed, total_sent / elapsed, total_replies / elapsed,
+         num_samples, num_accepted,
+         percentile(setup_times, num_samples, 0.5) * 1e6,
+         percentile(setup_times, num_samples, 0.99) * 1e6);
+
+  free(flooders);
+  free(setup_times);
+  mrt_close();
+  return 0;
+}
+
+/* sends RCONs from FLOOD_SOCKETS source ports in turn, never echoing
+ * the cookies, until told to stop; counts the COOKs that come back
+ */
+void *flooder(void *blaster_vp) {
+  blaster_t *blaster_p = (blaster_t *)blaster_vp;
+  struct sockaddr_in rece_addr = {0};
+  rece_addr.sin_family = AF_INET;
+  rece_addr.sin_port = htons(RECEIVER_PORT_NUMBER);
+  rece_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  int sockfds[FLOOD_SOCKETS], i, can_start;
+  for (i = 0; i < FLOOD_SOCKETS; i++) {
+    sockfds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+    connect(sockfds[i], (struct sockaddr *)&rece_addr, sizeof(rece_addr));
+  }
+  char outgoing_buffer[MRT_HEADER_LENGTH + 1];
+  char incoming_buffer[MAX_UDP_PAYLOAD_LENGTH];
+  int len = build_transmission(outgoing_buffer, MRT_RCON, 0, 0, NULL, 0);
+
+  while (!is_stopped(&can_start)) {
+    if (!can_start) {
+      usleep(1000);
+      continue;
+    }
+    for (i = 0; i < FLOOD_SOCKETS; i++) {
+      if (send(sockfds[i], outgoing_buffer, len, 0) > 0) { blaster_p->num_sent += 1; }
+      while (recv(sockfds[i], incoming_buffer, MAX_UDP_PAYLOAD_LENGTH, MSG_DONTWAIT) > 0) {
+        blaster_p->num_replies += 1;
+      }
+    }
+    usleep(FLOOD_PAUSE);
+  }
+  for (i = 0; i < FLOOD_SOCKETS; i++) {
+    close(sockfds[i]);
+  }
+  return NULL;
+}
+
+/* accepts whatever mrt_poll() says is pending until told to stop
+ */
+void *polling_acceptor(void *num_accepted_vp) {
+  long *num_accepted_p = (long *)num_accepted_vp;
+  mrt_event_t event;
+  int can_start;
+  while (!is_stopped(&can_start)) {
+    if (mrt_poll(&event, 1, EXPECTED_RTT) > 0 && (event.events & MRT_POLLPENDING)) {
+      free(mrt_accept1());
+      *num_accepted_p += 1;
+    }
+  }
+  return NULL;
+}
+
+int run_churn(int seconds, int read_every) {
+  if (mrt_open(RECEIVER_PORT_NUMBER) < 0) {
+    perror("mrt_open() error...\n");
+    return -1;
+  }
+  blaster_t churning_sender = {0};
+  mrt_event_t *events = calloc(CHURN_EVENTS, sizeof(mrt_event_t));
+  char buffer[MAX_MRT_PAYLOAD_LENGTH];
+  long num_accepted = 0, num_ended = 0;
+  int i, num_ready, second = 0;
+  pthread_create(&(churning_sender.thread), NULL, churner, &churning_sender);
+
+  /****** accept, read and see the end of whatever shows up ******/
+  pthread_mutex_lock(&flag_lock);
+  should_start = 1;
+  pthread_mutex_unlock(&flag_lock);
+  double start_time = now_seconds();
+  while (now_seconds() - start_time < seconds) {
+    num_ready = mrt_poll(events, CHURN_EVENTS, EXPECTED_RTT);
+    for (i = 0; i < num_ready; i++) {
+      if (events[i].events & MRT_POLLPENDING) {
+        free(mrt_accept1());
+        num_accepted += 1;
+      } else if (events[i].events == MRT_POLLHUP) {
+        num_ended += 1; // drained and over; the receiver lets it go
+      } else if (ntohs(events[i].id.sin_port) % read_every == 0) {
+        mrt_receive1(&(events[i].id), buffer, MAX_MRT_PAYLOAD_LENGTH); // won't block
+      }
+    }
+    if (now_seconds() - start_time >= second + 1) {
+      second += 1;
+      printf("churn: second=%d connections=%ld accepted=%ld ended=%ld rss_kb=%ld\n",
+             second, churning_sender.num_sent, num_accepted, num_ended, rss_kb());
+    }
+  }
+  pthread_mutex_lock(&flag_lock);
+  should_stop = 1;
+  pthread_mutex_unlock(&flag_lock);
+  // the churner may be waiting for its last connection to be accepted
+  while (pthread_tryjoin_np(churning_sender.thread, NULL) != 0) {
+    num_ready = mrt_poll(events, CHURN_EVENTS, EXPECTED_RTT);
+    for (i = 0; i < num_ready; i++) {
+      if (events[i].events & MRT_POLLPENDING) { free(mrt_accept1()); }
+    }
+  }
+
+  free(events);
+  mrt_close();
+  return 0;
+}
+
+int run_sink(int megabytes, const char *method, const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror("sink: could not open the output\n");
+    return -1;
+  }
+  if (mrt_open(RECEIVER_PORT_NUMBER) < 0) {
+    perror("mrt_open() error...\n");
+    return -1;
+  }
+  blaster_t file_sender = {0};
+  file_sender.window = SINK_WINDOW;
+  file_sender.num_to_send = ((long)megabytes * 1000000 + MAX_MRT_PAYLOAD_LENGTH - 1) / MAX_MRT_PAYLOAD_LENGTH;
+  pthread_create(&(file_sender.thread), NULL, streamer, &file_sender);
+  struct sockaddr_in *id_p = mrt_accept1();
+  char buffer[SINK_READ_SIZE];
+  const void *view_p = NULL;
+  long long total_bytes = 0;
+  int num_bytes_read;
+
+  /****** write the whole connection out ******/
+  pthread_mutex_lock(&flag_lock);
+  should_start = 1;
+  pthread_mutex_unlock(&flag_lock);
+  double start_time = now_seconds();
+  double start_cpu = cpu_seconds(RUSAGE_SELF), start_app_cpu = cpu_seconds(RUSAGE_THREAD);
+  if (strcmp(method, "fd") == 0) {
+    total_bytes = mrt_receive_to_fd(id_p, fd);
+  } else if (strcmp(method, "borrow") == 0) {
+    while ((num_bytes_read = mrt_borrow(id_p, &view_p)) > 0) {
+      total_bytes += write(fd, view_p, num_bytes_read);
+      mrt_release(id_p, num_bytes_read);
+    }
+  } else {
+    while ((num_bytes_read = mrt_receive1(id_p, buffer, SINK_READ_SIZE)) > 0) {
+      total_bytes += write(fd, buffer, num_bytes_read);
+    }
+  }
+  double elapsed = now_seconds() - start_time;
+  double cpu = cpu_seconds(RUSAGE_SELF) - start_cpu, app_cpu = cpu_seconds(RUSAGE_THREAD) - start_app_cpu;
+  pthread_join(file_sender.thread, NULL);
+  close(file_sender.sockfd);
+
+  printf("sink: method=%s bytes=%lld seconds=%.2f MBps=%.2f cpu_sec_per_GB=%.2f app_cpu_sec_per_GB=%.2f\n",
+         method, total_bytes, elapsed, total_bytes / elapsed / 1e6,
+         (total_bytes > 0) ? cpu / (total_bytes / 1e9) : 0.0,
+         (total_bytes > 0) ? app_cpu / (total_bytes / 1e9) : 0.0);
+
+  close(fd);
+  free(id_p);
+  mrt_close();
+  return 0;
+}
+
+int run_echo(unsigned short port_number) {
+  if (mrt_open(port_number) < 0) {
+    perror("mrt_open() error...\n");
+    return -1;
+  }
+  struct sockaddr_in *id_p = mrt_accept1();
+  mrt_receiver_stats_t stats = {0};
+  char buffer[ECHO_READ_SIZE];
+  long long total_bytes = 0;
+  int num_bytes_read;
+
+  while ((num_bytes_read = mrt_receive1(id_p, buffer, ECHO_READ_SIZE)) > 0) {
+    int is_replied = (mrt_reply(id_p, buffer, num_bytes_read) == 1);
+    // the stats are gone with the connection once its end is read
+    mrt_receiver_stats(id_p, &stats);
+    if (!is_replied) { break; }
+    total_bytes += num_bytes_read;
+  }
+  printf("echo: bytes=%lld adats=%lld acks_piggybacked=%lld\n",
+         total_bytes, stats.adats_sent, stats.acks_piggybacked);
+
+  free(id_p);
+  mrt_close();
+  return 0;
+}
+
+int run_close(int num_connections) {
+  if (mrt_open(RECEIVER_PORT_NUMBER) < 0) {
+    perror("mrt_open() error...\n");
+    return -1;
+  }
+  keeper_t keeper_state = { .sockfds = calloc(num_connections, sizeof(int)) };
+  pthread_t acceptor_thread;
+  int i;
+
+  /****** one at a time (the ACON comes once accepted) ******/
+  pthread_create(&acceptor_thread, NULL, acceptor, &num_connections);
+  // (the first connections would time out while the rest are set up otherwise)
+  pthread_create(&(keeper_state.thread), NULL, keeper, &keeper_state);
+  for (i = 0; i < num_connections; i++) {
+    keeper_state.sockfds[i] = socket(AF_INET, SOCK_DGRAM, 0);
+    if (keeper_state.sockfds[i] < 0 || connect_raw_sender(keeper_state.sockfds[i]) < 0) {
+      perror("close: could not connect\n");
+      break;
+    }
+    pthread_mutex_lock(&flag_lock);
+    keeper_state.num_sockets = i + 1;
+    pthread_mutex_unlock(&flag_lock);
+  }
+  int num_accepted = i;
+  usleep(KEEP_ALIVE_PERIOD * 2);
+  pthread_mutex_lock(&flag_lock);
+  should_stop = 1;
+  pthread_mutex_unlock(&flag_lock);
+  pthread_join(keeper_state.thread, NULL);
+
+  /****** nothing arrives from here on ******/
+  int threads_before = count_threads();
+  double start_time = now_seconds();
+  mrt_close();
+  double elapsed = now_seconds() - start_time;
+  printf("close: connections=%d threads_before=%d threads_after=%d close_ms=%.3f\n",
+         num_accepted, threads_before, count_threads(), elapsed * 1e3);
+  pthread_join(acceptor_thread, NULL); // (let go by mrt_close() if a connection failed)
+
+  for (i = 0; i < num_accepted; i++) { close(keeper_state.sockfds[i]); }
+  free(keeper_state.sockfds);
+  return (num_accepted == num_connections) ? 0 : -1;
+}
+
+/* sends an empty DATA on each of the connections accepted so far
+ * every KEEP_ALIVE_PERIOD, so that the receiver keeps them, until told
+ * to stop
+ */
+void *keeper(void *keeper_vp) {
+  keeper_t *keeper_p = (keeper_t *)keeper_vp;
+  char outgoing_buffer[MRT_HEADER_LENGTH];
+  int len = build_transmission(outgoing_buffer, MRT_DATA, -1, 0, NULL, 0);
+  int num_sockets;
+  while (1) {
+    pthread_mutex_lock(&flag_lock);
+    int must_stop = should_stop;
+    num_sockets = keeper_p->num_sockets;
+    pthread_mutex_unlock(&flag_lock);
+    if (must_stop) { break; }
+    for (int i = 0; i < num_sockets; i++) {
+      send(keeper_p->sockfds[i], outgoing_buffer, len, MSG_DONTWAIT);
+    }
+    usleep(KEEP_ALIVE_PERIOD);
+  }
+  return NULL;
+}
+
+// user plus system CPU time so far, of RUSAGE_SELF or RUSAGE_THREAD
+double cpu_seconds(int who) {
+  struct rusage usage;
+  getrusage(who, &usage);
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+         usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+/* opens a connection, sends one payload and closes it, over and over
+ * until told to stop; counts the connections in `num_sent`
+ */
+void *churner(void *blaster_vp) {
+  blaster_t *blaster_p = (blaster_t *)blaster_vp;
+  char payload[BLAST_PAYLOAD_LENGTH];
+  memset(payload, 'c', BLAST_PAYLOAD_LENGTH);
+  char outgoing_buffer[MAX_UDP_PAYLOAD_LENGTH + 1];
+  char incoming_buffer[MAX_UDP_PAYLOAD_LENGTH];
+  int type_holder, frag_holder, len, can_start, k;
+
+  while (!is_stopped(&can_start)) {
+    if (!can_start) {
+      usleep(1000);
+      continue;
+    }
+    blaster_p->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (blaster_p->sockfd < 0 || connect_raw_sender(blaster_p->sockfd) < 0) {
+      perror("churner: could not connect\n");
+      return NULL;
+    }
+    /* the payload, until it is ADAT'd, then RCLS until ACLS; the
+     * connection may be gone meanwhile if the port was reused from one
+     * the receiver was done with, so don't insist forever
+     */
+    len = build_transmission(outgoing_buffer, MRT_DATA, 1, MRT_FLAG_PUSH, payload, BLAST_PAYLOAD_LENGTH);
+    frag_holder = 0;
+    for (k = 0; k < CHURN_TRIES && frag_holder < 1; k++) {
+      send(blaster_p->sockfd, outgoing_buffer, len, 0);
+      if (recv(blaster_p->sockfd, incoming_buffer, MAX_UDP_PAYLOAD_LENGTH, 0) >= MRT_HEADER_LENGTH) {
+        memmove(&type_holder, incoming_buffer + MRT_TYPE_LOCATION, MRT_TYPE_LENGTH);
+        if (type_holder == MRT_ADAT) {
+          memmove(&frag_holder, incoming_buffer + MRT_FRAGMENT_LOCATION, MRT_FRAGMENT_LENGTH);
+        }
+      }
+    }
+    len = build_transmission(outgoing_buffer, MRT_RCLS, 0, 0, NULL, 0);
+    type_holder = MRT_UNKN;
+    for (k = 0; k < CHURN_TRIES && type_holder != MRT_ACLS; k++) {
+      send(blaster_p->sockfd, outgoing_buffer, len, 0);
+      if (recv(blaster_p->sockfd, incoming_buffer, MAX_UDP_PAYLOAD_LENGTH, 0) >= MRT_HASH_LENGTH + MRT_TYPE_LENGTH) {
+        memmove(&type_holder, incoming_buffer + MRT_TYPE_LOCATION, MRT_TYPE_LENGTH);
+      }
+    }
+    close(blaster_p->sockfd);
+    if (type_holder == MRT_ACLS) { blaster_p->num_sent += 1; }
+  }
+  return NULL;
+}
+
+// the resident set size of this process, from /proc/self/statm
+long rss_kb() {
+  long num_pages = 0;
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (statm == NULL) { return -1; }
+  if (fscanf(statm, "%*s %ld", &num_pages) != 1) { num_pages = 0; }
+  fclose(statm);
+  return num_pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* accepts the given number of connections then returns (or once the
+ * receiver is closed); each gets an ADAT for every DATA, so that the
+ * ADATs count the DATA handled
+ */
+void *acceptor(void *num_senders_vp) {
+  int num_senders = *((int *)num_senders_vp);
+  struct sockaddr_in *id_p;
+  for (int i = 0; i < num_senders; i++) {
+    if ((id_p = mrt_accept1()) == NULL) { break; }
+    mrt_set_ack_policy(id_p, 1, 0);
+    free(id_p);
+  }
+  return NULL;
+}
+
+/* connects, waits for the start signal, then sends bursts of DATA and
+ * counts the ADATs that come back until told to stop
+ */
+void *blaster(void *blaster_vp) {
+  blaster_t *blaster_p = (blaster_t *)blaster_vp;
+  blaster_p->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (blaster_p->sockfd < 0 || connect_raw_sender(blaster_p->sockfd) < 0) {
+    perror("blaster: could not connect\n");
+    return NULL;
+  }
+
+  char payload[BLAST_PAYLOAD_LENGTH];
+  memset(payload, 'x', BLAST_PAYLOAD_LENGTH);
+  char outgoing_buffer[MAX_UDP_PAYLOAD_LENGTH + 1];
+  int len = build_transmission(outgoing_buffer, MRT_DATA, BLAST_FRAG, 0, payload, BLAST_PAYLOAD_LENGTH);
+
+  struct iovec iovec = { outgoing_buffer, len };
+  struct mmsghdr msgs[BURST_SIZE];
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < BURST_SIZE; i++) {
+    msgs[i].msg_hdr.msg_iov = &iovec;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  char incoming_buffer[MAX_UDP_PAYLOAD_LENGTH];
+  int num_sent;
+
+  int can_start;
+  while (!is_stopped(&can_start)) {
+    if (!can_start) {
+      usleep(1000);
+      continue;
+    }
+
+    num_sent = sendmmsg(blaster_p->sockfd, msgs, BURST_SIZE, 0);
+    if (num_sent > 0) { blaster_p->num_sent += num_sent; }
+    while (recv(blaster_p->sockfd, incoming_buffer, MAX_UDP_PAYLOAD_LENGTH, MSG_DONTWAIT) > 0) {
+      blaster_p->num_replies += 1;
+    }
+  }
+  return NULL;
+}
+
+/* connects, waits for the start signal, then streams in-order DATA
+ * Go-Back-N style (at most STREAM_WINDOW fragments past the last ADAT)
+ * until told to stop
+ */
+void *streamer(void *blaster_vp) {
+  blaster_t *blaster_p = (blaster_t *)blaster_vp;
+  blaster_p->sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (blaster_p->sockfd < 0 || connect_raw_sender(blaster_p->sockfd) < 0) {
+    perror("streamer: could not connect\n");
+    return NULL;
+  }
+  struct timeval timeout = { 0, 1000 };
+  setsockopt(blaster_p->sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  char payload[MAX_MRT_PAYLOAD_LENGTH];
+  memset(payload, 'y', MAX_MRT_PAYLOAD_LENGTH);
+  char outgoing_buffer[MAX_UDP_PAYLOAD_LENGTH + 1];
+  char incoming_buffer[MAX_UDP_PAYLOAD_LENGTH];
+  int last_acknowledged_frag = 0, frag_holder = 0, type_holder = 0, len, k;
+
+  long num_to_send = blaster_p->num_to_send; // (and the last fragment)
+  int window = (blaster_p->window > 0) ? blaster_p->window : STREAM_WINDOW;
+  int can_start, is_last;
+  while (!is_stopped(&can_start)) {
+    if (!can_start) {
+      usleep(1000);
+      continue;
+    }
+    if (num_to_send > 0 && last_acknowledged_frag >= num_to_send) { break; }
+    for (k = 1; k <= window; k++) {
+      is_last = (num_to_send > 0 && last_acknowledged_frag + k >= num_to_send);
+      // like mrt_sender, flag the fragment that fills the window
+      len = build_transmission(outgoing_buffer, MRT_DATA, last_acknowledged_frag + k,
+        (k == window || is_last) ? MRT_FLAG_PUSH : 0, payload, MAX_MRT_PAYLOAD_LENGTH);
+      send(blaster_p->sockfd, outgoing_buffer, len, 0);
+      blaster_p->num_sent += 1;
+      if (is_last) { break; }
+    }
+    // block for the first ADAT (or the timeout), then drain the rest
+    int flags = 0;
+    while (recv(blaster_p->sockfd, incoming_buffer, MAX_UDP_PAYLOAD_LENGTH, flags) >= MRT_HEADER_LENGTH) {
+      blaster_p->num_replies += 1;
+      memmove(&type_holder, incoming_buffer + MRT_TYPE_LOCATION, MRT_TYPE_LENGTH);
+      memmove(&frag_holder, incoming_buffer + MRT_FRAGMENT_LOCATION, MRT_FRAGMENT_LENGTH);
+      if (type_holder == MRT_ADAT && frag_holder > last_acknowledged_frag) {
+        last_acknowledged_frag = frag_holder;
+      }
+      flags = MSG_DONTWAIT;
+    }
+  }
+  // done with what there was to send; close
+  len = build_transmission(outgoing_buffer, MRT_RCLS, 0, 0, NULL, 0);
+  type_holder = MRT_UNKN;
+  while (num_to_send > 0 && type_holder != MRT_ACLS) {
+    send(blaster_p->sockfd, outgoing_buffer, len, 0);
+    if (recv(blaster_p->sockfd, incoming_buffer, MAX_UDP_PAYLOAD_LENGTH, 0) >= MRT_HASH_LENGTH + MRT_TYPE_LENGTH) {
+      memmove(&type_holder, incoming_buffer + MRT_TYPE_LOCATION, MRT_TYPE_LENGTH);
+    }
+  }
+  return NULL;
+}
+
+/* drains its connection `read_size` bytes at a time (or a borrowed
+ * view at a time) until the connection is over, summing the bytes up
+ * and counting what is read before the stop signal
+ */
+void *reader(void *reader_vp) {
+  reader_t *reader_p = (reader_t *)reader_vp;
+  char *buffer = malloc(reader_p->read_size);
+  const void *view_p = NULL;
+  const unsigned char *bytes;
+  int num_bytes_read, can_start, i;
+  while (1) {
+    if (reader_p->read_size > 0) {
+      num_bytes_read = mrt_receive1(reader_p->id_p, buffer, reader_p->read_size);
+      bytes = (const unsigned char *)buffer;
+    } else {
+      num_bytes_read = mrt_borrow(reader_p->id_p, &view_p);
+      bytes = (const unsigned char *)view_p;
+    }
+    if (num_bytes_read <= 0) { break; }
+    for (i = 0; i < num_bytes_read; i++) {
+      reader_p->checksum += bytes[i];
+    }
+    if (reader_p->read_size == 0) {
+      mrt_release(reader_p->id_p, num_bytes_read);
+    }
+    if (!is_stopped(&can_start)) {
+      reader_p->num_calls += 1;
+      reader_p->num_bytes += num_bytes_read;
+    }
+  }
+  free(buffer);
+  return NULL;
+}
+
+/* keeps sending RCON on the (already created) socket until an ACON
+ * arrives; returns 0 on success and -1 on error
+ */
+int connect_raw_sender(int sockfd) {
+  struct sockaddr_in rece_addr = {0};
+  rece_addr.sin_family = AF_INET;
+  rece_addr.sin_port = htons(RECEIVER_PORT_NUMBER);
+  rece_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(sockfd, (struct sockaddr *)&rece_addr, sizeof(rece_addr)) < 0) {
+    return -1;
+  }
+  struct timeval timeout = { 0, EXPECTED_RTT * 2 };
+  setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  char outgoing_buffer[MRT_HEADER_LENGTH + 1];
+  char incoming_buffer[MAX_UDP_PAYLOAD_LENGTH];
+  int len = build_transmission(outgoing_buffer, MRT_RCON, 0, 0, NULL, 0);
+  int type_holder = MRT_UNKN, cookie_holder = 0;
+  while (type_holder != MRT_ACON) {
+    send(sockfd, outgoing_buffer, len, 0);
+    if (recv(sockfd, incoming_buffer, MAX_UDP_PAYLOAD_LENGTH, 0) >= MRT_HEADER_LENGTH) {
+      memmove(&type_holder, incoming_buffer + MRT_TYPE_LOCATION, MRT_TYPE_LENGTH);
+      if (type_holder == MRT_COOK) {
+        // echo the cookie from now on
+        memmove(&cookie_holder, incoming_buffer + MRT_COOKIE_LOCATION, MRT_COOKIE_LENGTH);
+        len = build_transmission(outgoing_buffer, MRT_RCON, 0, cookie_holder, NULL, 0);
+      }
+    }
+  }
+  return 0;
+}
+
+/* builds a (hashed) transmission in `buffer` and returns its length;
+ * `flags` go in the window size field (for RCONs, that's the cookie).
+ */
+int build_transmission(char *buffer, int type, int frag, int flags, char *payload, int payload_len) {
+  memmove(buffer + MRT_TYPE_LOCATION, &type, MRT_TYPE_LENGTH);
+  memmove(buffer + MRT_FRAGMENT_LOCATION, &frag, MRT_FRAGMENT_LENGTH);
+  memmove(buffer + MRT_FLAGS_LOCATION, &flags, MRT_FLAGS_LENGTH);
+  if (payload_len > 0) {
+    memmove(buffer + MRT_PAYLOAD_LOCATION, payload, payload_len);
+  }
+  unsigned long hash_holder = hash(buffer + MRT_HASH_LENGTH, MRT_PAYLOAD_LOCATION + payload_len - MRT_HASH_LENGTH);
+  memmove(buffer, &hash_holder, MRT_HASH_LENGTH);
+  return MRT_PAYLOAD_LOCATION + payload_len;
+}
+
+/* returns whether the stop signal is given, and reports the start
+ * signal in `can_start_p`
+ */
+int is_stopped(int *can_start_p) {
+  pthread_mutex_lock(&flag_lock);
+  int must_stop = should_stop;
+  *can_start_p = should_start;
+  pthread_mutex_unlock(&flag_lock);
+  return must_stop;
+}
+
+// atexit() callback dumping the trace, if MRT_TRACE asked for one
+void stop_trace() {
+  mrt_trace_stop();
+}
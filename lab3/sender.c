@@ -1,31 +1,46 @@
 /* The sender application testing the mrt_sender module
  *
  * command line:
- *	sender sender_port_number read_size
+ *	sender sender_port_number read_size [receiver_port_number]
+ *
+ * With MRT_TRACE set in the environment, the connection's events are
+ * traced into the file it names (see mrt_trace.h); with MRT_IO=uring,
+ * the connection is taken in by the ring thread if it can be (see
+ * mrt_set_io_engine()).
  *
  * For Dartmouth COSC 60 Lab 3;
  * By Shengsong Gao, May 2020.
  */
 
 #include <stdio.h>
-#include <stdlib.h> // atoi()
+#include <stdlib.h> // atoi(), getenv()
+#include <string.h> // strcmp()
 #include <unistd.h> // read(), STDIN_FILENO
 #include <netinet/in.h>  // INADDR_LOOPBACK
+#include "mrt.h"
 #include "mrt_sender.h"
+#include "mrt_trace.h"
 
 #define RECEIVER_PORT_NUMBER 7878
 #define BUFFER_SIZE 1000
 
 int main(int argc, char const *argv[]) {
   /****** parsing arguments ******/
-	if (argc != 3) {
-		fprintf(stderr, "usage: %s sender_port_number read_size\n", argv[0]);
+	if (argc != 3 && argc != 4) {
+		fprintf(stderr, "usage: %s sender_port_number read_size [receiver_port_number]\n", argv[0]);
 		return -1;
 	}
 	unsigned short sender_port_number = (unsigned short)(atoi(argv[1]));
   int read_size = atoi(argv[2]);
+  // e.g. a link emulator's port, in front of the receiver's
+  unsigned short receiver_port_number = (argc == 4) ? (unsigned short)(atoi(argv[3])) : RECEIVER_PORT_NUMBER;
+
+  const char *trace_path = getenv("MRT_TRACE");
+  if (trace_path != NULL) { mrt_trace_start(trace_path); }
+  const char *io_name = getenv("MRT_IO");
+  if (io_name != NULL && strcmp(io_name, "uring") == 0) { mrt_set_io_engine(MRT_IO_URING); }
 
-  int id = mrt_connect(sender_port_number, RECEIVER_PORT_NUMBER, INADDR_LOOPBACK);
+  int id = mrt_connect(sender_port_number, receiver_port_number, INADDR_LOOPBACK);
 
   if (id < 0) {
     perror("mrt_connect() failed...\n");
@@ -46,5 +61,6 @@ int main(int argc, char const *argv[]) {
 
   mrt_disconnect(id);
 
+  if (trace_path != NULL) { mrt_trace_stop(); }
   return 0;
 }
@@ -0,0 +1,170 @@
+/* Same-host benchmark for the MRT module: a bulk transfer to the
+ * `receiver` driver, then request/response round trips against
+ * `receiver_bench echo`, both in their own processes on loopback.
+ * Built twice: as shm_bench, whose mrt_send() goes through the ring the
+ * receiver takes in the handshake (see mrt.h), and as shm_bench_udp,
+ * whose sender never offers one (SENDER_SHARED_MEMORY=0), for the UDP
+ * path to compare with.
+ *
+ * command line:
+ *	shm_bench [megabytes [round_trips [request_size]]]
+ *
+ * Reported are the transfer's throughput and the round trips' latencies
+ * (median, 99th percentile and worst), along with the transport each
+ * connection ended up on. The echoes come back with mrt_reply(), which
+ * is UDP either way.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+#define _GNU_SOURCE // kill()
+
+#include <stdio.h>
+#include <stdlib.h> // atoi(), malloc(), free()
+#include <string.h>
+#include <unistd.h> // fork(), execl(), dup2()
+#include <fcntl.h>  // open()
+#include <signal.h>
+#include <sys/wait.h>
+#include <netinet/in.h>  // INADDR_LOOPBACK
+
+#include "mrt.h"
+#include "mrt_sender.h"
+#include "utilities.h" // now_usec()
+
+#define RECEIVER_PORT_NUMBER  7878 // the `receiver` driver's
+#define ECHO_PORT_NUMBER      7575
+#define SENDER_PORT_NUMBER    7676
+#define RECEIVER_PATH         "./receiver"
+#define SERVER_PATH           "./receiver_bench"
+#define CHUNK_SIZE            65536 // per mrt_send() of the transfer
+#define DEFAULT_MEGABYTES     64
+#define DEFAULT_ROUND_TRIPS   2000
+#define DEFAULT_REQUEST_SIZE  64
+#define MAX_REQUEST_SIZE      4096
+
+int run_transfer(int megabytes);
+int run_pingpong(int round_trips, int request_size);
+pid_t start_child(const char *path, const char *arg1, const char *arg2);
+
+int main(int argc, char const *argv[]) {
+  int megabytes = (argc >= 2) ? atoi(argv[1]) : DEFAULT_MEGABYTES;
+  int round_trips = (argc >= 3) ? atoi(argv[2]) : DEFAULT_ROUND_TRIPS;
+  int request_size = (argc >= 4) ? atoi(argv[3]) : DEFAULT_REQUEST_SIZE;
+  if (argc > 4 || megabytes <= 0 || round_trips <= 0 || request_size <= 0 || request_size > MAX_REQUEST_SIZE) {
+    fprintf(stderr, "usage: %s [megabytes [round_trips [request_size (at most %d)]]]\n", argv[0], MAX_REQUEST_SIZE);
+    return 1;
+  }
+  int has_failed = run_transfer(megabytes);
+  has_failed |= run_pingpong(round_trips, request_size);
+  return has_failed;
+}
+
+// sends `megabytes` MB in CHUNK_SIZE pieces and reports the throughput; returns 0 on success
+int run_transfer(int megabytes) {
+  char *chunk = malloc(CHUNK_SIZE);
+  mrt_sender_stats_t stats = {0};
+  long long i, num_chunks = (long long)megabytes * 1024 * 1024 / CHUNK_SIZE;
+  if (chunk == NULL) { return 1; }
+  memset(chunk, 'x', CHUNK_SIZE);
+
+  pid_t receiver_pid = start_child(RECEIVER_PATH, "1", NULL);
+  if (receiver_pid < 0) {
+    free(chunk);
+    return 1;
+  }
+  int id = mrt_connect(SENDER_PORT_NUMBER, RECEIVER_PORT_NUMBER, INADDR_LOOPBACK);
+  if (id < 0) {
+    kill(receiver_pid, SIGTERM);
+    waitpid(receiver_pid, NULL, 0);
+    free(chunk);
+    return 1;
+  }
+  long long start_time = now_usec();
+  for (i = 0; i < num_chunks; i++) {
+    if (mrt_send(id, chunk, CHUNK_SIZE) != 1) { break; }
+  }
+  long long elapsed = now_usec() - start_time;
+  mrt_stats(id, &stats);
+  mrt_disconnect(id);
+  waitpid(receiver_pid, NULL, 0);
+
+  printf("shm: transfer transport=%s megabytes=%lld seconds=%.3f mb_per_sec=%.1f frags_sent=%lld\n",
+         stats.is_shared_memory ? "shm" : "udp", i * CHUNK_SIZE / (1024 * 1024), elapsed / 1e6,
+         (i * CHUNK_SIZE / (1024.0 * 1024.0)) / (elapsed / 1e6), stats.frags_sent);
+  fflush(stdout);
+  free(chunk);
+  return i < num_chunks;
+}
+
+// one request at a time, each waiting for its whole echo; returns 0 on success
+int run_pingpong(int round_trips, int request_size) {
+  char request[MAX_REQUEST_SIZE], response[MAX_REQUEST_SIZE], port_str[16];
+  double *latencies = malloc(round_trips * sizeof(double));
+  mrt_sender_stats_t stats = {0};
+  int i, num_bytes, num_received, num_done = 0;
+  if (latencies == NULL) { return 1; }
+
+  snprintf(port_str, sizeof(port_str), "%d", ECHO_PORT_NUMBER);
+  pid_t server_pid = start_child(SERVER_PATH, "echo", port_str);
+  if (server_pid < 0) {
+    free(latencies);
+    return 1;
+  }
+  int id = mrt_connect(SENDER_PORT_NUMBER + 1, ECHO_PORT_NUMBER, INADDR_LOOPBACK);
+  if (id < 0) {
+    kill(server_pid, SIGTERM);
+    waitpid(server_pid, NULL, 0);
+    free(latencies);
+    return 1;
+  }
+  for (i = 0; i < round_trips; i++) {
+    memset(request, 'a' + i % 26, request_size);
+    long long start_time = now_usec();
+    if (mrt_send(id, request, request_size) != 1) { break; }
+    for (num_received = 0; num_received < request_size; num_received += num_bytes) {
+      num_bytes = mrt_receive(id, response + num_received, request_size - num_received);
+      if (num_bytes <= 0) { break; }
+    }
+    latencies[i] = (now_usec() - start_time) / 1000.0;
+    if (num_received < request_size || memcmp(request, response, request_size) != 0) {
+      fprintf(stderr, "shm: round trip %d came back wrong\n", i);
+      break;
+    }
+    num_done += 1;
+  }
+  mrt_stats(id, &stats);
+  mrt_disconnect(id);
+  waitpid(server_pid, NULL, 0);
+
+  sort_doubles(latencies, num_done);
+  printf("shm: pingpong transport=%s request_size=%d round_trips=%d", stats.is_shared_memory ? "shm" : "udp",
+         request_size, num_done);
+  if (num_done > 0) {
+    printf(" p50_ms=%.3f p99_ms=%.3f max_ms=%.3f", percentile(latencies, num_done, 0.5),
+           percentile(latencies, num_done, 0.99), percentile(latencies, num_done, 1.0));
+  }
+  printf("\n");
+  fflush(stdout);
+  free(latencies);
+  return num_done < round_trips;
+}
+
+// forks and execs `path` with up to two arguments, its output thrown away; returns its pid, or -1
+pid_t start_child(const char *path, const char *arg1, const char *arg2) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork() error\n");
+    return -1;
+  }
+  if (pid == 0) {
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd >= 0) { dup2(null_fd, STDOUT_FILENO); }
+    execl(path, path, arg1, arg2, (char *)NULL);
+    perror("execl() error\n");
+    _exit(127);
+  }
+  return pid;
+}
+
@@ -0,0 +1,227 @@
+/* Stream benchmark for the MRT module: small control records due at a
+ * steady pace next to a bulk transfer, over an emulated lossy link,
+ * sent (by stream_sender, in its own process) once all on stream 0 and
+ * once with the control records on a stream of their own, read by a
+ * thread of theirs.
+ *
+ * command line:
+ *	stream_bench [name=value ...]
+ *
+ * The link conditions are as for transfer_bench (by default 2% loss
+ * each way and 5 ms of delay, without jitter).
+ *
+ * For each run, how late the control records were (from when each was
+ * due to be sent to when it was read: median, 99th percentile and
+ * worst), how many bulk bytes came along, and whether everything came
+ * whole and in order are reported; the sender reports what it sent.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+#define _GNU_SOURCE // kill()
+
+#include <stdio.h>
+#include <stdlib.h> // atoi(), malloc(), free()
+#include <string.h>
+#include <unistd.h> // fork(), execl()
+#include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "mrt.h"
+#include "mrt_receiver.h"
+#include "link_emulator.h"
+#include "utilities.h" // now_usec()
+
+#define RECEIVER_PORT_NUMBER  7373
+#define LINK_PORT_NUMBER      7374
+#define FIRST_SENDER_PORT     7380 // one port per run
+#define SENDER_PATH           "./stream_sender"
+#define NUM_CONTROLS          "100"
+#define INTERVAL_USEC         "25000"
+#define BULK_SIZE             8192
+#define CONTROL_STREAM        1
+#define RECORD_BULK           0
+#define RECORD_CONTROL        1
+#define DEFAULT_SEED          60
+
+// what stream_sender starts every record with
+typedef struct stream_record {
+  int kind;
+  int len;
+  int seq;
+  long long due_usec;
+} stream_record_t;
+
+// what one reading thread saw on its stream
+typedef struct reader {
+  struct sockaddr_in *id_p;
+  int stream;
+  double *latencies; // of control records, in milliseconds
+  int num_controls;
+  int last_control_seq;
+  int last_bulk_seq;
+  long long bulk_bytes;
+  int is_intact;
+} reader_t;
+
+int run_streams(link_conditions_t *cond_p, unsigned short sender_port, int control_stream);
+pid_t start_sender(unsigned short sender_port, int control_stream);
+void *read_records(void *reader_vp);
+int read_fully(struct sockaddr_in *id_p, int stream, char *buffer, int len);
+void reader_init(reader_t *reader_p, struct sockaddr_in *id_p, int stream, double *latencies);
+
+int main(int argc, char const *argv[]) {
+  link_conditions_t cond = { .loss_rate = 0.02, .delay_usec = 5000, .jitter_usec = 0, .seed = DEFAULT_SEED };
+  int has_failed = 0, i;
+
+  for (i = 1; i < argc; i++) {
+    if (link_parse_condition(&cond, argv[i]) != 0) {
+      fprintf(stderr, "usage: %s [name=value ...]\n"
+                      "  names: loss corrupt reorder duplicate delay_ms jitter_ms rate_kbps seed\n", argv[0]);
+      return 1;
+    }
+  }
+  if (mrt_open(RECEIVER_PORT_NUMBER) < 0) {
+    perror("mrt_open() error...\n");
+    return 1;
+  }
+  has_failed |= run_streams(&cond, FIRST_SENDER_PORT, 0);
+  has_failed |= run_streams(&cond, FIRST_SENDER_PORT + 1, CONTROL_STREAM);
+  mrt_close();
+  return has_failed;
+}
+
+/* one run under the conditions, with the control records on
+ * `control_stream` (0 for the bulk's own); prints its line and returns
+ * 1 if a record came back wrong, out of order or not at all, otherwise 0.
+ */
+int run_streams(link_conditions_t *cond_p, unsigned short sender_port, int control_stream) {
+  link_t *link_p = link_start(LINK_PORT_NUMBER, RECEIVER_PORT_NUMBER, cond_p);
+  int num_controls = atoi(NUM_CONTROLS);
+  double *latencies = malloc(num_controls * sizeof(double));
+  reader_t bulk_reader, control_reader;
+  pthread_t bulk_thread;
+
+  if (link_p == NULL || latencies == NULL) { return 1; }
+  pid_t sender_pid = start_sender(sender_port, control_stream);
+  if (sender_pid < 0) {
+    link_stop(link_p);
+    return 1;
+  }
+  long long start_time = now_usec();
+  struct sockaddr_in *id_p = mrt_accept1();
+  reader_init(&bulk_reader, id_p, 0, latencies);
+  reader_init(&control_reader, id_p, control_stream, latencies);
+  if (id_p != NULL && control_stream == 0) {
+    read_records(&bulk_reader);
+  } else if (id_p != NULL) {
+    if (pthread_create(&bulk_thread, NULL, read_records, &bulk_reader) != 0) {
+      perror("pthread_create(read_records) error\n");
+      kill(sender_pid, SIGKILL);
+      bulk_reader.is_intact = 0;
+    } else {
+      read_records(&control_reader);
+      pthread_join(bulk_thread, NULL);
+    }
+  }
+  long long elapsed = now_usec() - start_time;
+  waitpid(sender_pid, NULL, 0);
+  link_stop(link_p);
+
+  int num_received = bulk_reader.num_controls + control_reader.num_controls;
+  int is_intact = bulk_reader.is_intact && control_reader.is_intact && num_received == num_controls;
+  sort_doubles(latencies, num_received);
+  printf("streams: control_stream=%d loss=%.3f delay_ms=%.1f jitter_ms=%.1f controls=%d/%d",
+         control_stream, cond_p->loss_rate, cond_p->delay_usec / 1000.0, cond_p->jitter_usec / 1000.0,
+         num_received, num_controls);
+  if (num_received > 0) {
+    printf(" p50_ms=%.1f p99_ms=%.1f max_ms=%.1f", percentile(latencies, num_received, 0.5),
+           percentile(latencies, num_received, 0.99), percentile(latencies, num_received, 1.0));
+  }
+  printf(" bulk_kbps=%.0f intact=%s\n",
+         elapsed > 0 ? bulk_reader.bulk_bytes * 8000.0 / elapsed : 0.0, is_intact ? "yes" : "NO");
+  fflush(stdout);
+  free(latencies);
+  free(id_p);
+  return !is_intact;
+}
+
+/* reads records off the reader's stream until the connection is over,
+ * checking each; control records go into the latencies
+ */
+void *read_records(void *reader_vp) {
+  reader_t *reader_p = (reader_t *)reader_vp;
+  stream_record_t record;
+  char *bytes = malloc(BULK_SIZE);
+  int j;
+  if (bytes == NULL) {
+    reader_p->is_intact = 0;
+    return NULL;
+  }
+  while (read_fully(reader_p->id_p, reader_p->stream, (char *)&record, sizeof(record)) > 0) {
+    long long now = now_usec();
+    if (record.kind == RECORD_CONTROL) {
+      if (record.len != 0 || record.seq != reader_p->last_control_seq + 1) { reader_p->is_intact = 0; }
+      reader_p->last_control_seq = record.seq;
+      reader_p->latencies[reader_p->num_controls++] = (now - record.due_usec) / 1000.0;
+      continue;
+    }
+    if (record.kind != RECORD_BULK || record.len != BULK_SIZE || record.seq != reader_p->last_bulk_seq + 1 ||
+        read_fully(reader_p->id_p, reader_p->stream, bytes, record.len) <= 0) {
+      reader_p->is_intact = 0;
+      break;
+    }
+    for (j = 0; j < record.len; j++) {
+      if (bytes[j] != (char)(record.seq % 251)) { reader_p->is_intact = 0; }
+    }
+    reader_p->last_bulk_seq = record.seq;
+    reader_p->bulk_bytes += record.len;
+  }
+  free(bytes);
+  return NULL;
+}
+
+// reads exactly `len` bytes off the stream; returns `len`, or what cut it short
+int read_fully(struct sockaddr_in *id_p, int stream, char *buffer, int len) {
+  int total = 0;
+  while (total < len) {
+    int bytes_read = mrt_receive_stream(id_p, stream, buffer + total, len - total);
+    if (bytes_read <= 0) { return bytes_read; }
+    total += bytes_read;
+  }
+  return total;
+}
+
+void reader_init(reader_t *reader_p, struct sockaddr_in *id_p, int stream, double *latencies) {
+  memset(reader_p, 0, sizeof(reader_t));
+  reader_p->id_p = id_p;
+  reader_p->stream = stream;
+  reader_p->latencies = latencies;
+  reader_p->last_control_seq = -1;
+  reader_p->last_bulk_seq = -1;
+  reader_p->is_intact = 1;
+}
+
+// forks and execs the sender side, connecting through the link; returns its pid, or -1
+pid_t start_sender(unsigned short sender_port, int control_stream) {
+  char sender_port_str[8], link_port_str[8], size_str[8], stream_str[8];
+  snprintf(sender_port_str, sizeof(sender_port_str), "%d", sender_port);
+  snprintf(link_port_str, sizeof(link_port_str), "%d", LINK_PORT_NUMBER);
+  snprintf(size_str, sizeof(size_str), "%d", BULK_SIZE);
+  snprintf(stream_str, sizeof(stream_str), "%d", control_stream);
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork() error\n");
+    return -1;
+  }
+  if (pid == 0) {
+    execl(SENDER_PATH, SENDER_PATH, sender_port_str, link_port_str, NUM_CONTROLS, INTERVAL_USEC,
+          size_str, stream_str, (char *)NULL);
+    perror("execl(" SENDER_PATH ") error\n");
+    _exit(127);
+  }
+  return pid;
+}
+
@@ -0,0 +1,150 @@
+/* The sending side of stream_bench: a bulk transfer with small control
+ * records due every `interval_usec` next to it, either all on stream 0
+ * (with the control records sent in between the bulk ones, as one
+ * stream would have them) or with the control records on a stream of
+ * their own (`control_stream`, weighted 4 to the bulk's 1), sent from
+ * their own thread while another keeps mrt_send()ing the bulk.
+ *
+ * Every record starts with a stream_record_t: its kind, the length of
+ * the bytes after it (each byte being seq % 251), its sequence number
+ * and when it was due to be sent (CLOCK_MONOTONIC, in microseconds).
+ * Control records have no bytes after them; the bulk goes on until the
+ * last control record is acknowledged.
+ *
+ * command line:
+ *	stream_sender sender_port receiver_port num_controls interval_usec
+ *	              bulk_size control_stream
+ *
+ * Once disconnected, prints the connection's statistics.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+// the following two are necessary for usleep()
+#define _XOPEN_SOURCE   600
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h> // atoi(), malloc(), free()
+#include <string.h>
+#include <unistd.h> // usleep()
+#include <pthread.h>
+#include <stdatomic.h>
+#include <netinet/in.h>  // INADDR_LOOPBACK
+
+#include "mrt.h"
+#include "mrt_sender.h"
+#include "utilities.h" // now_usec()
+
+#define RECORD_BULK     0
+#define RECORD_CONTROL  1
+#define CONTROL_WEIGHT  4
+#define MAX_BULK_SIZE   (1 << 20)
+
+// what every record starts with
+typedef struct stream_record {
+  int kind;
+  int len;
+  int seq;
+  long long due_usec;
+} stream_record_t;
+
+// for the bulk thread, when the control records have a stream of their own
+typedef struct bulk_args {
+  int id;
+  char *record; // room for a header and bulk_size bytes
+  int bulk_size;
+  _Atomic int is_done;
+  long long num_sent;
+} bulk_args_t;
+
+int send_bulk_record(int id, char *record, int bulk_size, int seq);
+void *bulk_sender(void *args_vp);
+
+int main(int argc, char const *argv[]) {
+  if (argc != 7) {
+    fprintf(stderr, "usage: %s sender_port receiver_port num_controls interval_usec"
+                    " bulk_size control_stream\n", argv[0]);
+    return -1;
+  }
+  unsigned short sender_port = (unsigned short)atoi(argv[1]);
+  unsigned short receiver_port = (unsigned short)atoi(argv[2]);
+  int num_controls = atoi(argv[3]), interval = atoi(argv[4]), bulk_size = atoi(argv[5]);
+  int control_stream = atoi(argv[6]);
+  if (bulk_size <= 0 || bulk_size > MAX_BULK_SIZE || control_stream < 0 || control_stream >= MRT_MAX_STREAMS) {
+    fprintf(stderr, "%s: bulk_size must be between 1 and %d, control_stream between 0 and %d\n", argv[0],
+            MAX_BULK_SIZE, MRT_MAX_STREAMS - 1);
+    return -1;
+  }
+  char *record = malloc(sizeof(stream_record_t) + bulk_size);
+  stream_record_t control = { .kind = RECORD_CONTROL, .len = 0 };
+  bulk_args_t bulk_args = { .bulk_size = bulk_size, .record = record };
+  mrt_sender_stats_t stats = {0};
+  pthread_t bulk_thread;
+  long long num_bulk_sent = 0;
+  int i;
+  if (record == NULL) { return -1; }
+
+  int id = mrt_connect(sender_port, receiver_port, INADDR_LOOPBACK);
+  if (id < 0) {
+    perror("mrt_connect() failed...\n");
+    return -1;
+  }
+  if (control_stream > 0) {
+    mrt_set_stream_weight(id, control_stream, CONTROL_WEIGHT);
+    bulk_args.id = id;
+    atomic_init(&(bulk_args.is_done), 0);
+    if (pthread_create(&bulk_thread, NULL, bulk_sender, &bulk_args) != 0) {
+      perror("pthread_create(bulk_sender) error\n");
+      return -1;
+    }
+  }
+
+  long long start_time = now_usec();
+  for (i = 0; i < num_controls; i++) {
+    control.seq = i;
+    control.due_usec = start_time + (long long)(i + 1) * interval;
+    if (control_stream == 0) {
+      // one stream: whatever bulk fits in before the record is due goes first
+      while (now_usec() < control.due_usec) {
+        if (send_bulk_record(id, record, bulk_size, (int)num_bulk_sent) != 1) { break; }
+        num_bulk_sent += 1;
+      }
+    } else {
+      long long time_left = control.due_usec - now_usec();
+      if (time_left > 0) { usleep(time_left); }
+    }
+    if (mrt_send_stream(id, control_stream, (char *)&control, sizeof(control)) != 1) { break; }
+  }
+  if (control_stream > 0) {
+    atomic_store(&(bulk_args.is_done), 1);
+    pthread_join(bulk_thread, NULL);
+    num_bulk_sent = bulk_args.num_sent;
+  }
+  mrt_stats(id, &stats);
+  mrt_disconnect(id);
+
+  printf("stream_sender: control_stream=%d controls=%d bulk_records=%lld frags_sent=%lld"
+         " frags_retransmitted=%lld\n",
+         control_stream, i, num_bulk_sent, stats.frags_sent, stats.frags_retransmitted);
+  free(record);
+  return 0;
+}
+
+// sends one bulk record on stream 0; returns what mrt_send() does
+int send_bulk_record(int id, char *record, int bulk_size, int seq) {
+  stream_record_t header = { .kind = RECORD_BULK, .len = bulk_size, .seq = seq, .due_usec = now_usec() };
+  memmove(record, &header, sizeof(header));
+  memset(record + sizeof(header), (char)(seq % 251), bulk_size);
+  return mrt_send(id, record, sizeof(header) + bulk_size);
+}
+
+// keeps the bulk going on stream 0 until the control records are done
+void *bulk_sender(void *args_vp) {
+  bulk_args_t *args_p = (bulk_args_t *)args_vp;
+  while (!atomic_load(&(args_p->is_done))) {
+    if (send_bulk_record(args_p->id, args_p->record, args_p->bulk_size, (int)args_p->num_sent) != 1) { break; }
+    args_p->num_sent += 1;
+  }
+  return NULL;
+}
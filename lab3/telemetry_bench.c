@@ -0,0 +1,164 @@
+/* Partial-reliability benchmark for the MRT module: a telemetry
+ * stream over an emulated lossy link, sent (by telemetry_sender, in
+ * its own process, since mrt_sender cannot be linked next to
+ * mrt_receiver) once with every message delivered and once with
+ * messages abandoned past a lifetime, and read one message at a time
+ * with mrt_receive_message().
+ *
+ * command line:
+ *	telemetry_bench [lifetime_ms] [name=value ...]
+ *
+ * The link conditions are as for transfer_bench (by default 5% loss
+ * each way and 5 +- 2 ms of delay); the lifetime defaults to
+ * DEFAULT_LIFETIME_MS.
+ *
+ * For each run, how many messages arrived and how late (from when each
+ * was due to be sent to when it was read: median, 99th percentile and
+ * worst), whether they came whole and in order, and what the receiver
+ * skipped are reported; the sender reports what it abandoned.
+ *
+ * With MRT_TRACE set in the environment, the receiving side's events
+ * are traced into the file it names (see mrt_trace.h).
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+#define _GNU_SOURCE // kill()
+
+#include <stdio.h>
+#include <stdlib.h> // atoi(), malloc(), free()
+#include <string.h>
+#include <unistd.h> // fork(), execl()
+#include <signal.h>
+#include <sys/wait.h>
+
+#include "mrt.h"
+#include "mrt_receiver.h"
+#include "link_emulator.h"
+#include "utilities.h" // now_usec()
+#include "mrt_trace.h"
+
+#define RECEIVER_PORT_NUMBER  7979
+#define LINK_PORT_NUMBER      7980
+#define FIRST_SENDER_PORT     7990 // one port per run
+#define SENDER_PATH           "./telemetry_sender"
+#define NUM_MESSAGES          "400"
+#define INTERVAL_USEC         "5000"
+#define MESSAGE_SIZE          200
+#define DEFAULT_LIFETIME_MS   100
+#define DEFAULT_SEED          60
+
+// what telemetry_sender starts every message with
+typedef struct telemetry_header {
+  int seq;
+  long long due_usec;
+} telemetry_header_t;
+
+int run_stream(link_conditions_t *cond_p, unsigned short sender_port, int lifetime_usec);
+pid_t start_sender(unsigned short sender_port, int lifetime_usec);
+
+int main(int argc, char const *argv[]) {
+  link_conditions_t cond = { .loss_rate = 0.05, .delay_usec = 5000, .jitter_usec = 2000, .seed = DEFAULT_SEED };
+  int lifetime_ms = DEFAULT_LIFETIME_MS, has_failed = 0, i = 1;
+
+  if (argc > 1 && strchr(argv[1], '=') == NULL) {
+    lifetime_ms = atoi(argv[1]);
+    i = 2;
+  }
+  for (; i < argc; i++) {
+    if (lifetime_ms <= 0 || link_parse_condition(&cond, argv[i]) != 0) {
+      fprintf(stderr, "usage: %s [lifetime_ms] [name=value ...]\n"
+                      "  names: loss corrupt reorder duplicate delay_ms jitter_ms rate_kbps seed\n", argv[0]);
+      return 1;
+    }
+  }
+  const char *trace_path = getenv("MRT_TRACE");
+  if (trace_path != NULL) { mrt_trace_start(trace_path); }
+  if (mrt_open(RECEIVER_PORT_NUMBER) < 0) {
+    perror("mrt_open() error...\n");
+    return 1;
+  }
+  has_failed |= run_stream(&cond, FIRST_SENDER_PORT, 0);
+  has_failed |= run_stream(&cond, FIRST_SENDER_PORT + 1, lifetime_ms * 1000);
+  mrt_close();
+  if (trace_path != NULL) { mrt_trace_stop(); }
+  return has_failed;
+}
+
+/* one stream under the conditions, with messages abandoned after
+ * `lifetime_usec` (never if 0); prints its line and returns 1 if a
+ * message came back wrong or out of order (or, with no lifetime, went
+ * missing), otherwise 0.
+ */
+int run_stream(link_conditions_t *cond_p, unsigned short sender_port, int lifetime_usec) {
+  link_t *link_p = link_start(LINK_PORT_NUMBER, RECEIVER_PORT_NUMBER, cond_p);
+  int num_messages = atoi(NUM_MESSAGES), num_received = 0, is_intact = 1, last_seq = -1, len, j;
+  double *latencies = malloc(num_messages * sizeof(double));
+  char message[MESSAGE_SIZE];
+  telemetry_header_t header;
+  mrt_receiver_stats_t stats = {0};
+  struct sockaddr_in *id_p;
+
+  if (link_p == NULL || latencies == NULL) { return 1; }
+  pid_t sender_pid = start_sender(sender_port, lifetime_usec);
+  if (sender_pid < 0) {
+    link_stop(link_p);
+    return 1;
+  }
+  id_p = mrt_accept1();
+  while (id_p != NULL && (len = mrt_receive_message(id_p, message, MESSAGE_SIZE)) > 0) {
+    long long now = now_usec();
+    memmove(&header, message, sizeof(header));
+    for (j = sizeof(header); j < len; j++) {
+      if (message[j] != (char)(header.seq % 251)) { is_intact = 0; }
+    }
+    if (len != MESSAGE_SIZE || header.seq <= last_seq || header.seq >= num_messages) {
+      is_intact = 0;
+      continue;
+    }
+    last_seq = header.seq;
+    latencies[num_received++] = (now - header.due_usec) / 1000.0;
+    mrt_receiver_stats(id_p, &stats);
+  }
+  if (lifetime_usec == 0 && num_received != num_messages) { is_intact = 0; }
+  waitpid(sender_pid, NULL, 0);
+  link_stop(link_p);
+
+  sort_doubles(latencies, num_received);
+  printf("telemetry: lifetime_ms=%d loss=%.3f delay_ms=%.1f jitter_ms=%.1f received=%d/%d",
+         lifetime_usec / 1000, cond_p->loss_rate, cond_p->delay_usec / 1000.0, cond_p->jitter_usec / 1000.0,
+         num_received, num_messages);
+  if (num_received > 0) {
+    printf(" p50_ms=%.1f p99_ms=%.1f max_ms=%.1f", percentile(latencies, num_received, 0.5),
+           percentile(latencies, num_received, 0.99), percentile(latencies, num_received, 1.0));
+  }
+  printf(" frags_skipped=%lld bytes_discarded=%lld intact=%s\n",
+         stats.frags_skipped, stats.bytes_discarded, is_intact ? "yes" : "NO");
+  fflush(stdout);
+  free(latencies);
+  free(id_p);
+  return !is_intact;
+}
+
+// forks and execs the sender side, connecting through the link; returns its pid, or -1
+pid_t start_sender(unsigned short sender_port, int lifetime_usec) {
+  char sender_port_str[8], link_port_str[8], size_str[8], lifetime_str[16];
+  snprintf(sender_port_str, sizeof(sender_port_str), "%d", sender_port);
+  snprintf(link_port_str, sizeof(link_port_str), "%d", LINK_PORT_NUMBER);
+  snprintf(size_str, sizeof(size_str), "%d", MESSAGE_SIZE);
+  snprintf(lifetime_str, sizeof(lifetime_str), "%d", lifetime_usec);
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork() error\n");
+    return -1;
+  }
+  if (pid == 0) {
+    execl(SENDER_PATH, SENDER_PATH, sender_port_str, link_port_str, NUM_MESSAGES, INTERVAL_USEC,
+          size_str, lifetime_str, "-1", (char *)NULL);
+    perror("execl(" SENDER_PATH ") error\n");
+    _exit(127);
+  }
+  return pid;
+}
+
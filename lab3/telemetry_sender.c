@@ -0,0 +1,88 @@
+/* The sending side of telemetry_bench: a stream of small messages,
+ * one every `interval_usec`, each sent with mrt_send_message() under
+ * the given lifetime and retransmission cap (0 and -1 for neither, so
+ * that every message is delivered).
+ *
+ * Every message starts with its sequence number and the time it was
+ * due to be sent (CLOCK_MONOTONIC, in microseconds, which the receiving
+ * process reads off the same clock); a message held up by a full
+ * buffer is late by that much, as real telemetry would be.
+ *
+ * command line:
+ *	telemetry_sender sender_port receiver_port num_messages interval_usec
+ *	                 message_size lifetime_usec max_retransmits
+ *
+ * Once disconnected, prints the connection's statistics.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+// the following two are necessary for usleep()
+#define _XOPEN_SOURCE   600
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h> // atoi()
+#include <string.h>
+#include <unistd.h> // usleep()
+#include <netinet/in.h>  // INADDR_LOOPBACK
+
+#include "mrt.h"
+#include "mrt_sender.h"
+#include "utilities.h" // now_usec()
+
+// what a message starts with
+typedef struct telemetry_header {
+  int seq;
+  long long due_usec;
+} telemetry_header_t;
+
+int main(int argc, char const *argv[]) {
+  if (argc != 8) {
+    fprintf(stderr, "usage: %s sender_port receiver_port num_messages interval_usec"
+                    " message_size lifetime_usec max_retransmits\n", argv[0]);
+    return -1;
+  }
+  unsigned short sender_port = (unsigned short)atoi(argv[1]);
+  unsigned short receiver_port = (unsigned short)atoi(argv[2]);
+  int num_messages = atoi(argv[3]), interval = atoi(argv[4]), message_size = atoi(argv[5]);
+  int lifetime = atoi(argv[6]), max_retransmits = atoi(argv[7]);
+  if (message_size < (int)sizeof(telemetry_header_t) || message_size > SENDER_MAX_MESSAGE_LENGTH) {
+    fprintf(stderr, "%s: message_size must be between %d and %d\n", argv[0],
+            (int)sizeof(telemetry_header_t), SENDER_MAX_MESSAGE_LENGTH);
+    return -1;
+  }
+  char message[SENDER_MAX_MESSAGE_LENGTH];
+  telemetry_header_t header;
+  mrt_sender_stats_t stats = {0};
+  int i, num_expired = 0;
+
+  int id = mrt_connect(sender_port, receiver_port, INADDR_LOOPBACK);
+  if (id < 0) {
+    perror("mrt_connect() failed...\n");
+    return -1;
+  }
+
+  long long start_time = now_usec();
+  for (i = 0; i < num_messages; i++) {
+    header.seq = i;
+    header.due_usec = start_time + (long long)i * interval;
+    long long time_left = header.due_usec - now_usec();
+    if (time_left > 0) { usleep(time_left); }
+    memset(message, (char)(i % 251), message_size);
+    memmove(message, &header, sizeof(header));
+    int result = mrt_send_message(id, message, message_size, lifetime, max_retransmits);
+    if (result < 0) { break; }
+    num_expired += (result == 0);
+  }
+  mrt_stats(id, &stats);
+  mrt_disconnect(id);
+  // messages can still be abandoned while it waits; the connection lingers until the ACLS
+  mrt_stats(id, &stats);
+
+  printf("telemetry_sender: messages=%lld abandoned=%lld (%d before buffered) frags_abandoned=%lld"
+         " skips=%lld frags_retransmitted=%lld\n",
+         stats.messages_sent, stats.messages_abandoned, num_expired, stats.frags_abandoned,
+         stats.skips_sent, stats.frags_retransmitted);
+  return 0;
+}
@@ -0,0 +1,238 @@
+/* Converts a dump written by mrt_trace_stop() into a qlog timeline
+ * (JSON, qlog 0.3): one trace per connection (named by the sending
+ * side's port), from the sender's (client) or the receiver's (server)
+ * point of view, with the events in time order and times in
+ * milliseconds since the first event in the dump.
+ *
+ * Packets sent, received and dropped map to qlog's transport events
+ * (with MRT's transmission types as packet types and fragment numbers
+ * as packet numbers), the RTT to recovery:metrics_updated and the
+ * resend timeout to recovery:loss_timer_updated; what qlog has no
+ * event for is named mrt:*.
+ *
+ * command line:
+ *	trace_to_qlog dump_file [title] > timeline.qlog
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+#include <stdio.h>
+#include <stdlib.h> // malloc(), qsort()
+#include <string.h>
+
+#include "mrt_trace.h"
+
+int read_dump(const char *path, trace_record_t **records_pp, long *num_records_p);
+int compare_records(const void *a_vp, const void *b_vp);
+void print_event(trace_record_t *record_p, unsigned long long first_ns);
+void print_packet(const char *name, const char *packet_type, trace_record_t *record_p, int has_number);
+
+int main(int argc, char const *argv[]) {
+  trace_record_t *records = NULL;
+  long num_records = 0, i;
+  unsigned long long first_ns = 0;
+  int is_first_trace = 1, is_first_event = 1;
+
+  if (argc != 2 && argc != 3) {
+    fprintf(stderr, "usage: %s dump_file [title]\n", argv[0]);
+    return 1;
+  }
+  if (read_dump(argv[1], &records, &num_records) != 0) { return 1; }
+
+  // all of one connection's events together, in time order
+  for (i = 0; i < num_records; i++) {
+    if (i == 0 || records[i].time_ns < first_ns) { first_ns = records[i].time_ns; }
+  }
+  qsort(records, num_records, sizeof(trace_record_t), compare_records);
+
+  printf("{\"qlog_version\": \"0.3\", \"qlog_format\": \"JSON\", \"title\": \"%s\",\n \"traces\": [",
+         (argc == 3) ? argv[2] : argv[1]);
+  for (i = 0; i < num_records; i++) {
+    if (i == 0 || records[i].port != records[i - 1].port) {
+      // a new connection; the first event not on both sides tells which side this is
+      const char *vantage = "unknown";
+      for (long j = i; j < num_records && records[j].port == records[i].port; j++) {
+        if (records[j].event == TRACE_CHECKSUM_FAILED) { continue; }
+        vantage = (records[j].event < TRACE_RCON_RECEIVED) ? "client" : "server";
+        break;
+      }
+      printf("%s\n  {\"title\": \"port %d\", \"vantage_point\": {\"type\": \"%s\"},\n"
+             "   \"common_fields\": {\"group_id\": \"%d\", \"time_format\": \"relative\"},\n"
+             "   \"events\": [",
+             is_first_trace ? "" : "]},", records[i].port, vantage, records[i].port);
+      is_first_trace = 0;
+      is_first_event = 1;
+    }
+    printf("%s\n    ", is_first_event ? "" : ",");
+    print_event(&(records[i]), first_ns);
+    is_first_event = 0;
+  }
+  printf("%s\n]}\n", is_first_trace ? "" : "]}");
+  free(records);
+  return 0;
+}
+
+/* reads the whole dump into a malloc'd array; returns -1 (after saying
+ * why) if it cannot be read or is not a dump of this version.
+ */
+int read_dump(const char *path, trace_record_t **records_pp, long *num_records_p) {
+  trace_file_header_t header;
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    perror("fopen() error");
+    return -1;
+  }
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != TRACE_VERSION || header.record_size != sizeof(trace_record_t)) {
+    fprintf(stderr, "%s: not an MRT trace (of version %d)\n", path, TRACE_VERSION);
+    fclose(file);
+    return -1;
+  }
+  *records_pp = malloc((header.num_records + 1) * sizeof(trace_record_t));
+  if (*records_pp == NULL) {
+    perror("malloc() error");
+    fclose(file);
+    return -1;
+  }
+  *num_records_p = (long)fread(*records_pp, sizeof(trace_record_t), header.num_records, file);
+  if (*num_records_p != (long)header.num_records) {
+    fprintf(stderr, "%s: truncated; %ld of %llu events read\n", path, *num_records_p,
+            (unsigned long long)header.num_records);
+  }
+  fclose(file);
+  return 0;
+}
+
+// by port, then by time.
+int compare_records(const void *a_vp, const void *b_vp) {
+  const trace_record_t *a_p = (const trace_record_t *)a_vp, *b_p = (const trace_record_t *)b_vp;
+  if (a_p->port != b_p->port) { return (a_p->port < b_p->port) ? -1 : 1; }
+  if (a_p->time_ns != b_p->time_ns) { return (a_p->time_ns < b_p->time_ns) ? -1 : 1; }
+  return 0;
+}
+
+// prints the record as one qlog event (without a trailing newline).
+void print_event(trace_record_t *record_p, unsigned long long first_ns) {
+  printf("{\"time\": %.6f, ", (record_p->time_ns - first_ns) / 1e6);
+
+  switch (record_p->event) {
+    case TRACE_RCON_SENT :
+      print_packet("transport:packet_sent", "RCON", record_p, 1);
+      printf(", \"cookie\": %u", (unsigned int)record_p->value);
+      break;
+    case TRACE_COOK_RECEIVED :
+      print_packet("transport:packet_received", "COOK", record_p, 0);
+      printf(", \"cookie\": %u", (unsigned int)record_p->value);
+      break;
+    case TRACE_ACON_RECEIVED :
+      print_packet("transport:packet_received", "ACON", record_p, 1);
+      break;
+    case TRACE_DATA_SENT :
+      print_packet("transport:packet_sent", "DATA", record_p, 1);
+      printf(", \"raw\": {\"payload_length\": %d}", record_p->value);
+      break;
+    case TRACE_DATA_RESENT :
+      print_packet("transport:packet_sent", "DATA", record_p, 1);
+      printf(", \"raw\": {\"payload_length\": %d}, \"trigger\": \"retransmit_timeout\"", record_p->value);
+      break;
+    case TRACE_EMPTY_DATA_SENT :
+      print_packet("transport:packet_sent", "DATA", record_p, 0);
+      printf(", \"raw\": {\"payload_length\": 0}, \"trigger\": \"keepalive\"");
+      break;
+    case TRACE_ADAT_RECEIVED :
+      print_packet("transport:packet_received", "ADAT", record_p, 1);
+      printf(", \"window\": %d", record_p->value);
+      break;
+    case TRACE_WINDOW_STALL :
+      printf("\"name\": \"mrt:window_stall\", \"data\": {\"next_frag\": %d, \"window\": %d",
+             record_p->frag, record_p->value);
+      break;
+    case TRACE_RESEND_TIMEOUT :
+      printf("\"name\": \"recovery:loss_timer_updated\", \"data\": {\"event_type\": \"expired\","
+             " \"first_frag\": %d, \"frags_in_flight\": %d", record_p->frag, record_p->value);
+      break;
+    case TRACE_RTT_UPDATED :
+      printf("\"name\": \"recovery:metrics_updated\", \"data\": {\"smoothed_rtt\": %.3f",
+             record_p->value / 1e3);
+      break;
+    case TRACE_SKIP_SENT :
+      print_packet("transport:packet_sent", "SKIP", record_p, 1);
+      printf(", \"frags_abandoned\": %d", record_p->value);
+      break;
+    case TRACE_RCLS_SENT :
+      print_packet("transport:packet_sent", "RCLS", record_p, 0);
+      break;
+    case TRACE_ACLS_RECEIVED :
+      print_packet("transport:packet_received", "ACLS", record_p, 0);
+      break;
+    case TRACE_SENDER_OVER :
+      printf("\"name\": \"connectivity:connection_closed\", \"data\": {\"trigger\": \"%s\"",
+             record_p->value ? "idle_timeout" : "clean");
+      break;
+    case TRACE_RCON_RECEIVED :
+      print_packet("transport:packet_received", "RCON", record_p, 1);
+      printf(", \"cookie\": %u", (unsigned int)record_p->value);
+      break;
+    case TRACE_COOK_SENT :
+      print_packet("transport:packet_sent", "COOK", record_p, 1);
+      printf(", \"cookie\": %u", (unsigned int)record_p->value);
+      break;
+    case TRACE_ACON_SENT :
+      print_packet("transport:packet_sent", "ACON", record_p, 1);
+      break;
+    case TRACE_ACCEPTED :
+      printf("\"name\": \"connectivity:connection_started\", \"data\": {");
+      break;
+    case TRACE_DATA_RECEIVED :
+      print_packet("transport:packet_received", "DATA", record_p, 1);
+      printf(", \"raw\": {\"payload_length\": %d}", record_p->value);
+      break;
+    case TRACE_DATA_DROPPED :
+      print_packet("transport:packet_dropped", "DATA", record_p, 1);
+      printf(", \"trigger\": \"%s\"",
+             (record_p->value == TRACE_DROP_DUPLICATE) ? "duplicate" :
+             (record_p->value == TRACE_DROP_WINDOW_FULL) ? "window_full" : "out_of_order");
+      break;
+    case TRACE_ADAT_SENT :
+      print_packet("transport:packet_sent", "ADAT", record_p, 1);
+      printf(", \"window\": %d", record_p->value);
+      break;
+    case TRACE_WINDOW_RESIZED :
+      printf("\"name\": \"mrt:receive_buffer_resized\", \"data\": {\"size\": %d", record_p->value);
+      break;
+    case TRACE_SKIP_RECEIVED :
+      print_packet("transport:packet_received", "SKIP", record_p, 1);
+      printf(", \"bytes_discarded\": %d", record_p->value);
+      break;
+    case TRACE_RCLS_RECEIVED :
+      print_packet("transport:packet_received", "RCLS", record_p, 0);
+      break;
+    case TRACE_ACLS_SENT :
+      print_packet("transport:packet_sent", "ACLS", record_p, 0);
+      break;
+    case TRACE_RECEIVER_OVER :
+      printf("\"name\": \"connectivity:connection_closed\", \"data\": {\"trigger\": \"over\"");
+      break;
+    case TRACE_RECLAIMED :
+      printf("\"name\": \"mrt:connection_reclaimed\", \"data\": {\"unread_bytes\": %d", record_p->value);
+      break;
+    case TRACE_CHECKSUM_FAILED :
+      printf("\"name\": \"transport:packet_dropped\", \"data\": {\"trigger\": \"checksum\","
+             " \"raw\": {\"length\": %d}", record_p->value);
+      break;
+    default :
+      printf("\"name\": \"mrt:unknown\", \"data\": {\"event\": %d, \"frag\": %d, \"value\": %d",
+             record_p->event, record_p->frag, record_p->value);
+      break;
+  }
+  // every case leaves the data object open for this
+  printf("%s\"thread\": %u}}", (record_p->event == TRACE_ACCEPTED) ? "" : ", ", record_p->thread);
+}
+
+// opens the event's data with the packet's header.
+void print_packet(const char *name, const char *packet_type, trace_record_t *record_p, int has_number) {
+  printf("\"name\": \"%s\", \"data\": {\"header\": {\"packet_type\": \"%s\"", name, packet_type);
+  if (has_number) { printf(", \"packet_number\": %d", record_p->frag); }
+  printf("}");
+}
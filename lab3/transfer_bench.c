@@ -0,0 +1,264 @@
+/* Transfer benchmarks for the MRT module over an emulated lossy link.
+ * Each run starts a link emulator in front of the receiver, has the
+ * sender driver (./sender, in its own process, since mrt_sender cannot
+ * be linked next to mrt_receiver) mrt_send() `kilobytes` KB through it,
+ * and drains the connection with mrt_receive1(), checking every byte.
+ *
+ * command line:
+ *	transfer_bench kilobytes [name=value ...]
+ *
+ * With no name=value, a matrix of conditions is run one after another;
+ * otherwise one run under the given conditions, out of
+ *	loss corrupt reorder duplicate  (rates between 0 and 1)
+ *	delay_ms jitter_ms rate_kbps seed
+ *
+ * For each run, the goodput (payload bytes over the time from starting
+ * the sender to reading the end of the connection), the completion
+ * time and the retransmission ratio (DATA the sender sent beyond the
+ * distinct fragments, over the distinct fragments) are reported, along
+ * with whether all the bytes arrived intact and in order, and what the
+ * receiver's statistics (mrt_receiver_stats()) say about the connection.
+ *
+ * For Dartmouth COSC 60 Lab 3.
+ */
+
+#define _GNU_SOURCE // kill(), strdup()
+
+#include <stdio.h>
+#include <stdlib.h> // atoi(), atof(), malloc(), free()
+#include <string.h>
+#include <unistd.h> // fork(), execl(), pipe(), write(), close()
+#include <signal.h>
+#include <fcntl.h>  // open()
+#include <sys/wait.h>
+#include <pthread.h>
+
+#include "mrt.h"
+#include "mrt_receiver.h"
+#include "link_emulator.h"
+#include "utilities.h" // now_seconds()
+
+#define RECEIVER_PORT_NUMBER  7676
+#define LINK_PORT_NUMBER      7677
+#define FIRST_SENDER_PORT     7700 // one port per run, so no run inherits another's connection
+#define SENDER_PATH           "./sender"
+#define SENDER_READ_SIZE      "1000"
+#define FEED_SIZE             4096
+#define RECEIVE_SIZE          4096
+#define POLL_EVENTS           16
+#define TRANSFER_TIMEOUT      120.0 // seconds; the sender is killed after this
+#define DEFAULT_SEED          60
+
+// what the sender is fed: a pattern the receiving side can check byte by byte
+typedef struct feeder {
+  pthread_t thread;
+  int fd;
+  long num_bytes;
+} feeder_t;
+
+typedef struct run_result {
+  long num_bytes;
+  int is_intact;
+  int is_timed_out;
+  double seconds;
+  mrt_receiver_stats_t stats; // as of the last read; the connection is gone by the end
+} run_result_t;
+
+int run_transfer(long num_bytes, link_conditions_t *cond_p, unsigned short sender_port);
+pid_t start_sender(unsigned short sender_port, int *feed_fd_p);
+void *feed(void *feeder_vp);
+void drain(pid_t sender_pid, long num_bytes, run_result_t *result_p);
+char pattern_byte(long i);
+
+int main(int argc, char const *argv[]) {
+  long num_bytes;
+  link_conditions_t cond = { .seed = DEFAULT_SEED };
+  int has_failed = 0, i;
+
+  if (argc < 2 || atol(argv[1]) <= 0) {
+    fprintf(stderr, "usage: %s kilobytes [name=value ...]\n"
+                    "  names: loss corrupt reorder duplicate delay_ms jitter_ms rate_kbps seed\n", argv[0]);
+    return 1;
+  }
+  num_bytes = atol(argv[1]) * 1000;
+  for (i = 2; i < argc; i++) {
+    if (link_parse_condition(&cond, argv[i]) != 0) {
+      fprintf(stderr, "%s: unknown condition %s\n", argv[0], argv[i]);
+      return 1;
+    }
+  }
+  signal(SIGPIPE, SIG_IGN); // the sender may be gone before it is fed everything
+
+  if (mrt_open(RECEIVER_PORT_NUMBER) < 0) {
+    perror("mrt_open() error...\n");
+    return 1;
+  }
+
+  if (argc > 2) {
+    has_failed = run_transfer(num_bytes, &cond, FIRST_SENDER_PORT);
+  } else {
+    link_conditions_t matrix[] = {
+      { .seed = DEFAULT_SEED },
+      { .loss_rate = 0.01, .seed = DEFAULT_SEED },
+      { .loss_rate = 0.05, .seed = DEFAULT_SEED },
+      { .corrupt_rate = 0.02, .seed = DEFAULT_SEED },
+      { .reorder_rate = 0.05, .seed = DEFAULT_SEED },
+      { .duplicate_rate = 0.05, .seed = DEFAULT_SEED },
+      { .delay_usec = 5000, .jitter_usec = 2000, .seed = DEFAULT_SEED },
+      { .rate_bytes_per_sec = 256000 / 8, .seed = DEFAULT_SEED },
+      { .loss_rate = 0.02, .reorder_rate = 0.02, .duplicate_rate = 0.01, .delay_usec = 2000,
+        .jitter_usec = 1000, .seed = DEFAULT_SEED },
+    };
+    for (i = 0; i < sizeof(matrix) / sizeof(matrix[0]); i++) {
+      has_failed |= run_transfer(num_bytes, &matrix[i], FIRST_SENDER_PORT + i);
+    }
+  }
+
+  mrt_close();
+  return has_failed;
+}
+
+/* one transfer of num_bytes under the conditions; prints its line and
+ * returns 1 if the bytes did not all arrive intact, otherwise 0.
+ */
+int run_transfer(long num_bytes, link_conditions_t *cond_p, unsigned short sender_port) {
+  link_t *link_p = link_start(LINK_PORT_NUMBER, RECEIVER_PORT_NUMBER, cond_p);
+  link_stats_t stats;
+  feeder_t feeder = { .num_bytes = num_bytes };
+  run_result_t result = { 0 };
+  pid_t sender_pid;
+  double start_time;
+
+  if (link_p == NULL) { return 1; }
+  start_time = now_seconds();
+  sender_pid = start_sender(sender_port, &(feeder.fd));
+  if (sender_pid < 0) {
+    link_stop(link_p);
+    return 1;
+  }
+  pthread_create(&(feeder.thread), NULL, feed, &feeder);
+
+  drain(sender_pid, num_bytes, &result);
+  result.seconds = now_seconds() - start_time;
+
+  waitpid(sender_pid, NULL, 0);
+  pthread_join(feeder.thread, NULL);
+  link_get_stats(link_p, &stats);
+  link_stop(link_p);
+
+  printf("transfer: loss=%.3f corrupt=%.3f reorder=%.3f duplicate=%.3f delay_ms=%.1f jitter_ms=%.1f rate_kbps=%ld"
+         " bytes=%ld seconds=%.2f goodput_KBps=%.1f retransmission_ratio=%.3f dropped=%ld/%ld"
+         " duplicate_frags=%lld out_of_order_frags=%lld adats=%lld checksum_failures=%lld rtt_ms=%.1f intact=%s\n",
+         cond_p->loss_rate, cond_p->corrupt_rate, cond_p->reorder_rate, cond_p->duplicate_rate,
+         cond_p->delay_usec / 1000.0, cond_p->jitter_usec / 1000.0, cond_p->rate_bytes_per_sec * 8 / 1000,
+         result.num_bytes, result.seconds, result.num_bytes / result.seconds / 1000,
+         (stats.num_data_frags > 0) ? (double)(stats.num_data - stats.num_data_frags) / stats.num_data_frags : 0.0,
+         stats.num_dropped[0], stats.num_dropped[1],
+         result.stats.frags_duplicate, result.stats.frags_out_of_order, result.stats.adats_sent,
+         result.stats.checksum_failures, result.stats.rtt_usec / 1000.0,
+         result.is_timed_out ? "timeout" : (result.is_intact ? "yes" : "NO"));
+  fflush(stdout);
+  return !result.is_intact;
+}
+
+/* forks and execs the sender driver, connecting through the link, with
+ * its stdin a pipe whose write end goes into *feed_fd_p and its stdout
+ * discarded; returns its pid, or -1 upon any error.
+ */
+pid_t start_sender(unsigned short sender_port, int *feed_fd_p) {
+  int pipe_fds[2];
+  char sender_port_str[8], link_port_str[8];
+  pid_t pid;
+
+  snprintf(sender_port_str, sizeof(sender_port_str), "%d", sender_port);
+  snprintf(link_port_str, sizeof(link_port_str), "%d", LINK_PORT_NUMBER);
+  if (pipe(pipe_fds) < 0) {
+    perror("pipe() error\n");
+    return -1;
+  }
+  pid = fork();
+  if (pid < 0) {
+    perror("fork() error\n");
+    return -1;
+  }
+  if (pid == 0) {
+    int null_fd = open("/dev/null", O_WRONLY);
+    dup2(pipe_fds[0], STDIN_FILENO);
+    dup2(null_fd, STDOUT_FILENO);
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+    close(null_fd);
+    execl(SENDER_PATH, SENDER_PATH, sender_port_str, SENDER_READ_SIZE, link_port_str, (char *)NULL);
+    perror("execl(" SENDER_PATH ") error\n");
+    _exit(127);
+  }
+  close(pipe_fds[0]);
+  *feed_fd_p = pipe_fds[1];
+  return pid;
+}
+
+// writes the pattern into the sender's stdin, then closes it.
+void *feed(void *feeder_vp) {
+  feeder_t *feeder_p = (feeder_t *)feeder_vp;
+  char chunk[FEED_SIZE];
+  long num_fed = 0, i;
+  int len;
+
+  while (num_fed < feeder_p->num_bytes) {
+    len = (feeder_p->num_bytes - num_fed < FEED_SIZE) ? feeder_p->num_bytes - num_fed : FEED_SIZE;
+    for (i = 0; i < len; i++) { chunk[i] = pattern_byte(num_fed + i); }
+    if (write(feeder_p->fd, chunk, len) != len) { break; } // the sender is gone
+    num_fed += len;
+  }
+  close(feeder_p->fd);
+  return NULL;
+}
+
+/* accepts the sender's connection and reads it to its end, checking
+ * the bytes against the pattern; kills the sender if it takes longer
+ * than TRANSFER_TIMEOUT.
+ */
+void drain(pid_t sender_pid, long num_bytes, run_result_t *result_p) {
+  mrt_event_t events[POLL_EVENTS];
+  struct sockaddr_in *id_p = NULL, *other_id_p;
+  char buffer[RECEIVE_SIZE];
+  double deadline = now_seconds() + TRANSFER_TIMEOUT;
+  int num_ready, len, i, j;
+
+  result_p->is_intact = 1;
+  while (1) {
+    if (!result_p->is_timed_out && now_seconds() > deadline) {
+      kill(sender_pid, SIGKILL); // the connection then times out on the receiver's side
+      result_p->is_timed_out = 1;
+      if (id_p == NULL) { break; }
+    }
+    num_ready = mrt_poll(events, POLL_EVENTS, EXPECTED_RTT * 10);
+    for (i = 0; i < num_ready; i++) {
+      if (events[i].events & MRT_POLLPENDING) {
+        // the first connection is this run's; anything else is a straggler
+        other_id_p = mrt_accept1();
+        if (id_p == NULL) { id_p = other_id_p; } else { free(other_id_p); }
+      } else if (id_p != NULL && events[i].id.sin_port == id_p->sin_port &&
+                 events[i].id.sin_addr.s_addr == id_p->sin_addr.s_addr) {
+        if (events[i].events == MRT_POLLHUP) { goto done; } // the lone one: drained
+        len = mrt_receive1(id_p, buffer, RECEIVE_SIZE);
+        for (j = 0; j < len; j++) {
+          if (buffer[j] != pattern_byte(result_p->num_bytes + j)) { result_p->is_intact = 0; }
+        }
+        result_p->num_bytes += (len > 0) ? len : 0;
+        mrt_receiver_stats(id_p, &(result_p->stats));
+      } else {
+        // a straggler from an earlier run; read it out of the way (won't block)
+        mrt_receive1(&(events[i].id), buffer, RECEIVE_SIZE);
+      }
+    }
+  }
+done:
+  if (result_p->num_bytes != num_bytes) { result_p->is_intact = 0; }
+  free(id_p);
+}
+
+char pattern_byte(long i) {
+  return (char)(i % 251);
+}
+
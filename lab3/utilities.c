@@ -5,17 +5,110 @@
  * By Shengsong Gao, April 2020.
  */
 
+// necessary for clock_gettime()
+#define _POSIX_C_SOURCE 200112L
+// and this one for pthread_setaffinity_np()
+#define _GNU_SOURCE
+
+#include <stdio.h> // fopen(), fgets(), sscanf()
+#include <time.h> // clock_gettime()
+#include <stdlib.h> // strtol(), qsort()
+#include <string.h> // strcmp()
+#include <sched.h> // cpu_set_t
+#include <pthread.h>
+
+#include "utilities.h"
+
 // Reference: http://www.cse.yorku.ca/~oz/hash.html
 // TODO: should I have changed str to signed char?
 unsigned long
-hash(char *str)
+hash(char *bytes, int len)
 {
   unsigned long hash = 5381;
   int c;
 
-  while ((c = *str++)) {
+  while (len-- > 0) {
+    c = *bytes++;
     hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
   }
 
   return hash;
 }
+
+long long
+now_usec()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+double
+now_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int
+compare_doubles(const void *a_p, const void *b_p)
+{
+  double a = *(const double *)a_p, b = *(const double *)b_p;
+  return (a > b) - (a < b);
+}
+
+void
+sort_doubles(double *values, int num_values)
+{
+  qsort(values, num_values, sizeof(double), compare_doubles);
+}
+
+double
+percentile(const double *sorted, int num_values, double fraction)
+{
+  if (num_values <= 0) { return 0.0; }
+  int i = (int)(num_values * fraction);
+  return sorted[(i < num_values) ? i : num_values - 1];
+}
+
+int
+count_threads()
+{
+  char line[128];
+  int num_threads = -1;
+  FILE *status_p = fopen("/proc/self/status", "r");
+  if (status_p == NULL) { return -1; }
+  while (fgets(line, sizeof(line), status_p) != NULL) {
+    if (sscanf(line, "Threads: %d", &num_threads) == 1) { break; }
+  }
+  fclose(status_p);
+  return num_threads;
+}
+
+int
+pin_thread(int cpu)
+{
+  cpu_set_t cpu_set;
+  if (cpu < 0 || cpu >= CPU_SETSIZE) { return -1; }
+  CPU_ZERO(&cpu_set);
+  CPU_SET(cpu, &cpu_set);
+  return (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0) ? 0 : -1;
+}
+
+int
+parse_cpus(const char *list, int *cpus, int max_cpus)
+{
+  int num_cpus = 0;
+  char *end_p;
+
+  if (strcmp(list, "any") == 0) { return 0; }
+  while (1) {
+    long cpu = strtol(list, &end_p, 10);
+    if (end_p == list || cpu < 0 || cpu >= CPU_SETSIZE || num_cpus == max_cpus) { return -1; }
+    cpus[num_cpus++] = (int)cpu;
+    if (*end_p == '\0') { return num_cpus; }
+    if (*end_p != ',') { return -1; }
+    list = end_p + 1;
+  }
+}
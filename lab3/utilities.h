@@ -8,12 +8,91 @@
 #ifndef _utilities_h
 #define _utilities_h
 
+#include <stdatomic.h>
+#include <sched.h> // sched_yield()
+
 /* the djb2 hash function
  * reference: http://www.cse.yorku.ca/~oz/hash.html
  *
- * expects the str to be NULL-terminated
+ * covers all `len` bytes, zeros included (stopping at the first zero
+ * would leave everything past an int's high bytes unchecked)
  */
 unsigned long
-hash(char *str);
+hash(char *bytes, int len);
+
+/* microseconds on the monotonic clock; only meaningful as a
+ * difference between two calls
+ */
+long long
+now_usec();
+
+/* seconds on the monotonic clock, for the benchmarks to time with;
+ * only meaningful as a difference between two calls
+ */
+double
+now_seconds();
+
+// qsort() comparator for doubles, in ascending order
+int
+compare_doubles(const void *a_p, const void *b_p);
+
+/* sorts `num_values` doubles in place, ready for percentile() */
+void
+sort_doubles(double *values, int num_values);
+
+/* the value at `fraction` of the way through `sorted` (sorted with
+ * sort_doubles()): 0.5 for the median, 0.99 for the 99th percentile,
+ * 1 for the largest; 0 if there are no values
+ */
+double
+percentile(const double *sorted, int num_values, double fraction);
+
+/* the calling process's number of threads, from /proc/self/status
+ * returns -1 if it cannot be read
+ */
+int
+count_threads();
+
+/* pins the calling thread to `cpu`
+ * returns 0, or -1 if it cannot be (no such CPU, not allowed, etc.)
+ */
+int
+pin_thread(int cpu);
+
+/* parses a comma-separated list of CPU numbers (like "2,3") into
+ * `cpus`, at most `max_cpus` of them; "any" is the empty list
+ * returns how many there are, or -1 if the list is malformed
+ */
+int
+parse_cpus(const char *list, int *cpus, int max_cpus);
+
+/* what a thread spinning instead of sleeping (see mrt_set_busy_poll()
+ * in either module's header) does between two looks: lets another
+ * thread have the CPU if one is waiting for it, which is only ever
+ * the case if the spinning threads are not on cores of their own
+ */
+static inline void
+spin_pause()
+{
+  sched_yield();
+}
+
+/* adds to a statistics counter that one thread at a time changes (under
+ * a lock it holds anyway) while any other may read it: a relaxed load
+ * and store, so keeping count costs no locked instruction
+ */
+static inline void
+stat_add(_Atomic long long *counter_p, long long n)
+{
+  atomic_store_explicit(counter_p,
+    atomic_load_explicit(counter_p, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+// the same for a gauge, which is overwritten instead
+static inline void
+stat_set(_Atomic int *gauge_p, int value)
+{
+  atomic_store_explicit(gauge_p, value, memory_order_relaxed);
+}
 
 #endif // _utilities_h
\ No newline at end of file